@@ -0,0 +1,82 @@
+// Copyright 2020 The TensorFlow Runtime Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//===- decode_jpeg_op.cc --------------------------------------------------===//
+//
+// This file implements the functions to decode and resize JPEG images.
+//
+//===----------------------------------------------------------------------===//
+
+#include "decode_jpeg_op.h"
+
+#include <memory>
+
+#include "jpeg/jpeg_mem.h"
+#include "resize_bilinear_op.h"
+#include "tfrt/support/error_util.h"
+
+namespace tfrt {
+namespace image {
+
+int get_jpeg_scale_ratio(ssize_t image_height, ssize_t image_width,
+                         ssize_t height, ssize_t width) {
+  for (int ratio : {8, 4, 2}) {
+    // libjpeg rounds the scaled size up.
+    const ssize_t scaled_height = (image_height + ratio - 1) / ratio;
+    const ssize_t scaled_width = (image_width + ratio - 1) / ratio;
+    if (scaled_height >= height && scaled_width >= width) return ratio;
+  }
+  return 1;
+}
+
+llvm::Error decode_and_resize_jpeg(string_view data, ssize_t height,
+                                   ssize_t width, float* output,
+                                   HostContext* host) {
+  if (!data.startswith("\xff\xd8\xff")) {
+    return MakeStringError("image does not have jpeg format");
+  }
+
+  int image_width, image_height;
+  if (!jpeg::GetImageInfo(data.data(), data.size(), &image_width,
+                          &image_height, /*components=*/nullptr)) {
+    return MakeStringError("cannot read jpeg header");
+  }
+
+  jpeg::UncompressFlags flags;
+  flags.components = 3;
+  flags.dct_method = JDCT_IFAST;
+  flags.ratio = get_jpeg_scale_ratio(image_height, image_width, height, width);
+
+  // Only the downscaled image is decoded into this buffer.
+  std::unique_ptr<uint8_t[]> decoded;
+  int decoded_height = 0;
+  int decoded_width = 0;
+  uint8_t* pixels = jpeg::Uncompress(
+      data.data(), data.size(), flags, nullptr /* nwarn */,
+      [&](int width, int height, int channels) -> uint8_t* {
+        decoded.reset(
+            new uint8_t[static_cast<size_t>(width) * height * channels]);
+        decoded_height = height;
+        decoded_width = width;
+        return decoded.get();
+      });
+  if (pixels == nullptr) return MakeStringError("cannot decode jpeg image");
+
+  resize_image(pixels, decoded_height, decoded_width, /*channels=*/3, height,
+               width, output, host);
+  return llvm::Error::success();
+}
+
+}  // namespace image
+}  // namespace tfrt
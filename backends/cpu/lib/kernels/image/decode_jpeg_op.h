@@ -0,0 +1,57 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- decode_jpeg_op.h -----------------------------------------*- C++ -*-===//
+//
+// This file declares the functions to decode and resize JPEG images.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef TFRT_BACKENDS_CPU_LIB_KERNELS_IMAGE_DECODE_JPEG_OP_H_
+#define TFRT_BACKENDS_CPU_LIB_KERNELS_IMAGE_DECODE_JPEG_OP_H_
+
+#include <cstdint>
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "tfrt/support/forward_decls.h"
+
+namespace tfrt {
+
+class HostContext;
+
+namespace image {
+
+// Returns the largest DCT scaling ratio (1, 2, 4 or 8) at which libjpeg decodes
+// the `image_height` x `image_width` image to at least `height` x `width`.
+int get_jpeg_scale_ratio(ssize_t image_height, ssize_t image_width,
+                         ssize_t height, ssize_t width);
+
+// Decodes the JPEG image `data` into 3 channels and resizes it to `height` x
+// `width` x 3 floats at `output`, like tf.image.decode_jpeg(data, channels=3)
+// followed by tf.compat.v1.image.resize(image, [height, width]).
+//
+// The image is decoded at the largest DCT scaling ratio that is still at least
+// the output size, so that the full-size image is never materialized. The
+// result is an approximation of resizing the full-size image.
+llvm::Error decode_and_resize_jpeg(string_view data, ssize_t height,
+                                   ssize_t width, float* output,
+                                   HostContext* host);
+
+}  // namespace image
+}  // namespace tfrt
+
+#endif  // TFRT_BACKENDS_CPU_LIB_KERNELS_IMAGE_DECODE_JPEG_OP_H_
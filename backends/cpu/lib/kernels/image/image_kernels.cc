@@ -18,14 +18,19 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <memory>
+
+#include "decode_jpeg_op.h"
 #include "jpeg/jpeg_mem.h"
 #include "resize_bilinear_op.h"
 #include "tfrt/host_context/function.h"
 #include "tfrt/host_context/kernel_utils.h"
 #include "tfrt/support/error_util.h"
+#include "tfrt/support/mutex.h"
 #include "tfrt/tensor/dense_host_tensor.h"
 #include "tfrt/tensor/dense_host_tensor_view.h"
 #include "tfrt/tensor/dense_tensor_utils.h"
+#include "tfrt/tensor/string_host_tensor.h"
 
 namespace tfrt {
 namespace image {
@@ -59,47 +64,142 @@ static AsyncValueRef<DenseHostTensor> DecodeJpeg(
   return result;
 }
 
-// TODO(donglin): allocate tensor buffer outside this kernel
 // Returns tf.compat.v1.image.resize(input, [height, width])
-static llvm::Expected<DenseHostTensor> ResizeBilinear(
-    const DenseHostTensor& input, int64_t height, int64_t width,
+static AsyncValueRef<DenseHostTensor> ResizeBilinear(
+    Argument<DenseHostTensor> input, int64_t height, int64_t width,
     const ExecutionContext& exec_ctx) {
   auto host = exec_ctx.host();
-  const TensorShape& shape = input.shape();
+  const TensorShape& shape = input->shape();
   if (shape.GetRank() != 3) {
-    return MakeStringError("input tensor shape must be 3");
+    return EmitErrorAsync(exec_ctx, "input tensor shape must be 3");
+  }
+  if (height <= 0 || width <= 0) {
+    return EmitErrorAsync(exec_ctx, "output size must be positive");
   }
 
-  ssize_t batch_size = 1;
   ssize_t input_height = shape.GetDimensionSize(0);
   ssize_t input_width = shape.GetDimensionSize(1);
   ssize_t channels = shape.GetDimensionSize(2);
-  float height_scale = input_height / static_cast<float>(height);
-  float width_scale = input_width / static_cast<float>(width);
-
-  // Create the temporary output tensor with batch_size=1. This follows the same
-  // logic in tf.image.resize which adds a batch dimension if the input image
-  // does not have the batch dimension. It is easier to port the code from TF
-  // to TFRT by following the same logic. And in the future we may also want
-  // this kernel to process input image with or without the batch dimension.
+
   auto dht = DenseHostTensor::CreateUninitialized<float>(
-      TensorShape({batch_size, height, width, channels}), host);
+      TensorShape({height, width, channels}), host);
+  if (!dht) {
+    return EmitErrorAsync(exec_ctx, "cannot allocate tensor");
+  }
+
+  // The rows are resized on the work queue, which uses the input and the
+  // output buffers until `on_done` runs.
+  auto result = host->MakeUnconstructedAsyncValueRef<DenseHostTensor>();
+  auto output = std::make_unique<DenseHostTensor>(std::move(*dht));
+  const uint8_t* input_data = static_cast<const uint8_t*>(input->data());
+  float* output_data = static_cast<float*>(output->data());
+  resize_image_async(input_data, input_height, input_width, channels, height,
+                     width, output_data, host,
+                     [input = input.ValueRef(), output = std::move(output),
+                      result = result.CopyRef()]() {
+                       result.emplace(std::move(*output));
+                     });
+  return result;
+}
+
+// Returns tf.compat.v1.image.resize(tf.image.decode_jpeg(data, channels=3),
+// [height, width]), approximately. The image is decoded at a reduced size and
+// resized directly into the output tensor.
+static llvm::Expected<DenseHostTensor> DecodeAndResizeJpeg(
+    const std::string& data, int64_t height, int64_t width,
+    const ExecutionContext& exec_ctx) {
+  if (height <= 0 || width <= 0) {
+    return MakeStringError("output size must be positive");
+  }
+  auto dht = DenseHostTensor::CreateUninitialized<float>(
+      TensorShape({height, width, 3}), exec_ctx.host());
   if (!dht) {
     return MakeStringError("cannot allocate tensor");
   }
-  resize_image(input, height_scale, width_scale, *dht);
+  if (auto error =
+          decode_and_resize_jpeg(data, height, width,
+                                 static_cast<float*>(dht->data()),
+                                 exec_ctx.host())) {
+    return std::move(error);
+  }
+  return std::move(*dht);
+}
+
+// Returns the [N, height, width, 3] float tensor of the N images of the 1-D
+// `images` tensor, each decoded and resized like image.decode_and_resize_jpeg.
+// The images are decoded in parallel on the work queue, each directly into its
+// slice of the result, so that the batch is allocated once and never copied.
+static AsyncValueRef<DenseHostTensor> DecodeJpegBatch(
+    Argument<StringHostTensor> images, int64_t height, int64_t width,
+    const ExecutionContext& exec_ctx) {
+  HostContext* host = exec_ctx.host();
+  if (images->shape().GetRank() != 1) {
+    return EmitErrorAsync(exec_ctx, "images tensor must have rank 1");
+  }
+  if (height <= 0 || width <= 0) {
+    return EmitErrorAsync(exec_ctx, "output size must be positive");
+  }
+  const int64_t batch_size = images->NumElements();
+  auto dht = DenseHostTensor::CreateUninitialized<float>(
+      TensorShape({batch_size, height, width, 3}), host);
+  if (!dht) {
+    return EmitErrorAsync(exec_ctx, "cannot allocate tensor");
+  }
+  if (batch_size == 0) {
+    return host->MakeConcreteAsyncValueRef<DenseHostTensor>(std::move(*dht));
+  }
 
-  // Remove the batch_size dimension before returning the result.
-  TensorMetadata output_metadata(GetDType<float>(), {height, width, channels});
-  DenseHostTensor output(output_metadata, dht->ReleaseBuffer());
+  struct State {
+    State(AsyncValueRef<StringHostTensor> images, DenseHostTensor output)
+        : images(std::move(images)), output(std::move(output)) {}
 
-  return output;
+    AsyncValueRef<StringHostTensor> images;
+    DenseHostTensor output;
+    mutex mu;
+    // The error of the first image that failed to decode, if any.
+    std::string error TFRT_GUARDED_BY(mu);
+  };
+  auto state = std::make_unique<State>(images.ValueRef(), std::move(*dht));
+  auto result = host->MakeUnconstructedAsyncValueRef<DenseHostTensor>();
+
+  State* state_ptr = state.get();
+  auto compute = [state_ptr, height, width, host](size_t begin, size_t end) {
+    ArrayRef<std::string> strings = state_ptr->images.get().strings();
+    float* output = static_cast<float*>(state_ptr->output.data());
+    const size_t image_size = height * width * 3;
+    for (size_t i = begin; i < end; ++i) {
+      if (auto error = decode_and_resize_jpeg(
+              strings[i], height, width, output + i * image_size, host)) {
+        mutex_lock lock(state_ptr->mu);
+        if (state_ptr->error.empty()) {
+          state_ptr->error =
+              StrCat("image ", i, ": ", llvm::toString(std::move(error)));
+        } else {
+          llvm::consumeError(std::move(error));
+        }
+      }
+    }
+  };
+  auto on_done = [state = std::move(state), result = result.CopyRef(),
+                  exec_ctx]() {
+    mutex_lock lock(state->mu);
+    if (!state->error.empty()) {
+      result.SetError(EmitError(exec_ctx, state->error));
+    } else {
+      result.emplace(std::move(state->output));
+    }
+  };
+  host->ParallelFor(batch_size, std::move(compute), std::move(on_done));
+  return result;
 }
 
 // This is the entrypoint to the library.
 void RegisterImageKernels(KernelRegistry* registry) {
   registry->AddKernel("image.decode_jpeg", TFRT_KERNEL(DecodeJpeg));
   registry->AddKernel("image.resize_bilinear", TFRT_KERNEL(ResizeBilinear));
+  registry->AddKernel("image.decode_and_resize_jpeg",
+                      TFRT_KERNEL(DecodeAndResizeJpeg));
+  registry->AddKernel("image.decode_jpeg_batch", TFRT_KERNEL(DecodeJpegBatch));
 }
 
 }  // namespace image
@@ -20,10 +20,50 @@
 
 #include "resize_bilinear_op.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include "Eigen/Core"  // from @eigen_archive
+#include "tfrt/host_context/shared_context.h"
+#include "tfrt/support/mutex.h"
+
 namespace tfrt {
 namespace image {
 namespace {
 
+// Packets of the output rows.
+using RowPacket = Eigen::internal::packet_traits<float>::type;
+constexpr ssize_t kRowPacketSize =
+    Eigen::internal::unpacket_traits<RowPacket>::size;
+
+#ifdef EIGEN_VECTORIZE_SSE2
+// Eigen has no packet load of uint8 values, so the pixels are loaded with SSE2
+// when it is available.
+constexpr ssize_t kPixelPacketSize = 4;
+
+// Returns the 4 uint8 values at `input` as floats.
+inline Eigen::internal::Packet4f load_pixel(const uint8_t* input) {
+  int32_t bytes;
+  std::memcpy(&bytes, input, sizeof(bytes));
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i words = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero);
+  return _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero));
+}
+#else
+constexpr ssize_t kPixelPacketSize = 0;
+#endif
+
+// Outputs with fewer values than this are resized in a single block.
+constexpr ssize_t kMinValuesPerBlock = 16384;
+
+// The number of interpolation tables kept by the cache.
+constexpr size_t kMaxCachedTables = 64;
+
 struct CachedInterpolation {
   ssize_t lower;  // Lower source index used in the interpolation
   ssize_t upper;  // Upper source index used in the interpolation
@@ -48,93 +88,194 @@ void compute_interpolation_weights(const ssize_t out_size,
   }
 }
 
-float compute_lerp(const float top_left, const float top_right,
-                   const float bottom_left, const float bottom_right,
-                   const float x_lerp, const float y_lerp) {
-  const float top = top_left + (top_right - top_left) * x_lerp;
-  const float bottom = bottom_left + (bottom_right - bottom_left) * x_lerp;
-  return top + (bottom - top) * y_lerp;
+// The interpolation weights of the rows and the columns of the output.
+struct InterpolationTables {
+  InterpolationTables(ssize_t input_height, ssize_t input_width,
+                      ssize_t channels, ssize_t output_height,
+                      ssize_t output_width)
+      : input_width(input_width),
+        channels(channels),
+        output_width(output_width),
+        ys(output_height + 1),
+        xs(output_width + 1) {
+    compute_interpolation_weights(
+        output_height, input_height,
+        input_height / static_cast<float>(output_height), ys.data());
+    compute_interpolation_weights(
+        output_width, input_width,
+        input_width / static_cast<float>(output_width), xs.data());
+    // Scale x interpolation weights to avoid a multiplication during
+    // iteration.
+    for (auto& x : xs) {
+      x.lower *= channels;
+      x.upper *= channels;
+    }
+    // The packets of the leading pixels are loaded from the input row and
+    // stored to the output row without going past their ends.
+    if (channels <= kPixelPacketSize) {
+      const ssize_t in_row_size = input_width * channels;
+      const ssize_t out_row_size = output_width * channels;
+      while (vector_width < output_width &&
+             xs[vector_width].upper + kPixelPacketSize <= in_row_size &&
+             vector_width * channels + kPixelPacketSize <= out_row_size) {
+        ++vector_width;
+      }
+    }
+  }
+
+  const ssize_t input_width;
+  const ssize_t channels;
+  const ssize_t output_width;
+  std::vector<CachedInterpolation> ys;
+  std::vector<CachedInterpolation> xs;
+  // The number of leading output pixels that are interpolated with packets.
+  ssize_t vector_width = 0;
+};
+
+// Caches the InterpolationTables of the recently used pairs of input and
+// output sizes, which are usually few in a model.
+class InterpolationTablesCache : public SharedContext {
+ public:
+  // GetOrCreateSharedContext constructs a SharedContext from the HostContext,
+  // which the tables do not depend on.
+  explicit InterpolationTablesCache(HostContext*) {}
+
+  std::shared_ptr<const InterpolationTables> Get(ssize_t input_height,
+                                                 ssize_t input_width,
+                                                 ssize_t channels,
+                                                 ssize_t output_height,
+                                                 ssize_t output_width) {
+    const Key key{input_height, input_width, channels, output_height,
+                  output_width};
+    mutex_lock lock(mu_);
+    auto it = tables_.find(key);
+    if (it != tables_.end()) return it->second;
+    if (tables_.size() >= kMaxCachedTables) tables_.clear();
+    auto tables = std::make_shared<const InterpolationTables>(
+        input_height, input_width, channels, output_height, output_width);
+    tables_.emplace(key, tables);
+    return tables;
+  }
+
+ private:
+  using Key = std::tuple<ssize_t, ssize_t, ssize_t, ssize_t, ssize_t>;
+
+  mutex mu_;
+  std::map<Key, std::shared_ptr<const InterpolationTables>> tables_
+      TFRT_GUARDED_BY(mu_);
+};
+
+// Interpolates the pixels of an output row from the pixels of the input row.
+void interpolate_columns(const InterpolationTables& tables,
+                         const uint8_t* input, float* output) {
+  const ssize_t channels = tables.channels;
+  const CachedInterpolation* xs = tables.xs.data();
+
+  ssize_t x = 0;
+#ifdef EIGEN_VECTORIZE_SSE2
+  using namespace Eigen::internal;  // NOLINT(build/namespaces)
+  // A packet holds all the channels of a pixel. Its store overwrites the first
+  // channels of the next pixel, which is written afterwards.
+  for (; x < tables.vector_width; ++x) {
+    const Packet4f left = load_pixel(input + xs[x].lower);
+    const Packet4f right = load_pixel(input + xs[x].upper);
+    pstoreu(output + x * channels,
+            pmadd(psub(right, left), pset1<Packet4f>(xs[x].lerp), left));
+  }
+#endif
+  for (; x < tables.output_width; ++x) {
+    const uint8_t* left = input + xs[x].lower;
+    const uint8_t* right = input + xs[x].upper;
+    const float lerp = xs[x].lerp;
+    for (ssize_t c = 0; c < channels; ++c) {
+      const float left_value = left[c];
+      output[x * channels + c] =
+          left_value + (static_cast<float>(right[c]) - left_value) * lerp;
+    }
+  }
 }
-}  // namespace
 
-void resize_image(const DenseHostTensor& input, const float height_scale,
-                  const float width_scale, DenseHostTensor& output) {
-  const TensorShape& input_shape = input.shape();
-  ssize_t batch_size = 1;
-  ssize_t input_height = input_shape.GetDimensionSize(0);
-  ssize_t input_width = input_shape.GetDimensionSize(1);
-  ssize_t channels = input_shape.GetDimensionSize(2);
-
-  const TensorShape& output_shape = output.shape();
-  ssize_t output_height = output_shape.GetDimensionSize(1);
-  ssize_t output_width = output_shape.GetDimensionSize(2);
-
-  std::vector<CachedInterpolation> ys(output_height + 1);
-  std::vector<CachedInterpolation> xs(output_width + 1);
-
-  compute_interpolation_weights(output_height, input_height, height_scale,
-                                ys.data());
-  compute_interpolation_weights(output_width, input_width, width_scale,
-                                xs.data());
-
-  // Scale x interpolation weights to avoid a multiplication during iteration.
-  for (int i = 0; i < xs.size(); ++i) {
-    xs[i].lower *= channels;
-    xs[i].upper *= channels;
+// Interpolates between the `top` and `bottom` rows of `size` values.
+void interpolate_rows(const float* top, const float* bottom, float lerp,
+                      ssize_t size, float* output) {
+  using namespace Eigen::internal;  // NOLINT(build/namespaces)
+  const RowPacket lerp_packet = pset1<RowPacket>(lerp);
+  ssize_t i = 0;
+  for (; i + kRowPacketSize <= size; i += kRowPacketSize) {
+    const RowPacket top_packet = ploadu<RowPacket>(top + i);
+    const RowPacket bottom_packet = ploadu<RowPacket>(bottom + i);
+    pstoreu(output + i,
+            pmadd(psub(bottom_packet, top_packet), lerp_packet, top_packet));
   }
+  for (; i < size; ++i) output[i] = top[i] + (bottom[i] - top[i]) * lerp;
+}
 
-  const ssize_t in_row_size = input_width * channels;
-  const ssize_t in_batch_num_values = input_height * in_row_size;
-  const ssize_t out_row_size = output_width * channels;
-  const uint8_t* input_b_ptr = static_cast<const uint8_t*>(input.data());
-  float* output_y_ptr = static_cast<float*>(output.data());
-
-  for (int b = 0; b < batch_size; ++b) {
-    for (ssize_t y = 0; y < output_height; ++y) {
-      const uint8_t* ys_input_lower_ptr =
-          input_b_ptr + ys[y].lower * in_row_size;
-      const uint8_t* ys_input_upper_ptr =
-          input_b_ptr + ys[y].upper * in_row_size;
-      const float ys_lerp = ys[y].lerp;
-      for (ssize_t x = 0; x < output_width; ++x) {
-        const ssize_t xs_lower = xs[x].lower;
-        const ssize_t xs_upper = xs[x].upper;
-        const float xs_lerp = xs[x].lerp;
-
-        // Read channel 0.
-        const float top_left0(ys_input_lower_ptr[xs_lower + 0]);
-        const float top_right0(ys_input_lower_ptr[xs_upper + 0]);
-        const float bottom_left0(ys_input_upper_ptr[xs_lower + 0]);
-        const float bottom_right0(ys_input_upper_ptr[xs_upper + 0]);
-
-        // Read channel 1.
-        const float top_left1(ys_input_lower_ptr[xs_lower + 1]);
-        const float top_right1(ys_input_lower_ptr[xs_upper + 1]);
-        const float bottom_left1(ys_input_upper_ptr[xs_lower + 1]);
-        const float bottom_right1(ys_input_upper_ptr[xs_upper + 1]);
-
-        // Read channel 2.
-        const float top_left2(ys_input_lower_ptr[xs_lower + 2]);
-        const float top_right2(ys_input_lower_ptr[xs_upper + 2]);
-        const float bottom_left2(ys_input_upper_ptr[xs_lower + 2]);
-        const float bottom_right2(ys_input_upper_ptr[xs_upper + 2]);
-
-        // Compute output.
-        output_y_ptr[x * channels + 0] =
-            compute_lerp(top_left0, top_right0, bottom_left0, bottom_right0,
-                         xs_lerp, ys_lerp);
-        output_y_ptr[x * channels + 1] =
-            compute_lerp(top_left1, top_right1, bottom_left1, bottom_right1,
-                         xs_lerp, ys_lerp);
-        output_y_ptr[x * channels + 2] =
-            compute_lerp(top_left2, top_right2, bottom_left2, bottom_right2,
-                         xs_lerp, ys_lerp);
+// Resizes the output rows in [begin, end). The input rows are first
+// interpolated horizontally to the output width, and the output rows are
+// interpolated vertically from them.
+void resize_rows(const InterpolationTables& tables, const uint8_t* input,
+                 float* output, ssize_t begin, ssize_t end) {
+  const ssize_t in_row_size = tables.input_width * tables.channels;
+  const ssize_t out_row_size = tables.output_width * tables.channels;
+
+  // The horizontally interpolated input rows of the current output row, which
+  // are reused by the next output rows with the same input rows.
+  std::vector<float> buffer(2 * out_row_size);
+  float* top = buffer.data();
+  float* bottom = top + out_row_size;
+  ssize_t top_index = -1;
+  ssize_t bottom_index = -1;
+
+  for (ssize_t y = begin; y < end; ++y) {
+    const CachedInterpolation& ys = tables.ys[y];
+    if (ys.lower != top_index) {
+      if (ys.lower == bottom_index) {
+        std::swap(top, bottom);
+        std::swap(top_index, bottom_index);
+      } else {
+        interpolate_columns(tables, input + ys.lower * in_row_size, top);
+        top_index = ys.lower;
       }
-      output_y_ptr += out_row_size;
     }
-    input_b_ptr += in_batch_num_values;
+    // The input rows are the same when the output row is at an input row.
+    if (ys.upper != top_index && ys.upper != bottom_index) {
+      interpolate_columns(tables, input + ys.upper * in_row_size, bottom);
+      bottom_index = ys.upper;
+    }
+    interpolate_rows(top, ys.upper == top_index ? top : bottom, ys.lerp,
+                     out_row_size, output + y * out_row_size);
   }
 }
 
+}  // namespace
+
+void resize_image(const uint8_t* input, ssize_t input_height,
+                  ssize_t input_width, ssize_t channels, ssize_t output_height,
+                  ssize_t output_width, float* output, HostContext* host) {
+  auto tables =
+      host->GetOrCreateSharedContext<InterpolationTablesCache>().Get(
+          input_height, input_width, channels, output_height, output_width);
+  resize_rows(*tables, input, output, 0, output_height);
+}
+
+void resize_image_async(const uint8_t* input, ssize_t input_height,
+                        ssize_t input_width, ssize_t channels,
+                        ssize_t output_height, ssize_t output_width,
+                        float* output, HostContext* host,
+                        llvm::unique_function<void()> on_done) {
+  auto tables =
+      host->GetOrCreateSharedContext<InterpolationTablesCache>().Get(
+          input_height, input_width, channels, output_height, output_width);
+  const ssize_t out_row_size = std::max<ssize_t>(output_width * channels, 1);
+  const size_t min_block_size =
+      (kMinValuesPerBlock + out_row_size - 1) / out_row_size;
+  host->ParallelFor(
+      output_height,
+      [tables, input, output](size_t begin, size_t end) {
+        resize_rows(*tables, input, output, begin, end);
+      },
+      std::move(on_done), min_block_size);
+}
+
 }  // namespace image
 }  // namespace tfrt
@@ -23,19 +23,33 @@
 #ifndef TFRT_BACKENDS_CPU_LIB_KERNELS_IMAGE_RESIZE_BILINEAR_OP_H_
 #define TFRT_BACKENDS_CPU_LIB_KERNELS_IMAGE_RESIZE_BILINEAR_OP_H_
 
-#include "jpeg/jpeg_mem.h"
-#include "tfrt/host_context/function.h"
-#include "tfrt/host_context/kernel_utils.h"
-#include "tfrt/support/error_util.h"
-#include "tfrt/tensor/dense_host_tensor.h"
-#include "tfrt/tensor/dense_host_tensor_view.h"
-#include "tfrt/tensor/dense_tensor_utils.h"
+#include <cstdint>
+
+#include "llvm/ADT/FunctionExtras.h"
+#include "tfrt/host_context/host_context.h"
 
 namespace tfrt {
 namespace image {
 
-void resize_image(const DenseHostTensor& input, const float height_scale,
-                  const float width_scale, DenseHostTensor& output);
+// Resizes the `input_height` x `input_width` x `channels` uint8 image at
+// `input` into the `output_height` x `output_width` x `channels` float image at
+// `output`, e.g. a slice of a caller-provided tensor, like
+// tf.compat.v1.image.resize. It runs on the calling thread.
+//
+// The interpolation tables of each pair of input and output sizes are computed
+// once and cached in `host`.
+void resize_image(const uint8_t* input, ssize_t input_height,
+                  ssize_t input_width, ssize_t channels, ssize_t output_height,
+                  ssize_t output_width, float* output, HostContext* host);
+
+// Same as above, but the rows of large outputs are resized in parallel on the
+// work queue of `host`. Calls `on_done` once `output` is written. `input` and
+// `output` must stay alive until then.
+void resize_image_async(const uint8_t* input, ssize_t input_height,
+                        ssize_t input_width, ssize_t channels,
+                        ssize_t output_height, ssize_t output_width,
+                        float* output, HostContext* host,
+                        llvm::unique_function<void()> on_done);
 
 }  // namespace image
 }  // namespace tfrt
@@ -0,0 +1,363 @@
+// Copyright 2020 The TensorFlow Runtime Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//===- example_parser.cc --------------------------------------------------===//
+//
+// This file implements ExampleParser.
+//
+//===----------------------------------------------------------------------===//
+
+#include "example_parser.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "tfrt/support/error_util.h"
+
+namespace tfrt {
+namespace proto {
+namespace {
+
+// Field numbers of the messages in example.proto.
+constexpr uint32_t kExampleFeatures = 1;
+constexpr uint32_t kFeaturesFeature = 1;
+constexpr uint32_t kMapEntryKey = 1;
+constexpr uint32_t kMapEntryValue = 2;
+constexpr uint32_t kFeatureBytesList = 1;
+constexpr uint32_t kFeatureFloatList = 2;
+constexpr uint32_t kFeatureInt64List = 3;
+constexpr uint32_t kListValue = 1;
+
+enum WireType : uint32_t {
+  kVarint = 0,
+  kFixed64 = 1,
+  kLengthDelimited = 2,
+  kFixed32 = 5,
+};
+
+// Reads the fields of a message in the protobuf wire format. The Read
+// functions return false if the message is truncated or malformed.
+class WireReader {
+ public:
+  explicit WireReader(string_view data)
+      : pos_(data.bytes_begin()), end_(data.bytes_end()) {}
+
+  bool done() const { return pos_ == end_; }
+
+  bool ReadVarint(uint64_t* value) {
+    // Most varints in tf.Example are tags and small lengths.
+    if (pos_ < end_ && *pos_ < 0x80) {
+      *value = *pos_++;
+      return true;
+    }
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && pos_ < end_; shift += 7) {
+      const uint8_t byte = *pos_++;
+      result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (byte < 0x80) {
+        *value = result;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool ReadTag(uint32_t* field, uint32_t* wire_type) {
+    uint64_t tag;
+    if (!ReadVarint(&tag)) return false;
+    *field = static_cast<uint32_t>(tag >> 3);
+    *wire_type = static_cast<uint32_t>(tag & 7);
+    return true;
+  }
+
+  bool ReadLengthDelimited(string_view* value) {
+    uint64_t size;
+    if (!ReadVarint(&size) || size > static_cast<uint64_t>(end_ - pos_)) {
+      return false;
+    }
+    *value = string_view(reinterpret_cast<const char*>(pos_), size);
+    pos_ += size;
+    return true;
+  }
+
+  bool ReadFixed32(uint32_t* value) {
+    if (end_ - pos_ < 4) return false;
+    // The wire format is little endian, like the hosts TFRT runs on.
+    std::memcpy(value, pos_, 4);
+    pos_ += 4;
+    return true;
+  }
+
+  bool Skip(uint32_t wire_type) {
+    uint64_t varint;
+    string_view bytes;
+    switch (wire_type) {
+      case kVarint:
+        return ReadVarint(&varint);
+      case kFixed64:
+        if (end_ - pos_ < 8) return false;
+        pos_ += 8;
+        return true;
+      case kLengthDelimited:
+        return ReadLengthDelimited(&bytes);
+      case kFixed32:
+        if (end_ - pos_ < 4) return false;
+        pos_ += 4;
+        return true;
+      default:
+        return false;
+    }
+  }
+
+ private:
+  const uint8_t* pos_;
+  const uint8_t* end_;
+};
+
+llvm::Error MakeMalformedError(size_t record_index) {
+  return MakeStringError("record ", record_index, " is not a valid Example");
+}
+
+uint32_t GetListField(DType dtype) {
+  switch (dtype.kind()) {
+    case DType::I64:
+      return kFeatureInt64List;
+    case DType::F32:
+      return kFeatureFloatList;
+    default:
+      return kFeatureBytesList;
+  }
+}
+
+// Copies the `n` values of type T from `input` to `output`.
+template <typename T>
+void CopyValues(const void* input, ssize_t n, void* output) {
+  std::copy_n(static_cast<const T*>(input), n, static_cast<T*>(output));
+}
+
+}  // namespace
+
+ssize_t FeatureSpec::NumElements() const {
+  ssize_t num_elements = 1;
+  for (ssize_t dim : shape) num_elements *= dim;
+  return num_elements;
+}
+
+bool FeatureSpec::HasDefault() const {
+  return !int64_default.empty() || !float_default.empty() ||
+         !string_default.empty();
+}
+
+ExampleParser::ExampleParser(ArrayRef<FeatureSpec> specs) : specs_(specs) {
+  for (size_t i = 0, e = specs.size(); i < e; ++i) {
+    indices_[specs[i].key] = i;
+  }
+}
+
+llvm::Error ExampleParser::Parse(ArrayRef<std::string> records,
+                                 ArrayRef<void*> outputs) const {
+  assert(outputs.size() == specs_.size());
+  SmallVector<bool, 16> found(specs_.size());
+  for (size_t r = 0, e = records.size(); r < e; ++r) {
+    std::fill(found.begin(), found.end(), false);
+    if (auto error = ParseRecord(records[r], r, outputs, found)) return error;
+
+    // Fill in the defaults of the missing features.
+    for (size_t i = 0, e = specs_.size(); i < e; ++i) {
+      if (found[i]) continue;
+      const FeatureSpec& spec = specs_[i];
+      if (!spec.HasDefault()) {
+        return MakeStringError("record ", r, " does not have required feature ",
+                               spec.key);
+      }
+      const ssize_t n = spec.NumElements();
+      switch (spec.dtype.kind()) {
+        case DType::I64:
+          CopyValues<int64_t>(spec.int64_default.data(), n,
+                              static_cast<int64_t*>(outputs[i]) + r * n);
+          break;
+        case DType::F32:
+          CopyValues<float>(spec.float_default.data(), n,
+                            static_cast<float*>(outputs[i]) + r * n);
+          break;
+        default:
+          CopyValues<std::string>(
+              spec.string_default.data(), n,
+              static_cast<std::string*>(outputs[i]) + r * n);
+          break;
+      }
+    }
+  }
+  return llvm::Error::success();
+}
+
+llvm::Error ExampleParser::ParseRecord(string_view record, size_t index,
+                                       ArrayRef<void*> outputs,
+                                       MutableArrayRef<bool> found) const {
+  uint32_t field, wire_type;
+  WireReader example(record);
+  while (!example.done()) {
+    if (!example.ReadTag(&field, &wire_type)) return MakeMalformedError(index);
+    if (field != kExampleFeatures || wire_type != kLengthDelimited) {
+      if (!example.Skip(wire_type)) return MakeMalformedError(index);
+      continue;
+    }
+
+    string_view features_data;
+    if (!example.ReadLengthDelimited(&features_data)) {
+      return MakeMalformedError(index);
+    }
+    WireReader features(features_data);
+    while (!features.done()) {
+      if (!features.ReadTag(&field, &wire_type)) {
+        return MakeMalformedError(index);
+      }
+      if (field != kFeaturesFeature || wire_type != kLengthDelimited) {
+        if (!features.Skip(wire_type)) return MakeMalformedError(index);
+        continue;
+      }
+
+      // A map entry with the key and the Feature.
+      string_view entry_data;
+      if (!features.ReadLengthDelimited(&entry_data)) {
+        return MakeMalformedError(index);
+      }
+      string_view key, feature;
+      WireReader entry(entry_data);
+      while (!entry.done()) {
+        if (!entry.ReadTag(&field, &wire_type)) {
+          return MakeMalformedError(index);
+        }
+        bool ok;
+        if (field == kMapEntryKey && wire_type == kLengthDelimited) {
+          ok = entry.ReadLengthDelimited(&key);
+        } else if (field == kMapEntryValue && wire_type == kLengthDelimited) {
+          ok = entry.ReadLengthDelimited(&feature);
+        } else {
+          ok = entry.Skip(wire_type);
+        }
+        if (!ok) return MakeMalformedError(index);
+      }
+
+      auto it = indices_.find(key);
+      if (it == indices_.end()) continue;
+      const size_t i = it->second;
+      if (auto error = ParseFeature(feature, i, index, outputs[i], &found[i])) {
+        return error;
+      }
+    }
+  }
+  return llvm::Error::success();
+}
+
+llvm::Error ExampleParser::ParseFeature(string_view feature, size_t spec_index,
+                                        size_t record_index, void* output,
+                                        bool* found) const {
+  const FeatureSpec& spec = specs_[spec_index];
+  const DType::Kind kind = spec.dtype.kind();
+  const uint32_t list_field = GetListField(spec.dtype);
+  const ssize_t n = spec.NumElements();
+
+  // Writes the values of this record, but counts all of them to report a
+  // wrong number of values.
+  int64_t* int64_output = static_cast<int64_t*>(output) + record_index * n;
+  float* float_output = static_cast<float*>(output) + record_index * n;
+  std::string* string_output =
+      static_cast<std::string*>(output) + record_index * n;
+  ssize_t count = 0;
+
+  uint32_t field, wire_type;
+  WireReader reader(feature);
+  while (!reader.done()) {
+    if (!reader.ReadTag(&field, &wire_type)) {
+      return MakeMalformedError(record_index);
+    }
+    if (wire_type != kLengthDelimited ||
+        (field != kFeatureBytesList && field != kFeatureFloatList &&
+         field != kFeatureInt64List)) {
+      if (!reader.Skip(wire_type)) return MakeMalformedError(record_index);
+      continue;
+    }
+    string_view list_data;
+    if (!reader.ReadLengthDelimited(&list_data)) {
+      return MakeMalformedError(record_index);
+    }
+    if (field != list_field) {
+      return MakeStringError("feature ", spec.key, " of record ", record_index,
+                             " does not have type ", spec.dtype);
+    }
+
+    // The kind is a oneof, of which the last one is used.
+    count = 0;
+    WireReader list(list_data);
+    while (!list.done()) {
+      if (!list.ReadTag(&field, &wire_type)) {
+        return MakeMalformedError(record_index);
+      }
+      bool ok = true;
+      if (field != kListValue) {
+        ok = list.Skip(wire_type);
+      } else if (kind == DType::I64 && wire_type == kVarint) {
+        uint64_t value;
+        ok = list.ReadVarint(&value);
+        if (count < n) int64_output[count] = static_cast<int64_t>(value);
+        ++count;
+      } else if (kind == DType::I64 && wire_type == kLengthDelimited) {
+        string_view packed;
+        ok = list.ReadLengthDelimited(&packed);
+        WireReader values(packed);
+        uint64_t value;
+        while (ok && !values.done()) {
+          ok = values.ReadVarint(&value);
+          if (count < n) int64_output[count] = static_cast<int64_t>(value);
+          ++count;
+        }
+      } else if (kind == DType::F32 && wire_type == kFixed32) {
+        uint32_t bits;
+        ok = list.ReadFixed32(&bits);
+        if (count < n) std::memcpy(&float_output[count], &bits, 4);
+        ++count;
+      } else if (kind == DType::F32 && wire_type == kLengthDelimited) {
+        string_view packed;
+        ok = list.ReadLengthDelimited(&packed) && packed.size() % 4 == 0;
+        const ssize_t num_values = packed.size() / 4;
+        if (ok && count < n) {
+          std::memcpy(&float_output[count], packed.data(),
+                      std::min(num_values, n - count) * 4);
+        }
+        count += num_values;
+      } else if (kind == DType::String && wire_type == kLengthDelimited) {
+        string_view value;
+        ok = list.ReadLengthDelimited(&value);
+        if (count < n) string_output[count].assign(value.data(), value.size());
+        ++count;
+      } else {
+        ok = list.Skip(wire_type);
+      }
+      if (!ok) return MakeMalformedError(record_index);
+    }
+  }
+
+  // A feature without values is missing.
+  if (count == 0) return llvm::Error::success();
+  if (count != n) {
+    return MakeStringError("feature ", spec.key, " of record ", record_index,
+                           " has ", count, " values, expected ", n);
+  }
+  *found = true;
+  return llvm::Error::success();
+}
+
+}  // namespace proto
+}  // namespace tfrt
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- example_parser.h -----------------------------------------*- C++ -*-===//
+//
+// This file declares ExampleParser, which parses batches of serialized
+// tf.Example records into dense tensors.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef TFRT_BACKENDS_CPU_LIB_KERNELS_PROTO_EXAMPLE_PARSER_H_
+#define TFRT_BACKENDS_CPU_LIB_KERNELS_PROTO_EXAMPLE_PARSER_H_
+
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Error.h"
+#include "tfrt/support/forward_decls.h"
+#include "tfrt/tensor/dtype.h"
+
+namespace tfrt {
+namespace proto {
+
+// A feature of the tf.Example records that has the same number of values in
+// every record, like tf.io.FixedLenFeature.
+struct FeatureSpec {
+  std::string key;
+  // I64, F32 or String, for the int64_list, float_list or bytes_list of the
+  // feature.
+  DType dtype;
+  // The shape of the values of one record.
+  SmallVector<ssize_t, 4> shape;
+  // The values used for the records that do not have the feature, of the type
+  // of `dtype`. If they are empty, the feature is required.
+  std::vector<int64_t> int64_default;
+  std::vector<float> float_default;
+  std::vector<std::string> string_default;
+
+  // Returns the number of values of one record.
+  ssize_t NumElements() const;
+  bool HasDefault() const;
+};
+
+// ExampleParser reads the protobuf wire format of tf.Example records directly,
+// without building message objects, and writes the values of each feature to
+// their place in the batch.
+class ExampleParser {
+ public:
+  explicit ExampleParser(ArrayRef<FeatureSpec> specs);
+
+  // Parses the `records` into `outputs`. outputs[i] has `records.size()` x
+  // specs[i].NumElements() values, of type int64_t, float or std::string for
+  // the I64, F32 and String dtypes, where the values of record r start at
+  // r x specs[i].NumElements().
+  llvm::Error Parse(ArrayRef<std::string> records,
+                    ArrayRef<void*> outputs) const;
+
+ private:
+  llvm::Error ParseRecord(string_view record, size_t index,
+                          ArrayRef<void*> outputs,
+                          MutableArrayRef<bool> found) const;
+  llvm::Error ParseFeature(string_view feature, size_t spec_index,
+                           size_t record_index, void* output,
+                           bool* found) const;
+
+  ArrayRef<FeatureSpec> specs_;
+  llvm::StringMap<size_t> indices_;
+};
+
+}  // namespace proto
+}  // namespace tfrt
+
+#endif  // TFRT_BACKENDS_CPU_LIB_KERNELS_PROTO_EXAMPLE_PARSER_H_
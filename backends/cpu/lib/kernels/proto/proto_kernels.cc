@@ -18,10 +18,13 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "example_parser.h"
 #include "tfrt/cpu/kernels/proto/example.proto.h"
 #include "tfrt/host_context/function.h"
 #include "tfrt/host_context/kernel_utils.h"
 #include "tfrt/support/error_util.h"
+#include "tfrt/tensor/dense_host_tensor.h"
+#include "tfrt/tensor/string_host_tensor.h"
 
 namespace tfrt {
 namespace proto {
@@ -61,6 +64,158 @@ static llvm::Expected<int64_t> GetInt64FieldFromExample(
   return int64_list.value(0);
 }
 
+// Decodes the default values of a feature of type T, which are an empty array
+// for a required feature.
+template <typename T>
+static llvm::Error DecodeDefault(AggregateAttribute feature,
+                                 std::vector<T>* values) {
+  BEFAttributeType type = feature.GetRawAttribute(3).second;
+  if (type != BEFAttributeType::kEmptyArray &&
+      (!IsArrayAttribute(type) ||
+       GetArrayAttributeElementType(type) != GetBEFAttributeType<T>())) {
+    return MakeStringError("default of feature ",
+                           feature.GetStringAttribute(0).get(),
+                           " does not have its type");
+  }
+  auto array = feature.GetArrayAttribute<T>(3).data();
+  values->assign(array.begin(), array.end());
+  return llvm::Error::success();
+}
+
+// Decodes the `features` attribute of proto.parse_example_batch.
+static llvm::Expected<std::vector<FeatureSpec>> DecodeFeatureSpecs(
+    AggregateAttribute features) {
+  std::vector<FeatureSpec> specs(features.size());
+  for (size_t i = 0, e = features.size(); i < e; ++i) {
+    AggregateAttribute feature = features.GetAggregateAttribute(i);
+    if (feature.size() != 4) {
+      return MakeStringError("feature ", i,
+                             " must be [key, dtype, shape, default]");
+    }
+    FeatureSpec& spec = specs[i];
+    spec.key = feature.GetStringAttribute(0).str();
+    for (int64_t dim : feature.GetArrayAttribute<int64_t>(2).data()) {
+      if (dim < 0) {
+        return MakeStringError("feature ", spec.key,
+                               " has a negative dimension ", dim);
+      }
+      spec.shape.push_back(dim);
+    }
+
+    string_view dtype = feature.GetStringAttribute(1).get();
+    if (dtype == "int64") {
+      spec.dtype = DType(DType::I64);
+      if (auto error = DecodeDefault(feature, &spec.int64_default))
+        return std::move(error);
+    } else if (dtype == "float") {
+      spec.dtype = DType(DType::F32);
+      if (auto error = DecodeDefault(feature, &spec.float_default))
+        return std::move(error);
+    } else if (dtype == "string") {
+      spec.dtype = DType(DType::String);
+      BEFAttributeType type = feature.GetRawAttribute(3).second;
+      if (type == BEFAttributeType::kAggregate) {
+        AggregateAttribute values = feature.GetAggregateAttribute(3);
+        for (size_t j = 0, e = values.size(); j < e; ++j) {
+          spec.string_default.push_back(values.GetStringAttribute(j).str());
+        }
+      } else if (type != BEFAttributeType::kEmptyArray) {
+        return MakeStringError("default of feature ", spec.key,
+                               " does not have its type");
+      }
+    } else {
+      return MakeStringError("feature ", spec.key, " has unsupported dtype ",
+                             dtype);
+    }
+
+    if (spec.HasDefault() &&
+        spec.int64_default.size() + spec.float_default.size() +
+                spec.string_default.size() !=
+            spec.NumElements()) {
+      return MakeStringError("default of feature ", spec.key,
+                             " does not have its shape");
+    }
+  }
+  return std::move(specs);
+}
+
+// Parses the 1-D `records` tensor of N serialized tf.Example records, like
+// tf.io.parse_example with a tf.io.FixedLenFeature per feature. Returns one
+// tensor of shape [N] + shape per feature: a DenseHostTensor for the int64 and
+// float features, and a StringHostTensor for the string features.
+//
+// `features` has one [key, dtype, shape, default] aggregate per feature, where
+// dtype is "int64", "float" or "string", and default has the values of one
+// record, as an array or an aggregate of strings. An empty default makes the
+// feature required:
+//
+//   %images, %labels = proto.parse_example_batch %records {features = [
+//       ["image/encoded", "string", [], []],
+//       ["image/class/label", "int64", [], [-1]]]}
+//
+// The records are parsed from the wire format straight into the results, see
+// ExampleParser.
+static void ParseExampleBatch(Argument<StringHostTensor> records,
+                              RemainingResults results,
+                              AggregateAttribute features,
+                              KernelErrorHandler handler,
+                              const ExecutionContext& exec_ctx) {
+  HostContext* host = exec_ctx.host();
+  auto specs = DecodeFeatureSpecs(features);
+  if (!specs) {
+    handler.ReportError(llvm::toString(specs.takeError()));
+    return;
+  }
+  if (specs->size() != results.size()) {
+    handler.ReportError("expected one result per feature");
+    return;
+  }
+  if (records->shape().GetRank() != 1) {
+    handler.ReportError("records tensor must have rank 1");
+    return;
+  }
+
+  // Allocate the results and the outputs of the parser.
+  const ssize_t batch_size = records->NumElements();
+  std::vector<llvm::Optional<DenseHostTensor>> dense_tensors(specs->size());
+  std::vector<llvm::Optional<StringHostTensor>> string_tensors(specs->size());
+  SmallVector<void*, 4> outputs(specs->size());
+  for (size_t i = 0, e = specs->size(); i < e; ++i) {
+    const FeatureSpec& spec = (*specs)[i];
+    SmallVector<ssize_t, 4> dims = {batch_size};
+    dims.append(spec.shape.begin(), spec.shape.end());
+    TensorMetadata metadata(spec.dtype, dims);
+    if (spec.dtype.kind() == DType::String) {
+      string_tensors[i] = StringHostTensor::CreateUninitialized(metadata, host);
+      if (string_tensors[i]) outputs[i] = string_tensors[i]->strings().data();
+    } else {
+      dense_tensors[i] = DenseHostTensor::CreateUninitialized(metadata, host);
+      if (dense_tensors[i]) outputs[i] = dense_tensors[i]->data();
+    }
+    if (!outputs[i]) {
+      handler.ReportError("cannot allocate tensor");
+      return;
+    }
+  }
+
+  if (auto error = ExampleParser(*specs).Parse(records->strings(), outputs)) {
+    handler.ReportError(llvm::toString(std::move(error)));
+    return;
+  }
+
+  for (size_t i = 0, e = specs->size(); i < e; ++i) {
+    if (string_tensors[i]) {
+      results[i] = host->MakeConcreteAsyncValueRef<StringHostTensor>(
+                           std::move(*string_tensors[i]))
+                       .ReleaseRCRef();
+    } else {
+      results[i] = host->MakeConcreteAsyncValueRef<DenseHostTensor>(
+                           std::move(*dense_tensors[i]))
+                       .ReleaseRCRef();
+    }
+  }
+}
+
 // This is the entrypoint to the library.
 void RegisterProtoKernels(KernelRegistry* registry) {
   registry->AddKernel("proto.parse_example_from_bytes",
@@ -69,6 +224,8 @@ void RegisterProtoKernels(KernelRegistry* registry) {
                       TFRT_KERNEL(GetBytesFieldFromExample));
   registry->AddKernel("proto.get_int64_field_from_example",
                       TFRT_KERNEL(GetInt64FieldFromExample));
+  registry->AddKernel("proto.parse_example_batch",
+                      TFRT_KERNEL(ParseExampleBatch));
 }
 
 }  // namespace proto
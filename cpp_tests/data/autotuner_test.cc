@@ -0,0 +1,348 @@
+// Copyright 2020 The TensorFlow Runtime Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//===- autotuner_test.cc --------------------------------------------------===//
+//
+// This file contains unit tests for the input pipeline Autotuner.
+//
+//===----------------------------------------------------------------------===//
+
+#include "lib/data/autotuner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "cpp_tests/data/dataset_test_util.h"
+#include "gtest/gtest.h"
+#include "lib/data/parallel_map_dataset.h"
+#include "tfrt/host_context/concurrent_work_queue.h"
+#include "tfrt/host_context/host_allocator.h"
+#include "tfrt/host_context/host_context.h"
+
+namespace tfrt {
+namespace data {
+namespace {
+
+using Kind = TunableParameter::Kind;
+
+constexpr int64_t kPeriodNs = 1000000;
+
+// The fake clock of the Autotuner and of the iterator counters. The tests
+// advance it by one period before every tuning step, or by the time of the
+// work that the iterators do.
+std::atomic<int64_t> fake_now_ns{0};
+int64_t FakeNow() { return fake_now_ns.load(); }
+
+std::unique_ptr<HostContext> CreateHostContext(
+    std::unique_ptr<ConcurrentWorkQueue> work_queue =
+        CreateMultiThreadedWorkQueue(2, 1)) {
+  auto decoded_diagnostic_handler = [&](const DecodedDiagnostic& diag) {
+    abort();
+  };
+  return std::make_unique<HostContext>(decoded_diagnostic_handler,
+                                       CreateMallocAllocator(),
+                                       std::move(work_queue));
+}
+
+Autotuner& GetAutotuner(HostContext* host, int64_t cpu_budget,
+                        int64_t memory_budget) {
+  auto& autotuner = host->GetOrCreateSharedContext<Autotuner>();
+  IteratorStats::SetClock(&FakeNow);
+  autotuner.SetPeriod(std::chrono::nanoseconds(kPeriodNs));
+  autotuner.SetBudget(cpu_budget, memory_budget);
+  return autotuner;
+}
+
+// The counters of a tuned iterator over one period, as fractions of the
+// period, see the Autotuner comment.
+struct Period {
+  // Fraction of the period that each producer was busy.
+  double busy;
+  // Fraction of the period that the iterator waited for its input.
+  double wait;
+  // Fraction of the period that the consumer waited for the iterator.
+  double consumer_wait;
+  int64_t element_bytes = 8;
+};
+
+// A tuned iterator, whose counters are set by the test.
+class FakeIterator {
+ public:
+  FakeIterator(Kind kind, int64_t num_producers, HostContext* host)
+      : kind_(kind),
+        num_producers_(num_producers),
+        parameter_(kind, num_producers, &stats_, host) {}
+
+  // Adds the counters of a period, for the current value of the parameter.
+  void Run(const Period& period) {
+    const int64_t num_producers =
+        kind_ == Kind::kParallelism ? parameter_.value() : num_producers_;
+    stats_.RecordElements(10);
+    stats_.AddBytes(10 * period.element_bytes);
+    stats_.AddProduceTime(period.busy * kPeriodNs * num_producers);
+    stats_.AddWaitTime(period.wait * kPeriodNs);
+    parameter_.AddConsumerWaitTime(period.consumer_wait * kPeriodNs);
+  }
+
+  TunableParameter& parameter() { return parameter_; }
+
+ private:
+  const Kind kind_;
+  const int64_t num_producers_;
+  IteratorStats stats_;
+  TunableParameter parameter_;
+};
+
+// Advances the fake clock by one period and runs a tuning step.
+void Step(FakeIterator* iterator) {
+  fake_now_ns += kPeriodNs;
+  iterator->parameter().MaybeTune();
+}
+
+// Runs `num_steps` periods of `iterator` and returns the value of its
+// parameter after each step.
+std::vector<int64_t> Tune(FakeIterator* iterator, const Period& period,
+                          int num_steps) {
+  std::vector<int64_t> values;
+  for (int i = 0; i < num_steps; ++i) {
+    iterator->Run(period);
+    Step(iterator);
+    values.push_back(iterator->parameter().value());
+  }
+  return values;
+}
+
+// The consumer waits for a busy iterator, so the parallelism is increased up
+// to the CPU budget.
+TEST(AutotunerTest, BottleneckParallelismIncreasesToCpuBudget) {
+  auto host = CreateHostContext();
+  GetAutotuner(host.get(), /*cpu_budget=*/4, /*memory_budget=*/1 << 20);
+  FakeIterator iterator(Kind::kParallelism, 1, host.get());
+  EXPECT_EQ(iterator.parameter().value(), 1);
+  EXPECT_EQ(Tune(&iterator, {/*busy=*/1, /*wait=*/0, /*consumer_wait=*/0.5},
+                 5),
+            std::vector<int64_t>({2, 3, 4, 4, 4}));
+}
+
+// The consumer does not wait, and the calls are idle half of the time, so
+// the parallelism is decreased down to 1. Busy calls keep their parallelism.
+TEST(AutotunerTest, IdleParallelismDecreases) {
+  auto host = CreateHostContext();
+  GetAutotuner(host.get(), /*cpu_budget=*/8, /*memory_budget=*/1 << 20);
+  FakeIterator iterator(Kind::kParallelism, 1, host.get());
+  const Period bottleneck = {/*busy=*/1, /*wait=*/0, /*consumer_wait=*/0.5};
+  EXPECT_EQ(Tune(&iterator, bottleneck, 4),
+            std::vector<int64_t>({2, 3, 4, 5}));
+  EXPECT_EQ(Tune(&iterator, {/*busy=*/0.9, /*wait=*/0, /*consumer_wait=*/0},
+                 2),
+            std::vector<int64_t>({5, 5}));
+  EXPECT_EQ(Tune(&iterator, {/*busy=*/0.2, /*wait=*/0, /*consumer_wait=*/0},
+                 6),
+            std::vector<int64_t>({4, 3, 2, 1, 1, 1}));
+}
+
+// A bottleneck that waits for its input most of the time is not given more
+// parallelism.
+TEST(AutotunerTest, InputBoundParallelismIsKept) {
+  auto host = CreateHostContext();
+  GetAutotuner(host.get(), /*cpu_budget=*/8, /*memory_budget=*/1 << 20);
+  FakeIterator iterator(Kind::kParallelism, 1, host.get());
+  EXPECT_EQ(Tune(&iterator, {/*busy=*/1, /*wait=*/0.9, /*consumer_wait=*/0.5},
+                 3),
+            std::vector<int64_t>({1, 1, 1}));
+}
+
+// An iterator without elements in the period is not tuned.
+TEST(AutotunerTest, InactiveIteratorIsKept) {
+  auto host = CreateHostContext();
+  GetAutotuner(host.get(), /*cpu_budget=*/8, /*memory_budget=*/1 << 20);
+  FakeIterator iterator(Kind::kParallelism, 1, host.get());
+  Tune(&iterator, {/*busy=*/1, /*wait=*/0, /*consumer_wait=*/0.5}, 2);
+  for (int i = 0; i < 3; ++i) {
+    Step(&iterator);
+    EXPECT_EQ(iterator.parameter().value(), 3);
+  }
+}
+
+// The parallelism is decreased while the CPU budget is exceeded, and the sum
+// of the parallelism of the iterators stays within the budget.
+TEST(AutotunerTest, CpuBudgetIsShared) {
+  auto host = CreateHostContext();
+  auto& autotuner =
+      GetAutotuner(host.get(), /*cpu_budget=*/6, /*memory_budget=*/1 << 20);
+  FakeIterator first(Kind::kParallelism, 1, host.get());
+  FakeIterator second(Kind::kParallelism, 1, host.get());
+  const Period bottleneck = {/*busy=*/1, /*wait=*/0, /*consumer_wait=*/0.5};
+  for (int i = 0; i < 10; ++i) {
+    first.Run(bottleneck);
+    second.Run(bottleneck);
+    Step(&first);
+    EXPECT_LE(first.parameter().value() + second.parameter().value(), 6);
+  }
+  EXPECT_EQ(first.parameter().value() + second.parameter().value(), 6);
+
+  autotuner.SetBudget(/*cpu_budget=*/2, /*memory_budget=*/1 << 20);
+  for (int i = 0; i < 10; ++i) {
+    first.Run(bottleneck);
+    second.Run(bottleneck);
+    Step(&first);
+  }
+  EXPECT_EQ(first.parameter().value(), 1);
+  EXPECT_EQ(second.parameter().value(), 1);
+}
+
+// The buffer of a bottleneck is doubled while its producers are idle part of
+// the time, up to 1024 elements, and never decreased.
+TEST(AutotunerTest, BufferSizeDoubles) {
+  auto host = CreateHostContext();
+  GetAutotuner(host.get(), /*cpu_budget=*/8, /*memory_budget=*/1 << 30);
+  FakeIterator iterator(Kind::kBufferSize, 1, host.get());
+  EXPECT_EQ(Tune(&iterator, {/*busy=*/0.5, /*wait=*/0, /*consumer_wait=*/0.1},
+                 3),
+            std::vector<int64_t>({2, 4, 8}));
+  // Always busy producers, and a consumer that does not wait.
+  EXPECT_EQ(Tune(&iterator, {/*busy=*/0.9, /*wait=*/0, /*consumer_wait=*/0.1},
+                 2),
+            std::vector<int64_t>({8, 8}));
+  EXPECT_EQ(Tune(&iterator, {/*busy=*/0.5, /*wait=*/0, /*consumer_wait=*/0},
+                 2),
+            std::vector<int64_t>({8, 8}));
+  auto values =
+      Tune(&iterator, {/*busy=*/0.5, /*wait=*/0, /*consumer_wait=*/0.1}, 10);
+  EXPECT_EQ(values[6], 1024);
+  EXPECT_EQ(values.back(), 1024);
+}
+
+// The buffer is not doubled past the memory budget, given the size of the
+// elements and the number of producers.
+TEST(AutotunerTest, BufferSizeWithinMemoryBudget) {
+  auto host = CreateHostContext();
+  GetAutotuner(host.get(), /*cpu_budget=*/8, /*memory_budget=*/16 * 1000);
+  FakeIterator iterator(Kind::kBufferSize, /*num_producers=*/2, host.get());
+  Period period = {/*busy=*/0.5, /*wait=*/0, /*consumer_wait=*/0.1};
+  period.element_bytes = 1000;
+  // 8 elements per producer use the 16000 bytes of the budget.
+  EXPECT_EQ(Tune(&iterator, period, 5),
+            std::vector<int64_t>({2, 4, 8, 8, 8}));
+}
+
+// A tuning step runs at most once per period.
+TEST(AutotunerTest, TunesOncePerPeriod) {
+  auto host = CreateHostContext();
+  GetAutotuner(host.get(), /*cpu_budget=*/8, /*memory_budget=*/1 << 20);
+  FakeIterator iterator(Kind::kParallelism, 1, host.get());
+  const Period bottleneck = {/*busy=*/1, /*wait=*/0, /*consumer_wait=*/0.5};
+  iterator.Run(bottleneck);
+  Step(&iterator);
+  EXPECT_EQ(iterator.parameter().value(), 2);
+  for (int i = 0; i < 3; ++i) {
+    iterator.Run(bottleneck);
+    fake_now_ns += kPeriodNs / 4;
+    iterator.parameter().MaybeTune();
+    EXPECT_EQ(iterator.parameter().value(), 2);
+  }
+  fake_now_ns += kPeriodNs / 4;
+  iterator.parameter().MaybeTune();
+  EXPECT_EQ(iterator.parameter().value(), 3);
+}
+
+// Dataset of the range [0, n) that counts the elements read by its iterator.
+class CountingRange : public Dataset<int64_t> {
+ public:
+  CountingRange(int64_t n, int64_t* num_read, HostContext* host)
+      : n_(n), num_read_(num_read), host_(host) {}
+
+  RCReference<Iterator<int64_t>> MakeIterator() override {
+    return TakeRef(host_->Construct<CountingIterator>(FormRef(this)));
+  }
+
+ private:
+  class CountingIterator : public Iterator<int64_t> {
+   public:
+    explicit CountingIterator(RCReference<CountingRange> dataset)
+        : dataset_(std::move(dataset)) {}
+
+    AsyncValueRef<std::tuple<int64_t>> GetNext(
+        const ExecutionContext& exec_ctx) override {
+      int64_t& num_read = *dataset_->num_read_;
+      if (num_read == dataset_->n_) return {};
+      return dataset_->host_->MakeConcreteAsyncValueRef<std::tuple<int64_t>>(
+          num_read++);
+    }
+
+   private:
+    void Destroy() override {
+      internal::DestroyImpl<CountingIterator>(this,
+                                              dataset_->host_->allocator());
+    }
+
+    RCReference<CountingRange> dataset_;
+  };
+
+  void Destroy() override {
+    internal::DestroyImpl<CountingRange>(this, host_->allocator());
+  }
+
+  const int64_t n_;
+  int64_t* const num_read_;
+  HostContext* host_;
+};
+
+// The map function of a ParallelMapDataset with autotuned parallelism takes a
+// tenth of a period, so the consumer always waits for it. The parallelism
+// increases by one per period up to the CPU budget, and stays there.
+TEST(AutotunerTest, SlowParallelMapConvergesToCpuBudget) {
+  // The map function only runs when the test thread awaits its result, one
+  // invocation at a time, so only the map function advances the fake clock.
+  auto host = CreateHostContext(CreateSingleThreadedWorkQueue());
+  GetAutotuner(host.get(), /*cpu_budget=*/3, /*memory_budget=*/1 << 20);
+  testing::TestFunction<int64_t, int64_t> slow_fn([](int64_t x) {
+    fake_now_ns += kPeriodNs / 10;
+    return x;
+  });
+  int64_t num_read = 0;
+  auto map = TakeRef(
+      host->Construct<
+          ParallelMapDataset<std::tuple<int64_t>, std::tuple<int64_t>>>(
+          TakeRef(host->Construct<CountingRange>(200, &num_read, host.get())),
+          RCArray<AsyncValue>(ArrayRef<AsyncValue*>()), slow_fn.Ref(),
+          kAutotune, /*deterministic=*/true, host.get()));
+  auto iterator = map->MakeIterator();
+
+  // The parallelism is the number of invocations in flight after GetNext,
+  // including the one of the returned element.
+  ExecutionContext exec_ctx(host.get());
+  std::vector<int64_t> parallelism;
+  for (int64_t i = 0; i < 200; ++i) {
+    auto element = iterator->GetNext(exec_ctx);
+    ASSERT_TRUE(static_cast<bool>(element));
+    if (num_read < 200) parallelism.push_back(num_read - i);
+    host->Await(element.CopyRCRef());
+    ASSERT_FALSE(element.IsError()) << element.GetError().message;
+    ASSERT_EQ(std::get<0>(element.get()), i);
+  }
+  // A period is ten elements.
+  std::vector<int64_t> expected(parallelism.size(), 3);
+  std::fill(expected.begin(), expected.begin() + 10, 1);
+  std::fill(expected.begin() + 10, expected.begin() + 20, 2);
+  EXPECT_EQ(parallelism, expected);
+  iterator.reset();
+  host->Quiesce();
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tfrt
@@ -0,0 +1,188 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- batch_dataset_benchmark.cc -----------------------------------------===//
+//
+// Benchmark for BatchDataset with 224x224x3 float image tensors, and with
+// scalars for which the per-element overhead dominates.
+//
+//===----------------------------------------------------------------------===//
+
+#include <cstring>
+
+#include "benchmark/benchmark.h"
+#include "lib/data/batch_dataset.h"
+#include "lib/data/range_dataset.h"
+#include "tfrt/host_context/concurrent_work_queue.h"
+#include "tfrt/host_context/host_allocator.h"
+#include "tfrt/host_context/host_context.h"
+
+namespace tfrt {
+namespace data {
+namespace {
+
+constexpr ssize_t kImageDims[] = {224, 224, 3};
+
+// Dataset of `num_elements` 224x224x3 float tensors. If `async` is true, the
+// tensors are produced on the work queue like the results of a map function.
+// Otherwise they are references to the same available tensor.
+class ImageDataset : public Dataset<DenseHostTensor> {
+ public:
+  ImageDataset(int64_t num_elements, bool async, HostContext* host)
+      : num_elements_(num_elements),
+        async_(async),
+        host_(host),
+        image_(*DenseHostTensor::CreateUninitialized(
+            TensorMetadata(GetDType<float>(), kImageDims), host)) {
+    std::memset(image_.data(), 0, image_.DataSizeInBytes());
+  }
+
+  RCReference<Iterator<DenseHostTensor>> MakeIterator() override;
+
+ private:
+  friend class ImageDatasetIterator;
+
+  void Destroy() override {
+    internal::DestroyImpl<ImageDataset>(this, host_->allocator());
+  }
+
+  int64_t num_elements_;
+  bool async_;
+  HostContext* host_;
+  DenseHostTensor image_;
+};
+
+class ImageDatasetIterator : public Iterator<DenseHostTensor> {
+ public:
+  explicit ImageDatasetIterator(RCReference<ImageDataset> dataset)
+      : dataset_(std::move(dataset)) {}
+
+  AsyncValueRef<std::tuple<DenseHostTensor>> GetNext(
+      const ExecutionContext& exec_ctx) override {
+    if (next_ == dataset_->num_elements_) return {};
+    ++next_;
+    HostContext* host = exec_ctx.host();
+    if (!dataset_->async_) {
+      return host->MakeConcreteAsyncValueRef<std::tuple<DenseHostTensor>>(
+          dataset_->image_.CopyRef());
+    }
+    auto value =
+        host->MakeUnconstructedAsyncValueRef<std::tuple<DenseHostTensor>>();
+    host->EnqueueWork([host, value = value.CopyRef()]() {
+      auto image = DenseHostTensor::CreateUninitialized(
+          TensorMetadata(GetDType<float>(), kImageDims), host);
+      std::memset(image->data(), 1, image->DataSizeInBytes());
+      value.emplace(std::move(*image));
+    });
+    return value;
+  }
+
+ private:
+  void Destroy() override {
+    internal::DestroyImpl<ImageDatasetIterator>(this,
+                                                dataset_->host_->allocator());
+  }
+
+  RCReference<ImageDataset> dataset_;
+  int64_t next_ = 0;
+};
+
+RCReference<Iterator<DenseHostTensor>> ImageDataset::MakeIterator() {
+  return TakeRef(host_->Construct<ImageDatasetIterator>(FormRef(this)));
+}
+
+std::unique_ptr<HostContext> CreateHostContext() {
+  auto decoded_diagnostic_handler = [&](const DecodedDiagnostic& diag) {
+    abort();
+  };
+  return std::make_unique<HostContext>(decoded_diagnostic_handler,
+                                       CreateMallocAllocator(),
+                                       CreateMultiThreadedWorkQueue(4, 1));
+}
+
+// Arguments: batch size, and whether the input elements are produced
+// asynchronously.
+void BM_BatchImages(benchmark::State& state) {
+  const int32_t batch_size = state.range(0);
+  const bool async = state.range(1);
+  const int64_t kNumBatches = 8;
+
+  auto host = CreateHostContext();
+  ExecutionContext exec_ctx(host.get());
+  auto input = TakeRef(host->Construct<ImageDataset>(batch_size * kNumBatches,
+                                                     async, host.get()));
+  auto dataset = TakeRef(host->Construct<BatchDataset<DenseHostTensor>>(
+      std::move(input), batch_size, host.get()));
+
+  for (auto _ : state) {
+    auto iterator = dataset->MakeIterator();
+    while (auto batch = iterator->GetNext(exec_ctx)) {
+      host->Await(batch.CopyRCRef());
+      if (batch.IsError()) {
+        state.SkipWithError("failed to batch elements");
+        return;
+      }
+    }
+  }
+
+  const int64_t num_elements = state.iterations() * batch_size * kNumBatches;
+  state.SetItemsProcessed(num_elements);
+  state.SetBytesProcessed(num_elements * 224 * 224 * 3 * sizeof(float));
+}
+
+BENCHMARK(BM_BatchImages)
+    ->ArgNames({"batch_size", "async"})
+    ->Args({32, 0})
+    ->Args({32, 1})
+    ->Args({128, 1})
+    ->UseRealTime();
+
+// Argument: batch size.
+void BM_BatchRange(benchmark::State& state) {
+  const int32_t batch_size = state.range(0);
+  const int64_t kNumElements = 1 << 20;
+
+  auto host = CreateHostContext();
+  ExecutionContext exec_ctx(host.get());
+  auto range = TakeRef(host->Construct<RangeDataset<int64_t>>(
+      0, kNumElements, 1, host.get()));
+  auto dataset = TakeRef(host->Construct<BatchDataset<int64_t>>(
+      std::move(range), batch_size, host.get()));
+
+  for (auto _ : state) {
+    auto iterator = dataset->MakeIterator();
+    while (auto batch = iterator->GetNext(exec_ctx)) {
+      host->Await(batch.CopyRCRef());
+      if (batch.IsError()) {
+        state.SkipWithError("failed to batch elements");
+        return;
+      }
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * kNumElements);
+}
+
+BENCHMARK(BM_BatchRange)
+    ->ArgNames({"batch_size"})
+    ->Arg(32)
+    ->Arg(1024)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace data
+}  // namespace tfrt
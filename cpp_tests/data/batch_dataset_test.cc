@@ -0,0 +1,150 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- batch_dataset_test.cc ------------------------------------*- C++ -*-===//
+//
+// This file contains unit tests for BatchDataset.
+//
+//===----------------------------------------------------------------------===//
+
+#include "lib/data/batch_dataset.h"
+
+#include "cpp_tests/data/dataset_test_util.h"
+#include "gtest/gtest.h"
+
+namespace tfrt {
+namespace data {
+namespace {
+
+using testing::CreateHostContext;
+using testing::GetDims;
+using testing::GetElements;
+using testing::GetValues;
+using testing::MakeAsyncValues;
+using testing::MakeRange;
+using testing::MakeSlice;
+using testing::MakeTensor;
+using testing::MakeValuesWithErrors;
+using testing::RequestElements;
+
+template <typename T>
+RCReference<Dataset<DenseHostTensor>> MakeBatch(RCReference<Dataset<T>> input,
+                                                int32_t batch_size,
+                                                HostContext* host) {
+  return TakeRef(
+      host->Construct<BatchDataset<T>>(std::move(input), batch_size, host));
+}
+
+TEST(BatchDatasetTest, BatchScalars) {
+  auto host = CreateHostContext();
+  auto batch = MakeBatch(MakeRange<int64_t>(10, host.get()),
+                         /*batch_size=*/4, host.get());
+  auto batches = GetElements(batch->MakeIterator().get(), host.get());
+  ASSERT_TRUE(static_cast<bool>(batches));
+  ASSERT_EQ(batches->size(), 3);
+  EXPECT_EQ(GetDims((*batches)[0]), std::vector<ssize_t>({4}));
+  EXPECT_EQ(GetValues<int64_t>((*batches)[0]),
+            std::vector<int64_t>({0, 1, 2, 3}));
+  EXPECT_EQ(GetValues<int64_t>((*batches)[1]),
+            std::vector<int64_t>({4, 5, 6, 7}));
+  // The last batch is short.
+  EXPECT_EQ(GetDims((*batches)[2]), std::vector<ssize_t>({2}));
+  EXPECT_EQ(GetValues<int64_t>((*batches)[2]), std::vector<int64_t>({8, 9}));
+  host->Quiesce();
+}
+
+TEST(BatchDatasetTest, BatchTensors) {
+  auto host = CreateHostContext();
+  std::vector<DenseHostTensor> tensors;
+  for (int i = 0; i < 3; ++i) {
+    tensors.push_back(MakeTensor<float>({2}, {i * 1.f, i * 10.f}, host.get()));
+  }
+  auto batch =
+      MakeBatch(MakeSlice(std::move(tensors), host.get()), 3, host.get());
+  auto batches = GetElements(batch->MakeIterator().get(), host.get());
+  ASSERT_TRUE(static_cast<bool>(batches));
+  ASSERT_EQ(batches->size(), 1);
+  EXPECT_EQ(GetDims(batches->front()), std::vector<ssize_t>({3, 2}));
+  EXPECT_EQ(GetValues<float>(batches->front()),
+            std::vector<float>({0, 0, 1, 10, 2, 20}));
+  host->Quiesce();
+}
+
+// Every element is copied into its slot when it becomes available, and the
+// batch is available once all of them are.
+TEST(BatchDatasetTest, ElementsCompleteOutOfOrder) {
+  auto host = CreateHostContext();
+  std::vector<AsyncValueRef<std::tuple<int64_t>>> values;
+  for (int i = 0; i < 4; ++i) {
+    values.push_back(
+        host->MakeUnconstructedAsyncValueRef<std::tuple<int64_t>>());
+  }
+  auto iterator = MakeBatch(MakeAsyncValues<int64_t>(values, host.get()),
+                            /*batch_size=*/4, host.get())
+                      ->MakeIterator();
+  auto batches = RequestElements(iterator.get(), 1, host.get());
+  ASSERT_EQ(batches.size(), 1);
+  for (int i : {3, 1, 0}) {
+    values[i].emplace(i * 10);
+    EXPECT_FALSE(batches[0].IsAvailable());
+  }
+  values[2].emplace(20);
+
+  host->Await(batches[0].CopyRCRef());
+  ASSERT_FALSE(batches[0].IsError());
+  EXPECT_EQ(GetValues<int64_t>(std::get<0>(batches[0].get())),
+            std::vector<int64_t>({0, 10, 20, 30}));
+  iterator.reset();
+  host->Quiesce();
+}
+
+TEST(BatchDatasetTest, MismatchedMetadata) {
+  auto host = CreateHostContext();
+  std::vector<DenseHostTensor> tensors;
+  tensors.push_back(MakeTensor<float>({2}, {1, 2}, host.get()));
+  tensors.push_back(MakeTensor<float>({3}, {1, 2, 3}, host.get()));
+  auto batch =
+      MakeBatch(MakeSlice(std::move(tensors), host.get()), 2, host.get());
+  auto batches = GetElements(batch->MakeIterator().get(), host.get());
+  ASSERT_FALSE(static_cast<bool>(batches));
+  EXPECT_EQ(llvm::toString(batches.takeError()),
+            "tensors to be batched must have the same metadata");
+  host->Quiesce();
+}
+
+TEST(BatchDatasetTest, InputError) {
+  auto host = CreateHostContext();
+  auto input = MakeAsyncValues<int64_t>(
+      MakeValuesWithErrors(8, {5}, host.get()), host.get());
+  auto iterator = MakeBatch(std::move(input), 4, host.get())->MakeIterator();
+  // An input error that is available when the batch is requested ends the
+  // batch, and the next batch starts after it.
+  auto batches = RequestElements(iterator.get(), testing::kAll, host.get());
+  ASSERT_EQ(batches.size(), 3);
+  host->Await(batches[1].CopyRCRef());
+  ASSERT_TRUE(batches[1].IsError());
+  EXPECT_EQ(batches[1].GetError().message, "error 5");
+  host->Await(batches[2].CopyRCRef());
+  ASSERT_FALSE(batches[2].IsError());
+  EXPECT_EQ(GetValues<int64_t>(std::get<0>(batches[2].get())),
+            std::vector<int64_t>({6, 7}));
+  iterator.reset();
+  host->Quiesce();
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tfrt
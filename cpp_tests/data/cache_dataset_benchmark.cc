@@ -0,0 +1,158 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- cache_dataset_benchmark.cc -----------------------------------------===//
+//
+// Benchmark for replaying the elements of a CacheDataset from memory and from
+// the spill file, compared to producing them again.
+//
+//===----------------------------------------------------------------------===//
+
+#include <cstdlib>
+#include <cstring>
+
+#include "benchmark/benchmark.h"
+#include "lib/data/cache_dataset.h"
+#include "tfrt/host_context/concurrent_work_queue.h"
+#include "tfrt/host_context/host_allocator.h"
+#include "tfrt/host_context/host_context.h"
+
+namespace tfrt {
+namespace data {
+namespace {
+
+constexpr int64_t kNumElements = 256;
+constexpr ssize_t kImageDims[] = {64, 64, 3};
+constexpr int64_t kImageBytes = 64 * 64 * 3 * sizeof(float);
+
+// Dataset of `num_elements` 64x64x3 float tensors. Every element is produced
+// on the work queue, and the production cost is a pass over the tensor, which
+// stands in for decoding an image.
+class ImageDataset : public Dataset<DenseHostTensor> {
+ public:
+  ImageDataset(int64_t num_elements, HostContext* host)
+      : num_elements_(num_elements), host_(host) {}
+
+  RCReference<Iterator<DenseHostTensor>> MakeIterator() override;
+
+ private:
+  friend class ImageDatasetIterator;
+
+  void Destroy() override {
+    internal::DestroyImpl<ImageDataset>(this, host_->allocator());
+  }
+
+  int64_t num_elements_;
+  HostContext* host_;
+};
+
+class ImageDatasetIterator : public Iterator<DenseHostTensor> {
+ public:
+  explicit ImageDatasetIterator(RCReference<ImageDataset> dataset)
+      : dataset_(std::move(dataset)) {}
+
+  AsyncValueRef<std::tuple<DenseHostTensor>> GetNext(
+      const ExecutionContext& exec_ctx) override {
+    if (next_ == dataset_->num_elements_) return {};
+    const int64_t index = next_++;
+    HostContext* host = exec_ctx.host();
+    auto value =
+        host->MakeUnconstructedAsyncValueRef<std::tuple<DenseHostTensor>>();
+    host->EnqueueWork([host, index, value = value.CopyRef()]() {
+      auto image = DenseHostTensor::CreateUninitialized(
+          TensorMetadata(GetDType<float>(), kImageDims), host);
+      float* data = static_cast<float*>(image->data());
+      for (int64_t i = 0, e = image->NumElements(); i < e; ++i) {
+        data[i] = (index * 31 + i) % 255 / 255.0f;
+      }
+      value.emplace(std::move(*image));
+    });
+    return value;
+  }
+
+ private:
+  void Destroy() override {
+    internal::DestroyImpl<ImageDatasetIterator>(this,
+                                                dataset_->host_->allocator());
+  }
+
+  RCReference<ImageDataset> dataset_;
+  int64_t next_ = 0;
+};
+
+RCReference<Iterator<DenseHostTensor>> ImageDataset::MakeIterator() {
+  return TakeRef(host_->Construct<ImageDatasetIterator>(FormRef(this)));
+}
+
+std::unique_ptr<HostContext> CreateHostContext() {
+  auto decoded_diagnostic_handler = [&](const DecodedDiagnostic& diag) {
+    abort();
+  };
+  return std::make_unique<HostContext>(decoded_diagnostic_handler,
+                                       CreateMallocAllocator(),
+                                       CreateMultiThreadedWorkQueue(4, 1));
+}
+
+void RunEpoch(Dataset<DenseHostTensor>* dataset, HostContext* host,
+              benchmark::State& state) {
+  ExecutionContext exec_ctx(host);
+  auto iterator = dataset->MakeIterator();
+  std::vector<RCReference<AsyncValue>> values;
+  while (auto value = iterator->GetNext(exec_ctx)) {
+    values.push_back(value.ReleaseRCRef());
+  }
+  host->Await(values);
+  for (auto& value : values) {
+    if (value->IsError()) state.SkipWithError("failed to get element");
+  }
+}
+
+// Baseline: every epoch produces the elements again.
+void BM_NoCache(benchmark::State& state) {
+  auto host = CreateHostContext();
+  auto dataset =
+      TakeRef(host->Construct<ImageDataset>(kNumElements, host.get()));
+  for (auto _ : state) RunEpoch(dataset.get(), host.get(), state);
+  state.SetBytesProcessed(state.iterations() * kNumElements * kImageBytes);
+}
+
+BENCHMARK(BM_NoCache)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Argument: whether the elements are spilled to a file.
+void BM_CacheReplay(benchmark::State& state) {
+  const bool spill = state.range(0);
+  const char* tmp_dir = std::getenv("TEST_TMPDIR");
+  auto host = CreateHostContext();
+  auto input = TakeRef(host->Construct<ImageDataset>(kNumElements, host.get()));
+  auto dataset = TakeRef(host->Construct<CacheDataset<DenseHostTensor>>(
+      std::move(input), /*memory_budget=*/spill ? 1 : 0,
+      spill ? (tmp_dir ? tmp_dir : "/tmp") : "", host.get()));
+  // The first epoch fills the cache.
+  RunEpoch(dataset.get(), host.get(), state);
+  for (auto _ : state) RunEpoch(dataset.get(), host.get(), state);
+  state.SetBytesProcessed(state.iterations() * kNumElements * kImageBytes);
+}
+
+BENCHMARK(BM_CacheReplay)
+    ->ArgNames({"spill"})
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace data
+}  // namespace tfrt
@@ -0,0 +1,306 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- cache_dataset_test.cc ------------------------------------*- C++ -*-===//
+//
+// This file contains unit tests for CacheDataset.
+//
+//===----------------------------------------------------------------------===//
+
+#include "lib/data/cache_dataset.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <string>
+
+#include "cpp_tests/data/dataset_test_util.h"
+#include "gtest/gtest.h"
+#include "lib/data/iterator_state.h"
+#include "lib/data/map_dataset.h"
+
+namespace tfrt {
+namespace data {
+namespace {
+
+using testing::AwaitElements;
+using testing::CreateHostContext;
+using testing::GetElements;
+using testing::MakeAsyncValues;
+using testing::MakeRange;
+using testing::MakeSlice;
+using testing::MakeValuesWithErrors;
+using testing::RequestElements;
+using testing::TestFunction;
+
+using Map = MapDataset<std::tuple<int64_t>, std::tuple<int64_t>>;
+
+std::string GetSpillDir() {
+  const char* tmp_dir = std::getenv("TEST_TMPDIR");
+  return tmp_dir ? tmp_dir : "/tmp";
+}
+
+template <typename T>
+RCReference<Dataset<T>> MakeCache(RCReference<Dataset<T>> input,
+                                  int64_t memory_budget, std::string spill_dir,
+                                  HostContext* host) {
+  return TakeRef(host->Construct<CacheDataset<T>>(
+      std::move(input), memory_budget, std::move(spill_dir), host));
+}
+
+// Returns the range [0, n) mapped by `map_fn`, so that the test can count the
+// elements read from the input.
+RCReference<Dataset<int64_t>> MakeCountedRange(int64_t n, const Function& fn,
+                                               HostContext* host) {
+  return TakeRef(host->Construct<Map>(
+      MakeRange<int64_t>(n, host), RCArray<AsyncValue>(ArrayRef<AsyncValue*>()),
+      FormRef(&fn), host));
+}
+
+std::vector<int64_t> Range(int64_t n) {
+  std::vector<int64_t> values;
+  for (int64_t i = 0; i < n; ++i) values.push_back(i);
+  return values;
+}
+
+// Every configuration returns the same elements in every epoch. The input is
+// read once if the elements are kept in memory or spilled, and in every epoch
+// if the cache exceeds its memory budget without a spill directory.
+TEST(CacheDatasetTest, ReplaysFirstIteration) {
+  auto host = CreateHostContext();
+  struct Config {
+    int64_t memory_budget;
+    std::string spill_dir;
+    int num_input_epochs;
+  };
+  const int64_t kNumElements = 100;
+  for (const Config& config :
+       {Config{0, "", 1}, Config{kNumElements * 8, "", 1},
+        Config{10 * 8, GetSpillDir(), 1}, Config{10 * 8, "", 3}}) {
+    std::atomic<int64_t> num_calls{0};
+    TestFunction<int64_t, int64_t> fn([&](int64_t x) {
+      ++num_calls;
+      return x;
+    });
+    auto cache = MakeCache(MakeCountedRange(kNumElements, fn, host.get()),
+                           config.memory_budget, config.spill_dir, host.get());
+    for (int epoch = 0; epoch < 3; ++epoch) {
+      auto elements = GetElements(cache->MakeIterator().get(), host.get());
+      ASSERT_TRUE(static_cast<bool>(elements));
+      EXPECT_EQ(*elements, Range(kNumElements));
+    }
+    EXPECT_EQ(num_calls, kNumElements * config.num_input_epochs);
+  }
+  host->Quiesce();
+}
+
+TEST(CacheDatasetTest, SpillsStrings) {
+  auto host = CreateHostContext();
+  std::vector<std::string> values;
+  for (int i = 0; i < 50; ++i) values.push_back(std::string(i, 'a' + i % 26));
+  auto cache = MakeCache(MakeSlice(values, host.get()), /*memory_budget=*/256,
+                         GetSpillDir(), host.get());
+  for (int epoch = 0; epoch < 2; ++epoch) {
+    auto elements = GetElements(cache->MakeIterator().get(), host.get());
+    ASSERT_TRUE(static_cast<bool>(elements));
+    EXPECT_EQ(*elements, values);
+  }
+  host->Quiesce();
+}
+
+// An iterator made after the first iterator requests every element replays
+// the cache once the elements become available.
+TEST(CacheDatasetTest, ReplayWaitsForCache) {
+  auto host = CreateHostContext();
+  std::vector<AsyncValueRef<std::tuple<int64_t>>> inputs;
+  for (int i = 0; i < 10; ++i) {
+    inputs.push_back(
+        host->MakeUnconstructedAsyncValueRef<std::tuple<int64_t>>());
+  }
+  auto cache = MakeCache(MakeAsyncValues<int64_t>(inputs, host.get()),
+                         /*memory_budget=*/0, "", host.get());
+  auto first = cache->MakeIterator();
+  auto first_values = RequestElements(first.get(), testing::kAll, host.get());
+  ASSERT_EQ(first_values.size(), 10);
+
+  auto replay = cache->MakeIterator();
+  auto replay_values = RequestElements(replay.get(), testing::kAll, host.get());
+  ASSERT_EQ(replay_values.size(), 10);
+  for (const auto& value : replay_values) EXPECT_FALSE(value.IsAvailable());
+
+  // Complete the input out of order.
+  for (int i = 9; i >= 0; --i) inputs[i].emplace(i);
+  auto elements = AwaitElements<int64_t>(first_values, host.get());
+  ASSERT_TRUE(static_cast<bool>(elements));
+  EXPECT_EQ(*elements, Range(10));
+  elements = AwaitElements<int64_t>(replay_values, host.get());
+  ASSERT_TRUE(static_cast<bool>(elements));
+  EXPECT_EQ(*elements, Range(10));
+  first.reset();
+  replay.reset();
+  host->Quiesce();
+}
+
+// If the input fails, the cache is abandoned, and a replay made before that
+// reads from the input instead.
+TEST(CacheDatasetTest, InputErrorAbandonsCache) {
+  auto host = CreateHostContext();
+  std::vector<AsyncValueRef<std::tuple<int64_t>>> inputs;
+  for (int i = 0; i < 5; ++i) {
+    inputs.push_back(
+        host->MakeUnconstructedAsyncValueRef<std::tuple<int64_t>>());
+  }
+  auto cache = MakeCache(MakeAsyncValues<int64_t>(inputs, host.get()),
+                         /*memory_budget=*/0, "", host.get());
+  auto first = cache->MakeIterator();
+  auto first_values = RequestElements(first.get(), testing::kAll, host.get());
+  auto replay = cache->MakeIterator();
+  for (int i = 0; i < 5; ++i) {
+    if (i == 3) {
+      inputs[i].SetError(DecodedDiagnostic("input error"));
+    } else {
+      inputs[i].emplace(i);
+    }
+  }
+  auto replay_values = RequestElements(replay.get(), testing::kAll, host.get());
+  ASSERT_EQ(replay_values.size(), 5);
+  for (const auto* values : {&first_values, &replay_values}) {
+    for (int i = 0; i < 5; ++i) {
+      const auto& value = (*values)[i];
+      host->Await(value.CopyRCRef());
+      if (i == 3) {
+        ASSERT_TRUE(value.IsError());
+        EXPECT_EQ(value.GetError().message, "input error");
+      } else {
+        ASSERT_FALSE(value.IsError());
+        EXPECT_EQ(std::get<0>(value.get()), i);
+      }
+    }
+  }
+
+  // The cache is not retried.
+  auto elements = GetElements(cache->MakeIterator().get(), host.get());
+  ASSERT_FALSE(static_cast<bool>(elements));
+  EXPECT_EQ(llvm::toString(elements.takeError()), "input error");
+  first.reset();
+  replay.reset();
+  host->Quiesce();
+}
+
+// A first iterator destroyed before the end of the input abandons its cache,
+// and the next iterator starts a new one. An iterator made while the first
+// iterator is running reads from the input.
+TEST(CacheDatasetTest, AbandonedCacheIsRetried) {
+  auto host = CreateHostContext();
+  std::atomic<int64_t> num_calls{0};
+  TestFunction<int64_t, int64_t> fn([&](int64_t x) {
+    ++num_calls;
+    return x;
+  });
+  auto cache = MakeCache(MakeCountedRange(20, fn, host.get()),
+                         /*memory_budget=*/0, "", host.get());
+  {
+    auto partial = cache->MakeIterator();
+    auto elements = GetElements(partial.get(), host.get(), 5);
+    ASSERT_TRUE(static_cast<bool>(elements));
+    EXPECT_EQ(*elements, Range(5));
+  }
+  EXPECT_EQ(num_calls, 5);
+
+  auto writer = cache->MakeIterator();
+  auto concurrent = GetElements(cache->MakeIterator().get(), host.get());
+  ASSERT_TRUE(static_cast<bool>(concurrent));
+  EXPECT_EQ(*concurrent, Range(20));
+  auto elements = GetElements(writer.get(), host.get());
+  ASSERT_TRUE(static_cast<bool>(elements));
+  EXPECT_EQ(*elements, Range(20));
+  EXPECT_EQ(num_calls, 45);
+
+  elements = GetElements(cache->MakeIterator().get(), host.get());
+  ASSERT_TRUE(static_cast<bool>(elements));
+  EXPECT_EQ(*elements, Range(20));
+  EXPECT_EQ(num_calls, 45);
+  writer.reset();
+  host->Quiesce();
+}
+
+// An input with errors that are available right away is not cached.
+TEST(CacheDatasetTest, AvailableInputErrors) {
+  auto host = CreateHostContext();
+  auto cache = MakeCache(MakeAsyncValues<int64_t>(
+                             MakeValuesWithErrors(5, {1}, host.get()),
+                             host.get()),
+                         /*memory_budget=*/0, "", host.get());
+  for (int epoch = 0; epoch < 2; ++epoch) {
+    auto values =
+        RequestElements(cache->MakeIterator().get(), testing::kAll, host.get());
+    ASSERT_EQ(values.size(), 5);
+    for (int i = 0; i < 5; ++i) {
+      host->Await(values[i].CopyRCRef());
+      EXPECT_EQ(values[i].IsError(), i == 1);
+    }
+  }
+  host->Quiesce();
+}
+
+// A replay restored to a position while the cache is filling returns the
+// elements from that position, whether the cache completes or is abandoned.
+TEST(CacheDatasetTest, RestoreReplayOfIncompleteCache) {
+  auto host = CreateHostContext();
+  for (bool abandon : {false, true}) {
+    std::vector<AsyncValueRef<std::tuple<int64_t>>> inputs;
+    for (int i = 0; i < 5; ++i) {
+      inputs.push_back(
+          host->MakeUnconstructedAsyncValueRef<std::tuple<int64_t>>());
+    }
+    auto cache = MakeCache(MakeAsyncValues<int64_t>(inputs, host.get()),
+                           /*memory_budget=*/0, "", host.get());
+    auto first = cache->MakeIterator();
+    auto first_values =
+        RequestElements(first.get(), testing::kAll, host.get());
+    ASSERT_EQ(first_values.size(), 5);
+
+    auto saved = cache->MakeIterator();
+    auto saved_values = RequestElements(saved.get(), 2, host.get());
+    IteratorStateWriter writer;
+    ASSERT_FALSE(static_cast<bool>(saved->Save(&writer)));
+    auto restored = cache->MakeIterator();
+    IteratorStateReader reader(writer.data(), host.get());
+    ASSERT_FALSE(static_cast<bool>(restored->Restore(&reader)));
+    auto restored_values =
+        RequestElements(restored.get(), testing::kAll, host.get());
+    ASSERT_EQ(restored_values.size(), 3);
+
+    // An input error abandons the cache.
+    for (int i = 0; i < 5; ++i) {
+      if (abandon && i == 0) {
+        inputs[i].SetError(DecodedDiagnostic("input error"));
+      } else {
+        inputs[i].emplace(i * 100);
+      }
+    }
+    auto elements = AwaitElements<int64_t>(restored_values, host.get());
+    ASSERT_TRUE(static_cast<bool>(elements)) << "abandon " << abandon;
+    EXPECT_EQ(*elements, std::vector<int64_t>({200, 300, 400}))
+        << "abandon " << abandon;
+    for (const auto& value : first_values) host->Await(value.CopyRCRef());
+    for (const auto& value : saved_values) host->Await(value.CopyRCRef());
+  }
+  host->Quiesce();
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tfrt
@@ -0,0 +1,270 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- dataset_test_util.h --------------------------------------*- C++ -*-===//
+//
+// This file declares helpers for the unit tests of the data pipeline
+// datasets.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef TFRT_CPP_TESTS_DATA_DATASET_TEST_UTIL_H_
+#define TFRT_CPP_TESTS_DATA_DATASET_TEST_UTIL_H_
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "lib/data/dataset.h"
+#include "lib/data/range_dataset.h"
+#include "lib/data/slice_dataset.h"
+#include "tfrt/host_context/concurrent_work_queue.h"
+#include "tfrt/host_context/function.h"
+#include "tfrt/host_context/host_allocator.h"
+#include "tfrt/host_context/host_context.h"
+#include "tfrt/support/error_util.h"
+#include "tfrt/support/string_util.h"
+#include "tfrt/tensor/dense_host_tensor.h"
+#include "tfrt/tensor/dense_host_tensor_view.h"
+
+namespace tfrt {
+namespace data {
+namespace testing {
+
+constexpr int64_t kAll = std::numeric_limits<int64_t>::max();
+
+// The diagnostics are ignored, the tests check the errors returned by the
+// iterators.
+inline std::unique_ptr<HostContext> CreateHostContext() {
+  auto decoded_diagnostic_handler = [&](const DecodedDiagnostic& diag) {};
+  return std::make_unique<HostContext>(decoded_diagnostic_handler,
+                                       CreateMallocAllocator(),
+                                       CreateMultiThreadedWorkQueue(2, 2));
+}
+
+// Requests the next `num_elements` elements of the iterator, or the elements
+// up to the end, without waiting for them.
+template <typename... T>
+std::vector<AsyncValueRef<std::tuple<T...>>> RequestElements(
+    Iterator<T...>* iterator, int64_t num_elements, HostContext* host) {
+  ExecutionContext exec_ctx(host);
+  std::vector<AsyncValueRef<std::tuple<T...>>> values;
+  for (int64_t i = 0; i < num_elements; ++i) {
+    auto value = iterator->GetNext(exec_ctx);
+    if (!value) break;
+    values.push_back(std::move(value));
+  }
+  return values;
+}
+
+// Waits for the values and returns their elements, or the first error.
+template <typename T>
+llvm::Expected<std::vector<T>> AwaitElements(
+    ArrayRef<AsyncValueRef<std::tuple<T>>> values, HostContext* host) {
+  std::vector<T> elements;
+  for (const auto& value : values) {
+    host->Await(value.CopyRCRef());
+    if (value.IsError()) return MakeStringError(value.GetError().message);
+    elements.push_back(internal::CopyValue(std::get<0>(value.get())));
+  }
+  return std::move(elements);
+}
+
+// Returns true if `value` is the error that iterators return for the values
+// that they could not tell were past the end when they were requested.
+template <typename... T>
+bool IsEndOfIterator(const AsyncValueRef<std::tuple<T...>>& value) {
+  return value.IsError() && value.GetError().message == "iterator reached end";
+}
+
+// Returns the next `num_elements` elements of the iterator, or the elements up
+// to the end, or the first error. Every element is waited for before the next
+// one is requested.
+template <typename T>
+llvm::Expected<std::vector<T>> GetElements(Iterator<T>* iterator,
+                                           HostContext* host,
+                                           int64_t num_elements = kAll) {
+  std::vector<T> elements;
+  for (int64_t i = 0; i < num_elements; ++i) {
+    auto values = RequestElements(iterator, 1, host);
+    if (values.empty()) break;
+    host->Await(values.front().CopyRCRef());
+    if (IsEndOfIterator(values.front())) break;
+    auto element = AwaitElements<T>(values, host);
+    if (!element) return element.takeError();
+    elements.push_back(std::move(element->front()));
+  }
+  return std::move(elements);
+}
+
+// Function of one argument and one result. The result is an error if `fn`
+// returns an error. If `async` is true, the result is computed by a task on
+// the work queue, so that the results of consecutive calls become available
+// out of order.
+template <typename Arg, typename Result>
+class TestFunction : public Function {
+ public:
+  explicit TestFunction(std::function<llvm::Expected<Result>(Arg)> fn,
+                        bool async = false)
+      : Function("test_function", {TypeName()}, {TypeName()}),
+        fn_(std::move(fn)),
+        async_(async) {}
+
+  void Execute(ArrayRef<AsyncValue*> arguments,
+               MutableArrayRef<RCReference<AsyncValue>> results,
+               HostContext* host) const override {
+    const Arg arg = arguments[0]->get<Arg>();
+    if (!async_) {
+      results[0] = Compute(arg, host);
+      return;
+    }
+    auto result = host->MakeIndirectAsyncValue();
+    results[0] = result.CopyRef();
+    host->EnqueueWork([this, arg, host, result = std::move(result)]() {
+      result->ForwardTo(Compute(arg, host));
+    });
+  }
+
+  void AddRef() const override {}
+  void DropRef() const override {}
+
+  RCReference<const Function> Ref() const { return FormRef(this); }
+
+ private:
+  RCReference<AsyncValue> Compute(Arg arg, HostContext* host) const {
+    auto result = fn_(arg);
+    if (!result) {
+      return host->MakeErrorAsyncValueRef(llvm::toString(result.takeError()));
+    }
+    return host->MakeConcreteAsyncValueRef<Result>(std::move(*result))
+        .ReleaseRCRef();
+  }
+
+  std::function<llvm::Expected<Result>(Arg)> fn_;
+  bool async_;
+};
+
+// Returns a tensor with the given dimensions and values.
+template <typename T>
+DenseHostTensor MakeTensor(ArrayRef<ssize_t> dims, ArrayRef<T> values,
+                           HostContext* host) {
+  auto tensor =
+      DenseHostTensor::CreateUninitialized<T>(TensorShape(dims), host);
+  MutableDHTArrayView<T> view(tensor.getPointer());
+  assert(view.NumElements() == values.size());
+  std::copy(values.begin(), values.end(), view.Elements().begin());
+  return std::move(*tensor);
+}
+
+template <typename T>
+std::vector<T> GetValues(const DenseHostTensor& tensor) {
+  DHTArrayView<T> view(&tensor);
+  return std::vector<T>(view.begin(), view.end());
+}
+
+inline std::vector<ssize_t> GetDims(const DenseHostTensor& tensor) {
+  SmallVector<ssize_t, 4> dims;
+  tensor.shape().GetDimensions(&dims);
+  return std::vector<ssize_t>(dims.begin(), dims.end());
+}
+
+template <typename T>
+RCReference<Dataset<T>> MakeRange(T stop, HostContext* host) {
+  return TakeRef(host->Construct<RangeDataset<T>>(0, stop, 1, host));
+}
+
+template <typename T>
+RCReference<Dataset<T>> MakeSlice(std::vector<T> data, HostContext* host) {
+  return TakeRef(host->Construct<SliceDataset<T>>(std::move(data), host));
+}
+
+// Dataset whose iterators return the given async values in order, e.g. errors
+// or values that the test makes available later.
+template <typename T>
+class AsyncValuesDataset : public Dataset<T> {
+ public:
+  AsyncValuesDataset(std::vector<AsyncValueRef<std::tuple<T>>> values,
+                     HostContext* host)
+      : values_(std::move(values)), host_(host) {}
+
+  RCReference<Iterator<T>> MakeIterator() override {
+    return TakeRef(host_->Construct<AsyncValuesIterator>(FormRef(this)));
+  }
+
+ private:
+  class AsyncValuesIterator : public Iterator<T> {
+   public:
+    explicit AsyncValuesIterator(RCReference<AsyncValuesDataset> dataset)
+        : dataset_(std::move(dataset)) {}
+
+    AsyncValueRef<std::tuple<T>> GetNext(
+        const ExecutionContext& exec_ctx) override {
+      if (index_ == dataset_->values_.size()) return {};
+      return dataset_->values_[index_++].CopyRef();
+    }
+
+   private:
+    void Destroy() override {
+      internal::DestroyImpl<AsyncValuesIterator>(this,
+                                                 dataset_->host_->allocator());
+    }
+
+    RCReference<AsyncValuesDataset> dataset_;
+    size_t index_ = 0;
+  };
+
+  void Destroy() override {
+    internal::DestroyImpl<AsyncValuesDataset>(this, host_->allocator());
+  }
+
+  std::vector<AsyncValueRef<std::tuple<T>>> values_;
+  HostContext* host_;
+};
+
+template <typename T>
+RCReference<Dataset<T>> MakeAsyncValues(
+    ArrayRef<AsyncValueRef<std::tuple<T>>> values, HostContext* host) {
+  std::vector<AsyncValueRef<std::tuple<T>>> copies;
+  for (const auto& value : values) copies.push_back(value.CopyRef());
+  return TakeRef(
+      host->Construct<AsyncValuesDataset<T>>(std::move(copies), host));
+}
+
+// Returns the values 0, ..., n - 1, except that the values in `errors` are
+// errors.
+inline std::vector<AsyncValueRef<std::tuple<int64_t>>> MakeValuesWithErrors(
+    int64_t n, ArrayRef<int64_t> errors, HostContext* host) {
+  std::vector<AsyncValueRef<std::tuple<int64_t>>> values;
+  for (int64_t i = 0; i < n; ++i) {
+    if (std::find(errors.begin(), errors.end(), i) != errors.end()) {
+      values.push_back(host->MakeErrorAsyncValueRef(StrCat("error ", i)));
+    } else {
+      values.push_back(
+          host->MakeConcreteAsyncValueRef<std::tuple<int64_t>>(i));
+    }
+  }
+  return values;
+}
+
+}  // namespace testing
+}  // namespace data
+}  // namespace tfrt
+
+#endif  // TFRT_CPP_TESTS_DATA_DATASET_TEST_UTIL_H_
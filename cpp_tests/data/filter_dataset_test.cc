@@ -0,0 +1,229 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- filter_dataset_test.cc -----------------------------------*- C++ -*-===//
+//
+// This file contains unit tests for FilterDataset.
+//
+//===----------------------------------------------------------------------===//
+
+#include "lib/data/filter_dataset.h"
+
+#include <future>
+#include <memory>
+#include <vector>
+
+#include "cpp_tests/data/dataset_test_util.h"
+#include "gtest/gtest.h"
+
+namespace tfrt {
+namespace data {
+namespace {
+
+using testing::AwaitElements;
+using testing::CreateHostContext;
+using testing::MakeAsyncValues;
+using testing::MakeRange;
+using testing::MakeValuesWithErrors;
+using testing::RequestElements;
+using testing::TestFunction;
+
+RCReference<Dataset<int64_t>> MakeFilter(RCReference<Dataset<int64_t>> input,
+                                         const TestFunction<int64_t, bool>& fn,
+                                         int64_t num_parallel_calls,
+                                         HostContext* host) {
+  return TakeRef(host->Construct<FilterDataset<int64_t>>(
+      std::move(input), RCArray<AsyncValue>(ArrayRef<AsyncValue*>()),
+      fn.Ref(), num_parallel_calls, host));
+}
+
+// Waits for `values` and drops the "iterator reached end" errors at the end,
+// which FilterDataset returns for the elements it could not tell did not
+// exist when they were requested.
+std::vector<AsyncValueRef<std::tuple<int64_t>>> AwaitFiltered(
+    std::vector<AsyncValueRef<std::tuple<int64_t>>> values, HostContext* host) {
+  for (const auto& value : values) host->Await(value.CopyRCRef());
+  while (!values.empty() && values.back().IsError() &&
+         values.back().GetError().message == "iterator reached end") {
+    values.pop_back();
+  }
+  return values;
+}
+
+// Returns the elements of the iterator, or the first error. Every element is
+// waited for before the next one is requested.
+llvm::Expected<std::vector<int64_t>> GetFilteredElements(
+    Iterator<int64_t>* iterator, HostContext* host) {
+  std::vector<int64_t> elements;
+  while (true) {
+    auto values = AwaitFiltered(RequestElements(iterator, 1, host), host);
+    if (values.empty()) return std::move(elements);
+    auto element = AwaitElements<int64_t>(values, host);
+    if (!element) return element.takeError();
+    elements.push_back(element->front());
+  }
+}
+
+std::vector<int64_t> MultiplesOfThree(int64_t stop) {
+  std::vector<int64_t> multiples;
+  for (int64_t i = 0; i < stop; i += 3) multiples.push_back(i);
+  return multiples;
+}
+
+// The predicates complete out of order, and the elements are still returned
+// in input order.
+TEST(FilterDatasetTest, KeepsInputOrder) {
+  auto host = CreateHostContext();
+  for (bool async : {false, true}) {
+    TestFunction<int64_t, bool> fn([](int64_t x) { return x % 3 == 0; },
+                                   async);
+    for (int64_t num_parallel_calls : {1, 4, 16}) {
+      auto filter = MakeFilter(MakeRange<int64_t>(100, host.get()), fn,
+                               num_parallel_calls, host.get());
+      auto elements =
+          GetFilteredElements(filter->MakeIterator().get(), host.get());
+      ASSERT_TRUE(static_cast<bool>(elements));
+      EXPECT_EQ(*elements, MultiplesOfThree(100))
+          << "num_parallel_calls " << num_parallel_calls;
+    }
+  }
+  host->Quiesce();
+}
+
+// GetNext does not block on the predicates that only the thread calling it
+// can run.
+TEST(FilterDatasetTest, SingleThreadedWorkQueue) {
+  auto host = std::make_unique<HostContext>(
+      [](const DecodedDiagnostic&) {}, CreateMallocAllocator(),
+      CreateSingleThreadedWorkQueue());
+  TestFunction<int64_t, bool> fn([](int64_t x) { return x % 3 == 0; },
+                                 /*async=*/true);
+  auto filter = MakeFilter(MakeRange<int64_t>(30, host.get()), fn,
+                           /*num_parallel_calls=*/4, host.get());
+  auto elements =
+      GetFilteredElements(filter->MakeIterator().get(), host.get());
+  ASSERT_TRUE(static_cast<bool>(elements));
+  EXPECT_EQ(*elements, MultiplesOfThree(30));
+  host->Quiesce();
+}
+
+TEST(FilterDatasetTest, NoElementPasses) {
+  auto host = CreateHostContext();
+  TestFunction<int64_t, bool> fn([](int64_t x) { return false; });
+  auto filter = MakeFilter(MakeRange<int64_t>(20, host.get()), fn,
+                           /*num_parallel_calls=*/4, host.get());
+  auto elements =
+      GetFilteredElements(filter->MakeIterator().get(), host.get());
+  ASSERT_TRUE(static_cast<bool>(elements));
+  EXPECT_TRUE(elements->empty());
+  host->Quiesce();
+}
+
+// The input errors and the predicate errors are returned in input order, as
+// if their elements passed.
+TEST(FilterDatasetTest, Errors) {
+  auto host = CreateHostContext();
+  TestFunction<int64_t, bool> fn(
+      [](int64_t x) -> llvm::Expected<bool> {
+        if (x == 7) return MakeStringError("predicate error");
+        return x % 2 == 0;
+      },
+      /*async=*/true);
+  auto values = MakeValuesWithErrors(10, {3, 4}, host.get());
+  auto filter = MakeFilter(MakeAsyncValues<int64_t>(values, host.get()), fn,
+                           /*num_parallel_calls=*/3, host.get());
+  auto iterator = filter->MakeIterator();
+  auto elements = AwaitFiltered(
+      RequestElements(iterator.get(), testing::kAll, host.get()), host.get());
+
+  // Elements 0, 2, 6 and 8, and errors 3, 4 and 7.
+  ASSERT_EQ(elements.size(), 7);
+  const std::vector<int64_t> expected = {0, 2, -3, -4, 6, -7, 8};
+  for (size_t i = 0; i < elements.size(); ++i) {
+    if (expected[i] < 0) {
+      ASSERT_TRUE(elements[i].IsError()) << "element " << i;
+      EXPECT_EQ(elements[i].GetError().message,
+                expected[i] == -7 ? "predicate error"
+                                  : StrCat("error ", -expected[i]));
+    } else {
+      ASSERT_FALSE(elements[i].IsError()) << elements[i].GetError().message;
+      EXPECT_EQ(std::get<0>(elements[i].get()), expected[i]);
+    }
+  }
+  iterator.reset();
+  host->Quiesce();
+}
+
+// The values returned while the predicates are not done are forwarded to the
+// elements that pass, and to the end of the iterator if none is left.
+TEST(FilterDatasetTest, ForwardsPendingResults) {
+  auto host = CreateHostContext();
+  TestFunction<int64_t, bool> fn([](int64_t x) { return x % 2 == 0; });
+  std::vector<AsyncValueRef<std::tuple<int64_t>>> values;
+  for (int i = 0; i < 4; ++i) {
+    values.push_back(
+        host->MakeUnconstructedAsyncValueRef<std::tuple<int64_t>>());
+  }
+  auto filter = MakeFilter(MakeAsyncValues<int64_t>(values, host.get()), fn,
+                           /*num_parallel_calls=*/2, host.get());
+  auto iterator = filter->MakeIterator();
+  // Only two of the four elements pass, but that is not known yet.
+  auto elements = RequestElements(iterator.get(), 4, host.get());
+  ASSERT_EQ(elements.size(), 4);
+  for (const auto& element : elements) EXPECT_FALSE(element.IsAvailable());
+  // A fifth element would need a fifth input element.
+  EXPECT_TRUE(RequestElements(iterator.get(), 1, host.get()).empty());
+
+  for (int i = 3; i >= 0; --i) values[i].emplace(i);
+  for (const auto& element : elements) host->Await(element.CopyRCRef());
+  ASSERT_FALSE(elements[0].IsError()) << elements[0].GetError().message;
+  EXPECT_EQ(std::get<0>(elements[0].get()), 0);
+  ASSERT_FALSE(elements[1].IsError()) << elements[1].GetError().message;
+  EXPECT_EQ(std::get<0>(elements[1].get()), 2);
+  for (int i : {2, 3}) {
+    ASSERT_TRUE(elements[i].IsError());
+    EXPECT_EQ(elements[i].GetError().message, "iterator reached end");
+  }
+  EXPECT_TRUE(RequestElements(iterator.get(), 1, host.get()).empty());
+  iterator.reset();
+  host->Quiesce();
+}
+
+// GetNext does not wait for the predicates, so it can be called by a thread of
+// the non-blocking work queue, e.g. by data.iterator_get_next.
+TEST(FilterDatasetTest, GetNextOnWorkQueue) {
+  auto host = CreateHostContext();
+  TestFunction<int64_t, bool> fn([](int64_t x) { return x % 3 == 0; },
+                                 /*async=*/true);
+  auto filter = MakeFilter(MakeRange<int64_t>(100, host.get()), fn,
+                           /*num_parallel_calls=*/4, host.get());
+  auto iterator = filter->MakeIterator();
+  std::promise<std::vector<AsyncValueRef<std::tuple<int64_t>>>> requested;
+  host->EnqueueWork([&]() {
+    requested.set_value(
+        RequestElements(iterator.get(), testing::kAll, host.get()));
+  });
+  auto elements = AwaitElements<int64_t>(
+      AwaitFiltered(requested.get_future().get(), host.get()), host.get());
+  ASSERT_TRUE(static_cast<bool>(elements));
+  EXPECT_EQ(*elements, MultiplesOfThree(100));
+  iterator.reset();
+  host->Quiesce();
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tfrt
@@ -0,0 +1,429 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- get_next_batch_test.cc -----------------------------------*- C++ -*-===//
+//
+// This file contains unit tests that check that the GetNextBatch overrides of
+// the iterators return the same elements as GetNext.
+//
+//===----------------------------------------------------------------------===//
+
+#include <functional>
+#include <string>
+
+#include "cpp_tests/data/dataset_test_util.h"
+#include "gtest/gtest.h"
+#include "lib/data/batch_dataset.h"
+#include "lib/data/map_dataset.h"
+#include "lib/data/repeat_dataset.h"
+#include "lib/data/skip_dataset.h"
+#include "lib/data/take_dataset.h"
+
+namespace tfrt {
+namespace data {
+namespace {
+
+using testing::CreateHostContext;
+using testing::GetDims;
+using testing::GetElements;
+using testing::GetValues;
+using testing::MakeAsyncValues;
+using testing::MakeRange;
+using testing::MakeSlice;
+using testing::MakeValuesWithErrors;
+using testing::TestFunction;
+
+using Input = RCReference<Dataset<int64_t>>;
+using BatchMode = Iterator<int64_t>::BatchMode;
+
+Input Repeat(Input input, int32_t epochs, HostContext* host) {
+  return TakeRef(
+      host->Construct<RepeatDataset<int64_t>>(std::move(input), epochs, host));
+}
+
+Input Take(Input input, int64_t count, HostContext* host) {
+  return TakeRef(
+      host->Construct<TakeDataset<int64_t>>(std::move(input), count, host));
+}
+
+Input Skip(Input input, int64_t count, HostContext* host) {
+  return TakeRef(
+      host->Construct<SkipDataset<int64_t>>(std::move(input), count, host));
+}
+
+Input Map(Input input, const Function& fn, HostContext* host) {
+  return TakeRef(
+      host->Construct<MapDataset<std::tuple<int64_t>, std::tuple<int64_t>>>(
+          std::move(input), RCArray<AsyncValue>(ArrayRef<AsyncValue*>()),
+          FormRef(&fn), host));
+}
+
+// Returns the elements of the iterator read with GetNextBatch(max_n), or the
+// first error. Every batch but the last one must have `max_n` elements.
+llvm::Expected<std::vector<int64_t>> GetBatchedElements(
+    Iterator<int64_t>* iterator, int64_t max_n, HostContext* host) {
+  ExecutionContext exec_ctx(host);
+  std::vector<int64_t> elements;
+  bool short_batch = false;
+  while (auto batch = iterator->GetNextBatch(exec_ctx, max_n)) {
+    host->Await(batch.CopyRCRef());
+    if (batch.IsError()) return MakeStringError(batch.GetError().message);
+    EXPECT_FALSE(short_batch) << "a short batch is not the last one";
+    EXPECT_GT(batch.get().size(), 0);
+    EXPECT_LE(batch.get().size(), max_n);
+    short_batch = batch.get().size() < max_n;
+    for (const auto& element : batch.get()) {
+      elements.push_back(std::get<0>(element));
+    }
+  }
+  return std::move(elements);
+}
+
+// Returns the elements of the iterator read with GetNext and GetNextBatch in
+// turn.
+std::vector<int64_t> GetMixedElements(Iterator<int64_t>* iterator,
+                                      int64_t max_n, HostContext* host) {
+  ExecutionContext exec_ctx(host);
+  std::vector<int64_t> elements;
+  while (true) {
+    auto element = iterator->GetNext(exec_ctx);
+    if (!element) break;
+    host->Await(element.CopyRCRef());
+    EXPECT_FALSE(element.IsError());
+    if (element.IsError()) break;
+    elements.push_back(std::get<0>(element.get()));
+    auto batch = iterator->GetNextBatch(exec_ctx, max_n);
+    if (!batch) break;
+    host->Await(batch.CopyRCRef());
+    EXPECT_FALSE(batch.IsError());
+    if (batch.IsError()) break;
+    for (const auto& element : batch.get()) {
+      elements.push_back(std::get<0>(element));
+    }
+  }
+  return elements;
+}
+
+struct Pipeline {
+  std::string name;
+  std::function<Input(HostContext*)> make;
+};
+
+// Pipelines of the iterators that override GetNextBatch, including take and
+// skip counts that truncate the input batches, and inputs that only batch
+// elementwise.
+std::vector<Pipeline> MakePipelines(const Function& sync_fn,
+                                    const Function& async_fn) {
+  return {
+      {"range", [](HostContext* host) { return MakeRange<int64_t>(20, host); }},
+      {"empty_range",
+       [](HostContext* host) { return MakeRange<int64_t>(0, host); }},
+      {"slice",
+       [](HostContext* host) {
+         return MakeSlice<int64_t>({5, 3, 8, 1, 9, 2, 7}, host);
+       }},
+      {"repeat",
+       [](HostContext* host) {
+         return Repeat(MakeRange<int64_t>(7, host), 3, host);
+       }},
+      {"repeat_take",
+       [](HostContext* host) {
+         return Repeat(Take(MakeRange<int64_t>(10, host), 4, host), 3, host);
+       }},
+      {"map",
+       [&sync_fn](HostContext* host) {
+         return Map(MakeRange<int64_t>(20, host), sync_fn, host);
+       }},
+      {"async_map",
+       [&async_fn](HostContext* host) {
+         return Map(MakeRange<int64_t>(20, host), async_fn, host);
+       }},
+      {"take",
+       [](HostContext* host) {
+         return Take(MakeRange<int64_t>(20, host), 13, host);
+       }},
+      {"take_zero",
+       [](HostContext* host) {
+         return Take(MakeRange<int64_t>(20, host), 0, host);
+       }},
+      {"take_all",
+       [](HostContext* host) {
+         return Take(MakeRange<int64_t>(20, host), -1, host);
+       }},
+      {"take_more",
+       [](HostContext* host) {
+         return Take(MakeRange<int64_t>(5, host), 10, host);
+       }},
+      {"skip",
+       [](HostContext* host) {
+         return Skip(MakeRange<int64_t>(20, host), 7, host);
+       }},
+      {"skip_zero",
+       [](HostContext* host) {
+         return Skip(MakeRange<int64_t>(20, host), 0, host);
+       }},
+      {"skip_all",
+       [](HostContext* host) {
+         return Skip(MakeRange<int64_t>(20, host), -1, host);
+       }},
+      {"skip_more",
+       [](HostContext* host) {
+         return Skip(MakeRange<int64_t>(20, host), 25, host);
+       }},
+      {"skip_take",
+       [](HostContext* host) {
+         return Take(Skip(MakeRange<int64_t>(20, host), 3, host), 9, host);
+       }},
+      {"take_skip_map",
+       [&async_fn](HostContext* host) {
+         return Skip(Take(Map(MakeRange<int64_t>(30, host), async_fn, host),
+                          17, host),
+                     4, host);
+       }},
+      {"repeat_skip",
+       [](HostContext* host) {
+         return Repeat(Skip(MakeRange<int64_t>(10, host), 6, host), 3, host);
+       }},
+      {"elementwise_take",
+       [](HostContext* host) {
+         return Take(MakeAsyncValues<int64_t>(
+                         MakeValuesWithErrors(10, {}, host), host),
+                     6, host);
+       }},
+      {"elementwise_skip",
+       [](HostContext* host) {
+         return Skip(MakeAsyncValues<int64_t>(
+                         MakeValuesWithErrors(10, {}, host), host),
+                     6, host);
+       }},
+  };
+}
+
+TEST(GetNextBatchTest, MatchesGetNext) {
+  auto host = CreateHostContext();
+  TestFunction<int64_t, int64_t> sync_fn([](int64_t x) { return x * 3; });
+  TestFunction<int64_t, int64_t> async_fn([](int64_t x) { return x + 100; },
+                                          /*async=*/true);
+  for (const auto& pipeline : MakePipelines(sync_fn, async_fn)) {
+    SCOPED_TRACE(pipeline.name);
+    auto dataset = pipeline.make(host.get());
+    auto expected = GetElements(dataset->MakeIterator().get(), host.get());
+    ASSERT_TRUE(static_cast<bool>(expected));
+    for (int64_t max_n : {1, 3, 7, 64}) {
+      SCOPED_TRACE(max_n);
+      auto batched =
+          GetBatchedElements(dataset->MakeIterator().get(), max_n, host.get());
+      ASSERT_TRUE(static_cast<bool>(batched));
+      EXPECT_EQ(*batched, *expected);
+      EXPECT_EQ(
+          GetMixedElements(dataset->MakeIterator().get(), max_n, host.get()),
+          *expected);
+    }
+  }
+  host->Quiesce();
+}
+
+// The batch modes report which inputs batch natively.
+TEST(GetNextBatchTest, BatchModes) {
+  auto host = CreateHostContext();
+  TestFunction<int64_t, int64_t> fn([](int64_t x) { return x; });
+  auto mode = [](const Input& dataset) {
+    return dataset->MakeIterator()->GetBatchMode();
+  };
+  EXPECT_EQ(mode(MakeRange<int64_t>(5, host.get())), BatchMode::kSync);
+  EXPECT_EQ(mode(Take(Skip(MakeRange<int64_t>(5, host.get()), 1, host.get()),
+                      2, host.get())),
+            BatchMode::kSync);
+  EXPECT_EQ(mode(MakeAsyncValues<int64_t>(
+                MakeValuesWithErrors(3, {}, host.get()), host.get())),
+            BatchMode::kElementwise);
+  EXPECT_EQ(mode(Repeat(MakeAsyncValues<int64_t>(
+                            MakeValuesWithErrors(3, {}, host.get()),
+                            host.get()),
+                        2, host.get())),
+            BatchMode::kElementwise);
+  EXPECT_NE(mode(Map(MakeRange<int64_t>(5, host.get()), fn, host.get())),
+            BatchMode::kElementwise);
+  host->Quiesce();
+}
+
+// A batch with an error is that error, and it consumes `max_n` elements, the
+// same as a batch without errors, whether the error is available or not.
+TEST(GetNextBatchTest, Errors) {
+  auto host = CreateHostContext();
+  for (bool available : {true, false}) {
+    SCOPED_TRACE(available);
+    auto values = MakeValuesWithErrors(10, {4}, host.get());
+    if (!available) {
+      values[4] = host->MakeUnconstructedAsyncValueRef<std::tuple<int64_t>>();
+    }
+    auto dataset = Take(MakeAsyncValues<int64_t>(values, host.get()), 8,
+                        host.get());
+    auto iterator = dataset->MakeIterator();
+    ExecutionContext exec_ctx(host.get());
+    auto first = iterator->GetNextBatch(exec_ctx, 3);
+    auto second = iterator->GetNextBatch(exec_ctx, 3);
+    auto third = iterator->GetNextBatch(exec_ctx, 3);
+    EXPECT_FALSE(iterator->GetNextBatch(exec_ctx, 3));
+    if (!available) values[4].SetError(DecodedDiagnostic("error 4"));
+    host->Await({first.CopyRCRef(), second.CopyRCRef(), third.CopyRCRef()});
+    ASSERT_FALSE(first.IsError());
+    ASSERT_TRUE(second.IsError());
+    EXPECT_EQ(second.GetError().message, "error 4");
+    ASSERT_FALSE(third.IsError());
+    ASSERT_EQ(third.get().size(), 2);
+    EXPECT_EQ(std::get<0>(third.get()[0]), 6);
+    EXPECT_EQ(std::get<0>(third.get()[1]), 7);
+    iterator.reset();
+  }
+  host->Quiesce();
+}
+
+// Dataset of available values, some of which are errors, whose iterators
+// produce their batches synchronously like a source dataset.
+class SyncValuesDataset : public Dataset<int64_t> {
+ public:
+  SyncValuesDataset(std::vector<AsyncValueRef<std::tuple<int64_t>>> values,
+                    HostContext* host)
+      : values_(std::move(values)), host_(host) {}
+
+  RCReference<Iterator<int64_t>> MakeIterator() override {
+    return TakeRef(host_->Construct<SyncValuesIterator>(FormRef(this)));
+  }
+
+ private:
+  class SyncValuesIterator : public Iterator<int64_t> {
+   public:
+    explicit SyncValuesIterator(RCReference<SyncValuesDataset> dataset)
+        : dataset_(std::move(dataset)) {}
+
+    AsyncValueRef<std::tuple<int64_t>> GetNext(
+        const ExecutionContext& exec_ctx) override {
+      if (index_ == dataset_->values_.size()) return {};
+      return dataset_->values_[index_++].CopyRef();
+    }
+
+    // The default GetNextBatch returns available batches, since the values
+    // are available.
+    BatchMode GetBatchMode() const override { return BatchMode::kSync; }
+
+   private:
+    void Destroy() override {
+      internal::DestroyImpl<SyncValuesIterator>(this,
+                                                dataset_->host_->allocator());
+    }
+
+    RCReference<SyncValuesDataset> dataset_;
+    size_t index_ = 0;
+  };
+
+  void Destroy() override {
+    internal::DestroyImpl<SyncValuesDataset>(this, host_->allocator());
+  }
+
+  std::vector<AsyncValueRef<std::tuple<int64_t>>> values_;
+  HostContext* host_;
+};
+
+// An error in the batch that completes a batch of the previous epoch is
+// returned after the elements of the previous epoch.
+TEST(GetNextBatchTest, RepeatErrorAfterEpochEnd) {
+  auto host = CreateHostContext();
+  auto dataset = Repeat(TakeRef(host->Construct<SyncValuesDataset>(
+                            MakeValuesWithErrors(4, {0}, host.get()),
+                            host.get())),
+                        2, host.get());
+  auto iterator = dataset->MakeIterator();
+  ASSERT_EQ(iterator->GetBatchMode(), BatchMode::kSync);
+  ExecutionContext exec_ctx(host.get());
+  // The batches are [error 0, 1, 2], [3], [error 0, 1] and [2, 3].
+  auto batch = iterator->GetNextBatch(exec_ctx, 3);
+  ASSERT_TRUE(batch.IsError());
+  EXPECT_EQ(batch.GetError().message, "error 0");
+  batch = iterator->GetNextBatch(exec_ctx, 3);
+  ASSERT_FALSE(batch.IsError()) << batch.GetError().message;
+  ASSERT_EQ(batch.get().size(), 1);
+  EXPECT_EQ(std::get<0>(batch.get()[0]), 3);
+  batch = iterator->GetNextBatch(exec_ctx, 3);
+  ASSERT_TRUE(batch.IsError());
+  EXPECT_EQ(batch.GetError().message, "error 0");
+  batch = iterator->GetNextBatch(exec_ctx, 3);
+  ASSERT_FALSE(batch.IsError()) << batch.GetError().message;
+  ASSERT_EQ(batch.get().size(), 2);
+  EXPECT_EQ(std::get<0>(batch.get()[0]), 2);
+  EXPECT_EQ(std::get<0>(batch.get()[1]), 3);
+  EXPECT_FALSE(iterator->GetNextBatch(exec_ctx, 3));
+  iterator.reset();
+  host->Quiesce();
+}
+
+// The elements of a batch are copied if other references to them remain, so
+// that their holders still see their values.
+TEST(GetNextBatchTest, SharedElementsAreCopied) {
+  auto host = CreateHostContext();
+  std::vector<AsyncValueRef<std::tuple<std::string>>> values;
+  for (const char* value : {"a", "b", "c"}) {
+    values.push_back(
+        host->MakeConcreteAsyncValueRef<std::tuple<std::string>>(value));
+  }
+  auto dataset = MakeAsyncValues<std::string>(values, host.get());
+  auto iterator = dataset->MakeIterator();
+  ExecutionContext exec_ctx(host.get());
+  auto batch = iterator->GetNextBatch(exec_ctx, 3);
+  host->Await(batch.CopyRCRef());
+  ASSERT_FALSE(batch.IsError());
+  ASSERT_EQ(batch.get().size(), 3);
+  EXPECT_EQ(std::get<0>(batch.get()[2]), "c");
+  EXPECT_EQ(std::get<0>(values[2].get()), "c");
+  iterator.reset();
+  host->Quiesce();
+}
+
+// GetNextBatch of a batch iterator returns several batches, which are the
+// same as the batches returned by GetNext.
+TEST(GetNextBatchTest, BatchDatasetMatchesGetNext) {
+  auto host = CreateHostContext();
+  for (int64_t count : {23, 24}) {
+    auto batch = TakeRef(host->Construct<BatchDataset<int64_t>>(
+        Take(MakeRange<int64_t>(100, host.get()), count, host.get()),
+        /*batch_size=*/4, host.get()));
+    auto expected = GetElements(batch->MakeIterator().get(), host.get());
+    ASSERT_TRUE(static_cast<bool>(expected));
+    for (int64_t max_n : {1, 2, 5}) {
+      auto iterator = batch->MakeIterator();
+      ExecutionContext exec_ctx(host.get());
+      std::vector<DenseHostTensor> batches;
+      while (auto values = iterator->GetNextBatch(exec_ctx, max_n)) {
+        host->Await(values.CopyRCRef());
+        ASSERT_FALSE(values.IsError());
+        for (auto& value : values.get()) {
+          batches.push_back(std::move(std::get<0>(value)));
+        }
+      }
+      ASSERT_EQ(batches.size(), expected->size());
+      for (size_t i = 0; i < batches.size(); ++i) {
+        EXPECT_EQ(GetDims(batches[i]), GetDims((*expected)[i]));
+        EXPECT_EQ(GetValues<int64_t>(batches[i]),
+                  GetValues<int64_t>((*expected)[i]));
+      }
+    }
+  }
+  host->Quiesce();
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tfrt
@@ -0,0 +1,496 @@
+// Copyright 2020 The TensorFlow Runtime Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//===- iterator_state_test.cc ---------------------------------------------===//
+//
+// This file contains unit tests for saving and restoring the state of the
+// input pipeline iterators.
+//
+//===----------------------------------------------------------------------===//
+
+#include "lib/data/iterator_state.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "lib/data/cache_dataset.h"
+#include "lib/data/filter_dataset.h"
+#include "lib/data/interleave_dataset.h"
+#include "lib/data/parallel_map_dataset.h"
+#include "lib/data/prefetch_dataset.h"
+#include "lib/data/range_dataset.h"
+#include "lib/data/repeat_dataset.h"
+#include "lib/data/shard_dataset.h"
+#include "lib/data/shuffle_dataset.h"
+#include "lib/data/skip_dataset.h"
+#include "lib/data/slice_dataset.h"
+#include "lib/data/take_dataset.h"
+#include "lib/data/tf_record_dataset.h"
+#include "tfrt/host_context/concurrent_work_queue.h"
+#include "tfrt/host_context/function.h"
+#include "tfrt/host_context/host_allocator.h"
+#include "tfrt/host_context/host_context.h"
+#include "tfrt/support/crc32c.h"
+#include "tfrt/support/latch.h"
+#include "tfrt/support/string_util.h"
+
+namespace tfrt {
+namespace data {
+namespace {
+
+constexpr int64_t kAll = std::numeric_limits<int64_t>::max();
+
+std::unique_ptr<HostContext> CreateHostContext() {
+  auto decoded_diagnostic_handler = [&](const DecodedDiagnostic& diag) {
+    abort();
+  };
+  return std::make_unique<HostContext>(decoded_diagnostic_handler,
+                                       CreateMallocAllocator(),
+                                       CreateMultiThreadedWorkQueue(2, 2));
+}
+
+std::string GetTestPath(string_view name) {
+  const char* tmp_dir = std::getenv("TEST_TMPDIR");
+  return StrCat(tmp_dir ? tmp_dir : "/tmp", "/iterator_state_test.", name);
+}
+
+// Map function that adds one to its argument.
+class AddOneFunction : public Function {
+ public:
+  AddOneFunction() : Function("add_one", {TypeName()}, {TypeName()}) {}
+
+  void Execute(ArrayRef<AsyncValue*> arguments,
+               MutableArrayRef<RCReference<AsyncValue>> results,
+               HostContext* host) const override {
+    results[0] = host->MakeConcreteAsyncValueRef<int64_t>(
+        arguments[0]->get<int64_t>() + 1);
+  }
+
+  void AddRef() const override {}
+  void DropRef() const override {}
+};
+
+// Filter predicate that returns true if its argument is even.
+class IsEvenFunction : public Function {
+ public:
+  IsEvenFunction() : Function("is_even", {TypeName()}, {TypeName()}) {}
+
+  void Execute(ArrayRef<AsyncValue*> arguments,
+               MutableArrayRef<RCReference<AsyncValue>> results,
+               HostContext* host) const override {
+    results[0] = host->MakeConcreteAsyncValueRef<bool>(
+        arguments[0]->get<int64_t>() % 2 == 0);
+  }
+
+  void AddRef() const override {}
+  void DropRef() const override {}
+};
+
+// Interleave function that returns range(0, x) for its argument x.
+class RangeFunction : public Function {
+ public:
+  RangeFunction() : Function("range", {TypeName()}, {TypeName()}) {}
+
+  void Execute(ArrayRef<AsyncValue*> arguments,
+               MutableArrayRef<RCReference<AsyncValue>> results,
+               HostContext* host) const override {
+    RCReference<Dataset<int64_t>> range =
+        TakeRef(host->Construct<RangeDataset<int64_t>>(
+            0, arguments[0]->get<int64_t>(), 1, host));
+    results[0] =
+        host->MakeConcreteAsyncValueRef<RCReference<Dataset<int64_t>>>(
+            std::move(range));
+  }
+
+  void AddRef() const override {}
+  void DropRef() const override {}
+};
+
+// Returns the next `num_elements` elements of the iterator, or the elements
+// up to the end.
+template <typename T>
+std::vector<T> GetElements(Iterator<T>* iterator, int64_t num_elements,
+                           HostContext* host) {
+  ExecutionContext exec_ctx(host);
+  std::vector<T> elements;
+  for (int64_t i = 0; i < num_elements; ++i) {
+    auto value = iterator->GetNext(exec_ctx);
+    if (!value) break;
+    latch done(1);
+    value.AndThen([&done]() { done.count_down(); });
+    done.wait();
+    EXPECT_FALSE(value.IsError());
+    if (value.IsError()) break;
+    elements.push_back(std::get<0>(value.get()));
+  }
+  return elements;
+}
+
+// How ExpectRestoredIteratorContinues compares the elements of a dataset
+// with the reference elements.
+enum class Order {
+  // The elements are the reference elements, in order.
+  kExact,
+  // The elements are a permutation of the reference elements, and a
+  // restored iterator yields them in the same order as the original one.
+  kPermutation,
+  // The elements are a permutation of the reference elements, and a
+  // restored iterator yields them in any order.
+  kAny,
+};
+
+// Reads `num_before_save` elements, saves the iterator and restores its
+// state into a new iterator. Checks that the dataset yields the `reference`
+// elements, and that both iterators yield the rest of them.
+template <typename T>
+void ExpectRestoredIteratorContinues(Dataset<T>* dataset,
+                                     std::vector<T> reference,
+                                     int64_t num_before_save, HostContext* host,
+                                     Order order = Order::kExact) {
+  std::vector<T> expected = GetElements(dataset->MakeIterator().get(), kAll,
+                                        host);
+  ASSERT_LT(num_before_save, expected.size());
+  if (order == Order::kExact) {
+    EXPECT_EQ(expected, reference);
+  } else {
+    std::vector<T> sorted = expected;
+    std::sort(sorted.begin(), sorted.end());
+    std::sort(reference.begin(), reference.end());
+    EXPECT_EQ(sorted, reference);
+  }
+
+  auto iterator = dataset->MakeIterator();
+  std::vector<T> elements = GetElements(iterator.get(), num_before_save, host);
+  IteratorStateWriter writer;
+  ASSERT_FALSE(static_cast<bool>(iterator->Save(&writer)));
+
+  auto restored = dataset->MakeIterator();
+  IteratorStateReader reader(writer.data(), host);
+  ASSERT_FALSE(static_cast<bool>(restored->Restore(&reader)));
+  EXPECT_TRUE(reader.empty());
+
+  std::vector<T> rest = GetElements(restored.get(), kAll, host);
+  std::vector<T> original_rest = GetElements(iterator.get(), kAll, host);
+  elements.insert(elements.end(), rest.begin(), rest.end());
+  if (order == Order::kAny) {
+    std::sort(expected.begin(), expected.end());
+    std::sort(elements.begin(), elements.end());
+    std::sort(rest.begin(), rest.end());
+    std::sort(original_rest.begin(), original_rest.end());
+  }
+  EXPECT_EQ(original_rest, rest);
+  EXPECT_EQ(elements, expected);
+
+  iterator.reset();
+  restored.reset();
+  host->Quiesce();
+}
+
+// Returns the integers in [start, stop) with the given step, as strings if T
+// is std::string.
+template <typename T = int64_t>
+std::vector<T> Range(int64_t start, int64_t stop, int64_t step = 1) {
+  std::vector<T> range;
+  for (int64_t i = start; i < stop; i += step) range.push_back(i);
+  return range;
+}
+
+template <>
+std::vector<std::string> Range(int64_t start, int64_t stop, int64_t step) {
+  std::vector<std::string> range;
+  for (int64_t i = start; i < stop; i += step) {
+    range.push_back(std::to_string(i));
+  }
+  return range;
+}
+
+RCReference<Dataset<int64_t>> MakeRange(int64_t stop, HostContext* host) {
+  return TakeRef(host->Construct<RangeDataset<int64_t>>(0, stop, 1, host));
+}
+
+RCReference<Dataset<int64_t>> MakeParallelMap(
+    RCReference<Dataset<int64_t>> input, const Function* map_fn,
+    bool deterministic, HostContext* host) {
+  return TakeRef(host->Construct<
+                 ParallelMapDataset<std::tuple<int64_t>, std::tuple<int64_t>>>(
+      std::move(input), RCArray<AsyncValue>(ArrayRef<AsyncValue*>()),
+      FormRef(map_fn), /*num_parallel_calls=*/4, deterministic, host));
+}
+
+// Writes a TFRecord file whose records are the strings "0", "1", ...
+std::string WriteTFRecordFile(int64_t num_records) {
+  auto append_fixed = [](std::string* out, uint64_t value, size_t size) {
+    for (size_t i = 0; i < size; ++i) out->push_back((value >> (8 * i)) & 0xff);
+  };
+  const std::string path = GetTestPath("tfrecord");
+  std::remove(TFRecordIndex::GetIndexPath(path).c_str());
+  std::ofstream out(path, std::ios_base::binary | std::ios_base::trunc);
+  for (int64_t i = 0; i < num_records; ++i) {
+    const std::string data = std::to_string(i);
+    std::string record;
+    append_fixed(&record, data.size(), sizeof(uint64_t));
+    append_fixed(&record, crc32c::Mask(crc32c::Value(record.data(), 8)),
+                 sizeof(uint32_t));
+    record += data;
+    append_fixed(&record,
+                 crc32c::Mask(crc32c::Value(data.data(), data.size())),
+                 sizeof(uint32_t));
+    out.write(record.data(), record.size());
+  }
+  return path;
+}
+
+TEST(IteratorStateTest, RangeAndSlice) {
+  auto host = CreateHostContext();
+  ExpectRestoredIteratorContinues(MakeRange(10, host.get()).get(),
+                                  Range(0, 10), 3, host.get());
+  auto slice = TakeRef(host->Construct<SliceDataset<int64_t>>(
+      std::vector<int64_t>{5, 4, 3, 2, 1}, host.get()));
+  ExpectRestoredIteratorContinues(slice.get(), {5, 4, 3, 2, 1}, 2,
+                                  host.get());
+}
+
+TEST(IteratorStateTest, ShuffleAndRepeat) {
+  auto host = CreateHostContext();
+  auto shuffle = TakeRef(host->Construct<ShuffleDataset<int64_t>>(
+      MakeRange(20, host.get()), /*buffer_size=*/8, /*seed=*/7,
+      /*reshuffle_each_iteration=*/false, host.get()));
+  auto repeat = TakeRef(host->Construct<RepeatDataset<int64_t>>(
+      std::move(shuffle), /*epochs=*/3, host.get()));
+  std::vector<int64_t> reference;
+  for (int epoch = 0; epoch < 3; ++epoch) {
+    for (int64_t i = 0; i < 20; ++i) reference.push_back(i);
+  }
+  // Save in the middle of the second epoch and near the end of input.
+  ExpectRestoredIteratorContinues(repeat.get(), reference, 25, host.get(),
+                                  Order::kPermutation);
+  ExpectRestoredIteratorContinues(repeat.get(), reference, 55, host.get(),
+                                  Order::kPermutation);
+}
+
+TEST(IteratorStateTest, Prefetch) {
+  auto host = CreateHostContext();
+  auto prefetch = TakeRef(host->Construct<PrefetchDataset<int64_t>>(
+      MakeRange(100, host.get()), /*prefetch_num=*/8,
+      /*max_buffer_bytes=*/0, host.get()));
+  ExpectRestoredIteratorContinues(prefetch.get(), Range(0, 100), 10,
+                                  host.get());
+}
+
+TEST(IteratorStateTest, ParallelMap) {
+  auto host = CreateHostContext();
+  AddOneFunction map_fn;
+  ExpectRestoredIteratorContinues(
+      MakeParallelMap(MakeRange(100, host.get()), &map_fn,
+                      /*deterministic=*/true, host.get())
+          .get(),
+      Range(1, 101), 10, host.get());
+  ExpectRestoredIteratorContinues(
+      MakeParallelMap(MakeRange(100, host.get()), &map_fn,
+                      /*deterministic=*/false, host.get())
+          .get(),
+      Range(1, 101), 10, host.get(), Order::kAny);
+}
+
+TEST(IteratorStateTest, Shard) {
+  auto host = CreateHostContext();
+  auto shard = TakeRef(host->Construct<ShardDataset<int64_t>>(
+      MakeRange(30, host.get()), /*num_shards=*/4, /*index=*/1, host.get()));
+  ExpectRestoredIteratorContinues(shard.get(), Range(1, 30, 4), 3,
+                                  host.get());
+}
+
+TEST(IteratorStateTest, Filter) {
+  auto host = CreateHostContext();
+  IsEvenFunction predicate_fn;
+  auto filter = TakeRef(host->Construct<FilterDataset<int64_t>>(
+      MakeRange(100, host.get()), RCArray<AsyncValue>(ArrayRef<AsyncValue*>()),
+      FormRef(static_cast<const Function*>(&predicate_fn)),
+      /*num_parallel_calls=*/4, host.get()));
+  ExpectRestoredIteratorContinues(filter.get(), Range(0, 100, 2), 10,
+                                  host.get());
+}
+
+TEST(IteratorStateTest, TakeAndSkip) {
+  auto host = CreateHostContext();
+  auto take = TakeRef(host->Construct<TakeDataset<int64_t>>(
+      MakeRange(100, host.get()), /*count=*/30, host.get()));
+  auto skip = TakeRef(host->Construct<SkipDataset<int64_t>>(
+      std::move(take), /*count=*/5, host.get()));
+  ExpectRestoredIteratorContinues(skip.get(), Range(5, 30), 10, host.get());
+}
+
+TEST(IteratorStateTest, Interleave) {
+  auto host = CreateHostContext();
+  RangeFunction map_fn;
+  auto slice = TakeRef(host->Construct<SliceDataset<int64_t>>(
+      std::vector<int64_t>{3, 5, 1, 4, 2}, host.get()));
+  auto interleave = TakeRef(
+      host->Construct<
+          InterleaveDataset<std::tuple<int64_t>, std::tuple<int64_t>>>(
+          std::move(slice), /*cycle_length=*/2, /*block_length=*/2,
+          FormRef(static_cast<const Function*>(&map_fn)), host.get()));
+  // Blocks of range(3) and range(5), then of range(1) and range(4) in the
+  // first slot when range(3) and range(1) end, and of range(2) in the second
+  // slot when range(5) ends.
+  ExpectRestoredIteratorContinues(
+      interleave.get(), {0, 1, 0, 1, 2, 2, 3, 0, 4, 0, 1, 0, 1, 2, 3}, 5,
+      host.get());
+}
+
+TEST(IteratorStateTest, Cache) {
+  auto host = CreateHostContext();
+  auto cache = TakeRef(host->Construct<CacheDataset<int64_t>>(
+      MakeRange(20, host.get()), /*memory_budget=*/1 << 20,
+      /*spill_dir=*/"", host.get()));
+  // The first iteration fills the cache, and the next ones replay it.
+  ExpectRestoredIteratorContinues(cache.get(), Range(0, 20), 5, host.get());
+  ExpectRestoredIteratorContinues(cache.get(), Range(0, 20), 15, host.get());
+}
+
+TEST(IteratorStateTest, TFRecord) {
+  auto host = CreateHostContext();
+  const std::string path = WriteTFRecordFile(50);
+  for (int64_t num_parallel_reads : {1, 4}) {
+    auto tf_record = TakeRef(host->Construct<TFRecordDataset>(
+        path, num_parallel_reads, host.get()));
+    ExpectRestoredIteratorContinues(tf_record.get(),
+                                    Range<std::string>(0, 50), 17, host.get());
+    auto shard = tf_record->MakeShard(/*num_shards=*/3, /*index=*/2);
+    ExpectRestoredIteratorContinues(shard.get(), Range<std::string>(2, 50, 3),
+                                    5, host.get());
+  }
+  std::remove(path.c_str());
+  std::remove(TFRecordIndex::GetIndexPath(path).c_str());
+}
+
+TEST(IteratorStateTest, RestoreInvalidState) {
+  auto host = CreateHostContext();
+  auto slice = TakeRef(host->Construct<SliceDataset<int64_t>>(
+      std::vector<int64_t>{1, 2, 3}, host.get()));
+  IteratorStateWriter writer;
+  writer.WriteInt(4);
+  IteratorStateReader reader(writer.data(), host.get());
+  auto error = slice->MakeIterator()->Restore(&reader);
+  EXPECT_TRUE(static_cast<bool>(error));
+  llvm::consumeError(std::move(error));
+
+  IteratorStateReader truncated(string_view(), host.get());
+  error = slice->MakeIterator()->Restore(&truncated);
+  EXPECT_TRUE(static_cast<bool>(error));
+  llvm::consumeError(std::move(error));
+}
+
+// A tensor state with negative dimensions or more elements than the rest of
+// the state is an error, before the tensor is allocated.
+TEST(IteratorStateTest, RestoreInvalidTensor) {
+  auto host = CreateHostContext();
+  auto tensor = DenseHostTensor::CreateUninitialized(
+      TensorMetadata(DType(DType::F32), {2, 3}), host.get());
+  ASSERT_TRUE(tensor.hasValue());
+  for (int i = 0; i < 6; ++i) static_cast<float*>(tensor->data())[i] = i;
+  IteratorStateWriter valid;
+  valid.WriteValue(*tensor);
+  {
+    IteratorStateReader reader(valid.data(), host.get());
+    llvm::Optional<DenseHostTensor> value;
+    ASSERT_FALSE(static_cast<bool>(reader.ReadValue(&value)));
+    EXPECT_EQ(value->shape(), tensor->shape());
+    EXPECT_EQ(std::memcmp(value->data(), tensor->data(), 6 * sizeof(float)),
+              0);
+  }
+
+  const int64_t kLarge = int64_t{1} << 40;
+  const std::vector<std::vector<int64_t>> invalid_dims = {
+      {2, -3}, {kLarge, kLarge}, {kLarge, kLarge, 0, -1}, {2, 4}};
+  for (const auto& dims : invalid_dims) {
+    IteratorStateWriter writer;
+    writer.WriteInt(DType::F32);
+    writer.WriteInt(dims.size());
+    for (int64_t dim : dims) writer.WriteInt(dim);
+    // The 6 values of a 2x3 tensor.
+    for (int i = 0; i < 3; ++i) writer.WriteInt(0);
+    IteratorStateReader reader(writer.data(), host.get());
+    llvm::Optional<DenseHostTensor> value;
+    auto error = reader.ReadValue(&value);
+    EXPECT_TRUE(static_cast<bool>(error));
+    llvm::consumeError(std::move(error));
+  }
+
+  IteratorStateWriter large_rank;
+  large_rank.WriteInt(DType::F32);
+  large_rank.WriteInt(kLarge);
+  IteratorStateReader reader(large_rank.data(), host.get());
+  llvm::Optional<DenseHostTensor> value;
+  auto error = reader.ReadValue(&value);
+  EXPECT_TRUE(static_cast<bool>(error));
+  llvm::consumeError(std::move(error));
+}
+
+TEST(IteratorStateTest, StateFile) {
+  const std::string path = GetTestPath("state");
+  IteratorStateWriter writer;
+  writer.WriteInt(42);
+  writer.WriteString("state");
+  ASSERT_FALSE(static_cast<bool>(WriteIteratorStateFile(path, writer.data())));
+
+  auto state = ReadIteratorStateFile(path);
+  ASSERT_TRUE(static_cast<bool>(state));
+  EXPECT_EQ(*state, writer.data());
+
+  // Corrupt the state.
+  {
+    std::fstream file(path, std::ios_base::binary | std::ios_base::in |
+                                std::ios_base::out);
+    file.seekp(10);
+    file.put('x');
+  }
+  state = ReadIteratorStateFile(path);
+  EXPECT_FALSE(static_cast<bool>(state));
+  llvm::consumeError(state.takeError());
+  std::remove(path.c_str());
+}
+
+// Threads that write the same state file do not write the same temporary
+// file.
+TEST(IteratorStateTest, ConcurrentStateFileWrites) {
+  const std::string path = GetTestPath("concurrent_state");
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&path, i]() {
+      IteratorStateWriter writer;
+      writer.WriteString(std::string(1000 * (i + 1), 'a' + i));
+      for (int j = 0; j < 20; ++j) {
+        EXPECT_FALSE(
+            static_cast<bool>(WriteIteratorStateFile(path, writer.data())));
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  auto state = ReadIteratorStateFile(path);
+  ASSERT_TRUE(static_cast<bool>(state)) << llvm::toString(state.takeError());
+  std::remove(path.c_str());
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tfrt
@@ -0,0 +1,184 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- map_and_batch_dataset_benchmark.cc ---------------------------------===//
+//
+// Benchmark for a cheap batch-compatible map function followed by batch, which
+// runs once per element with MapDataset before BatchDataset, and once per
+// batch with BatchDataset before MapDataset as in data.map_and_batch_dataset.
+//
+//===----------------------------------------------------------------------===//
+
+#include <cstring>
+
+#include "benchmark/benchmark.h"
+#include "lib/data/batch_dataset.h"
+#include "lib/data/map_dataset.h"
+#include "tfrt/host_context/concurrent_work_queue.h"
+#include "tfrt/host_context/function.h"
+#include "tfrt/host_context/host_allocator.h"
+#include "tfrt/host_context/host_context.h"
+
+namespace tfrt {
+namespace data {
+namespace {
+
+constexpr ssize_t kNumFeatures = 64;
+
+// Dataset of `num_elements` references to the same float tensor of
+// kNumFeatures features.
+class FeatureDataset : public Dataset<DenseHostTensor> {
+ public:
+  FeatureDataset(int64_t num_elements, HostContext* host)
+      : num_elements_(num_elements),
+        host_(host),
+        features_(*DenseHostTensor::CreateUninitialized(
+            TensorMetadata(GetDType<float>(), kNumFeatures), host)) {
+    std::memset(features_.data(), 0, features_.DataSizeInBytes());
+  }
+
+  RCReference<Iterator<DenseHostTensor>> MakeIterator() override;
+
+ private:
+  friend class FeatureDatasetIterator;
+
+  void Destroy() override {
+    internal::DestroyImpl<FeatureDataset>(this, host_->allocator());
+  }
+
+  int64_t num_elements_;
+  HostContext* host_;
+  DenseHostTensor features_;
+};
+
+class FeatureDatasetIterator : public Iterator<DenseHostTensor> {
+ public:
+  explicit FeatureDatasetIterator(RCReference<FeatureDataset> dataset)
+      : dataset_(std::move(dataset)) {}
+
+  AsyncValueRef<std::tuple<DenseHostTensor>> GetNext(
+      const ExecutionContext& exec_ctx) override {
+    if (next_ == dataset_->num_elements_) return {};
+    ++next_;
+    return exec_ctx.host()
+        ->MakeConcreteAsyncValueRef<std::tuple<DenseHostTensor>>(
+            dataset_->features_.CopyRef());
+  }
+
+ private:
+  void Destroy() override {
+    internal::DestroyImpl<FeatureDatasetIterator>(
+        this, dataset_->host_->allocator());
+  }
+
+  RCReference<FeatureDataset> dataset_;
+  int64_t next_ = 0;
+};
+
+RCReference<Iterator<DenseHostTensor>> FeatureDataset::MakeIterator() {
+  return TakeRef(host_->Construct<FeatureDatasetIterator>(FormRef(this)));
+}
+
+// Normalizes every value of a float tensor of any shape, so that it returns
+// the same batch whether it is called on every element or on the batch.
+class NormalizeFunction : public Function {
+ public:
+  NormalizeFunction() : Function("normalize", {TypeName()}, {TypeName()}) {}
+
+  void Execute(ArrayRef<AsyncValue*> arguments,
+               MutableArrayRef<RCReference<AsyncValue>> results,
+               HostContext* host) const override {
+    const auto& input = arguments[0]->get<DenseHostTensor>();
+    auto output = DenseHostTensor::CreateUninitialized(input.metadata(), host);
+    const float* in = static_cast<const float*>(input.data());
+    float* out = static_cast<float*>(output->data());
+    for (ssize_t i = 0, e = input.NumElements(); i < e; ++i) {
+      out[i] = (in[i] - 0.5f) * 4.0f;
+    }
+    results[0] = host->MakeConcreteAsyncValueRef<DenseHostTensor>(
+        std::move(*output));
+  }
+
+  void AddRef() const override {}
+  void DropRef() const override {}
+};
+
+std::unique_ptr<HostContext> CreateHostContext() {
+  auto decoded_diagnostic_handler = [&](const DecodedDiagnostic& diag) {
+    abort();
+  };
+  return std::make_unique<HostContext>(decoded_diagnostic_handler,
+                                       CreateMallocAllocator(),
+                                       CreateMultiThreadedWorkQueue(4, 1));
+}
+
+RCReference<Dataset<DenseHostTensor>> MakeMapDataset(
+    RCReference<Dataset<DenseHostTensor>> input,
+    const NormalizeFunction* map_fn, HostContext* host) {
+  return TakeRef(host->Construct<MapDataset<std::tuple<DenseHostTensor>,
+                                            std::tuple<DenseHostTensor>>>(
+      std::move(input), RCArray<AsyncValue>(ArrayRef<AsyncValue*>()),
+      FormRef(static_cast<const Function*>(map_fn)), host));
+}
+
+// Arguments: batch size, and whether the map function runs on the batches
+// rather than on the elements.
+void BM_MapAndBatch(benchmark::State& state) {
+  const int32_t batch_size = state.range(0);
+  const bool map_batches = state.range(1);
+  const int64_t kNumElements = 1 << 16;
+
+  auto host = CreateHostContext();
+  ExecutionContext exec_ctx(host.get());
+  NormalizeFunction map_fn;
+  RCReference<Dataset<DenseHostTensor>> dataset =
+      TakeRef(host->Construct<FeatureDataset>(kNumElements, host.get()));
+  if (map_batches) {
+    dataset = TakeRef(host->Construct<BatchDataset<DenseHostTensor>>(
+        std::move(dataset), batch_size, host.get()));
+    dataset = MakeMapDataset(std::move(dataset), &map_fn, host.get());
+  } else {
+    dataset = MakeMapDataset(std::move(dataset), &map_fn, host.get());
+    dataset = TakeRef(host->Construct<BatchDataset<DenseHostTensor>>(
+        std::move(dataset), batch_size, host.get()));
+  }
+
+  for (auto _ : state) {
+    auto iterator = dataset->MakeIterator();
+    while (auto batch = iterator->GetNext(exec_ctx)) {
+      host->Await(batch.CopyRCRef());
+      if (batch.IsError()) {
+        state.SkipWithError("failed to map and batch elements");
+        return;
+      }
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * kNumElements);
+}
+
+BENCHMARK(BM_MapAndBatch)
+    ->ArgNames({"batch_size", "map_batches"})
+    ->Args({32, 0})
+    ->Args({32, 1})
+    ->Args({256, 0})
+    ->Args({256, 1})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace data
+}  // namespace tfrt
@@ -0,0 +1,203 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- map_and_batch_dataset_test.cc ----------------------------*- C++ -*-===//
+//
+// This file contains unit tests for CreateMapAndBatchDataset, which must
+// return the same batches as MapDataset followed by BatchDataset.
+//
+//===----------------------------------------------------------------------===//
+
+#include "lib/data/map_and_batch_dataset.h"
+
+#include <atomic>
+
+#include "cpp_tests/data/dataset_test_util.h"
+#include "gtest/gtest.h"
+
+namespace tfrt {
+namespace data {
+namespace {
+
+using testing::CreateHostContext;
+using testing::GetDims;
+using testing::GetElements;
+using testing::GetValues;
+using testing::MakeAsyncValues;
+using testing::MakeRange;
+using testing::MakeSlice;
+using testing::MakeTensor;
+using testing::MakeValuesWithErrors;
+using testing::RequestElements;
+
+// Returns 3 * x - 1 for every value x of its argument, which is a scalar of
+// type T or a tensor of T, so that calling it on a batch returns the batch of
+// its results on the elements. The scalar results are 0-D tensors.
+template <typename T>
+class AffineFunction : public Function {
+ public:
+  AffineFunction() : Function("affine", {TypeName()}, {TypeName()}) {}
+
+  void Execute(ArrayRef<AsyncValue*> arguments,
+               MutableArrayRef<RCReference<AsyncValue>> results,
+               HostContext* host) const override {
+    ++num_calls_;
+    if (arguments[0]->IsType<DenseHostTensor>()) {
+      results[0] = Compute(arguments[0]->get<DenseHostTensor>(), host);
+    } else {
+      results[0] = Compute(
+          MakeTensor<T>({}, {arguments[0]->get<T>()}, host), host);
+    }
+  }
+
+  void AddRef() const override {}
+  void DropRef() const override {}
+
+  RCReference<const Function> Ref() const { return FormRef(this); }
+
+  int num_calls() const { return num_calls_; }
+
+ private:
+  RCReference<AsyncValue> Compute(const DenseHostTensor& input,
+                                  HostContext* host) const {
+    auto output = DenseHostTensor::CreateUninitialized(input.metadata(), host);
+    const T* in = static_cast<const T*>(input.data());
+    T* out = static_cast<T*>(output->data());
+    for (ssize_t i = 0, e = input.NumElements(); i < e; ++i) {
+      out[i] = 3 * in[i] - 1;
+    }
+    return host->MakeConcreteAsyncValueRef<DenseHostTensor>(std::move(*output))
+        .ReleaseRCRef();
+  }
+
+  mutable std::atomic<int> num_calls_{0};
+};
+
+// Returns map(fn) followed by batch(batch_size), which calls `fn` on every
+// element.
+template <typename Input, typename T>
+RCReference<Dataset<DenseHostTensor>> MakeMapThenBatch(
+    RCReference<Dataset<Input>> input, int32_t batch_size,
+    const AffineFunction<T>& fn, HostContext* host) {
+  using Map = MapDataset<std::tuple<Input>, std::tuple<DenseHostTensor>>;
+  auto map = TakeRef(host->Construct<Map>(
+      std::move(input), RCArray<AsyncValue>(ArrayRef<AsyncValue*>()), fn.Ref(),
+      host));
+  return TakeRef(host->Construct<BatchDataset<DenseHostTensor>>(
+      std::move(map), batch_size, host));
+}
+
+template <typename Input, typename T>
+RCReference<Dataset<DenseHostTensor>> MakeMapAndBatch(
+    RCReference<Dataset<Input>> input, int32_t batch_size,
+    const AffineFunction<T>& fn, HostContext* host) {
+  return CreateMapAndBatchDataset<Input, DenseHostTensor>(
+      std::move(input), RCArray<AsyncValue>(ArrayRef<AsyncValue*>()),
+      batch_size, fn.Ref(), host);
+}
+
+// Expects the datasets to return batches with the same shapes and values.
+template <typename T>
+void ExpectSameBatches(Dataset<DenseHostTensor>* expected_dataset,
+                       Dataset<DenseHostTensor>* dataset, HostContext* host) {
+  auto expected = GetElements(expected_dataset->MakeIterator().get(), host);
+  ASSERT_TRUE(static_cast<bool>(expected));
+  auto actual = GetElements(dataset->MakeIterator().get(), host);
+  ASSERT_TRUE(static_cast<bool>(actual));
+  ASSERT_EQ(actual->size(), expected->size());
+  for (size_t i = 0; i < actual->size(); ++i) {
+    EXPECT_EQ(GetDims((*actual)[i]), GetDims((*expected)[i])) << "batch " << i;
+    EXPECT_EQ(GetValues<T>((*actual)[i]), GetValues<T>((*expected)[i]))
+        << "batch " << i;
+  }
+}
+
+// The map function is called once per batch rather than once per element,
+// including the last short batch.
+TEST(MapAndBatchDatasetTest, Scalars) {
+  auto host = CreateHostContext();
+  for (int32_t batch_size : {1, 3, 4, 10, 16}) {
+    AffineFunction<int64_t> map_then_batch_fn, map_and_batch_fn;
+    auto map_then_batch = MakeMapThenBatch(MakeRange<int64_t>(10, host.get()),
+                                           batch_size, map_then_batch_fn,
+                                           host.get());
+    auto map_and_batch = MakeMapAndBatch(MakeRange<int64_t>(10, host.get()),
+                                         batch_size, map_and_batch_fn,
+                                         host.get());
+    ExpectSameBatches<int64_t>(map_then_batch.get(), map_and_batch.get(),
+                               host.get());
+    EXPECT_EQ(map_then_batch_fn.num_calls(), 10);
+    EXPECT_EQ(map_and_batch_fn.num_calls(), (10 + batch_size - 1) / batch_size);
+  }
+  host->Quiesce();
+}
+
+TEST(MapAndBatchDatasetTest, Tensors) {
+  auto host = CreateHostContext();
+  auto make_input = [&]() {
+    std::vector<DenseHostTensor> tensors;
+    for (int i = 0; i < 7; ++i) {
+      tensors.push_back(MakeTensor<float>({2, 3},
+                                          {i * 1.f, i * 2.f, i * 3.f, i * 4.f,
+                                           i * 5.f, i * 6.f},
+                                          host.get()));
+    }
+    return MakeSlice(std::move(tensors), host.get());
+  };
+  AffineFunction<float> fn;
+  auto map_then_batch = MakeMapThenBatch(make_input(), 3, fn, host.get());
+  auto map_and_batch = MakeMapAndBatch(make_input(), 3, fn, host.get());
+  ExpectSameBatches<float>(map_then_batch.get(), map_and_batch.get(),
+                           host.get());
+  host->Quiesce();
+}
+
+// The batches with an input error are errors, and the other batches are the
+// same.
+TEST(MapAndBatchDatasetTest, InputErrors) {
+  auto host = CreateHostContext();
+  auto values = MakeValuesWithErrors(10, {5}, host.get());
+  AffineFunction<int64_t> fn;
+  auto map_then_batch = MakeMapThenBatch(
+      MakeAsyncValues<int64_t>(values, host.get()), 4, fn, host.get());
+  auto map_and_batch = MakeMapAndBatch(
+      MakeAsyncValues<int64_t>(values, host.get()), 4, fn, host.get());
+  auto expected_iterator = map_then_batch->MakeIterator();
+  auto iterator = map_and_batch->MakeIterator();
+  auto expected =
+      RequestElements(expected_iterator.get(), testing::kAll, host.get());
+  auto actual = RequestElements(iterator.get(), testing::kAll, host.get());
+  ASSERT_EQ(actual.size(), 3);
+  ASSERT_EQ(expected.size(), 3);
+  for (int i = 0; i < 3; ++i) {
+    host->Await({expected[i].CopyRCRef(), actual[i].CopyRCRef()});
+    ASSERT_EQ(actual[i].IsError(), i == 1);
+    ASSERT_EQ(expected[i].IsError(), i == 1);
+    if (i == 1) {
+      EXPECT_EQ(actual[i].GetError().message, expected[i].GetError().message);
+    } else {
+      EXPECT_EQ(GetValues<int64_t>(std::get<0>(actual[i].get())),
+                GetValues<int64_t>(std::get<0>(expected[i].get())));
+    }
+  }
+  expected_iterator.reset();
+  iterator.reset();
+  host->Quiesce();
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tfrt
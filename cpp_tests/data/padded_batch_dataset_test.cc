@@ -0,0 +1,161 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- padded_batch_dataset_test.cc -----------------------------*- C++ -*-===//
+//
+// This file contains unit tests for PaddedBatchDataset and
+// RaggedBatchDataset.
+//
+//===----------------------------------------------------------------------===//
+
+#include "lib/data/padded_batch_dataset.h"
+
+#include "cpp_tests/data/dataset_test_util.h"
+#include "gtest/gtest.h"
+
+namespace tfrt {
+namespace data {
+namespace {
+
+using testing::CreateHostContext;
+using testing::GetDims;
+using testing::GetElements;
+using testing::GetValues;
+using testing::MakeSlice;
+using testing::MakeTensor;
+using testing::RequestElements;
+
+RCReference<Dataset<DenseHostTensor>> MakePaddedBatch(
+    std::vector<DenseHostTensor> tensors, int32_t batch_size,
+    HostContext* host) {
+  return TakeRef(host->Construct<PaddedBatchDataset<1>>(
+      MakeSlice(std::move(tensors), host), batch_size, host));
+}
+
+RCReference<Dataset<DenseHostTensor, DenseHostTensor>> MakeRaggedBatch(
+    std::vector<DenseHostTensor> tensors, int32_t batch_size,
+    HostContext* host) {
+  return TakeRef(host->Construct<RaggedBatchDataset<1>>(
+      MakeSlice(std::move(tensors), host), batch_size, host));
+}
+
+// Every tensor is padded with zeros to the maximum shape of its batch, and the
+// last batch is short.
+TEST(PaddedBatchDatasetTest, PadsToMaximumShape) {
+  auto host = CreateHostContext();
+  std::vector<DenseHostTensor> tensors;
+  tensors.push_back(MakeTensor<float>({2, 1}, {1, 2}, host.get()));
+  tensors.push_back(MakeTensor<float>({1, 3}, {3, 4, 5}, host.get()));
+  tensors.push_back(MakeTensor<float>({2, 2}, {6, 7, 8, 9}, host.get()));
+  auto padded_batch = MakePaddedBatch(std::move(tensors), 2, host.get());
+
+  auto batches = GetElements(padded_batch->MakeIterator().get(), host.get());
+  ASSERT_TRUE(static_cast<bool>(batches));
+  ASSERT_EQ(batches->size(), 2);
+  EXPECT_EQ(GetDims((*batches)[0]), std::vector<ssize_t>({2, 2, 3}));
+  EXPECT_EQ(GetValues<float>((*batches)[0]),
+            std::vector<float>({1, 0, 0, 2, 0, 0, 3, 4, 5, 0, 0, 0}));
+  EXPECT_EQ(GetDims((*batches)[1]), std::vector<ssize_t>({1, 2, 2}));
+  EXPECT_EQ(GetValues<float>((*batches)[1]),
+            std::vector<float>({6, 7, 8, 9}));
+  host->Quiesce();
+}
+
+TEST(PaddedBatchDatasetTest, Scalars) {
+  auto host = CreateHostContext();
+  std::vector<DenseHostTensor> tensors;
+  for (int32_t i = 0; i < 3; ++i) {
+    tensors.push_back(MakeTensor<int32_t>({}, {i}, host.get()));
+  }
+  auto padded_batch = MakePaddedBatch(std::move(tensors), 4, host.get());
+  auto batches = GetElements(padded_batch->MakeIterator().get(), host.get());
+  ASSERT_TRUE(static_cast<bool>(batches));
+  ASSERT_EQ(batches->size(), 1);
+  EXPECT_EQ(GetDims(batches->front()), std::vector<ssize_t>({3}));
+  EXPECT_EQ(GetValues<int32_t>(batches->front()),
+            std::vector<int32_t>({0, 1, 2}));
+  host->Quiesce();
+}
+
+TEST(PaddedBatchDatasetTest, DTypeMismatch) {
+  auto host = CreateHostContext();
+  std::vector<DenseHostTensor> tensors;
+  tensors.push_back(MakeTensor<float>({2}, {1, 2}, host.get()));
+  tensors.push_back(MakeTensor<int32_t>({2}, {1, 2}, host.get()));
+  auto padded_batch = MakePaddedBatch(std::move(tensors), 2, host.get());
+  auto batches = GetElements(padded_batch->MakeIterator().get(), host.get());
+  ASSERT_FALSE(static_cast<bool>(batches));
+  EXPECT_EQ(
+      llvm::toString(batches.takeError()),
+      "tensors to be padded and batched must have the same dtype and rank");
+  host->Quiesce();
+}
+
+// The tensors are concatenated along their first dimension, and the row
+// splits delimit the tensors of every element.
+TEST(RaggedBatchDatasetTest, RaggedShapes) {
+  auto host = CreateHostContext();
+  std::vector<DenseHostTensor> tensors;
+  tensors.push_back(MakeTensor<int32_t>({2, 2}, {1, 2, 3, 4}, host.get()));
+  tensors.push_back(MakeTensor<int32_t>({1, 2}, {5, 6}, host.get()));
+  tensors.push_back(
+      MakeTensor<int32_t>({3, 2}, {7, 8, 9, 10, 11, 12}, host.get()));
+  tensors.push_back(MakeTensor<int32_t>({0, 2}, {}, host.get()));
+  auto iterator =
+      MakeRaggedBatch(std::move(tensors), 3, host.get())->MakeIterator();
+
+  auto batches = RequestElements(iterator.get(), testing::kAll, host.get());
+  ASSERT_EQ(batches.size(), 2);
+  for (auto& batch : batches) host->Await(batch.CopyRCRef());
+  ASSERT_FALSE(batches[0].IsError());
+  const auto& values = std::get<0>(batches[0].get());
+  const auto& row_splits = std::get<1>(batches[0].get());
+  EXPECT_EQ(GetDims(values), std::vector<ssize_t>({6, 2}));
+  EXPECT_EQ(GetValues<int32_t>(values),
+            std::vector<int32_t>({1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12}));
+  EXPECT_EQ(GetValues<int64_t>(row_splits), std::vector<int64_t>({0, 2, 3, 6}));
+
+  // The last batch holds an empty tensor.
+  ASSERT_FALSE(batches[1].IsError());
+  EXPECT_EQ(GetDims(std::get<0>(batches[1].get())),
+            std::vector<ssize_t>({0, 2}));
+  EXPECT_EQ(GetValues<int64_t>(std::get<1>(batches[1].get())),
+            std::vector<int64_t>({0, 0}));
+  iterator.reset();
+  host->Quiesce();
+}
+
+TEST(RaggedBatchDatasetTest, InnerDimensionMismatch) {
+  auto host = CreateHostContext();
+  std::vector<DenseHostTensor> tensors;
+  tensors.push_back(MakeTensor<int32_t>({1, 2}, {1, 2}, host.get()));
+  tensors.push_back(MakeTensor<int32_t>({1, 3}, {1, 2, 3}, host.get()));
+  auto iterator =
+      MakeRaggedBatch(std::move(tensors), 2, host.get())->MakeIterator();
+  auto batches = RequestElements(iterator.get(), testing::kAll, host.get());
+  ASSERT_EQ(batches.size(), 1);
+  host->Await(batches[0].CopyRCRef());
+  ASSERT_TRUE(batches[0].IsError());
+  EXPECT_EQ(batches[0].GetError().message,
+            "tensors to be ragged batched must have the same dimensions "
+            "except the first one");
+  iterator.reset();
+  host->Quiesce();
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tfrt
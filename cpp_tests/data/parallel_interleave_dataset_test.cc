@@ -0,0 +1,212 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- parallel_interleave_dataset_test.cc ----------------------*- C++ -*-===//
+//
+// This file contains unit tests for ParallelInterleaveDataset.
+//
+//===----------------------------------------------------------------------===//
+
+#include "lib/data/parallel_interleave_dataset.h"
+
+#include <algorithm>
+
+#include "cpp_tests/data/dataset_test_util.h"
+#include "gtest/gtest.h"
+#include "lib/data/interleave_dataset.h"
+
+namespace tfrt {
+namespace data {
+namespace {
+
+using testing::CreateHostContext;
+using testing::GetElements;
+using testing::MakeAsyncValues;
+using testing::MakeRange;
+using testing::MakeSlice;
+using testing::MakeValuesWithErrors;
+using testing::RequestElements;
+using testing::TestFunction;
+
+using DatasetRef = RCReference<Dataset<int64_t>>;
+using InterleaveFunction = TestFunction<int64_t, DatasetRef>;
+
+DatasetRef MakeParallelInterleave(DatasetRef input, const Function& map_fn,
+                                  bool sloppy, HostContext* host,
+                                  int64_t cycle_length = 2,
+                                  int64_t block_length = 2) {
+  return TakeRef(host->Construct<ParallelInterleaveDataset<
+                     std::tuple<int64_t>, std::tuple<int64_t>>>(
+      std::move(input), cycle_length, block_length,
+      /*buffer_output_elements=*/2, sloppy, FormRef(&map_fn), host));
+}
+
+// Returns the elements returned by the iterator, with the errors replaced by
+// -1.
+std::vector<int64_t> GetElementsOrErrors(Iterator<int64_t>* iterator,
+                                         HostContext* host) {
+  std::vector<int64_t> elements;
+  for (auto& value : RequestElements(iterator, testing::kAll, host)) {
+    host->Await(value.CopyRCRef());
+    elements.push_back(value.IsError() ? -1 : std::get<0>(value.get()));
+  }
+  return elements;
+}
+
+TEST(ParallelInterleaveDatasetTest, CycleOrder) {
+  auto host = CreateHostContext();
+  InterleaveFunction map_fn(
+      [host = host.get()](int64_t x) { return MakeRange<int64_t>(x, host); });
+  const std::vector<int64_t> input = {3, 5, 1, 4, 2};
+
+  // Each iterator yields a block of 2 elements in turn, and the next input
+  // element takes the slot of an iterator that reached end.
+  auto parallel_interleave = MakeParallelInterleave(
+      MakeSlice(input, host.get()), map_fn, /*sloppy=*/false, host.get());
+  auto elements =
+      GetElements(parallel_interleave->MakeIterator().get(), host.get());
+  ASSERT_TRUE(static_cast<bool>(elements));
+  EXPECT_EQ(*elements, std::vector<int64_t>(
+                           {0, 1, 0, 1, 2, 2, 3, 0, 4, 0, 1, 0, 1, 2, 3}));
+
+  // The order is the one of InterleaveDataset for other cycle and block
+  // lengths.
+  for (int64_t cycle_length : {1, 3, 8}) {
+    for (int64_t block_length : {1, 3}) {
+      auto interleave = TakeRef(
+          host->Construct<
+              InterleaveDataset<std::tuple<int64_t>, std::tuple<int64_t>>>(
+              MakeSlice(input, host.get()), cycle_length, block_length,
+              FormRef(&map_fn), host.get()));
+      auto expected = GetElements(interleave->MakeIterator().get(), host.get());
+      ASSERT_TRUE(static_cast<bool>(expected));
+      auto actual = GetElements(
+          MakeParallelInterleave(MakeSlice(input, host.get()), map_fn,
+                                 /*sloppy=*/false, host.get(), cycle_length,
+                                 block_length)
+              ->MakeIterator()
+              .get(),
+          host.get());
+      ASSERT_TRUE(static_cast<bool>(actual));
+      EXPECT_EQ(*actual, *expected);
+    }
+  }
+  host->Quiesce();
+}
+
+TEST(ParallelInterleaveDatasetTest, SloppyReturnsAllElements) {
+  auto host = CreateHostContext();
+  InterleaveFunction map_fn([host = host.get()](int64_t x) {
+    return MakeSlice(std::vector<int64_t>(x, x), host);
+  });
+  auto parallel_interleave = MakeParallelInterleave(
+      MakeSlice<int64_t>({3, 5, 1, 4, 2}, host.get()), map_fn,
+      /*sloppy=*/true, host.get());
+  auto elements =
+      GetElements(parallel_interleave->MakeIterator().get(), host.get());
+  ASSERT_TRUE(static_cast<bool>(elements));
+  std::sort(elements->begin(), elements->end());
+  EXPECT_EQ(*elements, std::vector<int64_t>(
+                           {1, 2, 2, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 5}));
+  host->Quiesce();
+}
+
+// Errors of the input elements and of the interleaved datasets are returned
+// in place of their elements.
+TEST(ParallelInterleaveDatasetTest, PropagatesErrors) {
+  auto host = CreateHostContext();
+  // The interleaved datasets are 0, ..., x - 1, with an error in place of 1.
+  InterleaveFunction map_fn([host = host.get()](int64_t x) {
+    return MakeAsyncValues<int64_t>(MakeValuesWithErrors(x, {1}, host), host);
+  });
+  for (bool sloppy : {false, true}) {
+    auto input = MakeAsyncValues<int64_t>(
+        MakeValuesWithErrors(4, {2}, host.get()), host.get());
+    auto iterator =
+        MakeParallelInterleave(std::move(input), map_fn, sloppy, host.get())
+            ->MakeIterator();
+    // The input element 2 is an error, and the datasets of the input elements
+    // 0, 1 and 3 are {}, {0} and {0, error, 2}. The error is returned when the
+    // iterator of the input element 0 reaches end and its slot is reused.
+    std::vector<int64_t> elements =
+        GetElementsOrErrors(iterator.get(), host.get());
+    if (sloppy) {
+      std::sort(elements.begin(), elements.end());
+      EXPECT_EQ(elements, std::vector<int64_t>({-1, -1, 0, 0, 2}));
+    } else {
+      EXPECT_EQ(elements, std::vector<int64_t>({-1, 0, -1, 0, 2}));
+    }
+  }
+  host->Quiesce();
+}
+
+TEST(ParallelInterleaveDatasetTest, EarlyEnd) {
+  auto host = CreateHostContext();
+  InterleaveFunction map_fn(
+      [host = host.get()](int64_t x) { return MakeRange<int64_t>(x, host); });
+  for (bool sloppy : {false, true}) {
+    // No input elements, and input elements whose datasets are empty.
+    for (auto input : {std::vector<int64_t>{}, std::vector<int64_t>{0, 0, 0}}) {
+      auto iterator =
+          MakeParallelInterleave(MakeSlice(input, host.get()), map_fn, sloppy,
+                                 host.get())
+              ->MakeIterator();
+      EXPECT_TRUE(RequestElements(iterator.get(), 1, host.get()).empty());
+      EXPECT_TRUE(RequestElements(iterator.get(), 1, host.get()).empty());
+    }
+
+    // Releasing the iterator before the end stops the background tasks that
+    // read ahead from the open iterators.
+    auto iterator = MakeParallelInterleave(
+                        MakeSlice<int64_t>({1000, 1000, 1000}, host.get()),
+                        map_fn, sloppy, host.get(), /*cycle_length=*/3)
+                        ->MakeIterator();
+    auto elements = GetElements(iterator.get(), host.get(), 5);
+    ASSERT_TRUE(static_cast<bool>(elements));
+    EXPECT_EQ(elements->size(), 5);
+    iterator.reset();
+  }
+  host->Quiesce();
+}
+
+// The iterators of the cycle are opened synchronously, so an input element
+// that is not available yet is an error.
+TEST(ParallelInterleaveDatasetTest, UnavailableInput) {
+  auto host = CreateHostContext();
+  InterleaveFunction map_fn(
+      [host = host.get()](int64_t x) { return MakeRange<int64_t>(x, host); });
+  auto input_value =
+      host->MakeUnconstructedAsyncValueRef<std::tuple<int64_t>>();
+  auto iterator =
+      MakeParallelInterleave(
+          MakeAsyncValues<int64_t>({input_value.CopyRef()}, host.get()), map_fn,
+          /*sloppy=*/false, host.get())
+          ->MakeIterator();
+  auto values = RequestElements(iterator.get(), 1, host.get());
+  ASSERT_EQ(values.size(), 1);
+  host->Await(values[0].CopyRCRef());
+  ASSERT_TRUE(values[0].IsError());
+  EXPECT_EQ(values[0].GetError().message,
+            "parallel_interleave expects its inputs to be available "
+            "synchronously");
+  input_value.emplace(3);
+  iterator.reset();
+  host->Quiesce();
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tfrt
@@ -0,0 +1,171 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- parallel_map_dataset_test.cc -----------------------------*- C++ -*-===//
+//
+// This file contains unit tests for ParallelMapDataset.
+//
+//===----------------------------------------------------------------------===//
+
+#include "lib/data/parallel_map_dataset.h"
+
+#include <algorithm>
+
+#include "cpp_tests/data/dataset_test_util.h"
+#include "gtest/gtest.h"
+
+namespace tfrt {
+namespace data {
+namespace {
+
+using testing::CreateHostContext;
+using testing::GetElements;
+using testing::MakeAsyncValues;
+using testing::MakeRange;
+using testing::MakeValuesWithErrors;
+using testing::RequestElements;
+using testing::TestFunction;
+
+using ParallelMap =
+    ParallelMapDataset<std::tuple<int64_t>, std::tuple<int64_t>>;
+
+RCReference<Dataset<int64_t>> MakeParallelMap(
+    RCReference<Dataset<int64_t>> input, const Function& map_fn,
+    int64_t num_parallel_calls, bool deterministic, HostContext* host) {
+  return TakeRef(host->Construct<ParallelMap>(
+      std::move(input), RCArray<AsyncValue>(ArrayRef<AsyncValue*>()),
+      FormRef(&map_fn), num_parallel_calls, deterministic, host));
+}
+
+// Returns the elements returned by the iterator, with the errors replaced by
+// -1.
+std::vector<int64_t> GetElementsOrErrors(Iterator<int64_t>* iterator,
+                                         HostContext* host) {
+  std::vector<int64_t> elements;
+  for (auto& value : RequestElements(iterator, testing::kAll, host)) {
+    host->Await(value.CopyRCRef());
+    elements.push_back(value.IsError() ? -1 : std::get<0>(value.get()));
+  }
+  return elements;
+}
+
+// Invocations of the map function complete out of order, but the results are
+// returned in the order of the input.
+TEST(ParallelMapDatasetTest, PreservesOrder) {
+  auto host = CreateHostContext();
+  TestFunction<int64_t, int64_t> map_fn([](int64_t x) { return x * 2; },
+                                        /*async=*/true);
+  std::vector<int64_t> expected;
+  for (int64_t i = 0; i < 500; ++i) expected.push_back(i * 2);
+
+  for (int64_t num_parallel_calls : {int64_t{1}, int64_t{4}, int64_t{16},
+                                     kAutotune}) {
+    auto map = MakeParallelMap(MakeRange<int64_t>(500, host.get()), map_fn,
+                               num_parallel_calls, /*deterministic=*/true,
+                               host.get());
+    // Request the elements both one at a time and all at once.
+    auto elements = GetElements(map->MakeIterator().get(), host.get());
+    ASSERT_TRUE(static_cast<bool>(elements));
+    EXPECT_EQ(*elements, expected);
+    EXPECT_EQ(GetElementsOrErrors(map->MakeIterator().get(), host.get()),
+              expected);
+  }
+  host->Quiesce();
+}
+
+TEST(ParallelMapDatasetTest, NonDeterministicReturnsAllElements) {
+  auto host = CreateHostContext();
+  TestFunction<int64_t, int64_t> map_fn([](int64_t x) { return x + 1; },
+                                        /*async=*/true);
+  auto map = MakeParallelMap(MakeRange<int64_t>(500, host.get()), map_fn,
+                             /*num_parallel_calls=*/8,
+                             /*deterministic=*/false, host.get());
+  std::vector<int64_t> elements =
+      GetElementsOrErrors(map->MakeIterator().get(), host.get());
+  std::sort(elements.begin(), elements.end());
+  std::vector<int64_t> expected;
+  for (int64_t i = 1; i <= 500; ++i) expected.push_back(i);
+  EXPECT_EQ(elements, expected);
+  host->Quiesce();
+}
+
+// Errors of the map function and of the input are returned in place of their
+// elements, and the following elements are still mapped.
+TEST(ParallelMapDatasetTest, PropagatesErrors) {
+  auto host = CreateHostContext();
+  TestFunction<int64_t, int64_t> map_fn(
+      [](int64_t x) -> llvm::Expected<int64_t> {
+        if (x == 5) return MakeStringError("map error");
+        return x * 10;
+      },
+      /*async=*/true);
+  for (bool deterministic : {true, false}) {
+    auto input = MakeAsyncValues<int64_t>(
+        MakeValuesWithErrors(10, {2}, host.get()), host.get());
+    auto iterator = MakeParallelMap(std::move(input), map_fn,
+                                    /*num_parallel_calls=*/4, deterministic,
+                                    host.get())
+                        ->MakeIterator();
+    std::vector<int64_t> elements =
+        GetElementsOrErrors(iterator.get(), host.get());
+    std::vector<int64_t> expected = {0, 10, -1, 30, 40, -1, 60, 70, 80, 90};
+    if (!deterministic) {
+      std::sort(elements.begin(), elements.end());
+      std::sort(expected.begin(), expected.end());
+    }
+    EXPECT_EQ(elements, expected);
+  }
+
+  // The error message of the map function is preserved.
+  auto iterator = MakeParallelMap(MakeRange<int64_t>(10, host.get()), map_fn,
+                                  /*num_parallel_calls=*/4,
+                                  /*deterministic=*/true, host.get())
+                      ->MakeIterator();
+  auto elements = GetElements(iterator.get(), host.get());
+  ASSERT_FALSE(static_cast<bool>(elements));
+  EXPECT_EQ(llvm::toString(elements.takeError()), "map error");
+  iterator.reset();
+  host->Quiesce();
+}
+
+TEST(ParallelMapDatasetTest, EndOfInput) {
+  auto host = CreateHostContext();
+  TestFunction<int64_t, int64_t> map_fn([](int64_t x) { return x; },
+                                        /*async=*/true);
+  auto empty = MakeParallelMap(MakeRange<int64_t>(0, host.get()), map_fn,
+                               /*num_parallel_calls=*/4,
+                               /*deterministic=*/true, host.get());
+  EXPECT_TRUE(
+      RequestElements(empty->MakeIterator().get(), 1, host.get()).empty());
+
+  auto iterator = MakeParallelMap(MakeRange<int64_t>(3, host.get()), map_fn,
+                                  /*num_parallel_calls=*/8,
+                                  /*deterministic=*/true, host.get())
+                      ->MakeIterator();
+  // Fewer elements than parallel calls.
+  auto elements = GetElements(iterator.get(), host.get());
+  ASSERT_TRUE(static_cast<bool>(elements));
+  EXPECT_EQ(*elements, std::vector<int64_t>({0, 1, 2}));
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_TRUE(RequestElements(iterator.get(), 1, host.get()).empty());
+  }
+  iterator.reset();
+  host->Quiesce();
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tfrt
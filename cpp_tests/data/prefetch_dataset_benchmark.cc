@@ -0,0 +1,148 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- prefetch_dataset_benchmark.cc --------------------------------------===//
+//
+// Input pipeline benchmark for PrefetchDataset. The input dataset simulates
+// blocking reads, and the consumer simulates a training step per element. The
+// reported counter is the time the consumer waits for the next element.
+//
+//===----------------------------------------------------------------------===//
+
+#include <chrono>
+#include <thread>
+
+#include "benchmark/benchmark.h"
+#include "lib/data/prefetch_dataset.h"
+#include "tfrt/host_context/concurrent_work_queue.h"
+#include "tfrt/host_context/host_allocator.h"
+#include "tfrt/host_context/host_context.h"
+
+namespace tfrt {
+namespace data {
+namespace {
+
+using std::chrono::microseconds;
+using std::chrono::steady_clock;
+
+// Dataset of `num_elements` integers, that sleeps for `read_latency` in every
+// GetNext to simulate a blocking read.
+class SlowDataset : public Dataset<int64_t> {
+ public:
+  SlowDataset(int64_t num_elements, microseconds read_latency,
+              HostContext* host)
+      : num_elements_(num_elements), read_latency_(read_latency), host_(host) {}
+
+  RCReference<Iterator<int64_t>> MakeIterator() override;
+
+  bool IsBlocking() const override { return true; }
+
+ private:
+  friend class SlowDatasetIterator;
+
+  void Destroy() override {
+    internal::DestroyImpl<SlowDataset>(this, host_->allocator());
+  }
+
+  int64_t num_elements_;
+  microseconds read_latency_;
+  HostContext* host_;
+};
+
+class SlowDatasetIterator : public Iterator<int64_t> {
+ public:
+  explicit SlowDatasetIterator(RCReference<SlowDataset> dataset)
+      : dataset_(std::move(dataset)) {}
+
+  AsyncValueRef<std::tuple<int64_t>> GetNext(
+      const ExecutionContext& exec_ctx) override {
+    if (next_ == dataset_->num_elements_) return {};
+    std::this_thread::sleep_for(dataset_->read_latency_);
+    return exec_ctx.host()->MakeConcreteAsyncValueRef<std::tuple<int64_t>>(
+        next_++);
+  }
+
+ private:
+  void Destroy() override {
+    internal::DestroyImpl<SlowDatasetIterator>(this,
+                                               dataset_->host_->allocator());
+  }
+
+  RCReference<SlowDataset> dataset_;
+  int64_t next_ = 0;
+};
+
+RCReference<Iterator<int64_t>> SlowDataset::MakeIterator() {
+  return TakeRef(host_->Construct<SlowDatasetIterator>(FormRef(this)));
+}
+
+std::unique_ptr<HostContext> CreateHostContext() {
+  auto decoded_diagnostic_handler = [&](const DecodedDiagnostic& diag) {
+    abort();
+  };
+  return std::make_unique<HostContext>(decoded_diagnostic_handler,
+                                       CreateMallocAllocator(),
+                                       CreateMultiThreadedWorkQueue(4, 4));
+}
+
+// Arguments: prefetch_num (0 to read from the input directly), read latency
+// and compute latency in microseconds.
+void BM_PrefetchPipeline(benchmark::State& state) {
+  const int64_t prefetch_num = state.range(0);
+  const microseconds read_latency(state.range(1));
+  const microseconds compute_latency(state.range(2));
+  const int64_t kNumElements = 100;
+
+  auto host = CreateHostContext();
+  ExecutionContext exec_ctx(host.get());
+
+  RCReference<Dataset<int64_t>> dataset = TakeRef(
+      host->Construct<SlowDataset>(kNumElements, read_latency, host.get()));
+  if (prefetch_num > 0) {
+    dataset = TakeRef(host->Construct<PrefetchDataset<int64_t>>(
+        std::move(dataset), prefetch_num, /*max_buffer_bytes=*/0, host.get()));
+  }
+
+  steady_clock::duration stall_time{0};
+  for (auto _ : state) {
+    auto iterator = dataset->MakeIterator();
+    while (true) {
+      auto start = steady_clock::now();
+      auto value = iterator->GetNext(exec_ctx);
+      if (!value) break;
+      host->Await(value.CopyRCRef());
+      stall_time += steady_clock::now() - start;
+      // Simulate a training step.
+      std::this_thread::sleep_for(compute_latency);
+    }
+  }
+
+  state.counters["stall_us_per_element"] =
+      std::chrono::duration<double, std::micro>(stall_time).count() /
+      (state.iterations() * kNumElements);
+  state.SetItemsProcessed(state.iterations() * kNumElements);
+}
+
+BENCHMARK(BM_PrefetchPipeline)
+    ->UseRealTime()
+    ->Args({0, 200, 300})
+    ->Args({1, 200, 300})
+    ->Args({8, 200, 300})
+    ->Args({8, 300, 300});
+
+}  // namespace
+}  // namespace data
+}  // namespace tfrt
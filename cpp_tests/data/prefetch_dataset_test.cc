@@ -0,0 +1,229 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- prefetch_dataset_test.cc ---------------------------------*- C++ -*-===//
+//
+// This file contains unit tests for PrefetchDataset.
+//
+//===----------------------------------------------------------------------===//
+
+#include "lib/data/prefetch_dataset.h"
+
+#include <future>
+#include <numeric>
+
+#include "cpp_tests/data/dataset_test_util.h"
+#include "gtest/gtest.h"
+
+namespace tfrt {
+namespace data {
+namespace {
+
+using testing::AwaitElements;
+using testing::CreateHostContext;
+using testing::GetElements;
+using testing::IsEndOfIterator;
+using testing::MakeAsyncValues;
+using testing::MakeRange;
+using testing::MakeValuesWithErrors;
+using testing::RequestElements;
+
+// Dataset of the elements 0, ..., n - 1 whose iterator blocks in GetNext for
+// the elements after the first one until the test opens the gate.
+class GatedDataset : public Dataset<int64_t> {
+ public:
+  GatedDataset(int64_t n, HostContext* host) : n_(n), host_(host) {}
+
+  RCReference<Iterator<int64_t>> MakeIterator() override {
+    return TakeRef(host_->Construct<GatedIterator>(FormRef(this)));
+  }
+
+  bool IsBlocking() const override { return true; }
+
+  // Returns when an iterator is blocked in GetNext.
+  void AwaitBlocked() { blocked_.get_future().wait(); }
+
+  void OpenGate() { gate_.set_value(); }
+
+ private:
+  class GatedIterator : public Iterator<int64_t> {
+   public:
+    explicit GatedIterator(RCReference<GatedDataset> dataset)
+        : dataset_(std::move(dataset)) {}
+
+    AsyncValueRef<std::tuple<int64_t>> GetNext(
+        const ExecutionContext& exec_ctx) override {
+      if (index_ > 0 && !passed_gate_) {
+        dataset_->blocked_.set_value();
+        dataset_->gate_future_.wait();
+        passed_gate_ = true;
+      }
+      if (index_ == dataset_->n_) return {};
+      return dataset_->host_->MakeConcreteAsyncValueRef<std::tuple<int64_t>>(
+          index_++);
+    }
+
+   private:
+    void Destroy() override {
+      internal::DestroyImpl<GatedIterator>(this, dataset_->host_->allocator());
+    }
+
+    RCReference<GatedDataset> dataset_;
+    int64_t index_ = 0;
+    bool passed_gate_ = false;
+  };
+
+  void Destroy() override {
+    internal::DestroyImpl<GatedDataset>(this, host_->allocator());
+  }
+
+  const int64_t n_;
+  HostContext* host_;
+  std::promise<void> blocked_;
+  std::promise<void> gate_;
+  std::shared_future<void> gate_future_ = gate_.get_future().share();
+};
+
+RCReference<Dataset<int64_t>> MakePrefetch(RCReference<Dataset<int64_t>> input,
+                                           int64_t prefetch_num,
+                                           HostContext* host) {
+  return TakeRef(host->Construct<PrefetchDataset<int64_t>>(
+      std::move(input), prefetch_num, /*max_buffer_bytes=*/0, host));
+}
+
+TEST(PrefetchDatasetTest, PreservesOrder) {
+  auto host = CreateHostContext();
+  std::vector<int64_t> expected(1000);
+  std::iota(expected.begin(), expected.end(), 0);
+  for (int64_t prefetch_num : {1, 8, 2000}) {
+    auto prefetch =
+        MakePrefetch(MakeRange<int64_t>(1000, host.get()), prefetch_num,
+                     host.get());
+    auto elements = GetElements(prefetch->MakeIterator().get(), host.get());
+    ASSERT_TRUE(static_cast<bool>(elements));
+    EXPECT_EQ(*elements, expected);
+  }
+  host->Quiesce();
+}
+
+// The buffered elements keep their order even if they become available in a
+// different order.
+TEST(PrefetchDatasetTest, ElementsAvailableOutOfOrder) {
+  auto host = CreateHostContext();
+  std::vector<AsyncValueRef<std::tuple<int64_t>>> values;
+  for (int i = 0; i < 10; ++i) {
+    values.push_back(
+        host->MakeUnconstructedAsyncValueRef<std::tuple<int64_t>>());
+  }
+  auto iterator = MakePrefetch(MakeAsyncValues<int64_t>(values, host.get()),
+                               /*prefetch_num=*/4, host.get())
+                      ->MakeIterator();
+  auto requested = RequestElements(iterator.get(), 10, host.get());
+  ASSERT_EQ(requested.size(), 10);
+  for (int i = 9; i >= 0; --i) values[i].emplace(i);
+
+  auto elements = AwaitElements<int64_t>(requested, host.get());
+  ASSERT_TRUE(static_cast<bool>(elements));
+  EXPECT_EQ(*elements, std::vector<int64_t>({0, 1, 2, 3, 4, 5, 6, 7, 8, 9}));
+  EXPECT_TRUE(RequestElements(iterator.get(), 1, host.get()).empty());
+  iterator.reset();
+  host->Quiesce();
+}
+
+// An error of the input is returned in place of its element, and the
+// following elements are still returned.
+TEST(PrefetchDatasetTest, PropagatesErrors) {
+  auto host = CreateHostContext();
+  auto input = MakeAsyncValues<int64_t>(
+      MakeValuesWithErrors(20, {3, 15}, host.get()), host.get());
+  auto iterator = MakePrefetch(std::move(input), /*prefetch_num=*/4, host.get())
+                      ->MakeIterator();
+  auto values = RequestElements(iterator.get(), testing::kAll, host.get());
+  // The values requested while the producer read the end of the input are
+  // resolved to the end of the iterator.
+  for (const auto& value : values) host->Await(value.CopyRCRef());
+  while (!values.empty() && IsEndOfIterator(values.back())) values.pop_back();
+  ASSERT_EQ(values.size(), 20);
+  for (int64_t i = 0; i < 20; ++i) {
+    if (i == 3 || i == 15) {
+      ASSERT_TRUE(values[i].IsError());
+      EXPECT_EQ(values[i].GetError().message, StrCat("error ", i));
+    } else {
+      ASSERT_FALSE(values[i].IsError());
+      EXPECT_EQ(std::get<0>(values[i].get()), i);
+    }
+  }
+  iterator.reset();
+  host->Quiesce();
+}
+
+// The iterator keeps returning the end of input, and releasing it early stops
+// the background producer.
+TEST(PrefetchDatasetTest, EndOfInput) {
+  auto host = CreateHostContext();
+  auto prefetch = MakePrefetch(MakeRange<int64_t>(5, host.get()),
+                               /*prefetch_num=*/8, host.get());
+  auto iterator = prefetch->MakeIterator();
+  auto elements = GetElements(iterator.get(), host.get());
+  ASSERT_TRUE(static_cast<bool>(elements));
+  EXPECT_EQ(elements->size(), 5);
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_TRUE(RequestElements(iterator.get(), 1, host.get()).empty());
+  }
+
+  auto partial = prefetch->MakeIterator();
+  elements = GetElements(partial.get(), host.get(), /*num_elements=*/2);
+  ASSERT_TRUE(static_cast<bool>(elements));
+  EXPECT_EQ(*elements, std::vector<int64_t>({0, 1}));
+  partial.reset();
+  iterator.reset();
+  host->Quiesce();
+}
+
+// GetNext does not wait for the producer reading from the input. It returns
+// values that are forwarded to the elements that the producer reads, or to
+// the end of the iterator.
+TEST(PrefetchDatasetTest, ForwardsPendingResults) {
+  auto host = CreateHostContext();
+  auto gated = TakeRef(host->Construct<GatedDataset>(3, host.get()));
+  auto iterator = MakePrefetch(gated.CopyRef(), /*prefetch_num=*/4, host.get())
+                      ->MakeIterator();
+  // The first element is read inline and starts the producer, which blocks on
+  // the second one.
+  auto elements = GetElements(iterator.get(), host.get(), 1);
+  ASSERT_TRUE(static_cast<bool>(elements));
+  EXPECT_EQ(*elements, std::vector<int64_t>({0}));
+  gated->AwaitBlocked();
+
+  auto values = RequestElements(iterator.get(), 4, host.get());
+  ASSERT_EQ(values.size(), 4);
+  for (const auto& value : values) EXPECT_FALSE(value.IsAvailable());
+
+  gated->OpenGate();
+  for (const auto& value : values) host->Await(value.CopyRCRef());
+  for (int i : {0, 1}) {
+    ASSERT_FALSE(values[i].IsError()) << values[i].GetError().message;
+    EXPECT_EQ(std::get<0>(values[i].get()), i + 1);
+  }
+  for (int i : {2, 3}) EXPECT_TRUE(IsEndOfIterator(values[i]));
+  EXPECT_TRUE(RequestElements(iterator.get(), 1, host.get()).empty());
+  iterator.reset();
+  host->Quiesce();
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tfrt
@@ -0,0 +1,306 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- shard_dataset_test.cc ------------------------------------*- C++ -*-===//
+//
+// This file contains unit tests for ShardDataset and for the datasets that
+// shard themselves with Dataset::MakeShard.
+//
+//===----------------------------------------------------------------------===//
+
+#include "lib/data/shard_dataset.h"
+
+#include <zlib.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "cpp_tests/data/dataset_test_util.h"
+#include "gtest/gtest.h"
+#include "lib/data/map_dataset.h"
+#include "lib/data/tf_record_dataset.h"
+#include "lib/data/tf_record_index.h"
+#include "tfrt/support/crc32c.h"
+
+namespace tfrt {
+namespace data {
+namespace {
+
+using testing::CreateHostContext;
+using testing::GetElements;
+using testing::MakeAsyncValues;
+using testing::MakeSlice;
+using testing::TestFunction;
+
+using Compression = TFRecordReader::Compression;
+
+// Returns the elements of `elements` whose index modulo `num_shards` is
+// `index`.
+template <typename T>
+std::vector<T> ShardOf(const std::vector<T>& elements, int64_t num_shards,
+                       int64_t index) {
+  std::vector<T> shard;
+  for (size_t i = index; i < elements.size(); i += num_shards) {
+    shard.push_back(elements[i]);
+  }
+  return shard;
+}
+
+// Expects every shard of `dataset` for 1 to 4 and 7 shards to have the
+// elements of ShardOf `elements`. `make_shard` returns the shard of a
+// dataset.
+template <typename T, typename F>
+void ExpectShards(Dataset<T>* dataset, const std::vector<T>& elements,
+                  F make_shard, HostContext* host) {
+  for (int64_t num_shards : {1, 2, 3, 4, 7}) {
+    for (int64_t index = 0; index < num_shards; ++index) {
+      auto shard = make_shard(dataset, num_shards, index);
+      ASSERT_TRUE(shard);
+      auto shard_elements = GetElements(shard->MakeIterator().get(), host);
+      ASSERT_TRUE(static_cast<bool>(shard_elements));
+      EXPECT_EQ(*shard_elements, ShardOf(elements, num_shards, index))
+          << "shard " << index << " of " << num_shards;
+    }
+  }
+}
+
+template <typename T>
+RCReference<Dataset<T>> MakeShard(Dataset<T>* dataset, int64_t num_shards,
+                                  int64_t index) {
+  return dataset->MakeShard(num_shards, index);
+}
+
+// A shard of a shard is the shard of the input with the product of their
+// numbers of shards.
+template <typename T>
+RCReference<Dataset<T>> MakeShardOfShard(Dataset<T>* dataset,
+                                         int64_t num_shards, int64_t index) {
+  auto shard = dataset->MakeShard(2, 1);
+  if (!shard) return {};
+  return shard->MakeShard(num_shards, index);
+}
+
+// Returns the shards of a shard like MakeShardOfShard, but for the input of
+// ShardOf.
+template <typename T>
+std::vector<T> ShardOfShard(const std::vector<T>& elements, int64_t num_shards,
+                            int64_t index) {
+  return ShardOf(ShardOf(elements, 2, 1), num_shards, index);
+}
+
+template <typename T>
+RCReference<Dataset<T>> MakeShardDataset(Dataset<T>* dataset,
+                                         int64_t num_shards, int64_t index,
+                                         HostContext* host) {
+  return TakeRef(host->Construct<ShardDataset<T>>(FormRef(dataset), num_shards,
+                                                  index, host));
+}
+
+TEST(ShardDatasetTest, Range) {
+  auto host = CreateHostContext();
+  auto range =
+      TakeRef(host->Construct<RangeDataset<int64_t>>(3, 40, 2, host.get()));
+  std::vector<int64_t> elements;
+  for (int64_t i = 3; i < 40; i += 2) elements.push_back(i);
+  ExpectShards<int64_t>(range.get(), elements, MakeShard<int64_t>, host.get());
+  host->Quiesce();
+}
+
+TEST(ShardDatasetTest, Slice) {
+  auto host = CreateHostContext();
+  std::vector<std::string> elements;
+  for (int i = 0; i < 10; ++i) elements.push_back("file " + std::to_string(i));
+  auto slice = MakeSlice(elements, host.get());
+  ExpectShards<std::string>(slice.get(), elements, MakeShard<std::string>,
+                            host.get());
+  host->Quiesce();
+}
+
+// Datasets that cannot shard themselves are sharded by ShardDataset, which
+// produces and discards the elements of the other shards.
+TEST(ShardDatasetTest, ShardDataset) {
+  auto host = CreateHostContext();
+  std::vector<AsyncValueRef<std::tuple<int64_t>>> values;
+  std::vector<int64_t> elements;
+  for (int64_t i = 0; i < 10; ++i) {
+    values.push_back(
+        host->MakeConcreteAsyncValueRef<std::tuple<int64_t>>(i * 10));
+    elements.push_back(i * 10);
+  }
+  auto input = MakeAsyncValues<int64_t>(values, host.get());
+  EXPECT_FALSE(input->MakeShard(2, 0));
+  ExpectShards<int64_t>(
+      input.get(), elements,
+      [&](Dataset<int64_t>* dataset, int64_t num_shards, int64_t index) {
+        return MakeShardDataset(dataset, num_shards, index, host.get());
+      },
+      host.get());
+  host->Quiesce();
+}
+
+// The shard of a map is the map of the shard of its input, which only calls
+// the map function on the elements of the shard.
+TEST(ShardDatasetTest, Map) {
+  auto host = CreateHostContext();
+  std::atomic<int> num_calls{0};
+  TestFunction<int64_t, int64_t> fn([&](int64_t x) {
+    ++num_calls;
+    return x * x;
+  });
+  auto map =
+      TakeRef(host->Construct<
+              MapDataset<std::tuple<int64_t>, std::tuple<int64_t>>>(
+          testing::MakeRange<int64_t>(20, host.get()),
+          RCArray<AsyncValue>(ArrayRef<AsyncValue*>()), fn.Ref(), host.get()));
+  auto shard = map->MakeShard(3, 1);
+  ASSERT_TRUE(shard);
+  auto elements = GetElements(shard->MakeIterator().get(), host.get());
+  ASSERT_TRUE(static_cast<bool>(elements));
+  EXPECT_EQ(*elements,
+            std::vector<int64_t>({1, 16, 49, 100, 169, 256, 361}));
+  EXPECT_EQ(num_calls, 7);
+  host->Quiesce();
+}
+
+TEST(ShardDatasetTest, ComposedShards) {
+  auto host = CreateHostContext();
+  std::vector<int64_t> elements;
+  std::vector<AsyncValueRef<std::tuple<int64_t>>> values;
+  for (int64_t i = 0; i < 30; ++i) {
+    elements.push_back(i);
+    values.push_back(host->MakeConcreteAsyncValueRef<std::tuple<int64_t>>(i));
+  }
+  auto range = testing::MakeRange<int64_t>(30, host.get());
+  auto slice = MakeSlice(elements, host.get());
+  auto shard_input = MakeAsyncValues<int64_t>(values, host.get());
+  for (int64_t num_shards : {1, 2, 3, 4}) {
+    for (int64_t index = 0; index < num_shards; ++index) {
+      const auto expected = ShardOfShard(elements, num_shards, index);
+      for (auto* dataset : {range.get(), slice.get()}) {
+        auto shard = MakeShardOfShard(dataset, num_shards, index);
+        ASSERT_TRUE(shard);
+        auto actual = GetElements(shard->MakeIterator().get(), host.get());
+        ASSERT_TRUE(static_cast<bool>(actual));
+        EXPECT_EQ(*actual, expected);
+      }
+
+      auto shard = MakeShardDataset(shard_input.get(), 2, 1, host.get())
+                       ->MakeShard(num_shards, index);
+      ASSERT_TRUE(shard);
+      auto actual = GetElements(shard->MakeIterator().get(), host.get());
+      ASSERT_TRUE(static_cast<bool>(actual));
+      EXPECT_EQ(*actual, expected);
+    }
+  }
+  host->Quiesce();
+}
+
+std::string GetTestPath(const std::string& name) {
+  const char* tmp_dir = std::getenv("TEST_TMPDIR");
+  return std::string(tmp_dir ? tmp_dir : "/tmp") + "/shard_dataset_test." +
+         name;
+}
+
+std::vector<std::string> MakeRecords(int64_t num_records) {
+  std::vector<std::string> records;
+  for (int64_t i = 0; i < num_records; ++i) {
+    records.push_back(std::to_string(i) + std::string(i * 37 % 300, 'a'));
+  }
+  return records;
+}
+
+// Writes the records to a TFRecord file, ZLIB compressed if `compression` is
+// kZlib.
+std::string WriteRecords(const std::string& name,
+                         const std::vector<std::string>& records,
+                         Compression compression) {
+  auto append_fixed = [](std::string* out, uint64_t value, size_t size) {
+    for (size_t i = 0; i < size; ++i) out->push_back((value >> (8 * i)) & 0xff);
+  };
+  std::string data;
+  for (const auto& record : records) {
+    std::string header;
+    append_fixed(&header, record.size(), sizeof(uint64_t));
+    append_fixed(&header, crc32c::Mask(crc32c::Value(header.data(), 8)),
+                 sizeof(uint32_t));
+    data += header + record;
+    append_fixed(&data,
+                 crc32c::Mask(crc32c::Value(record.data(), record.size())),
+                 sizeof(uint32_t));
+  }
+  if (compression == Compression::kZlib) {
+    uLongf size = compressBound(data.size());
+    std::string compressed(size, '\0');
+    EXPECT_EQ(compress(reinterpret_cast<Bytef*>(&compressed[0]), &size,
+                       reinterpret_cast<const Bytef*>(data.data()),
+                       data.size()),
+              Z_OK);
+    compressed.resize(size);
+    data = std::move(compressed);
+  }
+
+  const std::string path = GetTestPath(name);
+  std::ofstream out(path, std::ios_base::binary | std::ios_base::trunc);
+  out.write(data.data(), data.size());
+  std::remove(TFRecordIndex::GetIndexPath(path).c_str());
+  return path;
+}
+
+// The shards of an uncompressed file seek to their records with the index of
+// the file, read sequentially or in parallel. The shards of a compressed file
+// have no index, and skip the records of the other shards.
+TEST(ShardDatasetTest, TFRecord) {
+  auto host = CreateHostContext();
+  const auto records = MakeRecords(25);
+  struct Config {
+    Compression compression;
+    int64_t num_parallel_reads;
+    bool indexed;
+  };
+  for (const Config& config : {Config{Compression::kNone, 1, true},
+                               Config{Compression::kNone, 3, true},
+                               Config{Compression::kZlib, 1, false}}) {
+    const std::string path = WriteRecords("tf_record", records,
+                                          config.compression);
+    auto dataset = TakeRef(host->Construct<TFRecordDataset>(
+        path, config.num_parallel_reads, config.compression, host.get()));
+    ExpectShards<std::string>(dataset.get(), records, MakeShard<std::string>,
+                              host.get());
+    for (int64_t num_shards : {1, 2, 3}) {
+      for (int64_t index = 0; index < num_shards; ++index) {
+        auto shard = MakeShardOfShard<std::string>(dataset.get(), num_shards,
+                                                   index);
+        auto actual = GetElements(shard->MakeIterator().get(), host.get());
+        ASSERT_TRUE(static_cast<bool>(actual));
+        EXPECT_EQ(*actual, ShardOfShard(records, num_shards, index));
+      }
+    }
+
+    std::ifstream index_file(TFRecordIndex::GetIndexPath(path));
+    EXPECT_EQ(static_cast<bool>(index_file), config.indexed);
+    std::remove(TFRecordIndex::GetIndexPath(path).c_str());
+    std::remove(path.c_str());
+  }
+  host->Quiesce();
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tfrt
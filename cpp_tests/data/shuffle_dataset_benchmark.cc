@@ -0,0 +1,88 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- shuffle_dataset_benchmark.cc ---------------------------------------===//
+//
+// Benchmark for the per-element cost of ShuffleDataset.
+//
+//===----------------------------------------------------------------------===//
+
+#include "benchmark/benchmark.h"
+#include "lib/data/range_dataset.h"
+#include "lib/data/shuffle_dataset.h"
+#include "tfrt/host_context/concurrent_work_queue.h"
+#include "tfrt/host_context/host_allocator.h"
+#include "tfrt/host_context/host_context.h"
+
+namespace tfrt {
+namespace data {
+namespace {
+
+constexpr int64_t kNumElements = 1 << 20;
+
+std::unique_ptr<HostContext> CreateHostContext() {
+  auto decoded_diagnostic_handler = [&](const DecodedDiagnostic& diag) {
+    abort();
+  };
+  return std::make_unique<HostContext>(decoded_diagnostic_handler,
+                                       CreateMallocAllocator(),
+                                       CreateMultiThreadedWorkQueue(1, 1));
+}
+
+void RunIterator(Dataset<int64_t>* dataset, const ExecutionContext& exec_ctx,
+                 benchmark::State& state) {
+  for (auto _ : state) {
+    auto iterator = dataset->MakeIterator();
+    while (auto value = iterator->GetNext(exec_ctx)) {
+      benchmark::DoNotOptimize(std::get<0>(value.get()));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kNumElements);
+}
+
+// Baseline without shuffling.
+void BM_Range(benchmark::State& state) {
+  auto host = CreateHostContext();
+  ExecutionContext exec_ctx(host.get());
+  auto range = TakeRef(host->Construct<RangeDataset<int64_t>>(
+      0, kNumElements, 1, host.get()));
+  RunIterator(range.get(), exec_ctx, state);
+}
+
+BENCHMARK(BM_Range)->Unit(benchmark::kMillisecond);
+
+// Argument: the shuffle buffer size.
+void BM_Shuffle(benchmark::State& state) {
+  auto host = CreateHostContext();
+  ExecutionContext exec_ctx(host.get());
+  auto range = TakeRef(host->Construct<RangeDataset<int64_t>>(
+      0, kNumElements, 1, host.get()));
+  auto shuffle = TakeRef(host->Construct<ShuffleDataset<int64_t>>(
+      std::move(range), state.range(0), /*seed=*/1,
+      /*reshuffle_each_iteration=*/true, host.get()));
+  RunIterator(shuffle.get(), exec_ctx, state);
+}
+
+BENCHMARK(BM_Shuffle)
+    ->ArgNames({"buffer_size"})
+    ->Arg(1 << 10)
+    ->Arg(1 << 16)
+    ->Arg(1 << 20)
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+}  // namespace data
+}  // namespace tfrt
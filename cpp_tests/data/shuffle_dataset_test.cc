@@ -0,0 +1,136 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- shuffle_dataset_test.cc ----------------------------------*- C++ -*-===//
+//
+// This file contains unit tests for ShuffleDataset.
+//
+//===----------------------------------------------------------------------===//
+
+#include "lib/data/shuffle_dataset.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "cpp_tests/data/dataset_test_util.h"
+#include "gtest/gtest.h"
+#include "lib/data/repeat_dataset.h"
+
+namespace tfrt {
+namespace data {
+namespace {
+
+using testing::CreateHostContext;
+using testing::GetElements;
+using testing::MakeRange;
+
+constexpr int64_t kNumElements = 100;
+
+RCReference<Dataset<int64_t>> MakeShuffle(int64_t buffer_size, int64_t seed,
+                                          bool reshuffle_each_iteration,
+                                          HostContext* host) {
+  return TakeRef(host->Construct<ShuffleDataset<int64_t>>(
+      MakeRange<int64_t>(kNumElements, host), buffer_size, seed,
+      reshuffle_each_iteration, host));
+}
+
+std::vector<int64_t> GetAll(Dataset<int64_t>* dataset, HostContext* host) {
+  auto elements = GetElements(dataset->MakeIterator().get(), host);
+  EXPECT_TRUE(static_cast<bool>(elements));
+  if (!elements) {
+    llvm::consumeError(elements.takeError());
+    return {};
+  }
+  return std::move(*elements);
+}
+
+std::vector<int64_t> Sorted(std::vector<int64_t> elements) {
+  std::sort(elements.begin(), elements.end());
+  return elements;
+}
+
+// Every iterator returns a permutation of the input, in which an element is
+// at most `buffer_size - 1` positions ahead of its input position.
+TEST(ShuffleDatasetTest, ReturnsPermutation) {
+  auto host = CreateHostContext();
+  std::vector<int64_t> range(kNumElements);
+  std::iota(range.begin(), range.end(), 0);
+
+  for (int64_t buffer_size : {1, 2, 10, 1000}) {
+    auto shuffle = MakeShuffle(buffer_size, /*seed=*/7,
+                               /*reshuffle_each_iteration=*/false, host.get());
+    std::vector<int64_t> elements = GetAll(shuffle.get(), host.get());
+    EXPECT_EQ(Sorted(elements), range);
+    for (int64_t i = 0; i < kNumElements; ++i) {
+      EXPECT_LT(elements[i], i + buffer_size);
+    }
+    if (buffer_size == 1) {
+      EXPECT_EQ(elements, range);
+    } else {
+      EXPECT_NE(elements, range);
+    }
+  }
+  host->Quiesce();
+}
+
+TEST(ShuffleDatasetTest, SameSeedSameOrder) {
+  auto host = CreateHostContext();
+  auto shuffle = MakeShuffle(/*buffer_size=*/16, /*seed=*/42,
+                             /*reshuffle_each_iteration=*/false, host.get());
+  std::vector<int64_t> first = GetAll(shuffle.get(), host.get());
+  // Another iterator and another dataset with the same seed.
+  EXPECT_EQ(GetAll(shuffle.get(), host.get()), first);
+  auto other = MakeShuffle(/*buffer_size=*/16, /*seed=*/42,
+                           /*reshuffle_each_iteration=*/false, host.get());
+  EXPECT_EQ(GetAll(other.get(), host.get()), first);
+  // A different seed gives a different order.
+  auto different = MakeShuffle(/*buffer_size=*/16, /*seed=*/43,
+                               /*reshuffle_each_iteration=*/false, host.get());
+  EXPECT_NE(GetAll(different.get(), host.get()), first);
+  host->Quiesce();
+}
+
+// With reshuffle_each_iteration, every epoch of a repeat is a different
+// permutation of the input.
+TEST(ShuffleDatasetTest, ReshufflesBetweenEpochs) {
+  auto host = CreateHostContext();
+  for (bool reshuffle : {false, true}) {
+    auto repeat = TakeRef(host->Construct<RepeatDataset<int64_t>>(
+        MakeShuffle(/*buffer_size=*/32, /*seed=*/5, reshuffle, host.get()),
+        /*epochs=*/3, host.get()));
+    std::vector<int64_t> elements = GetAll(repeat.get(), host.get());
+    ASSERT_EQ(elements.size(), 3 * kNumElements);
+
+    std::vector<std::vector<int64_t>> epochs;
+    for (int i = 0; i < 3; ++i) {
+      epochs.emplace_back(elements.begin() + i * kNumElements,
+                          elements.begin() + (i + 1) * kNumElements);
+      EXPECT_EQ(Sorted(epochs.back()), Sorted(epochs.front()));
+    }
+    if (reshuffle) {
+      EXPECT_NE(epochs[0], epochs[1]);
+      EXPECT_NE(epochs[1], epochs[2]);
+    } else {
+      EXPECT_EQ(epochs[0], epochs[1]);
+      EXPECT_EQ(epochs[1], epochs[2]);
+    }
+  }
+  host->Quiesce();
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tfrt
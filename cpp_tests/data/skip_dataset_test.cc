@@ -0,0 +1,107 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- skip_dataset_test.cc -------------------------------------*- C++ -*-===//
+//
+// This file contains unit tests for SkipDataset.
+//
+//===----------------------------------------------------------------------===//
+
+#include "lib/data/skip_dataset.h"
+
+#include <vector>
+
+#include "cpp_tests/data/dataset_test_util.h"
+#include "gtest/gtest.h"
+
+namespace tfrt {
+namespace data {
+namespace {
+
+using testing::CreateHostContext;
+using testing::GetElements;
+using testing::MakeAsyncValues;
+using testing::MakeRange;
+using testing::MakeSlice;
+using testing::MakeValuesWithErrors;
+using testing::RequestElements;
+
+RCReference<Dataset<int64_t>> MakeSkip(RCReference<Dataset<int64_t>> input,
+                                       int64_t count, HostContext* host) {
+  return TakeRef(
+      host->Construct<SkipDataset<int64_t>>(std::move(input), count, host));
+}
+
+std::vector<int64_t> Range(int64_t start, int64_t stop) {
+  std::vector<int64_t> range;
+  for (int64_t i = start; i < stop; ++i) range.push_back(i);
+  return range;
+}
+
+// A negative count skips all the elements. Ranges and slices skip their
+// elements in a single batch, and the other inputs one at a time.
+TEST(SkipDatasetTest, Count) {
+  auto host = CreateHostContext();
+  std::vector<AsyncValueRef<std::tuple<int64_t>>> values;
+  for (int64_t i = 0; i < 10; ++i) {
+    values.push_back(host->MakeConcreteAsyncValueRef<std::tuple<int64_t>>(i));
+  }
+  for (int64_t count : {0, 1, 5, 10, 20, -1}) {
+    const auto expected = count < 0
+                              ? std::vector<int64_t>()
+                              : Range(std::min<int64_t>(count, 10), 10);
+    RCReference<Dataset<int64_t>> inputs[] = {
+        MakeRange<int64_t>(10, host.get()), MakeSlice(Range(0, 10), host.get()),
+        MakeAsyncValues<int64_t>(values, host.get())};
+    for (auto& input : inputs) {
+      auto skip = MakeSkip(std::move(input), count, host.get());
+      auto elements = GetElements(skip->MakeIterator().get(), host.get());
+      ASSERT_TRUE(static_cast<bool>(elements));
+      EXPECT_EQ(*elements, expected) << "count " << count;
+    }
+  }
+  host->Quiesce();
+}
+
+// The skipped errors that are available are returned, and count as skipped
+// elements. The errors after the skipped elements are returned in order.
+TEST(SkipDatasetTest, Errors) {
+  auto host = CreateHostContext();
+  auto values = MakeValuesWithErrors(10, {1, 6}, host.get());
+  auto skip = MakeSkip(MakeAsyncValues<int64_t>(values, host.get()), 3,
+                       host.get());
+  auto iterator = skip->MakeIterator();
+  auto elements = RequestElements(iterator.get(), testing::kAll, host.get());
+  const std::vector<int64_t> expected = {-1, 3, 4, 5, -6, 7, 8, 9};
+  ASSERT_EQ(elements.size(), expected.size());
+  for (size_t i = 0; i < elements.size(); ++i) {
+    host->Await(elements[i].CopyRCRef());
+    if (expected[i] < 0) {
+      ASSERT_TRUE(elements[i].IsError()) << "element " << i;
+      EXPECT_EQ(elements[i].GetError().message,
+                StrCat("error ", -expected[i]));
+    } else {
+      ASSERT_FALSE(elements[i].IsError()) << elements[i].GetError().message;
+      EXPECT_EQ(std::get<0>(elements[i].get()), expected[i]);
+    }
+  }
+  iterator.reset();
+  host->Quiesce();
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tfrt
@@ -0,0 +1,142 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- take_dataset_test.cc -------------------------------------*- C++ -*-===//
+//
+// This file contains unit tests for TakeDataset.
+//
+//===----------------------------------------------------------------------===//
+
+#include "lib/data/take_dataset.h"
+
+#include <vector>
+
+#include "cpp_tests/data/dataset_test_util.h"
+#include "gtest/gtest.h"
+
+namespace tfrt {
+namespace data {
+namespace {
+
+using testing::CreateHostContext;
+using testing::GetElements;
+using testing::MakeRange;
+
+// Dataset of the elements of its input, which counts the iterators that are
+// not destroyed yet.
+class CountingDataset : public Dataset<int64_t> {
+ public:
+  CountingDataset(RCReference<Dataset<int64_t>> input, HostContext* host)
+      : input_(std::move(input)), host_(host) {}
+
+  RCReference<Iterator<int64_t>> MakeIterator() override {
+    return TakeRef(host_->Construct<CountingIterator>(FormRef(this)));
+  }
+
+  int num_iterators() const { return num_iterators_; }
+
+ private:
+  class CountingIterator : public Iterator<int64_t> {
+   public:
+    explicit CountingIterator(RCReference<CountingDataset> dataset)
+        : dataset_(std::move(dataset)),
+          input_(dataset_->input_->MakeIterator()) {
+      ++dataset_->num_iterators_;
+    }
+
+    AsyncValueRef<std::tuple<int64_t>> GetNext(
+        const ExecutionContext& exec_ctx) override {
+      return input_->GetNext(exec_ctx);
+    }
+
+   private:
+    void Destroy() override {
+      --dataset_->num_iterators_;
+      internal::DestroyImpl<CountingIterator>(this,
+                                              dataset_->host_->allocator());
+    }
+
+    RCReference<CountingDataset> dataset_;
+    RCReference<Iterator<int64_t>> input_;
+  };
+
+  void Destroy() override {
+    internal::DestroyImpl<CountingDataset>(this, host_->allocator());
+  }
+
+  RCReference<Dataset<int64_t>> input_;
+  HostContext* host_;
+  int num_iterators_ = 0;
+};
+
+RCReference<Dataset<int64_t>> MakeTake(RCReference<Dataset<int64_t>> input,
+                                       int64_t count, HostContext* host) {
+  return TakeRef(
+      host->Construct<TakeDataset<int64_t>>(std::move(input), count, host));
+}
+
+std::vector<int64_t> Range(int64_t stop) {
+  std::vector<int64_t> range;
+  for (int64_t i = 0; i < stop; ++i) range.push_back(i);
+  return range;
+}
+
+// A negative count takes all the elements.
+TEST(TakeDatasetTest, Count) {
+  auto host = CreateHostContext();
+  for (int64_t count : {0, 1, 5, 10, 20, -1}) {
+    auto take = MakeTake(MakeRange<int64_t>(10, host.get()), count, host.get());
+    auto elements = GetElements(take->MakeIterator().get(), host.get());
+    ASSERT_TRUE(static_cast<bool>(elements));
+    EXPECT_EQ(*elements, Range(count < 0 ? 10 : std::min<int64_t>(count, 10)))
+        << "count " << count;
+  }
+  host->Quiesce();
+}
+
+// The input iterator is released as soon as the last element is returned, or
+// the input reaches end, and not created at all if the count is 0.
+TEST(TakeDatasetTest, ReleasesInputIterator) {
+  auto host = CreateHostContext();
+  ExecutionContext exec_ctx(host.get());
+  auto input = TakeRef(host->Construct<CountingDataset>(
+      MakeRange<int64_t>(10, host.get()), host.get()));
+
+  auto iterator = MakeTake(input.CopyRef(), 3, host.get())->MakeIterator();
+  EXPECT_EQ(input->num_iterators(), 1);
+  auto elements = GetElements(iterator.get(), host.get(), 3);
+  ASSERT_TRUE(static_cast<bool>(elements));
+  EXPECT_EQ(*elements, Range(3));
+  EXPECT_EQ(input->num_iterators(), 0);
+  EXPECT_FALSE(iterator->GetNext(exec_ctx));
+
+  iterator = MakeTake(input.CopyRef(), -1, host.get())->MakeIterator();
+  elements = GetElements(iterator.get(), host.get(), 10);
+  ASSERT_TRUE(static_cast<bool>(elements));
+  EXPECT_EQ(input->num_iterators(), 1);
+  EXPECT_FALSE(iterator->GetNext(exec_ctx));
+  EXPECT_EQ(input->num_iterators(), 0);
+
+  iterator = MakeTake(input.CopyRef(), 0, host.get())->MakeIterator();
+  EXPECT_EQ(input->num_iterators(), 0);
+  EXPECT_FALSE(iterator->GetNext(exec_ctx));
+  iterator.reset();
+  host->Quiesce();
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tfrt
@@ -0,0 +1,187 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- tf_record_reader_benchmark.cc --------------------------------------===//
+//
+// Throughput benchmarks for TFRecordReader and CRC32C. The benchmark file is
+// written once per record size, so reads are mostly served from the page
+// cache, and the reported bytes per second is the cost of the reader itself.
+//
+//===----------------------------------------------------------------------===//
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include "benchmark/benchmark.h"
+#include "lib/data/tf_record_dataset.h"
+#include "lib/data/tf_record_index.h"
+#include "lib/data/tf_record_reader.h"
+#include "tfrt/host_context/concurrent_work_queue.h"
+#include "tfrt/host_context/host_allocator.h"
+#include "tfrt/host_context/host_context.h"
+#include "tfrt/support/crc32c.h"
+
+namespace tfrt {
+namespace data {
+namespace {
+
+constexpr int64_t kFileSize = int64_t{2} << 30;
+
+void AppendFixed(std::string* out, uint64_t value, size_t size) {
+  for (size_t i = 0; i < size; ++i) out->push_back((value >> (8 * i)) & 0xff);
+}
+
+// Returns the path of a TFRecord file of about kFileSize bytes, with records
+// of `record_size` bytes. Only the file for the last record size is kept.
+const std::string& GetTestFile(int64_t record_size) {
+  struct TestFile {
+    ~TestFile() { Remove(); }
+    void Remove() {
+      if (path.empty()) return;
+      std::remove(path.c_str());
+      std::remove(TFRecordIndex::GetIndexPath(path).c_str());
+    }
+    std::string path;
+    int64_t record_size = 0;
+  };
+  static TestFile file;
+  if (file.record_size == record_size) return file.path;
+
+  file.Remove();
+  const char* tmp_dir = std::getenv("TEST_TMPDIR");
+  file.path = std::string(tmp_dir ? tmp_dir : "/tmp") +
+               "/tf_record_reader_benchmark." + std::to_string(record_size);
+  file.record_size = record_size;
+
+  std::string data(record_size, 0);
+  for (int64_t i = 0; i < record_size; ++i) data[i] = i * 31;
+  std::string record;
+  AppendFixed(&record, record_size, sizeof(uint64_t));
+  AppendFixed(&record, crc32c::Mask(crc32c::Value(record.data(), 8)),
+              sizeof(uint32_t));
+  record += data;
+  AppendFixed(&record, crc32c::Mask(crc32c::Value(data.data(), data.size())),
+              sizeof(uint32_t));
+
+  std::ofstream out(file.path, std::ios_base::binary);
+  for (int64_t written = 0; written < kFileSize; written += record.size()) {
+    out.write(record.data(), record.size());
+  }
+  return file.path;
+}
+
+std::unique_ptr<HostContext> CreateHostContext() {
+  auto decoded_diagnostic_handler = [&](const DecodedDiagnostic& diag) {
+    abort();
+  };
+  return std::make_unique<HostContext>(decoded_diagnostic_handler,
+                                       CreateMallocAllocator(),
+                                       CreateMultiThreadedWorkQueue(1, 8));
+}
+
+// Arguments: whether to use mmap, and the record size in bytes.
+void BM_TFRecordReader(benchmark::State& state) {
+  TFRecordReader::Options options;
+  options.use_mmap = state.range(0);
+  const std::string& path = GetTestFile(state.range(1));
+  auto allocator = CreateMallocAllocator();
+
+  int64_t num_bytes = 0;
+  for (auto _ : state) {
+    TFRecordReader reader(path, options, allocator.get());
+    bool eof = false;
+    while (true) {
+      auto record = reader.ReadRecord(&eof);
+      if (eof) break;
+      if (!record) {
+        state.SkipWithError("failed to read record");
+        return;
+      }
+      benchmark::DoNotOptimize(record->data.data());
+    }
+    num_bytes += reader.offset();
+  }
+  state.SetBytesProcessed(num_bytes);
+}
+
+BENCHMARK(BM_TFRecordReader)
+    ->ArgNames({"mmap", "record_size"})
+    ->Args({1, 1 << 10})
+    ->Args({0, 1 << 10})
+    ->Args({1, 100 << 10})
+    ->Args({0, 100 << 10})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Reads the records through TFRecordDataset, which copies them into strings.
+// Arguments: the record size in bytes, and the number of chunks of the file
+// read in parallel. The index of the file is built before the benchmark.
+void BM_TFRecordDataset(benchmark::State& state) {
+  const std::string& path = GetTestFile(state.range(0));
+  const int64_t num_parallel_reads = state.range(1);
+  auto host = CreateHostContext();
+  ExecutionContext exec_ctx(host.get());
+  if (num_parallel_reads > 1) {
+    auto index = TFRecordIndex::Load(path, host->allocator());
+    if (!index) {
+      state.SkipWithError("failed to build the index");
+      llvm::consumeError(index.takeError());
+      return;
+    }
+  }
+  auto dataset = TakeRef(
+      host->Construct<TFRecordDataset>(path, num_parallel_reads, host.get()));
+
+  int64_t num_bytes = 0;
+  for (auto _ : state) {
+    auto iterator = dataset->MakeIterator();
+    while (auto value = iterator->GetNext(exec_ctx)) {
+      host->Await(value.CopyRCRef());
+      if (value.IsError()) {
+        state.SkipWithError("failed to read record");
+        return;
+      }
+      num_bytes += std::get<0>(value.get()).size();
+    }
+  }
+  state.SetBytesProcessed(num_bytes);
+}
+
+BENCHMARK(BM_TFRecordDataset)
+    ->ArgNames({"record_size", "num_parallel_reads"})
+    ->Args({1 << 10, 1})
+    ->Args({1 << 10, 8})
+    ->Args({100 << 10, 1})
+    ->Args({100 << 10, 8})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+void BM_Crc32c(benchmark::State& state) {
+  std::string data(state.range(0), 'x');
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(crc32c::Value(data.data(), data.size()));
+  }
+  state.SetBytesProcessed(state.iterations() * data.size());
+  state.SetLabel(crc32c::IsHardwareAccelerated() ? "hardware" : "table");
+}
+
+BENCHMARK(BM_Crc32c)->Arg(1 << 10)->Arg(1 << 20);
+
+}  // namespace
+}  // namespace data
+}  // namespace tfrt
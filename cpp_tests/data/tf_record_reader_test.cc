@@ -0,0 +1,324 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- tf_record_reader_test.cc ---------------------------------*- C++ -*-===//
+//
+// This file contains unit tests for reading ZLIB and GZIP compressed TFRecord
+// files with TFRecordReader and TFRecordDataset.
+//
+//===----------------------------------------------------------------------===//
+
+#include "lib/data/tf_record_reader.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "lib/data/tf_record_dataset.h"
+#include "lib/data/tf_record_index.h"
+#include "tfrt/host_context/concurrent_work_queue.h"
+#include "tfrt/host_context/host_allocator.h"
+#include "tfrt/host_context/host_context.h"
+#include "tfrt/support/crc32c.h"
+#include "tfrt/support/latch.h"
+
+namespace tfrt {
+namespace data {
+namespace {
+
+using Compression = TFRecordReader::Compression;
+
+std::unique_ptr<HostContext> CreateHostContext() {
+  auto decoded_diagnostic_handler = [&](const DecodedDiagnostic& diag) {
+    abort();
+  };
+  return std::make_unique<HostContext>(decoded_diagnostic_handler,
+                                       CreateMallocAllocator(),
+                                       CreateMultiThreadedWorkQueue(2, 2));
+}
+
+std::string GetTestPath(const std::string& name) {
+  const char* tmp_dir = std::getenv("TEST_TMPDIR");
+  return std::string(tmp_dir ? tmp_dir : "/tmp") + "/tf_record_reader_test." +
+         name;
+}
+
+// Returns the records of the test files. Their sizes vary so that records span
+// the blocks of the reader.
+std::vector<std::string> MakeRecords(int64_t num_records) {
+  std::vector<std::string> records;
+  for (int64_t i = 0; i < num_records; ++i) {
+    records.push_back(std::to_string(i) + std::string(i * 37 % 3000, 'a' + i));
+  }
+  return records;
+}
+
+std::string EncodeRecords(const std::vector<std::string>& records) {
+  auto append_fixed = [](std::string* out, uint64_t value, size_t size) {
+    for (size_t i = 0; i < size; ++i) out->push_back((value >> (8 * i)) & 0xff);
+  };
+  std::string encoded;
+  for (const auto& data : records) {
+    std::string header;
+    append_fixed(&header, data.size(), sizeof(uint64_t));
+    append_fixed(&header, crc32c::Mask(crc32c::Value(header.data(), 8)),
+                 sizeof(uint32_t));
+    encoded += header;
+    encoded += data;
+    append_fixed(&encoded,
+                 crc32c::Mask(crc32c::Value(data.data(), data.size())),
+                 sizeof(uint32_t));
+  }
+  return encoded;
+}
+
+std::string Compress(const std::string& data, Compression compression) {
+  z_stream stream = {};
+  const int window_bits =
+      compression == Compression::kGzip ? MAX_WBITS + 16 : MAX_WBITS;
+  EXPECT_EQ(deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                         window_bits, 8, Z_DEFAULT_STRATEGY),
+            Z_OK);
+  std::string compressed(deflateBound(&stream, data.size()), '\0');
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  stream.avail_in = data.size();
+  stream.next_out = reinterpret_cast<Bytef*>(&compressed[0]);
+  stream.avail_out = compressed.size();
+  EXPECT_EQ(deflate(&stream, Z_FINISH), Z_STREAM_END);
+  compressed.resize(stream.total_out);
+  deflateEnd(&stream);
+  return compressed;
+}
+
+std::string WriteFile(const std::string& name, const std::string& data) {
+  const std::string path = GetTestPath(name);
+  std::ofstream out(path, std::ios_base::binary | std::ios_base::trunc);
+  out.write(data.data(), data.size());
+  return path;
+}
+
+// Small blocks, so that the records span blocks and the ring wraps around.
+TFRecordReader::Options SmallBlockOptions(Compression compression,
+                                          HostContext* host) {
+  TFRecordReader::Options options;
+  options.block_size = 4096;
+  options.compression = compression;
+  options.host = host;
+  return options;
+}
+
+// Reads the records of the reader until the end of file, and records their
+// offsets.
+std::vector<std::string> ReadAll(TFRecordReader* reader,
+                                 std::vector<uint64_t>* offsets = nullptr) {
+  std::vector<std::string> records;
+  while (true) {
+    if (offsets) offsets->push_back(reader->offset());
+    bool eof = false;
+    auto record = reader->ReadRecord(&eof);
+    if (eof) break;
+    if (!record) {
+      ADD_FAILURE() << llvm::toString(record.takeError());
+      break;
+    }
+    records.push_back(record->data.str());
+  }
+  return records;
+}
+
+TEST(TFRecordReaderTest, ReadCompressedFile) {
+  auto host = CreateHostContext();
+  const auto records = MakeRecords(200);
+  for (auto compression : {Compression::kZlib, Compression::kGzip}) {
+    const std::string path =
+        WriteFile("compressed", Compress(EncodeRecords(records), compression));
+    for (HostContext* inflate_host : {static_cast<HostContext*>(nullptr),
+                                      host.get()}) {
+      TFRecordReader reader(path, SmallBlockOptions(compression, inflate_host),
+                            host->allocator());
+      EXPECT_EQ(ReadAll(&reader), records);
+    }
+    std::remove(path.c_str());
+  }
+  host->Quiesce();
+}
+
+// The blocks are inflated by the reader while the blocking work queue has not
+// started the inflate task, e.g. because its only thread is busy.
+TEST(TFRecordReaderTest, ReadCompressedFileWithBusyBlockingQueue) {
+  auto host = std::make_unique<HostContext>(
+      [](const DecodedDiagnostic&) { abort(); }, CreateMallocAllocator(),
+      CreateMultiThreadedWorkQueue(/*num_threads=*/1,
+                                   /*num_blocking_threads=*/1));
+  latch release(1);
+  ASSERT_TRUE(host->EnqueueBlockingWork([&release]() { release.wait(); }));
+
+  const auto records = MakeRecords(100);
+  const std::string path = WriteFile(
+      "busy_queue", Compress(EncodeRecords(records), Compression::kZlib));
+  {
+    TFRecordReader reader(path, SmallBlockOptions(Compression::kZlib,
+                                                  host.get()),
+                          host->allocator());
+    EXPECT_EQ(ReadAll(&reader), records);
+  }
+  release.count_down();
+  std::remove(path.c_str());
+  host->Quiesce();
+}
+
+TEST(TFRecordReaderTest, ReadConcatenatedGzipMembers) {
+  auto host = CreateHostContext();
+  const auto records = MakeRecords(100);
+  const std::vector<std::string> first(records.begin(), records.begin() + 40);
+  const std::vector<std::string> second(records.begin() + 40, records.end());
+  const std::string path =
+      WriteFile("members", Compress(EncodeRecords(first), Compression::kGzip) +
+                               Compress(EncodeRecords(second),
+                                        Compression::kGzip));
+  TFRecordReader reader(path, SmallBlockOptions(Compression::kGzip, host.get()),
+                        host->allocator());
+  EXPECT_EQ(ReadAll(&reader), records);
+  std::remove(path.c_str());
+  host->Quiesce();
+}
+
+TEST(TFRecordReaderTest, SeekInCompressedFile) {
+  auto host = CreateHostContext();
+  const auto records = MakeRecords(200);
+  const std::string path = WriteFile(
+      "seek", Compress(EncodeRecords(records), Compression::kGzip));
+  TFRecordReader reader(path, SmallBlockOptions(Compression::kGzip, host.get()),
+                        host->allocator());
+  std::vector<uint64_t> offsets;
+  ASSERT_EQ(ReadAll(&reader, &offsets), records);
+
+  // Seeking backwards inflates the file again, and seeking forwards skips the
+  // records in between.
+  for (int i : {150, 10, 120, 0, 199}) {
+    reader.Seek(offsets[i]);
+    bool eof = false;
+    auto record = reader.ReadRecord(&eof);
+    ASSERT_FALSE(eof);
+    ASSERT_TRUE(static_cast<bool>(record));
+    EXPECT_EQ(record->data.str(), records[i]);
+  }
+  bool eof = false;
+  EXPECT_FALSE(reader.SkipRecord(&eof));
+  EXPECT_TRUE(eof);
+  std::remove(path.c_str());
+  host->Quiesce();
+}
+
+TEST(TFRecordReaderTest, TruncatedCompressedFile) {
+  auto host = CreateHostContext();
+  const std::string compressed =
+      Compress(EncodeRecords(MakeRecords(100)), Compression::kZlib);
+  const std::string path =
+      WriteFile("truncated", compressed.substr(0, compressed.size() / 2));
+  TFRecordReader reader(path, SmallBlockOptions(Compression::kZlib, host.get()),
+                        host->allocator());
+  bool eof = false;
+  while (true) {
+    auto record = reader.ReadRecord(&eof);
+    ASSERT_FALSE(eof);
+    if (!record) {
+      llvm::consumeError(record.takeError());
+      break;
+    }
+  }
+  std::remove(path.c_str());
+  host->Quiesce();
+}
+
+TEST(TFRecordReaderTest, ParseCompression) {
+  auto none = TFRecordReader::ParseCompression("");
+  ASSERT_TRUE(static_cast<bool>(none));
+  EXPECT_EQ(*none, Compression::kNone);
+  auto gzip = TFRecordReader::ParseCompression("GZIP");
+  ASSERT_TRUE(static_cast<bool>(gzip));
+  EXPECT_EQ(*gzip, Compression::kGzip);
+  auto invalid = TFRecordReader::ParseCompression("LZ4");
+  EXPECT_FALSE(static_cast<bool>(invalid));
+  llvm::consumeError(invalid.takeError());
+}
+
+// Compressed files are read sequentially, even if parallel reads are
+// requested, and the shards skip the records of the other shards.
+TEST(TFRecordReaderTest, CompressedTFRecordDataset) {
+  auto host = CreateHostContext();
+  ExecutionContext exec_ctx(host.get());
+  const auto records = MakeRecords(100);
+  const std::string path = WriteFile(
+      "dataset", Compress(EncodeRecords(records), Compression::kGzip));
+  auto dataset = TakeRef(host->Construct<TFRecordDataset>(
+      path, /*num_parallel_reads=*/4, Compression::kGzip, host.get()));
+  auto shard = dataset->MakeShard(/*num_shards=*/3, /*index=*/1);
+  auto iterator = shard->MakeIterator();
+  std::vector<std::string> expected, actual;
+  for (size_t i = 1; i < records.size(); i += 3) expected.push_back(records[i]);
+  while (auto value = iterator->GetNext(exec_ctx)) {
+    host->Await(value.CopyRCRef());
+    ASSERT_FALSE(value.IsError()) << value.GetError().message;
+    actual.push_back(std::get<0>(value.get()));
+  }
+  EXPECT_EQ(actual, expected);
+  iterator.reset();
+  std::remove(path.c_str());
+  host->Quiesce();
+}
+
+// A file that is rewritten with records of other sizes, but the same total
+// size, is indexed again.
+TEST(TFRecordReaderTest, StaleIndex) {
+  auto host = CreateHostContext();
+  const std::string path =
+      WriteFile("stale_index", EncodeRecords({"abc", "d", "ef"}));
+  const std::string index_path = TFRecordIndex::GetIndexPath(path);
+  std::remove(index_path.c_str());
+  auto index = TFRecordIndex::Load(path, host->allocator());
+  ASSERT_TRUE(static_cast<bool>(index)) << llvm::toString(index.takeError());
+  EXPECT_EQ(index->num_records(), 3);
+  EXPECT_EQ(index->record_size(0), 3 + 16);
+
+  WriteFile("stale_index", EncodeRecords({"a", "bcd", "ef"}));
+  // Modify the file after the index, even if the clock does not tick.
+  struct stat stat_buf;
+  ASSERT_EQ(stat(index_path.c_str(), &stat_buf), 0);
+  struct timespec times[2] = {stat_buf.st_atim, stat_buf.st_mtim};
+  ++times[1].tv_sec;
+  ASSERT_EQ(utimensat(AT_FDCWD, path.c_str(), times, 0), 0);
+
+  index = TFRecordIndex::Load(path, host->allocator());
+  ASSERT_TRUE(static_cast<bool>(index)) << llvm::toString(index.takeError());
+  EXPECT_EQ(index->num_records(), 3);
+  EXPECT_EQ(index->record_size(0), 1 + 16);
+  EXPECT_EQ(index->record_size(1), 3 + 16);
+  std::remove(index_path.c_str());
+  std::remove(path.c_str());
+  host->Quiesce();
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tfrt
@@ -0,0 +1,285 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- async_coroutine_test.cc --------------------------------------------===//
+//
+// This file contains unit tests and benchmarks for AsyncValueRef coroutines.
+//
+//===----------------------------------------------------------------------===//
+
+#include "tfrt/host_context/async_coroutine.h"
+
+#if !TFRT_HAS_COROUTINES
+#error "async_coroutine_test requires compiler support for coroutines"
+#endif
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "benchmark/benchmark.h"
+#include "gtest/gtest.h"
+#include "tfrt/host_context/concurrent_work_queue.h"
+#include "tfrt/host_context/host_allocator.h"
+#include "tfrt/host_context/host_context.h"
+#include "tfrt/host_context/kernel_registry.h"
+#include "tfrt/host_context/kernel_utils.h"
+#include "tfrt/support/error_util.h"
+
+// Counts heap allocations that bypass the HostContext allocator.
+static std::atomic<int64_t> num_heap_allocations{0};
+
+void* operator new(size_t size) {
+  num_heap_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* ptr = std::malloc(size)) return ptr;
+  std::abort();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+namespace tfrt {
+namespace {
+
+// Malloc allocator that counts allocations.
+class CountingAllocator : public HostAllocator {
+ public:
+  void* AllocateBytes(size_t size, size_t alignment) override {
+    num_allocations_.fetch_add(1, std::memory_order_relaxed);
+    return allocator_->AllocateBytes(size, alignment);
+  }
+
+  void DeallocateBytes(void* ptr, size_t size) override {
+    allocator_->DeallocateBytes(ptr, size);
+  }
+
+  int64_t num_allocations() const {
+    return num_allocations_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::unique_ptr<HostAllocator> allocator_ = CreateMallocAllocator();
+  std::atomic<int64_t> num_allocations_{0};
+};
+
+std::unique_ptr<HostContext> CreateHostContext(
+    std::unique_ptr<HostAllocator> allocator) {
+  auto decoded_diagnostic_handler = [&](const DecodedDiagnostic& diag) {
+    abort();
+  };
+  return std::make_unique<HostContext>(decoded_diagnostic_handler,
+                                       std::move(allocator),
+                                       CreateMultiThreadedWorkQueue(4, 1));
+}
+
+std::unique_ptr<HostContext> CreateHostContext() {
+  return CreateHostContext(CreateMallocAllocator());
+}
+
+AsyncValueRef<int> AddOne(HostContext* host, AsyncValueRef<int> value) {
+  int v = co_await value;
+  co_return v + 1;
+}
+
+AsyncValueRef<int> AddAll(HostContext* host, int num_values) {
+  int sum = 0;
+  for (int i = 0; i < num_values; ++i) {
+    sum += co_await host->EnqueueWork([i] { return i; });
+  }
+  co_return sum;
+}
+
+AsyncValueRef<int> ReturnError(HostContext* host, bool error) {
+  if (error) co_return MakeStringError("failed");
+  co_return 42;
+}
+
+TEST(AsyncCoroutineTest, AvailableValue) {
+  auto host = CreateHostContext();
+
+  AsyncValueRef<int> result =
+      AddOne(host.get(), host->MakeConcreteAsyncValueRef<int>(1));
+  ASSERT_TRUE(result.IsAvailable());
+  EXPECT_EQ(result.get(), 2);
+}
+
+TEST(AsyncCoroutineTest, UnavailableValue) {
+  auto host = CreateHostContext();
+
+  AsyncValueRef<int> value = host->MakeUnconstructedAsyncValueRef<int>();
+  AsyncValueRef<int> result = AddOne(host.get(), value.CopyRef());
+  EXPECT_FALSE(result.IsAvailable());
+
+  value.emplace(1);
+  host->Await(result.CopyRCRef());
+  ASSERT_FALSE(result.IsError());
+  EXPECT_EQ(result.get(), 2);
+}
+
+TEST(AsyncCoroutineTest, ResumedFromWorkQueue) {
+  auto host = CreateHostContext();
+
+  AsyncValueRef<int> result = AddAll(host.get(), 100);
+  host->Await(result.CopyRCRef());
+  ASSERT_FALSE(result.IsError());
+  EXPECT_EQ(result.get(), 99 * 100 / 2);
+}
+
+TEST(AsyncCoroutineTest, ReturnError) {
+  auto host = CreateHostContext();
+
+  AsyncValueRef<int> ok = ReturnError(host.get(), false);
+  ASSERT_TRUE(ok.IsConcrete());
+  EXPECT_EQ(ok.get(), 42);
+
+  AsyncValueRef<int> error = ReturnError(host.get(), true);
+  ASSERT_TRUE(error.IsError());
+  EXPECT_EQ(error.GetError().message, "failed");
+}
+
+TEST(AsyncCoroutineTest, PropagateAvailableError) {
+  auto host = CreateHostContext();
+
+  AsyncValueRef<int> result =
+      AddOne(host.get(), host->MakeErrorAsyncValueRef("error"));
+  ASSERT_TRUE(result.IsError());
+  EXPECT_EQ(result.GetError().message, "error");
+}
+
+TEST(AsyncCoroutineTest, PropagateUnavailableError) {
+  auto host = CreateHostContext();
+
+  AsyncValueRef<int> value = host->MakeUnconstructedAsyncValueRef<int>();
+  AsyncValueRef<int> result = AddOne(host.get(), value.CopyRef());
+  EXPECT_FALSE(result.IsAvailable());
+
+  value.SetError("error");
+  ASSERT_TRUE(result.IsError());
+  EXPECT_EQ(result.GetError().message, "error");
+}
+
+TEST(AsyncCoroutineTest, FrameAllocatedFromHostAllocator) {
+  auto allocator = std::make_unique<CountingAllocator>();
+  CountingAllocator* counting_allocator = allocator.get();
+  auto host = CreateHostContext(std::move(allocator));
+
+  AsyncValueRef<int> value = host->MakeConcreteAsyncValueRef<int>(1);
+  int64_t num_heap_allocations_before = num_heap_allocations;
+  int64_t num_allocations_before = counting_allocator->num_allocations();
+
+  AsyncValueRef<int> result = AddOne(host.get(), value.CopyRef());
+  EXPECT_EQ(result.get(), 2);
+
+  // One allocation for the frame, and one for the result async value.
+  EXPECT_EQ(counting_allocator->num_allocations() - num_allocations_before, 2);
+  EXPECT_EQ(num_heap_allocations - num_heap_allocations_before, 0);
+}
+
+// Coroutines can be registered as kernels.
+static AsyncValueRef<int32_t> AddOneKernel(Argument<int32_t> arg,
+                                           const ExecutionContext& exec_ctx) {
+  AsyncValueRef<int32_t> value =
+      exec_ctx.host()->EnqueueWork([v = *arg] { return v; });
+  int32_t v = co_await value;
+  co_return v + 1;
+}
+
+TEST(AsyncCoroutineTest, Kernel) {
+  KernelImplementation kernel = TFRT_KERNEL(AddOneKernel);
+  EXPECT_NE(kernel, nullptr);
+}
+
+// Benchmarks below resolve `num_values` async values one by one in the work
+// queue, and continue in the coroutine or in the AndThen callback. Reported
+// counters are the number of allocations per suspension.
+
+AsyncValueRef<int> CoroutineChain(HostContext* host, int num_values) {
+  int sum = 0;
+  for (int i = 0; i < num_values; ++i) {
+    AsyncValueRef<int> value = host->MakeUnconstructedAsyncValueRef<int>();
+    host->EnqueueWork([value = value.CopyRef(), i] { value.emplace(i); });
+    sum += co_await value;
+  }
+  co_return sum;
+}
+
+void CallbackChain(HostContext* host, int index, int num_values, int sum,
+                   AsyncValueRef<int> result) {
+  if (index == num_values) {
+    result.emplace(sum);
+    return;
+  }
+
+  AsyncValueRef<int> value = host->MakeUnconstructedAsyncValueRef<int>();
+  host->EnqueueWork([value = value.CopyRef(), index] { value.emplace(index); });
+  AsyncValue* av = value.release();
+  av->AndThen([host, av, index, num_values, sum,
+               result = std::move(result)]() mutable {
+    AsyncValueRef<int> value(TakeRef(av));
+    host->EnqueueWork(
+        [host, value = std::move(value), index, num_values, sum,
+         result = std::move(result)]() mutable {
+          CallbackChain(host, index + 1, num_values, sum + value.get(),
+                        std::move(result));
+        },
+        WorkerAffinity::SameWorker());
+  });
+}
+
+template <typename Chain>
+void BenchmarkChain(benchmark::State& state, Chain chain) {
+  const int num_values = state.range(0);
+
+  auto allocator = std::make_unique<CountingAllocator>();
+  CountingAllocator* counting_allocator = allocator.get();
+  auto host = CreateHostContext(std::move(allocator));
+
+  int64_t num_heap_allocations_before = num_heap_allocations;
+  int64_t num_allocations_before = counting_allocator->num_allocations();
+
+  for (auto _ : state) {
+    AsyncValueRef<int> result = chain(host.get(), num_values);
+    host->Await(result.CopyRCRef());
+    benchmark::DoNotOptimize(result.get());
+  }
+
+  const double num_suspensions =
+      static_cast<double>(state.iterations()) * num_values;
+  state.counters["host_allocs"] =
+      (counting_allocator->num_allocations() - num_allocations_before) /
+      num_suspensions;
+  state.counters["heap_allocs"] =
+      (num_heap_allocations - num_heap_allocations_before) / num_suspensions;
+  state.SetItemsProcessed(state.iterations() * num_values);
+}
+
+void BM_CoroutineChain(benchmark::State& state) {
+  BenchmarkChain(state, CoroutineChain);
+}
+
+void BM_CallbackChain(benchmark::State& state) {
+  BenchmarkChain(state, [](HostContext* host, int num_values) {
+    AsyncValueRef<int> result = host->MakeUnconstructedAsyncValueRef<int>();
+    CallbackChain(host, 0, num_values, 0, result.CopyRef());
+    return result;
+  });
+}
+
+BENCHMARK(BM_CoroutineChain)->Arg(1)->Arg(100);
+BENCHMARK(BM_CallbackChain)->Arg(1)->Arg(100);
+
+}  // namespace
+}  // namespace tfrt
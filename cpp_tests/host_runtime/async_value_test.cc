@@ -0,0 +1,256 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- async_value_test.cc ------------------------------------------------===//
+//
+// This file contains unit tests and benchmarks for AsyncValue waiters.
+//
+//===----------------------------------------------------------------------===//
+
+#include "tfrt/host_context/async_value.h"
+
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+
+#include "benchmark/benchmark.h"
+#include "gtest/gtest.h"
+#include "tfrt/cpp_tests/test_util.h"
+#include "tfrt/host_context/async_value_ref.h"
+#include "tfrt/host_context/concurrent_work_queue.h"
+#include "tfrt/host_context/host_allocator.h"
+#include "tfrt/host_context/host_context.h"
+
+// Counts heap allocations.
+static std::atomic<int64_t> num_heap_allocations{0};
+
+void* operator new(size_t size) {
+  num_heap_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* ptr = std::malloc(size)) return ptr;
+  std::abort();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+namespace tfrt {
+namespace {
+
+// Counts the allocations of the waiter nodes, which come from the host
+// allocator.
+class CountingAllocator : public HostAllocator {
+ public:
+  void* AllocateBytes(size_t size, size_t alignment) override {
+    ++num_allocations_;
+    return allocator_->AllocateBytes(size, alignment);
+  }
+
+  void DeallocateBytes(void* ptr, size_t size) override {
+    allocator_->DeallocateBytes(ptr, size);
+  }
+
+  int64_t num_allocations() const { return num_allocations_; }
+
+ private:
+  std::unique_ptr<HostAllocator> allocator_ = CreateMallocAllocator();
+  std::atomic<int64_t> num_allocations_{0};
+};
+
+std::unique_ptr<HostContext> CreateCountingHostContext(
+    CountingAllocator** allocator) {
+  auto counting_allocator = std::make_unique<CountingAllocator>();
+  *allocator = counting_allocator.get();
+  return std::make_unique<HostContext>([](const DecodedDiagnostic&) {},
+                                       std::move(counting_allocator),
+                                       CreateSingleThreadedWorkQueue());
+}
+
+TEST(AsyncValueTest, InlineWaiter) {
+  auto host = CreateHostContext();
+
+  AsyncValueRef<int> value = host->MakeUnconstructedAsyncValueRef<int>();
+  int result = 0;
+  int* result_ptr = &result;
+  value.AndThen([value = value.GetAsyncValue(), result_ptr]() {
+    *result_ptr = value->get<int>();
+  });
+  EXPECT_EQ(result, 0);
+
+  value.emplace(42);
+  EXPECT_EQ(result, 42);
+}
+
+TEST(AsyncValueTest, FunctionWaiter) {
+  auto host = CreateHostContext();
+
+  AsyncValueRef<int> value = host->MakeUnconstructedAsyncValueRef<int>();
+  std::string result;
+  bool done = false;
+  std::string payload(64, 'x');
+  value.AndThen([&result, payload]() { result = payload; });
+  value.AndThen(llvm::unique_function<void()>([&done]() { done = true; }));
+  EXPECT_TRUE(result.empty());
+  EXPECT_FALSE(done);
+
+  value.emplace(42);
+  EXPECT_EQ(result, std::string(64, 'x'));
+  EXPECT_TRUE(done);
+}
+
+TEST(AsyncValueTest, WaitersDestroyed) {
+  auto host = CreateHostContext();
+
+  AsyncValueRef<int> value = host->MakeUnconstructedAsyncValueRef<int>();
+  AsyncValueRef<int> captured = host->MakeConcreteAsyncValueRef<int>(1);
+  value.AndThen([captured = captured.CopyRef()]() {});
+  EXPECT_FALSE(captured.GetAsyncValue()->IsUnique());
+
+  value.SetError("error");
+  EXPECT_TRUE(captured.GetAsyncValue()->IsUnique());
+}
+
+// Inline waiters are copied into their node, which is the only allocation.
+TEST(AsyncValueTest, InlineWaiterAllocatesOnlyNode) {
+  CountingAllocator* allocator;
+  auto host = CreateCountingHostContext(&allocator);
+
+  AsyncValueRef<int> value = host->MakeUnconstructedAsyncValueRef<int>();
+  int counter = 0;
+  int* counter_ptr = &counter;
+  int64_t num_heap_allocations_before = num_heap_allocations;
+  int64_t num_allocations_before = allocator->num_allocations();
+
+  for (int j = 0; j < 100; ++j) {
+    value.AndThen([counter_ptr] { ++*counter_ptr; });
+  }
+  value.emplace(42);
+
+  EXPECT_EQ(counter, 100);
+  EXPECT_EQ(num_heap_allocations - num_heap_allocations_before, 0);
+  EXPECT_EQ(allocator->num_allocations() - num_allocations_before, 100);
+}
+
+// The first value kept alive by an unavailable value with no waiters does not
+// need a waiter node.
+TEST(AsyncValueTest, KeepAliveDoesNotAllocate) {
+  CountingAllocator* allocator;
+  auto host = CreateCountingHostContext(&allocator);
+
+  AsyncValueRef<int> value = host->MakeUnconstructedAsyncValueRef<int>();
+  AsyncValueRef<int> kept = host->MakeConcreteAsyncValueRef<int>(1);
+  AsyncValueRef<int> kept_with_node = host->MakeConcreteAsyncValueRef<int>(2);
+  int counter = 0;
+  int* counter_ptr = &counter;
+  int64_t num_allocations_before = allocator->num_allocations();
+
+  value.GetAsyncValue()->KeepAliveUntilAvailable(kept.CopyRCRef());
+  EXPECT_EQ(allocator->num_allocations() - num_allocations_before, 0);
+  // Waiters are added in front of the kept alive value.
+  value.AndThen([counter_ptr] { ++*counter_ptr; });
+  EXPECT_EQ(allocator->num_allocations() - num_allocations_before, 1);
+  // The list is not empty anymore, so this one needs a node.
+  value.GetAsyncValue()->KeepAliveUntilAvailable(kept_with_node.CopyRCRef());
+  EXPECT_EQ(allocator->num_allocations() - num_allocations_before, 2);
+  EXPECT_FALSE(kept.GetAsyncValue()->IsUnique());
+  EXPECT_FALSE(kept_with_node.GetAsyncValue()->IsUnique());
+
+  value.emplace(42);
+  EXPECT_EQ(counter, 1);
+  EXPECT_TRUE(kept.GetAsyncValue()->IsUnique());
+  EXPECT_TRUE(kept_with_node.GetAsyncValue()->IsUnique());
+
+  // An available value does not keep anything alive.
+  value.GetAsyncValue()->KeepAliveUntilAvailable(kept.CopyRCRef());
+  EXPECT_TRUE(kept.GetAsyncValue()->IsUnique());
+}
+
+// Adds `state.range(0)` waiters to an unavailable async value, then resolves
+// it. Reports the number of heap and host allocator allocations per waiter.
+template <typename MakeWaiter>
+void BenchmarkAndThen(benchmark::State& state, MakeWaiter make_waiter) {
+  const int num_waiters = state.range(0);
+  CountingAllocator* allocator;
+  auto host = CreateCountingHostContext(&allocator);
+  int counter = 0;
+
+  int64_t num_heap_allocations_before = num_heap_allocations;
+  int64_t num_allocations_before = allocator->num_allocations();
+  for (auto _ : state) {
+    AsyncValueRef<int> value = host->MakeUnconstructedAsyncValueRef<int>();
+    for (int i = 0; i < num_waiters; ++i) value.AndThen(make_waiter(&counter));
+    value.emplace(42);
+  }
+  benchmark::DoNotOptimize(counter);
+
+  const double num_added =
+      static_cast<double>(state.iterations()) * num_waiters;
+  state.counters["heap_allocs"] =
+      (num_heap_allocations - num_heap_allocations_before) / num_added;
+  // Includes the allocation of the async value itself.
+  state.counters["host_allocs"] =
+      (allocator->num_allocations() - num_allocations_before) / num_added;
+  state.SetItemsProcessed(state.iterations() * num_waiters);
+}
+
+void BM_AndThenInline(benchmark::State& state) {
+  BenchmarkAndThen(state,
+                   [](int* counter) { return [counter] { ++*counter; }; });
+}
+
+void BM_AndThenFunction(benchmark::State& state) {
+  BenchmarkAndThen(state, [](int* counter) {
+    return llvm::unique_function<void()>([counter] { ++*counter; });
+  });
+}
+
+void BM_AndThenLargeCapture(benchmark::State& state) {
+  BenchmarkAndThen(state, [](int* counter) {
+    return [counter, padding = std::array<int64_t, 8>()] {
+      *counter += padding.size();
+    };
+  });
+}
+
+// Keeps a value alive until an unavailable async value is resolved, as the
+// executor does for its unused results.
+void BM_KeepAlive(benchmark::State& state) {
+  CountingAllocator* allocator;
+  auto host = CreateCountingHostContext(&allocator);
+  AsyncValueRef<int> kept = host->MakeConcreteAsyncValueRef<int>(1);
+
+  int64_t num_allocations_before = allocator->num_allocations();
+  for (auto _ : state) {
+    AsyncValueRef<int> value = host->MakeUnconstructedAsyncValueRef<int>();
+    value.GetAsyncValue()->KeepAliveUntilAvailable(kept.CopyRCRef());
+    value.emplace(42);
+  }
+
+  // Includes the allocation of the async value itself.
+  state.counters["host_allocs"] =
+      (allocator->num_allocations() - num_allocations_before) /
+      static_cast<double>(state.iterations());
+}
+
+BENCHMARK(BM_AndThenInline)->Arg(1)->Arg(16);
+BENCHMARK(BM_AndThenFunction)->Arg(1)->Arg(16);
+BENCHMARK(BM_AndThenLargeCapture)->Arg(1)->Arg(16);
+BENCHMARK(BM_KeepAlive);
+
+}  // namespace
+}  // namespace tfrt
@@ -0,0 +1,140 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- replay_work_queue_test.cc ------------------------------------------===//
+//
+// This file contains unit tests for the recording and replay work queues.
+//
+//===----------------------------------------------------------------------===//
+
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "tfrt/host_context/concurrent_work_queue.h"
+#include "tfrt/host_context/host_allocator.h"
+#include "tfrt/host_context/host_context.h"
+#include "tfrt/support/mutex.h"
+
+namespace tfrt {
+namespace {
+
+std::unique_ptr<HostContext> CreateHostContext(
+    std::unique_ptr<ConcurrentWorkQueue> work_queue) {
+  auto decoded_diagnostic_handler = [&](const DecodedDiagnostic& diag) {
+    abort();
+  };
+  return std::make_unique<HostContext>(decoded_diagnostic_handler,
+                                       CreateMallocAllocator(),
+                                       std::move(work_queue));
+}
+
+// Labels of the tasks executed by each worker thread, in execution order.
+using Trace = std::map<int, std::vector<std::string>>;
+
+// Runs a tree of tasks with the given `fanout` and `depth`, and returns the
+// per-worker trace.
+Trace RunTaskTree(HostContext* host, int fanout, int depth) {
+  mutex mu;
+  Trace trace;
+
+  std::function<void(std::string, int)> run = [&](std::string label,
+                                                  int level) {
+    {
+      mutex_lock lock(mu);
+      trace[host->GetCurrentWorkerIndex()].push_back(label);
+    }
+    if (level == depth) return;
+    for (int i = 0; i < fanout; ++i) {
+      std::string child = label + "." + std::to_string(i);
+      host->EnqueueWork([&run, child, level]() { run(child, level + 1); });
+    }
+  };
+
+  for (int i = 0; i < fanout; ++i) {
+    std::string root = std::to_string(i);
+    host->EnqueueWork([&run, root]() { run(root, 1); });
+  }
+  host->Quiesce();
+
+  return trace;
+}
+
+TEST(ReplayWorkQueueTest, ReplayRecordedSchedule) {
+  std::string log_path = ::testing::TempDir() + "/replay_work_queue_test.log";
+
+  Trace recorded;
+  {
+    auto host = CreateHostContext(CreateRecordingWorkQueue(4, log_path));
+    recorded = RunTaskTree(host.get(), /*fanout=*/4, /*depth=*/4);
+  }
+
+  for (int i = 0; i < 3; ++i) {
+    auto work_queue = CreateReplayWorkQueue(log_path);
+    ASSERT_TRUE(!!work_queue);
+
+    auto host = CreateHostContext(std::move(*work_queue));
+    EXPECT_EQ(host->GetNumWorkerThreads(), 4);
+    EXPECT_EQ(RunTaskTree(host.get(), /*fanout=*/4, /*depth=*/4), recorded);
+  }
+}
+
+TEST(ReplayWorkQueueTest, QueuedBlockingTasks) {
+  std::string log_path =
+      ::testing::TempDir() + "/replay_work_queue_test.blocking";
+  auto host = CreateHostContext(CreateRecordingWorkQueue(2, log_path));
+
+  std::atomic<int> num_running{0};
+  std::atomic<int> max_running{0};
+  std::atomic<int> num_done{0};
+  for (int i = 0; i < 64; ++i) {
+    ASSERT_TRUE(host->EnqueueBlockingWork([&]() {
+      int running = ++num_running;
+      int max = max_running.load();
+      while (running > max && !max_running.compare_exchange_weak(max, running))
+        continue;
+      --num_running;
+      ++num_done;
+    }));
+  }
+  host->Quiesce();
+  EXPECT_EQ(num_done.load(), 64);
+  // Queued blocking tasks share a bounded number of threads.
+  EXPECT_LE(max_running.load(), 8);
+
+  // The log is written while the work queue is alive.
+  auto work_queue = CreateReplayWorkQueue(log_path);
+  ASSERT_TRUE(!!work_queue);
+}
+
+TEST(ReplayWorkQueueTest, InvalidLog) {
+  std::string log_path = ::testing::TempDir() + "/replay_work_queue_test.bad";
+  {
+    std::ofstream file(log_path);
+    file << "not a log";
+  }
+
+  auto work_queue = CreateReplayWorkQueue(log_path);
+  ASSERT_FALSE(!!work_queue);
+  llvm::consumeError(work_queue.takeError());
+}
+
+}  // namespace
+}  // namespace tfrt
@@ -0,0 +1,156 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- decode_jpeg_batch_test.cc --------------------------------*- C++ -*-===//
+//
+// This file contains unit tests for the image.decode_jpeg_batch kernel, which
+// must return the same images as decoding them one at a time.
+//
+//===----------------------------------------------------------------------===//
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "backends/cpu/lib/kernels/image/decode_jpeg_op.h"
+#include "cpp_tests/image/image_test_util.h"
+#include "gtest/gtest.h"
+#include "tfrt/host_context/concurrent_work_queue.h"
+#include "tfrt/host_context/host_allocator.h"
+#include "tfrt/host_context/host_context.h"
+#include "tfrt/host_context/kernel_frame.h"
+#include "tfrt/host_context/kernel_registry.h"
+#include "tfrt/tensor/dense_host_tensor.h"
+#include "tfrt/tensor/string_host_tensor.h"
+
+namespace tfrt {
+namespace image {
+
+void RegisterImageKernels(KernelRegistry* registry);
+
+namespace {
+
+using testing::CreateJpeg;
+
+// The diagnostics are ignored, the tests check the errors returned by the
+// kernel.
+std::unique_ptr<HostContext> CreateHostContext() {
+  auto decoded_diagnostic_handler = [&](const DecodedDiagnostic& diag) {};
+  auto host = std::make_unique<HostContext>(decoded_diagnostic_handler,
+                                            CreateMallocAllocator(),
+                                            CreateMultiThreadedWorkQueue(4, 4));
+  RegisterImageKernels(host->GetRegistry());
+  return host;
+}
+
+// Runs image.decode_jpeg_batch on `images` and waits for its result.
+RCReference<AsyncValue> DecodeJpegBatch(const std::vector<std::string>& images,
+                                        int64_t height, int64_t width,
+                                        HostContext* host) {
+  auto tensor = StringHostTensor::CreateUninitialized(
+      TensorMetadata(DType(DType::String),
+                     TensorShape(static_cast<ssize_t>(images.size()))),
+      host);
+  assert(tensor.hasValue());
+  std::copy(images.begin(), images.end(), tensor->strings().begin());
+
+  auto images_value =
+      host->MakeConcreteAsyncValueRef<StringHostTensor>(std::move(*tensor));
+  auto height_value = host->MakeConcreteAsyncValueRef<int64_t>(height);
+  auto width_value = host->MakeConcreteAsyncValueRef<int64_t>(width);
+  KernelFrameBuilder frame(host);
+  frame.AddArg(images_value.GetAsyncValue());
+  frame.AddArg(height_value.GetAsyncValue());
+  frame.AddArg(width_value.GetAsyncValue());
+  frame.SetNumResults(1);
+  host->GetRegistry()->GetKernel("image.decode_jpeg_batch")(&frame);
+  auto result = TakeRef(frame.GetResultAt(0));
+  host->Await(result.CopyRef());
+  return result;
+}
+
+// Images larger than the output, which are decoded with DCT scaling, smaller
+// ones, which are upscaled, and one of the same size.
+std::vector<std::string> MakeImages() {
+  return {CreateJpeg(480, 640), CreateJpeg(100, 150), CreateJpeg(64, 64),
+          CreateJpeg(1200, 900), CreateJpeg(37, 53)};
+}
+
+TEST(DecodeJpegBatchTest, MatchesSingleImageDecode) {
+  auto host = CreateHostContext();
+  const std::vector<std::string> images = MakeImages();
+  for (int64_t size : {1, 64, 224}) {
+    auto result = DecodeJpegBatch(images, size, size, host.get());
+    ASSERT_FALSE(result->IsError()) << result->GetError().message;
+    const auto& batch = result->get<DenseHostTensor>();
+    SmallVector<ssize_t, 4> dims;
+    batch.shape().GetDimensions(&dims);
+    ASSERT_EQ(dims.size(), 4);
+    EXPECT_EQ(dims[0], images.size());
+    EXPECT_EQ(dims[1], size);
+    EXPECT_EQ(dims[2], size);
+    EXPECT_EQ(dims[3], 3);
+
+    const size_t image_size = size * size * 3;
+    const float* batch_data = static_cast<const float*>(batch.data());
+    std::vector<float> expected(image_size);
+    for (size_t i = 0; i < images.size(); ++i) {
+      auto error = decode_and_resize_jpeg(images[i], size, size,
+                                          expected.data(), host.get());
+      ASSERT_FALSE(static_cast<bool>(error))
+          << llvm::toString(std::move(error));
+      const std::vector<float> actual(batch_data + i * image_size,
+                                      batch_data + (i + 1) * image_size);
+      EXPECT_EQ(actual, expected) << "image " << i << ", size " << size;
+    }
+  }
+  host->Quiesce();
+}
+
+TEST(DecodeJpegBatchTest, EmptyBatch) {
+  auto host = CreateHostContext();
+  auto result = DecodeJpegBatch({}, 32, 48, host.get());
+  ASSERT_FALSE(result->IsError()) << result->GetError().message;
+  SmallVector<ssize_t, 4> dims;
+  result->get<DenseHostTensor>().shape().GetDimensions(&dims);
+  EXPECT_EQ(std::vector<ssize_t>(dims.begin(), dims.end()),
+            std::vector<ssize_t>({0, 32, 48, 3}));
+  host->Quiesce();
+}
+
+TEST(DecodeJpegBatchTest, InvalidImage) {
+  auto host = CreateHostContext();
+  std::vector<std::string> images = MakeImages();
+  images[1] = "not a jpeg";
+  auto result = DecodeJpegBatch(images, 64, 64, host.get());
+  ASSERT_TRUE(result->IsError());
+  EXPECT_EQ(result->GetError().message.rfind("image 1: ", 0), 0)
+      << result->GetError().message;
+  host->Quiesce();
+}
+
+TEST(DecodeJpegBatchTest, InvalidOutputSize) {
+  auto host = CreateHostContext();
+  auto result = DecodeJpegBatch(MakeImages(), 0, 64, host.get());
+  ASSERT_TRUE(result->IsError());
+  EXPECT_EQ(result->GetError().message, "output size must be positive");
+  host->Quiesce();
+}
+
+}  // namespace
+}  // namespace image
+}  // namespace tfrt
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- decode_jpeg_benchmark.cc -------------------------------------------===//
+//
+// Benchmark for decoding JPEG photos and resizing them to 224x224, either at
+// full size followed by a resize like image.decode_jpeg and
+// image.resize_bilinear, or fused like image.decode_and_resize_jpeg.
+//
+//===----------------------------------------------------------------------===//
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "backends/cpu/lib/kernels/image/decode_jpeg_op.h"
+#include "backends/cpu/lib/kernels/image/jpeg/jpeg_mem.h"
+#include "backends/cpu/lib/kernels/image/resize_bilinear_op.h"
+#include "benchmark/benchmark.h"
+#include "cpp_tests/image/image_test_util.h"
+#include "tfrt/host_context/concurrent_work_queue.h"
+#include "tfrt/host_context/host_allocator.h"
+#include "tfrt/host_context/host_context.h"
+
+namespace tfrt {
+namespace image {
+namespace {
+
+using testing::CreateJpeg;
+
+constexpr ssize_t kOutputHeight = 224;
+constexpr ssize_t kOutputWidth = 224;
+
+std::unique_ptr<HostContext> CreateHostContext() {
+  auto decoded_diagnostic_handler = [&](const DecodedDiagnostic& diag) {
+    abort();
+  };
+  return std::make_unique<HostContext>(decoded_diagnostic_handler,
+                                       CreateMallocAllocator(),
+                                       CreateSingleThreadedWorkQueue());
+}
+
+// Decodes the full-size image and resizes it, like image.decode_jpeg followed
+// by image.resize_bilinear.
+void BM_DecodeJpegThenResize(benchmark::State& state) {
+  const std::string jpeg = CreateJpeg(state.range(0), state.range(1));
+  std::vector<float> output(kOutputHeight * kOutputWidth * 3);
+  auto host = CreateHostContext();
+
+  jpeg::UncompressFlags flags;
+  flags.components = 3;
+  flags.dct_method = JDCT_IFAST;
+
+  for (auto _ : state) {
+    std::vector<uint8_t> image;
+    int height = 0;
+    int width = 0;
+    jpeg::Uncompress(jpeg.data(), jpeg.size(), flags, nullptr /* nwarn */,
+                     [&](int w, int h, int c) {
+                       image.resize(static_cast<size_t>(w) * h * c);
+                       height = h;
+                       width = w;
+                       return image.data();
+                     });
+    resize_image(image.data(), height, width, /*channels=*/3, kOutputHeight,
+                 kOutputWidth, output.data(), host.get());
+    benchmark::DoNotOptimize(output.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Decodes the image at a reduced size and resizes it, like
+// image.decode_and_resize_jpeg.
+void BM_DecodeAndResizeJpeg(benchmark::State& state) {
+  const std::string jpeg = CreateJpeg(state.range(0), state.range(1));
+  std::vector<float> output(kOutputHeight * kOutputWidth * 3);
+  auto host = CreateHostContext();
+
+  for (auto _ : state) {
+    llvm::cantFail(decode_and_resize_jpeg(jpeg, kOutputHeight, kOutputWidth,
+                                          output.data(), host.get()));
+    benchmark::DoNotOptimize(output.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// 1, 2 and 4 megapixel photos.
+BENCHMARK(BM_DecodeJpegThenResize)
+    ->Args({864, 1152})
+    ->Args({1200, 1600})
+    ->Args({1728, 2304});
+BENCHMARK(BM_DecodeAndResizeJpeg)
+    ->Args({864, 1152})
+    ->Args({1200, 1600})
+    ->Args({1728, 2304});
+
+}  // namespace
+}  // namespace image
+}  // namespace tfrt
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- image_test_util.h ----------------------------------------*- C++ -*-===//
+//
+// This file declares helpers for the unit tests and benchmarks of the image
+// kernels.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef TFRT_CPP_TESTS_IMAGE_IMAGE_TEST_UTIL_H_
+#define TFRT_CPP_TESTS_IMAGE_IMAGE_TEST_UTIL_H_
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "third_party/libjpeg_turbo/jpeglib.h"
+
+namespace tfrt {
+namespace image {
+namespace testing {
+
+// Returns a `height` x `width` RGB JPEG image of smooth gradients with some
+// noise, which compresses like a photo at quality 90.
+inline std::string CreateJpeg(int height, int width) {
+  std::vector<uint8_t> pixels(static_cast<size_t>(height) * width * 3);
+  std::srand(42);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      uint8_t* pixel = &pixels[(static_cast<size_t>(y) * width + x) * 3];
+      const int noise = std::rand() % 4;
+      pixel[0] = (255 * x / width + noise) & 0xff;
+      pixel[1] = (255 * y / height + noise) & 0xff;
+      pixel[2] = static_cast<int>(127.5 * (1 + std::sin(x * 0.02 + y * 0.03)));
+    }
+  }
+
+  struct jpeg_compress_struct cinfo;
+  struct jpeg_error_mgr jerr;
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_compress(&cinfo);
+  unsigned char* buffer = nullptr;
+  unsigned long size = 0;  // NOLINT(runtime/int)
+  jpeg_mem_dest(&cinfo, &buffer, &size);
+  cinfo.image_width = width;
+  cinfo.image_height = height;
+  cinfo.input_components = 3;
+  cinfo.in_color_space = JCS_RGB;
+  jpeg_set_defaults(&cinfo);
+  jpeg_set_quality(&cinfo, 90, TRUE);
+  jpeg_start_compress(&cinfo, TRUE);
+  while (cinfo.next_scanline < cinfo.image_height) {
+    JSAMPROW row =
+        &pixels[static_cast<size_t>(cinfo.next_scanline) * width * 3];
+    jpeg_write_scanlines(&cinfo, &row, 1);
+  }
+  jpeg_finish_compress(&cinfo);
+  jpeg_destroy_compress(&cinfo);
+  std::string jpeg(reinterpret_cast<char*>(buffer), size);
+  free(buffer);
+  return jpeg;
+}
+
+}  // namespace testing
+}  // namespace image
+}  // namespace tfrt
+
+#endif  // TFRT_CPP_TESTS_IMAGE_IMAGE_TEST_UTIL_H_
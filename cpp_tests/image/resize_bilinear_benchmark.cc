@@ -0,0 +1,103 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- resize_bilinear_benchmark.cc ---------------------------------------===//
+//
+// Benchmark for the bilinear resize of RGB images to 224x224, on the calling
+// thread and with the rows split over the work queue.
+//
+//===----------------------------------------------------------------------===//
+
+#include <memory>
+#include <vector>
+
+#include "backends/cpu/lib/kernels/image/resize_bilinear_op.h"
+#include "benchmark/benchmark.h"
+#include "tfrt/host_context/concurrent_work_queue.h"
+#include "tfrt/host_context/host_allocator.h"
+#include "tfrt/support/latch.h"
+
+namespace tfrt {
+namespace image {
+namespace {
+
+constexpr ssize_t kOutputHeight = 224;
+constexpr ssize_t kOutputWidth = 224;
+constexpr ssize_t kChannels = 3;
+
+std::unique_ptr<HostContext> CreateHostContext() {
+  auto decoded_diagnostic_handler = [&](const DecodedDiagnostic& diag) {
+    abort();
+  };
+  return std::make_unique<HostContext>(decoded_diagnostic_handler,
+                                       CreateMallocAllocator(),
+                                       CreateMultiThreadedWorkQueue(4, 1));
+}
+
+std::vector<uint8_t> CreateImage(ssize_t height, ssize_t width) {
+  std::vector<uint8_t> image(height * width * kChannels);
+  for (size_t i = 0; i < image.size(); ++i) image[i] = i * 7;
+  return image;
+}
+
+void BM_ResizeImage(benchmark::State& state) {
+  const ssize_t height = state.range(0);
+  const ssize_t width = state.range(1);
+  const std::vector<uint8_t> image = CreateImage(height, width);
+  std::vector<float> output(kOutputHeight * kOutputWidth * kChannels);
+  auto host = CreateHostContext();
+
+  for (auto _ : state) {
+    resize_image(image.data(), height, width, kChannels, kOutputHeight,
+                 kOutputWidth, output.data(), host.get());
+    benchmark::DoNotOptimize(output.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_ResizeImageAsync(benchmark::State& state) {
+  const ssize_t height = state.range(0);
+  const ssize_t width = state.range(1);
+  const std::vector<uint8_t> image = CreateImage(height, width);
+  std::vector<float> output(kOutputHeight * kOutputWidth * kChannels);
+  auto host = CreateHostContext();
+
+  for (auto _ : state) {
+    latch done(1);
+    resize_image_async(image.data(), height, width, kChannels, kOutputHeight,
+                       kOutputWidth, output.data(), host.get(),
+                       [&done]() { done.count_down(); });
+    done.wait();
+    benchmark::DoNotOptimize(output.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// A photo decoded at a reduced size, a 4 megapixel photo, and a thumbnail that
+// is enlarged.
+BENCHMARK(BM_ResizeImage)
+    ->Args({432, 576})
+    ->Args({1728, 2304})
+    ->Args({120, 160});
+BENCHMARK(BM_ResizeImageAsync)
+    ->UseRealTime()
+    ->Args({432, 576})
+    ->Args({1728, 2304})
+    ->Args({120, 160});
+
+}  // namespace
+}  // namespace image
+}  // namespace tfrt
@@ -0,0 +1,166 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- resize_bilinear_test.cc ----------------------------------*- C++ -*-===//
+//
+// This file contains unit tests for the bilinear resize of images, which are
+// compared with a scalar implementation of tf.compat.v1.image.resize.
+//
+//===----------------------------------------------------------------------===//
+
+#include "backends/cpu/lib/kernels/image/resize_bilinear_op.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "tfrt/host_context/concurrent_work_queue.h"
+#include "tfrt/host_context/host_allocator.h"
+#include "tfrt/support/latch.h"
+
+namespace tfrt {
+namespace image {
+namespace {
+
+std::unique_ptr<HostContext> CreateHostContext() {
+  auto decoded_diagnostic_handler = [&](const DecodedDiagnostic& diag) {
+    abort();
+  };
+  return std::make_unique<HostContext>(decoded_diagnostic_handler,
+                                       CreateMallocAllocator(),
+                                       CreateMultiThreadedWorkQueue(4, 1));
+}
+
+std::vector<uint8_t> CreateImage(ssize_t height, ssize_t width,
+                                 ssize_t channels) {
+  std::vector<uint8_t> image(height * width * channels);
+  for (size_t i = 0; i < image.size(); ++i) image[i] = i * 7 + i / 13;
+  return image;
+}
+
+// Resizes the image one value at a time, without interpolation tables.
+std::vector<float> ResizeReference(const std::vector<uint8_t>& input,
+                                   ssize_t input_height, ssize_t input_width,
+                                   ssize_t channels, ssize_t output_height,
+                                   ssize_t output_width) {
+  const float height_scale = input_height / static_cast<float>(output_height);
+  const float width_scale = input_width / static_cast<float>(output_width);
+  auto pixel = [&](ssize_t y, ssize_t x, ssize_t c) -> float {
+    return input[(y * input_width + x) * channels + c];
+  };
+  std::vector<float> output;
+  for (ssize_t y = 0; y < output_height; ++y) {
+    const float in_y = y * height_scale;
+    const ssize_t top = std::max<ssize_t>(std::floor(in_y), 0);
+    const ssize_t bottom = std::min<ssize_t>(std::ceil(in_y), input_height - 1);
+    const float y_lerp = in_y - std::floor(in_y);
+    for (ssize_t x = 0; x < output_width; ++x) {
+      const float in_x = x * width_scale;
+      const ssize_t left = std::max<ssize_t>(std::floor(in_x), 0);
+      const ssize_t right = std::min<ssize_t>(std::ceil(in_x), input_width - 1);
+      const float x_lerp = in_x - std::floor(in_x);
+      for (ssize_t c = 0; c < channels; ++c) {
+        const float top_value =
+            pixel(top, left, c) +
+            (pixel(top, right, c) - pixel(top, left, c)) * x_lerp;
+        const float bottom_value =
+            pixel(bottom, left, c) +
+            (pixel(bottom, right, c) - pixel(bottom, left, c)) * x_lerp;
+        output.push_back(top_value + (bottom_value - top_value) * y_lerp);
+      }
+    }
+  }
+  return output;
+}
+
+void ExpectNear(const std::vector<float>& actual,
+                const std::vector<float>& expected) {
+  ASSERT_EQ(actual.size(), expected.size());
+  for (size_t i = 0; i < actual.size(); ++i) {
+    ASSERT_NEAR(actual[i], expected[i], 1e-2) << "value " << i;
+  }
+}
+
+struct Size {
+  ssize_t input_height;
+  ssize_t input_width;
+  ssize_t output_height;
+  ssize_t output_width;
+};
+
+// Downscales and upscales, with the last output columns at the last input
+// column, and widths of a few pixels so that the trailing columns, which are
+// not interpolated with packets, are most of the row or all of it.
+std::vector<Size> TestSizes() {
+  return {{432, 576, 224, 224}, {120, 160, 224, 224}, {224, 224, 224, 224},
+          {37, 53, 17, 29},     {5, 3, 7, 2},         {1, 1, 4, 4},
+          {4, 4, 1, 1},         {9, 2, 3, 5},         {3, 7, 6, 1}};
+}
+
+TEST(ResizeBilinearTest, MatchesReference) {
+  auto host = CreateHostContext();
+  for (ssize_t channels : {1, 2, 3, 4, 5}) {
+    for (const Size& size : TestSizes()) {
+      SCOPED_TRACE(::testing::Message()
+                   << size.input_height << "x" << size.input_width << " to "
+                   << size.output_height << "x" << size.output_width << "x"
+                   << channels);
+      const auto input =
+          CreateImage(size.input_height, size.input_width, channels);
+      std::vector<float> output(size.output_height * size.output_width *
+                                channels);
+      resize_image(input.data(), size.input_height, size.input_width,
+                   channels, size.output_height, size.output_width,
+                   output.data(), host.get());
+      ExpectNear(output, ResizeReference(input, size.input_height,
+                                         size.input_width, channels,
+                                         size.output_height,
+                                         size.output_width));
+    }
+  }
+  host->Quiesce();
+}
+
+// The rows that are resized in parallel are the same as on a single thread.
+TEST(ResizeBilinearTest, AsyncMatchesSync) {
+  auto host = CreateHostContext();
+  const ssize_t channels = 3;
+  for (const Size& size : TestSizes()) {
+    const auto input =
+        CreateImage(size.input_height, size.input_width, channels);
+    const size_t output_size =
+        size.output_height * size.output_width * channels;
+    std::vector<float> expected(output_size);
+    resize_image(input.data(), size.input_height, size.input_width, channels,
+                 size.output_height, size.output_width, expected.data(),
+                 host.get());
+    std::vector<float> output(output_size);
+    latch done(1);
+    resize_image_async(input.data(), size.input_height, size.input_width,
+                       channels, size.output_height, size.output_width,
+                       output.data(), host.get(),
+                       [&done]() { done.count_down(); });
+    done.wait();
+    EXPECT_EQ(output, expected);
+  }
+  host->Quiesce();
+}
+
+}  // namespace
+}  // namespace image
+}  // namespace tfrt
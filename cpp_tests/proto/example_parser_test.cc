@@ -0,0 +1,223 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- example_parser_test.cc -----------------------------------*- C++ -*-===//
+//
+// This file contains unit tests for ExampleParser, which must return the
+// values of the Example messages that the records encode.
+//
+//===----------------------------------------------------------------------===//
+
+#include "backends/cpu/lib/kernels/proto/example_parser.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "llvm/Support/Error.h"
+#include "tfrt/cpu/kernels/proto/example.proto.h"
+
+namespace tfrt {
+namespace proto {
+namespace {
+
+FeatureSpec MakeSpec(std::string key, DType::Kind kind,
+                     std::vector<ssize_t> shape = {}) {
+  FeatureSpec spec;
+  spec.key = std::move(key);
+  spec.dtype = DType(kind);
+  spec.shape.assign(shape.begin(), shape.end());
+  return spec;
+}
+
+// The outputs of the records for CreateSpecs.
+struct Outputs {
+  explicit Outputs(size_t num_records)
+      : labels(num_records), boxes(num_records * 4), names(num_records * 2) {}
+
+  std::vector<int64_t> labels;
+  std::vector<float> boxes;
+  std::vector<std::string> names;
+};
+
+std::vector<FeatureSpec> CreateSpecs() {
+  return {MakeSpec("label", DType::I64), MakeSpec("box", DType::F32, {2, 2}),
+          MakeSpec("names", DType::String, {2})};
+}
+
+// Parses `records` into `outputs`, for specs like CreateSpecs.
+llvm::Error Parse(ArrayRef<FeatureSpec> specs,
+                  const std::vector<std::string>& records, Outputs* outputs) {
+  void* output_data[] = {outputs->labels.data(), outputs->boxes.data(),
+                         outputs->names.data()};
+  return ExampleParser(specs).Parse(records, output_data);
+}
+
+std::string ParseError(ArrayRef<FeatureSpec> specs,
+                       const std::vector<std::string>& records) {
+  Outputs outputs(records.size());
+  auto error = Parse(specs, records, &outputs);
+  return error ? llvm::toString(std::move(error)) : "";
+}
+
+// Encodes the protobuf wire format, to write the encodings that Example
+// messages do not serialize to.
+std::string Varint(uint64_t value) {
+  std::string bytes;
+  for (; value >= 0x80; value >>= 7) bytes.push_back((value & 0x7f) | 0x80);
+  bytes.push_back(value);
+  return bytes;
+}
+
+std::string LengthDelimited(uint32_t field, const std::string& data) {
+  return Varint(field << 3 | 2) + Varint(data.size()) + data;
+}
+
+// Returns an Example with one feature, whose Feature message is `feature`.
+std::string EncodeExample(const std::string& key, const std::string& feature) {
+  const std::string entry =
+      LengthDelimited(1, key) + LengthDelimited(2, feature);
+  return LengthDelimited(1, LengthDelimited(1, entry));
+}
+
+TEST(ExampleParserTest, ParseFeatures) {
+  std::vector<std::string> records;
+  for (int i = 0; i < 5; ++i) {
+    Example example;
+    auto& features = *example.mutable_features()->mutable_feature();
+    // Negative varints take 10 bytes.
+    features["label"].mutable_int64_list()->add_value(i - 2);
+    for (int j = 0; j < 4; ++j) {
+      features["box"].mutable_float_list()->add_value(i + j * 0.25f);
+    }
+    features["names"].mutable_bytes_list()->add_value(std::string(i, 'a'));
+    features["names"].mutable_bytes_list()->add_value("name " +
+                                                      std::to_string(i));
+    // Features that are not parsed are skipped.
+    features["other"].mutable_bytes_list()->add_value("other");
+    features["other_int"].mutable_int64_list()->add_value(i);
+    records.push_back(example.SerializeAsString());
+  }
+
+  const auto specs = CreateSpecs();
+  Outputs outputs(records.size());
+  ASSERT_FALSE(static_cast<bool>(Parse(specs, records, &outputs)));
+  for (int i = 0; i < 5; ++i) {
+    Example example;
+    ASSERT_TRUE(example.ParseFromString(records[i]));
+    const auto& features = example.features().feature();
+    EXPECT_EQ(outputs.labels[i], features.at("label").int64_list().value(0));
+    for (int j = 0; j < 4; ++j) {
+      EXPECT_EQ(outputs.boxes[i * 4 + j],
+                features.at("box").float_list().value(j));
+    }
+    for (int j = 0; j < 2; ++j) {
+      EXPECT_EQ(outputs.names[i * 2 + j],
+                features.at("names").bytes_list().value(j));
+    }
+  }
+}
+
+// The records that do not have a feature, or have it without values, get its
+// default values.
+TEST(ExampleParserTest, Defaults) {
+  auto specs = CreateSpecs();
+  specs[0].int64_default = {-1};
+  specs[1].float_default = {1, 2, 3, 4};
+  specs[2].string_default = {"x", "y"};
+
+  Example example;
+  auto& features = *example.mutable_features()->mutable_feature();
+  features["label"].mutable_int64_list()->add_value(7);
+  features["box"].mutable_float_list();
+  const std::vector<std::string> records = {example.SerializeAsString(),
+                                            Example().SerializeAsString()};
+
+  Outputs outputs(records.size());
+  ASSERT_FALSE(static_cast<bool>(Parse(specs, records, &outputs)));
+  EXPECT_EQ(outputs.labels, std::vector<int64_t>({7, -1}));
+  EXPECT_EQ(outputs.boxes, std::vector<float>({1, 2, 3, 4, 1, 2, 3, 4}));
+  EXPECT_EQ(outputs.names, std::vector<std::string>({"x", "y", "x", "y"}));
+}
+
+// The values of the int64 and float lists may be packed or not, and in
+// several fields.
+TEST(ExampleParserTest, UnpackedAndPackedValues) {
+  auto fixed32 = [](float value) {
+    std::string bytes(4, '\0');
+    std::memcpy(&bytes[0], &value, 4);
+    return bytes;
+  };
+  const std::string label =
+      LengthDelimited(3, Varint(1 << 3 | 0) + Varint(42));
+  const std::string box = LengthDelimited(
+      2, Varint(1 << 3 | 5) + fixed32(0.5f) +
+             LengthDelimited(1, fixed32(1.5f) + fixed32(2.5f)) +
+             Varint(1 << 3 | 5) + fixed32(3.5f));
+  const std::string names = LengthDelimited(
+      1, LengthDelimited(1, "first") + LengthDelimited(1, "second"));
+  const std::vector<std::string> records = {EncodeExample("label", label) +
+                                            EncodeExample("box", box) +
+                                            EncodeExample("names", names)};
+
+  Outputs outputs(records.size());
+  ASSERT_FALSE(static_cast<bool>(Parse(CreateSpecs(), records, &outputs)));
+  EXPECT_EQ(outputs.labels, std::vector<int64_t>({42}));
+  EXPECT_EQ(outputs.boxes, std::vector<float>({0.5f, 1.5f, 2.5f, 3.5f}));
+  EXPECT_EQ(outputs.names, std::vector<std::string>({"first", "second"}));
+}
+
+TEST(ExampleParserTest, Errors) {
+  Example valid;
+  auto& features = *valid.mutable_features()->mutable_feature();
+  features["label"].mutable_int64_list()->add_value(1);
+  for (int j = 0; j < 4; ++j) {
+    features["box"].mutable_float_list()->add_value(j);
+  }
+  features["names"].mutable_bytes_list()->add_value("a");
+  features["names"].mutable_bytes_list()->add_value("b");
+  const std::string record = valid.SerializeAsString();
+  const auto specs = CreateSpecs();
+  ASSERT_EQ(ParseError(specs, {record}), "");
+
+  Example missing = valid;
+  missing.mutable_features()->mutable_feature()->erase("label");
+  EXPECT_EQ(ParseError(specs, {record, missing.SerializeAsString()}),
+            "record 1 does not have required feature label");
+
+  Example wrong_count = valid;
+  (*wrong_count.mutable_features()->mutable_feature())["box"]
+      .mutable_float_list()
+      ->add_value(5);
+  EXPECT_EQ(ParseError(specs, {wrong_count.SerializeAsString()}),
+            "feature box of record 0 has 5 values, expected 4");
+
+  Example wrong_kind = valid;
+  (*wrong_kind.mutable_features()->mutable_feature())["label"]
+      .mutable_bytes_list()
+      ->add_value("1");
+  EXPECT_EQ(ParseError(specs, {wrong_kind.SerializeAsString()}),
+            "feature label of record 0 does not have type I64");
+
+  EXPECT_EQ(ParseError(specs, {record, record.substr(0, record.size() - 1)}),
+            "record 1 is not a valid Example");
+  EXPECT_EQ(ParseError(specs, {"\xff"}), "record 0 is not a valid Example");
+}
+
+}  // namespace
+}  // namespace proto
+}  // namespace tfrt
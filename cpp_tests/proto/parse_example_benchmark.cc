@@ -0,0 +1,126 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- parse_example_benchmark.cc -----------------------------------------===//
+//
+// Benchmark for parsing batches of image classification tf.Example records,
+// with the Example message like proto.parse_example_from_bytes and
+// proto.get_*_field_from_example, and with ExampleParser like
+// proto.parse_example_batch.
+//
+//===----------------------------------------------------------------------===//
+
+#include <string>
+#include <vector>
+
+#include "backends/cpu/lib/kernels/proto/example_parser.h"
+#include "benchmark/benchmark.h"
+#include "llvm/Support/Error.h"
+#include "tfrt/cpu/kernels/proto/example.proto.h"
+
+namespace tfrt {
+namespace proto {
+namespace {
+
+constexpr int kBatchSize = 64;
+
+// Returns records with an encoded image, its size, its label, a bounding box,
+// and text features that are not parsed.
+std::vector<std::string> CreateRecords() {
+  std::vector<std::string> records;
+  for (int i = 0; i < kBatchSize; ++i) {
+    Example example;
+    auto& features = *example.mutable_features()->mutable_feature();
+    features["image/encoded"].mutable_bytes_list()->add_value(
+        std::string(4096, 'x'));
+    features["image/format"].mutable_bytes_list()->add_value("jpeg");
+    features["image/filename"].mutable_bytes_list()->add_value(
+        "n01440764_10026.JPEG");
+    features["image/class/text"].mutable_bytes_list()->add_value("tench");
+    features["image/height"].mutable_int64_list()->add_value(375);
+    features["image/width"].mutable_int64_list()->add_value(500);
+    features["image/class/label"].mutable_int64_list()->add_value(i % 1000);
+    auto* bbox = features["image/object/bbox"].mutable_float_list();
+    for (float value : {0.1f, 0.2f, 0.8f, 0.9f}) bbox->add_value(value);
+    records.push_back(example.SerializeAsString());
+  }
+  return records;
+}
+
+std::vector<FeatureSpec> CreateSpecs() {
+  std::vector<FeatureSpec> specs(5);
+  specs[0].key = "image/encoded";
+  specs[0].dtype = DType(DType::String);
+  specs[1].key = "image/height";
+  specs[1].dtype = DType(DType::I64);
+  specs[2].key = "image/width";
+  specs[2].dtype = DType(DType::I64);
+  specs[3].key = "image/class/label";
+  specs[3].dtype = DType(DType::I64);
+  specs[4].key = "image/object/bbox";
+  specs[4].dtype = DType(DType::F32);
+  specs[4].shape = {4};
+  return specs;
+}
+
+void BM_ParseExampleMessage(benchmark::State& state) {
+  const std::vector<std::string> records = CreateRecords();
+  std::vector<std::string> images(kBatchSize);
+  std::vector<int64_t> heights(kBatchSize), widths(kBatchSize),
+      labels(kBatchSize);
+  std::vector<float> bboxes(kBatchSize * 4);
+
+  for (auto _ : state) {
+    for (int i = 0; i < kBatchSize; ++i) {
+      Example example;
+      example.ParseFromString(records[i]);
+      const auto& features = example.features().feature();
+      images[i] = features.at("image/encoded").bytes_list().value(0);
+      heights[i] = features.at("image/height").int64_list().value(0);
+      widths[i] = features.at("image/width").int64_list().value(0);
+      labels[i] = features.at("image/class/label").int64_list().value(0);
+      const auto& bbox = features.at("image/object/bbox").float_list();
+      for (int j = 0; j < 4; ++j) bboxes[i * 4 + j] = bbox.value(j);
+    }
+    benchmark::DoNotOptimize(labels.data());
+  }
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+void BM_ExampleParser(benchmark::State& state) {
+  const std::vector<std::string> records = CreateRecords();
+  const std::vector<FeatureSpec> specs = CreateSpecs();
+  std::vector<std::string> images(kBatchSize);
+  std::vector<int64_t> heights(kBatchSize), widths(kBatchSize),
+      labels(kBatchSize);
+  std::vector<float> bboxes(kBatchSize * 4);
+  void* outputs[] = {images.data(), heights.data(), widths.data(),
+                     labels.data(), bboxes.data()};
+
+  for (auto _ : state) {
+    ExampleParser parser(specs);
+    llvm::cantFail(parser.Parse(records, outputs));
+    benchmark::DoNotOptimize(labels.data());
+  }
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+BENCHMARK(BM_ParseExampleMessage);
+BENCHMARK(BM_ExampleParser);
+
+}  // namespace
+}  // namespace proto
+}  // namespace tfrt
@@ -0,0 +1,86 @@
+// Copyright 2020 The TensorFlow Runtime Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//===- latch_test.cc --------------------------------------------*- C++ -*-===//
+//
+//===- crc32c_test.cc -------------------------------------------*- C++ -*-===//
+//
+// Tests for CRC32C checksums.
+//
+//===----------------------------------------------------------------------===//
+
+#include "tfrt/support/crc32c.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace tfrt {
+namespace {
+
+// Test vectors are from RFC 3720 section B.4.
+TEST(Crc32cTest, StandardResults) {
+  char buf[32];
+
+  memset(buf, 0, sizeof(buf));
+  EXPECT_EQ(0x8a9136aa, crc32c::Value(buf, sizeof(buf)));
+
+  memset(buf, 0xff, sizeof(buf));
+  EXPECT_EQ(0x62a8ab43, crc32c::Value(buf, sizeof(buf)));
+
+  for (int i = 0; i < 32; i++) buf[i] = i;
+  EXPECT_EQ(0x46dd794e, crc32c::Value(buf, sizeof(buf)));
+
+  for (int i = 0; i < 32; i++) buf[i] = 31 - i;
+  EXPECT_EQ(0x113fdb5c, crc32c::Value(buf, sizeof(buf)));
+
+  unsigned char data[48] = {
+      0x01, 0xc0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00,
+      0x00, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00, 0x18, 0x28, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  };
+  EXPECT_EQ(0xd9963a56,
+            crc32c::Value(reinterpret_cast<char*>(data), sizeof(data)));
+}
+
+TEST(Crc32cTest, Values) {
+  EXPECT_NE(crc32c::Value("a", 1), crc32c::Value("foo", 3));
+  EXPECT_EQ(0u, crc32c::Value("", 0));
+}
+
+TEST(Crc32cTest, Extend) {
+  std::string data(1000, 0);
+  for (size_t i = 0; i < data.size(); ++i) data[i] = i * 7;
+  const uint32_t expected = crc32c::Value(data.data(), data.size());
+
+  // Split at every offset, which covers all alignments of both parts.
+  for (size_t split = 0; split <= data.size(); ++split) {
+    uint32_t crc = crc32c::Value(data.data(), split);
+    EXPECT_EQ(expected, crc32c::Extend(crc, data.data() + split,
+                                       data.size() - split));
+  }
+}
+
+TEST(Crc32cTest, Mask) {
+  uint32_t crc = crc32c::Value("foo", 3);
+  EXPECT_NE(crc, crc32c::Mask(crc));
+  EXPECT_NE(crc, crc32c::Mask(crc32c::Mask(crc)));
+  EXPECT_EQ(crc, crc32c::Unmask(crc32c::Mask(crc)));
+  EXPECT_EQ(crc, crc32c::Unmask(crc32c::Unmask(
+                     crc32c::Mask(crc32c::Mask(crc)))));
+}
+
+}  // namespace
+}  // namespace tfrt
@@ -131,6 +131,19 @@ def tfrt_dependencies():
         ],
     )
 
+    maybe(
+        name = "libjpeg_turbo",
+        repo_rule = tfrt_http_archive,
+        build_file = "//third_party:libjpeg_turbo.BUILD",
+        sha256 = "7777c3c19762940cff42b3ba4d7cd5c52d1671b39a79532050c85efb99079064",
+        strip_prefix = "libjpeg-turbo-2.0.4",
+        system_build_file = "//third_party/systemlibs:libjpeg_turbo.BUILD",
+        urls = [
+            "https://storage.googleapis.com/mirror.tensorflow.org/github.com/libjpeg-turbo/libjpeg-turbo/archive/2.0.4.tar.gz",
+            "https://github.com/libjpeg-turbo/libjpeg-turbo/archive/2.0.4.tar.gz",
+        ],
+    )
+
     maybe(
         name = "zlib",
         repo_rule = tfrt_http_archive,
@@ -0,0 +1,228 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- async_coroutine.h - Coroutine support for AsyncValueRef --*- C++ -*-===//
+//
+// This file adds C++20 coroutine support for functions returning
+// AsyncValueRef<T>, including kernels registered with TFRT_KERNEL.
+//
+// A coroutine can `co_await` an AsyncValueRef<U>. If the value is not yet
+// available, the coroutine is suspended, and it is resumed via the work queue
+// when the value becomes available. If the awaited value is an error, the
+// error is propagated to the coroutine result and the coroutine is destroyed.
+//
+//   static AsyncValueRef<int32_t> AddOneAsync(Argument<int32_t> arg,
+//                                             const ExecutionContext& ctx) {
+//     AsyncValueRef<int32_t> value =
+//         ctx.host()->EnqueueWork([v = *arg] { return v; });
+//     int32_t v = co_await value;
+//     co_return v + 1;
+//   }
+//
+//   registry->AddKernel("tfrt_test.add_one_async", TFRT_KERNEL(AddOneAsync));
+//
+// The coroutine must take a `HostContext*` or a `const ExecutionContext&`
+// parameter. The coroutine frame is allocated from the HostContext allocator.
+//
+// Kernel arguments (Argument<T>, RemainingArguments, etc.) are views into the
+// kernel frame, and must not be used after the first suspension point. Take an
+// AsyncValueRef with Argument<T>::ValueRef() if a value is needed later.
+//
+// Coroutines require C++20 (or the coroutines TS). If the compiler does not
+// support them, this header defines nothing, and TFRT_HAS_COROUTINES is 0.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef TFRT_HOST_CONTEXT_ASYNC_COROUTINE_H_
+#define TFRT_HOST_CONTEXT_ASYNC_COROUTINE_H_
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define TFRT_HAS_COROUTINES 1
+#define TFRT_COROUTINE_NAMESPACE std
+#elif defined(__cpp_coroutines) && __has_include(<experimental/coroutine>)
+#include <experimental/coroutine>
+#define TFRT_HAS_COROUTINES 1
+#define TFRT_COROUTINE_NAMESPACE std::experimental
+#else
+#define TFRT_HAS_COROUTINES 0
+#endif
+
+#if TFRT_HAS_COROUTINES
+
+#include <cstddef>
+#include <cstdlib>
+#include <initializer_list>
+
+#include "tfrt/host_context/async_value_ref.h"
+#include "tfrt/host_context/execution_context.h"
+#include "tfrt/host_context/host_context.h"
+
+namespace tfrt {
+namespace coroutine_internal {
+
+namespace coro = ::TFRT_COROUTINE_NAMESPACE;
+
+inline HostContext* FindHost(HostContext* host) { return host; }
+inline HostContext* FindHost(const ExecutionContext& exec_ctx) {
+  return exec_ctx.host();
+}
+template <typename T>
+HostContext* FindHost(const T&) {
+  return nullptr;
+}
+
+// Returns the first HostContext found in the coroutine arguments.
+template <typename... Args>
+HostContext* FindHostInArgs(const Args&... args) {
+  HostContext* host = nullptr;
+  // Evaluated left to right, keeps the first non-null host.
+  (void)std::initializer_list<int>{
+      (host = host ? host : FindHost(args), 0)...};
+  assert(host && "coroutine must take HostContext* or ExecutionContext");
+  return host;
+}
+
+// Coroutine frames are allocated from the HostContext allocator. The host is
+// stored in front of the frame, so we can find it in operator delete.
+struct alignas(alignof(std::max_align_t)) FrameHeader {
+  HostContext* host;
+};
+
+inline void* AllocateFrame(HostContext* host, size_t size) {
+  void* ptr = host->AllocateBytes(sizeof(FrameHeader) + size,
+                                  alignof(FrameHeader));
+  auto* header = static_cast<FrameHeader*>(ptr);
+  header->host = host;
+  return header + 1;
+}
+
+inline void DeallocateFrame(void* ptr, size_t size) {
+  auto* header = static_cast<FrameHeader*>(ptr) - 1;
+  header->host->DeallocateBytes(header, sizeof(FrameHeader) + size);
+}
+
+// Promise type for coroutines returning AsyncValueRef<T>.
+template <typename T>
+class AsyncValuePromise {
+ public:
+  template <typename... Args>
+  explicit AsyncValuePromise(const Args&... args)
+      : host_(FindHostInArgs(args...)),
+        result_(host_->MakeUnconstructedAsyncValueRef<T>()) {}
+
+  template <typename... Args>
+  static void* operator new(size_t size, const Args&... args) {
+    return AllocateFrame(FindHostInArgs(args...), size);
+  }
+
+  static void operator delete(void* ptr, size_t size) {
+    DeallocateFrame(ptr, size);
+  }
+
+  AsyncValueRef<T> get_return_object() { return result_.CopyRef(); }
+
+  // Coroutine starts running synchronously in the caller thread, and the frame
+  // is destroyed as soon as it completes.
+  coro::suspend_never initial_suspend() noexcept { return {}; }
+  coro::suspend_never final_suspend() noexcept { return {}; }
+
+  void return_value(Expected<T> value) { result_.emplace(std::move(value)); }
+
+  // Exceptions are disabled in TFRT.
+  void unhandled_exception() { std::abort(); }
+
+  HostContext* host() const { return host_; }
+  const AsyncValueRef<T>& result() const { return result_; }
+
+ private:
+  HostContext* host_;
+  AsyncValueRef<T> result_;
+};
+
+// Awaiter for AsyncValueRef<T>.
+template <typename T>
+class AsyncValueAwaiter {
+ public:
+  explicit AsyncValueAwaiter(AsyncValueRef<T> value)
+      : value_(std::move(value)) {}
+
+  bool await_ready() const { return value_.IsAvailable() && !value_.IsError(); }
+
+  // Always returns true, the coroutine is resumed (or destroyed) only from the
+  // AsyncValue waiter, never inline.
+  template <typename U>
+  bool await_suspend(coro::coroutine_handle<AsyncValuePromise<U>> handle) {
+    AsyncValue* value = value_.GetAsyncValue();
+
+    // Error is already available, propagate it to the coroutine result.
+    if (value->IsError()) {
+      PropagateError(value, handle);
+      return true;
+    }
+
+    HostContext* host = handle.promise().host();
+    value->AndThen([value, handle, host]() {
+      if (value->IsError()) {
+        PropagateError(value, handle);
+        return;
+      }
+      // Resume the coroutine on the worker that resolved the value.
+      host->EnqueueWork([handle]() { handle.resume(); },
+                        WorkerAffinity::SameWorker());
+    });
+    return true;
+  }
+
+  // The returned reference is valid for as long as the awaited AsyncValueRef.
+  T& await_resume() const { return value_.get(); }
+
+ private:
+  // Sets the error to the coroutine result, and destroys the coroutine. The
+  // awaiter lives in the coroutine frame, so it must not be accessed after
+  // calling this function.
+  template <typename U>
+  static void PropagateError(
+      AsyncValue* value, coro::coroutine_handle<AsyncValuePromise<U>> handle) {
+    handle.promise().result().SetError(value->GetError());
+    handle.destroy();
+  }
+
+  AsyncValueRef<T> value_;
+};
+
+}  // namespace coroutine_internal
+
+template <typename T>
+coroutine_internal::AsyncValueAwaiter<T> operator co_await(
+    const AsyncValueRef<T>& value) {
+  return coroutine_internal::AsyncValueAwaiter<T>(value.CopyRef());
+}
+
+}  // namespace tfrt
+
+namespace TFRT_COROUTINE_NAMESPACE {
+
+template <typename T, typename... Args>
+struct coroutine_traits<::tfrt::AsyncValueRef<T>, Args...> {
+  using promise_type = ::tfrt::coroutine_internal::AsyncValuePromise<T>;
+};
+
+}  // namespace TFRT_COROUTINE_NAMESPACE
+
+#endif  // TFRT_HAS_COROUTINES
+
+#endif  // TFRT_HOST_CONTEXT_ASYNC_COROUTINE_H_
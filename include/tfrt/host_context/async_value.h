@@ -33,6 +33,7 @@
 #include <string>
 #include <type_traits>
 
+#include "llvm/ADT/FunctionExtras.h"
 #include "llvm/ADT/PointerIntPair.h"
 #include "tfrt/host_context/diagnostic.h"
 #include "tfrt/host_context/host_context_ptr.h"
@@ -162,6 +163,12 @@ class AsyncValue {
   template <typename WaiterT>
   void AndThen(WaiterT&& waiter);
 
+  // Keeps `value` alive until this value is available. This is equivalent to
+  // an AndThen waiter that only holds `value`, but the reference is stored in
+  // place of the waiter list if the list is empty, so it does not allocate a
+  // waiter node.
+  void KeepAliveUntilAvailable(RCReference<AsyncValue> value);
+
   HostContext* GetHostContext() const { return host_context_.get(); }
   HostContextPtr GetHostContextPtr() const { return host_context_; }
 
@@ -252,6 +259,7 @@ class AsyncValue {
   // Implementation details follow.  Clients should ignore them.
 
   friend class HostContext;
+  friend class NotifierListNode;
   friend class IndirectAsyncValue;
   // Destructor returns the size of the derived AsyncValue to be deallocated.
   using Destructor = size_t (*)(AsyncValue*);
@@ -347,11 +355,10 @@ class AsyncValue {
     static inline NotifierListNode* getFromVoidPointer(void* ptr) {
       return static_cast<NotifierListNode*>(ptr);
     }
-    // NotifierListNode has an alignment of at least alignof(void*).
-    enum {
-      NumLowBitsAvailable =
-          llvm::PointerLikeTypeTraits<void**>::NumLowBitsAvailable
-    };
+    // NotifierListNode and AsyncValue have an alignment of at least
+    // alignof(void*). The lowest two bits hold the state, and the next one
+    // tells a waiter node from an AsyncValue kept alive in place of the list.
+    enum { NumLowBitsAvailable = 2 };
   };
 
   // The waiter list and the state are compacted into one single atomic word as
@@ -401,8 +408,34 @@ class AsyncValue {
   // Returns the TypeInfoTable instance (there is one per process).
   static TypeInfoTable* GetTypeInfoTableSingleton();
 
+  // Waiters that are trivially copyable and fit into kInlineWaiterSize bytes
+  // are stored inline in the waiter list node. Other waiters are type erased
+  // with llvm::unique_function, which may allocate for large captures.
+  static constexpr size_t kInlineWaiterSize = 4 * sizeof(void*);
+
+  template <typename WaiterT>
+  using IsInlineWaiter =
+      std::integral_constant<bool, std::is_trivially_copyable<WaiterT>::value &&
+                                       sizeof(WaiterT) <= kInlineWaiterSize &&
+                                       alignof(WaiterT) <= alignof(void*)>;
+
+  template <typename WaiterT>
+  void EnqueueWaiter(WaiterT&& waiter, WaitersAndState old_value,
+                     std::true_type /*is_inline_waiter*/);
+  template <typename WaiterT>
+  void EnqueueWaiter(WaiterT&& waiter, WaitersAndState old_value,
+                     std::false_type /*is_inline_waiter*/);
+
+  void EnqueueWaiter(void (*invoke)(void* waiter), const void* waiter,
+                     size_t size, WaitersAndState old_value);
   void EnqueueWaiter(llvm::unique_function<void()>&& waiter,
                      WaitersAndState old_value);
+  void EnqueueWaiter(NotifierListNode* node, WaitersAndState old_value);
+
+  // The bit of the waiter list pointer that tells an AsyncValue kept alive by
+  // KeepAliveUntilAvailable from a waiter node. Such a value is always at the
+  // end of the list.
+  static constexpr uintptr_t kKeepAliveTag = 4;
 
   /// This is a global counter of the number of AsyncValue instances currently
   /// live in the process.  This is intended to be used for debugging only, and
@@ -742,7 +775,26 @@ void AsyncValue::AndThen(WaiterT&& waiter) {
     waiter();
     return;
   }
-  EnqueueWaiter(std::forward<WaiterT>(waiter), old_value);
+  EnqueueWaiter(std::forward<WaiterT>(waiter), old_value,
+                IsInlineWaiter<std::decay_t<WaiterT>>());
+}
+
+template <typename WaiterT>
+void AsyncValue::EnqueueWaiter(WaiterT&& waiter, WaitersAndState old_value,
+                               std::true_type) {
+  using Waiter = std::decay_t<WaiterT>;
+  Waiter copy(std::forward<WaiterT>(waiter));
+  // The waiter is trivially copyable, it is copied into the node bytewise and
+  // does not need to be destroyed.
+  EnqueueWaiter([](void* waiter) { (*static_cast<Waiter*>(waiter))(); }, &copy,
+                sizeof(Waiter), old_value);
+}
+
+template <typename WaiterT>
+void AsyncValue::EnqueueWaiter(WaiterT&& waiter, WaitersAndState old_value,
+                               std::false_type) {
+  EnqueueWaiter(llvm::unique_function<void()>(std::forward<WaiterT>(waiter)),
+                old_value);
 }
 
 }  // namespace tfrt
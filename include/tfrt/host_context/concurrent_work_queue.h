@@ -24,6 +24,7 @@
 #ifndef TFRT_HOST_CONTEXT_CONCURRENT_WORK_QUEUE_H_
 #define TFRT_HOST_CONTEXT_CONCURRENT_WORK_QUEUE_H_
 
+#include <chrono>
 #include <functional>
 #include <memory>
 
@@ -84,6 +85,16 @@ class ConcurrentWorkQueue {
   // thread.
   virtual void AddTask(TaskFunction work) = 0;
 
+  // Enqueue a block of work with a worker affinity hint. Thread-safe.
+  //
+  // The default implementation is for work queues without indexed workers,
+  // i.e. whose GetCurrentWorkerIndex() is always -1. There is no worker to
+  // prefer, so every hint, including WorkerAffinity::SameWorker(), means any
+  // worker. Work queues with indexed workers override it to honour the hint.
+  virtual void AddTask(TaskFunction work, WorkerAffinity affinity) {
+    AddTask(std::move(work));
+  }
+
   // Enqueue a blocking task. Thread-safe.
   //
   // If `allow_queuing` is false, implementation must guarantee that work will
@@ -113,6 +124,10 @@ class ConcurrentWorkQueue {
   // TODO(clattner): this is a terrible name.
   virtual int GetParallelismLevel() const = 0;
 
+  // Return the index of the calling worker thread in [0, parallelism level),
+  // or -1 if the caller is not a non-blocking worker thread of this queue.
+  virtual int GetCurrentWorkerIndex() const { return -1; }
+
   ConcurrentWorkQueue() = default;
 
  private:
@@ -137,13 +152,52 @@ std::unique_ptr<ConcurrentWorkQueue> CreateSingleThreadedWorkQueue();
 // num_threads: Number of pre-allocated threads used in non-blocking concurrent
 // work queue, in addition to the host donor threads.
 //
-// num_blocking_threads: Number of pre-allocated threads used in blocking
-// work queue.
+// num_blocking_threads: Maximum number of threads used for queued blocking
+// work. The blocking work queue starts with a single thread and grows on
+// demand up to this limit. Threads started on demand exit after being idle for
+// one second.
 //
 // Requires `num_threads` > 0 and `num_blocking_threads` > 0.
 std::unique_ptr<ConcurrentWorkQueue> CreateMultiThreadedWorkQueue(
     int num_threads, int num_blocking_threads);
 
+// Same as above, with explicit control over the blocking work queue.
+//
+// blocking_idle_timeout: For how long a blocking thread started on demand waits
+// for the next task before exiting.
+//
+// max_num_pending_blocking_tasks: Maximum number of queued blocking tasks that
+// wait for a free blocking thread. If the limit is reached, new blocking work
+// is rejected, and HostContext::EnqueueBlockingWork reports a failure to the
+// caller. Producers should treat it as a backpressure signal.
+//
+// Requires `max_num_pending_blocking_tasks` >= 0.
+std::unique_ptr<ConcurrentWorkQueue> CreateMultiThreadedWorkQueue(
+    int num_threads, int num_blocking_threads,
+    std::chrono::nanoseconds blocking_idle_timeout,
+    int max_num_pending_blocking_tasks);
+
+// Create a multi-threaded work queue that records the order in which tasks are
+// enqueued and started, and the worker threads they run on. The log is written
+// to `log_path` while the work queue runs: whenever 64 KiB of events are
+// buffered, when a worker runs out of tasks, when a thread starts waiting in
+// Await or Quiesce, and when the work queue is destroyed. The log of a run
+// that crashes is therefore mostly complete. It can be replayed with a work
+// queue created by CreateReplayWorkQueue.
+//
+// This work queue is intended for debugging and profiling scheduling-dependent
+// problems, and is slower than the multi-threaded work queue.
+//
+// Requires `num_threads` > 0.
+std::unique_ptr<ConcurrentWorkQueue> CreateRecordingWorkQueue(
+    int num_threads, string_view log_path);
+
+// Create a multi-threaded work queue that replays the log written by the
+// recording work queue: non-blocking tasks start in the recorded order on the
+// recorded worker threads. The number of threads is read from the log.
+Expected<std::unique_ptr<ConcurrentWorkQueue>> CreateReplayWorkQueue(
+    string_view log_path);
+
 // A factory function for creating ConcurrentWorkQueue objects. The factory
 // function defines the semantics of the argument string.
 // TODO(pgavin): Consider using a configuration object or other data structure
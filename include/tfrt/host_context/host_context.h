@@ -28,6 +28,7 @@
 #include "llvm/Support/Compiler.h"
 #include "tfrt/host_context/async_value_ref.h"
 #include "tfrt/host_context/kernel_registry.h"
+#include "tfrt/host_context/task_function.h"
 
 namespace tfrt {
 
@@ -192,6 +193,11 @@ class HostContext {
   // Add some non-blocking work to the work_queue managed by this CPU device.
   void EnqueueWork(llvm::unique_function<void()> work);
 
+  // Add some non-blocking work to the work_queue managed by this CPU device,
+  // with a hint about which worker thread should run it. See WorkerAffinity.
+  void EnqueueWork(llvm::unique_function<void()> work,
+                   WorkerAffinity affinity);
+
   // Add some non-blocking work to the work_queue managed by this CPU device.
   // Return AsyncValueRef<R> for work that returns R. R cannot be void.
   //
@@ -202,6 +208,12 @@ class HostContext {
             std::enable_if_t<!std::is_void<R>(), int> = 0>
   LLVM_NODISCARD AsyncValueRef<R> EnqueueWork(F&& work);
 
+  // Same as above, with a hint about which worker thread should run `work`.
+  template <typename F, typename R = ResultTypeT<F>,
+            std::enable_if_t<!std::is_void<R>(), int> = 0>
+  LLVM_NODISCARD AsyncValueRef<R> EnqueueWork(F&& work,
+                                              WorkerAffinity affinity);
+
   // Add some blocking work to the work_queue managed by this CPU device.
   LLVM_NODISCARD bool EnqueueBlockingWork(llvm::unique_function<void()> work);
 
@@ -215,6 +227,12 @@ class HostContext {
   // created to handle blocking work (enqueued by EnqueueBlockingWork).
   int GetNumWorkerThreads() const;
 
+  // Returns the index of the calling worker thread in [0, number of worker
+  // threads), or -1 if the caller is not a worker thread of this host. The
+  // result can be passed to WorkerAffinity::Worker() to send follow-up work
+  // back to the same thread.
+  int GetCurrentWorkerIndex() const;
+
   // Run the specified function when the specified set of AsyncValue's are all
   // resolved.  This is a set-version of "AndThen".
   void RunWhenReady(ArrayRef<AsyncValue*> values,
@@ -331,6 +349,17 @@ AsyncValueRef<R> HostContext::EnqueueWork(F&& work) {
   return result;
 }
 
+template <typename F, typename R, std::enable_if_t<!std::is_void<R>(), int>>
+AsyncValueRef<R> HostContext::EnqueueWork(F&& work, WorkerAffinity affinity) {
+  auto result = this->MakeUnconstructedAsyncValueRef<R>();
+  this->EnqueueWork(
+      [result = result.CopyRef(), work = std::forward<F>(work)]() mutable {
+        result.emplace(work());
+      },
+      affinity);
+  return result;
+}
+
 template <typename F, typename R, std::enable_if_t<!std::is_void<R>(), int>>
 AsyncValueRef<R> HostContext::EnqueueBlockingWork(F&& work) {
   auto result = this->MakeUnconstructedAsyncValueRef<R>();
@@ -16,7 +16,8 @@
 
 //===- task_function.h - Task Function Abstraction --------------*- C++ -*-===//
 //
-// This file defines the TaskFunction class for representing work queue tasks.
+// This file defines the TaskFunction class for representing work queue tasks,
+// and the WorkerAffinity hint that can be attached to them.
 //
 //===----------------------------------------------------------------------===//
 
@@ -46,6 +47,42 @@ class TaskFunction {
   llvm::unique_function<void()> work_;
 };
 
+// WorkerAffinity is a hint to the work queue about which worker thread should
+// run a non-blocking task. It is used to keep producer-consumer chains on the
+// same core, so the consumer finds the producer's data in a warm cache. Work
+// queue implementations are free to ignore the hint, and clients must not rely
+// on it for correctness.
+class WorkerAffinity {
+ public:
+  // No preference, the work queue picks a worker.
+  static WorkerAffinity Any() { return WorkerAffinity(kAny); }
+
+  // Prefer the worker that is submitting the task. Equivalent to Any() if the
+  // caller is not a worker thread of the work queue.
+  static WorkerAffinity SameWorker() { return WorkerAffinity(kSameWorker); }
+
+  // Prefer the worker with the given index in [0, parallelism level). Indices
+  // can be obtained from HostContext::GetCurrentWorkerIndex().
+  static WorkerAffinity Worker(int index) {
+    return index < 0 ? Any() : WorkerAffinity(index);
+  }
+
+  bool IsAny() const { return value_ == kAny; }
+  bool IsSameWorker() const { return value_ == kSameWorker; }
+
+  // Returns the requested worker index, or -1 if this is not a specific worker
+  // hint.
+  int worker_index() const { return value_ >= 0 ? value_ : -1; }
+
+ private:
+  static constexpr int kAny = -1;
+  static constexpr int kSameWorker = -2;
+
+  explicit WorkerAffinity(int value) : value_(value) {}
+
+  int value_;
+};
+
 }  // namespace tfrt
 
 #endif  // TFRT_HOST_CONTEXT_TASK_FUNCTION_H_
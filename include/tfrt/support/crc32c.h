@@ -0,0 +1,62 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- crc32c.h - CRC32C Checksums ------------------------------*- C++ -*-===//
+//
+// This file declares CRC32C (Castagnoli) checksum utilities. The checksum uses
+// the SSE4.2 or ARMv8 CRC32 instructions when the CPU supports them, and a
+// table based implementation otherwise.
+//
+//===----------------------------------------------------------------------===//
+#ifndef TFRT_SUPPORT_CRC32C_H_
+#define TFRT_SUPPORT_CRC32C_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace tfrt {
+namespace crc32c {
+
+// Returns the crc32c of concat(A, data[0,n-1]) where init_crc is the crc32c of
+// some string A.
+uint32_t Extend(uint32_t init_crc, const char* data, size_t n);
+
+// Returns the crc32c of data[0,n-1].
+inline uint32_t Value(const char* data, size_t n) { return Extend(0, data, n); }
+
+// Returns true if Extend uses the CRC32 instructions of the CPU.
+bool IsHardwareAccelerated();
+
+static constexpr uint32_t kMaskDelta = 0xa282ead8ul;
+
+// Returns a masked representation of crc. It is problematic to compute the CRC
+// of a string that contains embedded CRCs, so TFRecord files store masked
+// CRCs.
+inline uint32_t Mask(uint32_t crc) {
+  // Rotate right by 15 bits and add a constant.
+  return ((crc >> 15) | (crc << 17)) + kMaskDelta;
+}
+
+// Returns the crc whose masked representation is masked_crc.
+inline uint32_t Unmask(uint32_t masked_crc) {
+  uint32_t rot = masked_crc - kMaskDelta;
+  return ((rot >> 17) | (rot << 15));
+}
+
+}  // namespace crc32c
+}  // namespace tfrt
+
+#endif  // TFRT_SUPPORT_CRC32C_H_
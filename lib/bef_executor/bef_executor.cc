@@ -203,6 +203,7 @@ class BEFExecutor final : public ReferenceCounted<BEFExecutor> {
                       AsyncValue* result, int* entry_offset,
                       SmallVectorImpl<unsigned>* kernel_ids);
   void MaybeAddRefForResult(AsyncValue* result);
+  RCReference<AsyncValue> GetLocationHandlerHold();
   HostContext* GetHost() const { return location_handler_->GetHost(); }
 
  private:
@@ -225,6 +226,11 @@ class BEFExecutor final : public ReferenceCounted<BEFExecutor> {
 
   // Make sure location handler is alive as long as there is pending execution.
   RCReference<BEFLocationHandler> location_handler_;
+
+  // An available AsyncValue that holds a reference to location_handler_. It is
+  // created by the first unused result that is not available, and is kept
+  // alive by such results instead of the location handler itself.
+  std::atomic<AsyncValue*> location_handler_hold_{nullptr};
 };
 
 //===----------------------------------------------------------------------===//
@@ -359,10 +365,31 @@ void BEFExecutor::ProcessArgumentsPseudoKernel(
 // unavailable result.
 void BEFExecutor::MaybeAddRefForResult(AsyncValue* result) {
   if (!result->IsAvailable()) {
-    result->AndThen([handler = location_handler_.CopyRef()]() {});
+    // The hold is stored in place of the empty waiter list of the result, so
+    // keeping it alive does not allocate a waiter node.
+    result->KeepAliveUntilAvailable(GetLocationHandlerHold());
   }
 }
 
+RCReference<AsyncValue> BEFExecutor::GetLocationHandlerHold() {
+  AsyncValue* hold = location_handler_hold_.load(std::memory_order_acquire);
+  if (!hold) {
+    AsyncValue* new_hold =
+        GetHost()
+            ->MakeConcreteAsyncValueRef<RCReference<BEFLocationHandler>>(
+                location_handler_.CopyRef())
+            .release();
+    if (location_handler_hold_.compare_exchange_strong(
+            hold, new_hold, std::memory_order_acq_rel,
+            std::memory_order_acquire)) {
+      hold = new_hold;
+    } else {
+      new_hold->DropRef();
+    }
+  }
+  return FormRef(hold);
+}
+
 /// Decrement arguments_not_ready counters for the specified kernels by one,
 /// executing them if they are now ready to run. This processes the kernels
 /// from the end of the vector to the start - worklist style.
@@ -563,7 +590,10 @@ BEFExecutor::BEFExecutor(BEFFileImpl* bef_file, HostContext* host,
   DecrementArgumentsNotReadyCounts(&kernel_ids_to_visit);
 }
 
-BEFExecutor::~BEFExecutor() {}
+BEFExecutor::~BEFExecutor() {
+  if (auto* hold = location_handler_hold_.load(std::memory_order_relaxed))
+    hold->DropRef();
+}
 
 // Set RegisterInfo::value for argument registers.
 static void InitializeArgumentRegisters(
@@ -0,0 +1,181 @@
+// Copyright 2020 The TensorFlow Runtime Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//===- autotuner.cc -------------------------------------------------------===//
+//
+// This file implements the Autotuner.
+//
+//===----------------------------------------------------------------------===//
+
+#include "autotuner.h"
+
+#include <algorithm>
+
+#include "llvm/ADT/SmallVector.h"
+
+namespace tfrt {
+namespace data {
+
+namespace {
+
+constexpr int64_t kDefaultMemoryBudget = int64_t{1} << 30;
+constexpr std::chrono::milliseconds kDefaultPeriod(50);
+constexpr int64_t kMaxBufferSize = 1024;
+
+// Fractions of the tuning period, see the Autotuner comment.
+constexpr double kBottleneckThreshold = 0.01;
+constexpr double kBusyThreshold = 0.8;
+constexpr double kIdleThreshold = 0.5;
+constexpr double kInputBoundThreshold = 0.5;
+
+}  // namespace
+
+TunableParameter::TunableParameter(Kind kind, int64_t num_producers,
+                                   const IteratorStats* stats,
+                                   HostContext* host)
+    : kind_(kind),
+      num_producers_(num_producers),
+      stats_(stats),
+      autotuner_(&host->GetOrCreateSharedContext<Autotuner>()),
+      last_step_ns_(IteratorStats::Now()) {
+  autotuner_->Register(this);
+}
+
+TunableParameter::~TunableParameter() { autotuner_->Unregister(this); }
+
+Autotuner::Autotuner(HostContext* host)
+    : period_ns_(std::chrono::nanoseconds(kDefaultPeriod).count()),
+      cpu_budget_(host->GetNumWorkerThreads()),
+      memory_budget_(kDefaultMemoryBudget) {}
+
+void Autotuner::SetBudget(int64_t cpu_budget, int64_t memory_budget) {
+  mutex_lock lock(mu_);
+  cpu_budget_ = cpu_budget;
+  memory_budget_ = memory_budget;
+}
+
+void Autotuner::SetPeriod(std::chrono::nanoseconds period) {
+  period_ns_.store(period.count(), std::memory_order_relaxed);
+  next_step_ns_.store(0, std::memory_order_relaxed);
+}
+
+void Autotuner::Register(TunableParameter* parameter) {
+  mutex_lock lock(mu_);
+  parameters_.push_back(parameter);
+}
+
+void Autotuner::Unregister(TunableParameter* parameter) {
+  mutex_lock lock(mu_);
+  parameters_.erase(
+      std::find(parameters_.begin(), parameters_.end(), parameter));
+}
+
+void Autotuner::Tune(int64_t now) {
+  using Kind = TunableParameter::Kind;
+
+  // The counters of a parameter over the last period, as fractions of the
+  // period.
+  struct Usage {
+    bool active = false;
+    // Fraction of the period that the producers were busy.
+    double busy = 0;
+    // Fraction of the period that the iterator waited for its input.
+    double wait = 0;
+    // Fraction of the period that the consumer waited for the iterator.
+    double consumer_wait = 0;
+  };
+
+  mutex_lock lock(mu_);
+  SmallVector<Usage, 8> usages(parameters_.size());
+  int64_t cpu_used = 0;
+  int64_t memory_used = 0;
+  for (size_t i = 0, e = parameters_.size(); i < e; ++i) {
+    TunableParameter* parameter = parameters_[i];
+    const IteratorStats& stats = *parameter->stats_;
+    const int64_t value = parameter->value();
+
+    const int64_t num_elements = stats.num_elements();
+    const int64_t num_bytes = stats.num_bytes();
+    const int64_t wait_time_ns = stats.wait_time_ns();
+    const int64_t produce_time_ns = stats.produce_time_ns();
+    const int64_t consumer_wait_time_ns =
+        parameter->consumer_wait_time_ns_.load(std::memory_order_relaxed);
+    const int64_t elements = num_elements - parameter->last_num_elements_;
+    const int64_t bytes = num_bytes - parameter->last_num_bytes_;
+    const int64_t elapsed_ns = now - parameter->last_step_ns_;
+    if (elements > 0 && elapsed_ns > 0) {
+      // Every concurrent call is a producer.
+      const int64_t num_producers = parameter->kind_ == Kind::kParallelism
+                                        ? value
+                                        : parameter->num_producers_;
+      Usage& usage = usages[i];
+      usage.active = true;
+      usage.busy = static_cast<double>(produce_time_ns -
+                                       parameter->last_produce_time_ns_) /
+                   (elapsed_ns * num_producers);
+      usage.wait =
+          static_cast<double>(wait_time_ns - parameter->last_wait_time_ns_) /
+          elapsed_ns;
+      usage.consumer_wait =
+          static_cast<double>(consumer_wait_time_ns -
+                              parameter->last_consumer_wait_time_ns_) /
+          elapsed_ns;
+      if (bytes > 0) parameter->element_bytes_ = bytes / elements;
+    }
+    parameter->last_step_ns_ = now;
+    parameter->last_num_elements_ = num_elements;
+    parameter->last_num_bytes_ = num_bytes;
+    parameter->last_wait_time_ns_ = wait_time_ns;
+    parameter->last_produce_time_ns_ = produce_time_ns;
+    parameter->last_consumer_wait_time_ns_ = consumer_wait_time_ns;
+
+    if (parameter->kind_ == Kind::kParallelism) cpu_used += value;
+    memory_used +=
+        value * parameter->num_producers_ * parameter->element_bytes_;
+  }
+
+  for (size_t i = 0, e = parameters_.size(); i < e; ++i) {
+    TunableParameter* parameter = parameters_[i];
+    const Usage& usage = usages[i];
+    const int64_t value = parameter->value();
+    const int64_t element_bytes =
+        parameter->num_producers_ * parameter->element_bytes_;
+
+    const bool is_bottleneck =
+        usage.active && usage.consumer_wait > kBottleneckThreshold;
+
+    int64_t new_value = value;
+    if (parameter->kind_ == Kind::kParallelism) {
+      if (cpu_used > cpu_budget_ ||
+          (usage.active && !is_bottleneck && usage.busy < kIdleThreshold)) {
+        new_value = std::max<int64_t>(value - 1, 1);
+      } else if (is_bottleneck && usage.wait < kInputBoundThreshold &&
+                 cpu_used + 1 <= cpu_budget_ &&
+                 memory_used + element_bytes <= memory_budget_) {
+        new_value = value + 1;
+      }
+      cpu_used += new_value - value;
+    } else if (is_bottleneck && usage.busy < kBusyThreshold &&
+               value < kMaxBufferSize &&
+               memory_used + value * element_bytes <= memory_budget_) {
+      new_value = std::min(value * 2, kMaxBufferSize);
+    }
+
+    memory_used += (new_value - value) * element_bytes;
+    parameter->value_.store(new_value, std::memory_order_relaxed);
+  }
+}
+
+}  // namespace data
+}  // namespace tfrt
@@ -0,0 +1,177 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- autotuner.h ----------------------------------------------*- C++ -*-===//
+//
+// This file declares the Autotuner, which chooses the buffer sizes and the
+// parallelism of the input pipeline iterators at runtime.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef TFRT_LIB_DATA_AUTOTUNER_H_
+#define TFRT_LIB_DATA_AUTOTUNER_H_
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "dataset.h"
+#include "tfrt/host_context/shared_context.h"
+#include "tfrt/support/mutex.h"
+
+namespace tfrt {
+namespace data {
+
+class Autotuner;
+
+// The value of a buffer size or parallelism attribute that lets the Autotuner
+// choose it.
+constexpr int64_t kAutotune = -1;
+
+// A parameter of an iterator that is chosen by the Autotuner. The iterator
+// reads value() whenever it decides whether to produce more elements, so that
+// a new value takes effect immediately.
+class TunableParameter {
+ public:
+  enum class Kind {
+    // The number of elements produced concurrently. Each of them uses a worker
+    // thread while it is produced.
+    kParallelism,
+    // The number of elements buffered ahead of the consumer by each of the
+    // `num_producers` producers of the iterator.
+    kBufferSize,
+  };
+
+  // Registers the parameter of the iterator with `stats` with the Autotuner of
+  // `host`. The parameter starts at 1.
+  TunableParameter(Kind kind, int64_t num_producers, const IteratorStats* stats,
+                   HostContext* host);
+
+  // Unregisters the parameter. The iterator must destroy it before `stats`.
+  ~TunableParameter();
+
+  // This class is not copyable or movable.
+  TunableParameter(const TunableParameter&) = delete;
+  TunableParameter& operator=(const TunableParameter&) = delete;
+
+  int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+  // Adds the time that the consumer of the iterator waited for an element,
+  // e.g. because it was returned before it was available.
+  void AddConsumerWaitTime(int64_t ns) {
+    consumer_wait_time_ns_.fetch_add(ns, std::memory_order_relaxed);
+  }
+
+  // Runs a tuning step if the tuning period elapsed since the last step.
+  // Iterators call it from GetNext, so the Autotuner only runs while the input
+  // pipeline is in use.
+  void MaybeTune();
+
+ private:
+  friend class Autotuner;
+
+  const Kind kind_;
+  const int64_t num_producers_;
+  const IteratorStats* const stats_;
+  Autotuner* const autotuner_;
+  std::atomic<int64_t> value_{1};
+  std::atomic<int64_t> consumer_wait_time_ns_{0};
+
+  // Time and counters at the last tuning step, only used by the Autotuner.
+  int64_t last_step_ns_;
+  int64_t last_num_elements_ = 0;
+  int64_t last_num_bytes_ = 0;
+  int64_t last_wait_time_ns_ = 0;
+  int64_t last_produce_time_ns_ = 0;
+  int64_t last_consumer_wait_time_ns_ = 0;
+  // Average size of an element in bytes, or 0 if it is unknown.
+  int64_t element_bytes_ = 0;
+};
+
+// Autotuner periodically adjusts the registered TunableParameters to maximize
+// the throughput of the input pipeline within a CPU budget, in worker threads,
+// and a memory budget, in bytes of buffered elements. It is shared by all the
+// input pipelines of a HostContext:
+//
+//   Autotuner& autotuner = host->GetOrCreateSharedContext<Autotuner>();
+//
+// Each tuning step uses the counters of the tuned iterators over the last
+// period. A tuned iterator is the bottleneck of its consumer if the consumer
+// waited for its elements for more than 1% of the period.
+//
+// - The parallelism of a bottleneck iterator is increased by one, unless the
+//   iterator spent most of the period waiting for its input. The parallelism
+//   of an iterator that is not a bottleneck is decreased by one if its calls
+//   were busy for less than half of the period, i.e. its consumer is slower
+//   than its calls.
+//
+// - The buffer size of a bottleneck iterator is doubled if its producers were
+//   busy for less than 80% of the period, i.e. a larger buffer would absorb
+//   the variations of the input speed. A buffer does not help an input that
+//   is always slower than its consumer, and buffer sizes are never decreased.
+//   They are at most 1024 elements per producer.
+//
+// Increases that exceed either budget are skipped, and the parallelism is
+// decreased while the CPU budget is exceeded, e.g. after SetBudget.
+class Autotuner : public SharedContext {
+ public:
+  explicit Autotuner(HostContext* host);
+
+  // Sets the maximum sum of the parallelism of the tuned iterators, and the
+  // maximum size in bytes of the elements buffered by the tuned iterators.
+  void SetBudget(int64_t cpu_budget, int64_t memory_budget);
+
+  // Sets the time between two tuning steps.
+  void SetPeriod(std::chrono::nanoseconds period);
+
+ private:
+  friend class TunableParameter;
+
+  void Register(TunableParameter* parameter);
+  void Unregister(TunableParameter* parameter);
+
+  // Runs a tuning step if the tuning period elapsed since the last step. The
+  // periods are timed with the clock of the iterator counters.
+  void MaybeTune() {
+    int64_t now = IteratorStats::Now();
+    int64_t next_step_ns = next_step_ns_.load(std::memory_order_relaxed);
+    if (now < next_step_ns) return;
+    // Only one of the threads that see the end of the period runs the step.
+    if (!next_step_ns_.compare_exchange_strong(
+            next_step_ns, now + period_ns_.load(std::memory_order_relaxed),
+            std::memory_order_relaxed)) {
+      return;
+    }
+    Tune(now);
+  }
+
+  void Tune(int64_t now);
+
+  std::atomic<int64_t> period_ns_;
+  std::atomic<int64_t> next_step_ns_{0};
+
+  mutex mu_;
+  int64_t cpu_budget_ TFRT_GUARDED_BY(mu_);
+  int64_t memory_budget_ TFRT_GUARDED_BY(mu_);
+  std::vector<TunableParameter*> parameters_ TFRT_GUARDED_BY(mu_);
+};
+
+inline void TunableParameter::MaybeTune() { autotuner_->MaybeTune(); }
+
+}  // namespace data
+}  // namespace tfrt
+
+#endif  // TFRT_LIB_DATA_AUTOTUNER_H_
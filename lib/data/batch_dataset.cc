@@ -14,8 +14,7 @@
 
 //===- batch_dataset.cc ---------------------------------------------------===//
 //
-// This file implements BatchDatasetHelper class to batch an array of tensors
-// into one tensor.
+// This file implements the helpers that copy tensors into a batch tensor.
 //
 //===----------------------------------------------------------------------===//
 
@@ -24,42 +23,42 @@
 namespace tfrt {
 namespace data {
 
-template <>
-llvm::Expected<DenseHostTensor> BatchValues<DenseHostTensor>(
-    ArrayRef<DenseHostTensor> values, HostAllocator* allocator) {
-  // Verify that all batched tensors have the same dtype and tensor shape.
-  for (int i = 1, e = values.size(); i < e; i++) {
-    assert((values[0].metadata() == values[i].metadata()) &&
-           "tensors to be batched must have the same metadata");
-  }
+namespace internal {
+
+TensorMetadata GetBatchMetadata(const DenseHostTensor& value,
+                                ssize_t batch_size) {
   // Construct the output tensor with the +1 dimension and the same dtype as
   // the batched tensors.
   SmallVector<ssize_t, 4> output_dims;
-  values[0].shape().GetDimensions(&output_dims);
-  const int original_rank = output_dims.size();
-  output_dims.resize(original_rank + 1);
-  for (int i = original_rank; i > 0; i--) {
-    output_dims[i] = output_dims[i - 1];
-  }
-  output_dims[0] = values.size();
-  TensorMetadata output_metadata(values[0].metadata().dtype, output_dims);
+  value.shape().GetDimensions(&output_dims);
+  output_dims.insert(output_dims.begin(), batch_size);
+  return TensorMetadata(value.metadata().dtype, output_dims);
+}
 
-  auto output_dht =
-      DenseHostTensor::CreateUninitialized(output_metadata, allocator);
-  if (!output_dht) {
-    return MakeStringError("failed to create uninitialized tensor");
+bool IsBatchCompatible(const DenseHostTensor& value,
+                       const TensorMetadata& batch_metadata) {
+  const TensorShape& batch_shape = batch_metadata.shape;
+  if (value.metadata().dtype != batch_metadata.dtype ||
+      value.shape().GetRank() + 1 != batch_shape.GetRank()) {
+    return false;
   }
-  // IDEA(donglin): We can optimize performance by returning a tensor backed by
-  // the data of the batched tensors without copying data.
-  // Copy data from the batched tensors to the output tensor
-  size_t data_size = values[0].DataSizeInBytes();
-  for (int i = 0; i < values.size(); i++) {
-    char* ptr = static_cast<char*>(output_dht->data()) + i * data_size;
-    std::memcpy(ptr, values[i].data(), data_size);
+  for (int i = 0, e = value.shape().GetRank(); i < e; ++i) {
+    if (value.shape().GetDimensionSize(i) !=
+        batch_shape.GetDimensionSize(i + 1)) {
+      return false;
+    }
   }
+  return true;
+}
 
-  return std::move(*output_dht);
+void CopyToBatch(const DenseHostTensor& value, ssize_t index,
+                 DenseHostTensor* batch) {
+  size_t data_size = value.DataSizeInBytes();
+  char* ptr = static_cast<char*>(batch->data()) + index * data_size;
+  std::memcpy(ptr, value.data(), data_size);
 }
 
+}  // namespace internal
+
 }  // namespace data
 }  // namespace tfrt
@@ -29,11 +29,16 @@
 #ifndef TFRT_DATA_BATCH_DATASET_H_
 #define TFRT_DATA_BATCH_DATASET_H_
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+
 #include "dataset.h"
 #include "llvm/ADT/SmallVector.h"
 #include "tfrt/host_context/execution_context.h"
 #include "tfrt/support/error_util.h"
 #include "tfrt/support/forward_decls.h"
+#include "tfrt/support/mutex.h"
 #include "tfrt/support/ref_count.h"
 #include "tfrt/support/string_util.h"
 #include "tfrt/support/template_util.h"
@@ -60,83 +65,183 @@ using DHTDataset = RepeatTypeHelperT<Dataset, N, DenseHostTensor>;
 template <size_t N>
 using DHTTuple = RepeatTypeHelperT<std::tuple, N, DenseHostTensor>;
 
-// Template for BatchDatasetHelper<T> where T is a scalar type. GetNext()
-// should return a 1-D DenseHostTensor of the batched scalar values.
+namespace internal {
+
+// Returns the metadata of a batch of `batch_size` scalar values. The batch is
+// a 1-D tensor of the same scalar type.
 template <typename T>
-llvm::Expected<DenseHostTensor> BatchValues(ArrayRef<T> values,
-                                            HostAllocator* allocator) {
+TensorMetadata GetBatchMetadata(const T& value, ssize_t batch_size) {
   static_assert(std::is_scalar<T>::value, "T needs to be a scalar type");
-  // Construct a 1-D tensor as output.
-  ssize_t size = values.size();
-  TensorMetadata output_metadata(GetDType<T>(), {size});
+  return TensorMetadata(GetDType<T>(), ArrayRef<ssize_t>(batch_size));
+}
 
-  auto output_dht =
-      DenseHostTensor::CreateUninitialized(output_metadata, allocator);
-  if (!output_dht) {
-    return MakeStringError("failed to create uninitialized tensor");
-  }
-  // Copy scalar values into the output tensor.
-  MutableDHTArrayView<T> output_dht_view(output_dht.getPointer());
-  std::copy(values.begin(), values.end(), output_dht_view.Elements().begin());
+// Returns the metadata of a batch of `batch_size` tensors like `value`. The
+// batch has the same dtype and +1 dimension.
+TensorMetadata GetBatchMetadata(const DenseHostTensor& value,
+                                ssize_t batch_size);
 
-  return std::move(*output_dht);
+// Returns true if `value` can be copied into a batch with `batch_metadata`.
+template <typename T>
+bool IsBatchCompatible(const T& value, const TensorMetadata& batch_metadata) {
+  return true;
+}
+
+bool IsBatchCompatible(const DenseHostTensor& value,
+                       const TensorMetadata& batch_metadata);
+
+// Copies `value` into the `index`th slot of `batch`.
+template <typename T>
+void CopyToBatch(const T& value, ssize_t index, DenseHostTensor* batch) {
+  static_cast<T*>(batch->data())[index] = value;
 }
 
-// Template specialization for BatchDataset<DenseHostTensor>. GetNext() returns
-// a DenseHostTensor with +1 dimension. The current implementation copies data
-// of the batched tensors to construct a new tensor.
-template <>
-llvm::Expected<DenseHostTensor> BatchValues<DenseHostTensor>(
-    ArrayRef<DenseHostTensor> values, HostAllocator* allocator);
-
-template <std::size_t N, std::size_t Index, typename... T>
-struct TuplesToDHTsHelper {
-  // This method converts std::vector<std::tuple<T...>> into
-  // std::tuple<DenseHostTensor...>. The i'th element of the output tuple is a
-  // DenseHostTensor presenting batched value of i'th values of every input
-  // tuple.
-  static llvm::Expected<DHTTuple<N - Index>> Convert(
-      std::vector<std::tuple<T...>>& tuples, HostAllocator* allocator) {
-    using ElementT = typename std::tuple_element<Index, std::tuple<T...>>::type;
-    // Move 'Index'th value of every tuple into a vector.
-    std::vector<ElementT> values;
-    for (int i = 0, e = tuples.size(); i < e; i++) {
-      values.push_back(std::move(std::get<Index>(tuples[i])));
+void CopyToBatch(const DenseHostTensor& value, ssize_t index,
+                 DenseHostTensor* batch);
+
+// BatchBuilder assembles a batch from input elements that become available
+// in any order. The batch tensors are allocated when the first element is
+// available, and every element is copied into its slot as soon as it is
+// available, so that copies overlap with the production of the next elements.
+template <typename... T>
+class BatchBuilder : public ReferenceCounted<BatchBuilder<T...>> {
+ public:
+  BatchBuilder(ssize_t batch_size, AsyncValueRef<DHTTuple<sizeof...(T)>> result,
+               HostAllocator* allocator)
+      : batch_size_(batch_size),
+        num_pending_(batch_size),
+        result_(std::move(result)),
+        allocator_(allocator) {}
+
+  // Copies the input element at `index` into the batch. This must be called
+  // once for every index in [0, batch_size), possibly concurrently, or once
+  // for all of them with AddBatch. The result is set by the last call.
+  void Add(ssize_t index, AsyncValue* element,
+           const ExecutionContext& exec_ctx) {
+    if (element->IsError()) {
+      SetError(element->GetError());
+    } else {
+      AddElement(index, element->get<std::tuple<T...>>(), exec_ctx,
+                 std::make_index_sequence<sizeof...(T)>{});
     }
-    // Batch the vector of values into std::tuple<DenseHostTensor>.
-    auto dht = BatchValues<ElementT>(ArrayRef<ElementT>(values), allocator);
-    if (!dht) {
-      return dht.takeError();
+    CompleteElements(1);
+  }
+
+  // Copies the input elements into the batch at once.
+  void AddBatch(ArrayRef<std::tuple<T...>> elements,
+                const ExecutionContext& exec_ctx) {
+    assert(static_cast<ssize_t>(elements.size()) == batch_size_);
+    for (ssize_t i = 0; i < batch_size_; ++i) {
+      AddElement(i, elements[i], exec_ctx,
+                 std::make_index_sequence<sizeof...(T)>{});
     }
-    auto head_tuple = std::make_tuple(std::move(*dht));
-    // Recursively convert the remaining values of tuples into
-    // std::tuple<DenseHostTensor...>.
-    auto tail_tuple =
-        TuplesToDHTsHelper<N, Index + 1U, T...>::Convert(tuples, allocator);
-    if (!tail_tuple) {
-      return tail_tuple.takeError();
+    CompleteElements(batch_size_);
+  }
+
+ private:
+  friend class ReferenceCounted<BatchBuilder>;
+
+  void Destroy() { internal::DestroyImpl<BatchBuilder>(this, allocator_); }
+
+  // Sets the result if the last `n` pending elements were added.
+  void CompleteElements(ssize_t n) {
+    if (num_pending_.fetch_sub(n) != n) return;
+
+    llvm::Optional<DecodedDiagnostic> error;
+    {
+      mutex_lock lock(mu_);
+      error = std::move(error_);
+    }
+    if (error) {
+      result_.SetError(*error);
+      return;
     }
-    // Concatenate the first_tuple with the tail_tuple.
-    return std::tuple_cat(std::move(head_tuple), std::move(*tail_tuple));
+    result_.emplace(MakeResult(std::make_index_sequence<sizeof...(T)>{}));
   }
-};
 
-// Base case for TuplesToDHTsHelper<N, Index, T...> where Index == N.
-template <std::size_t N, typename... T>
-struct TuplesToDHTsHelper<N, N, T...> {
-  static llvm::Expected<std::tuple<>> Convert(
-      std::vector<std::tuple<T...>>& tuples, HostAllocator* allocator) {
-    return std::make_tuple();
+  template <size_t... I>
+  void AddElement(ssize_t index, const std::tuple<T...>& value,
+                  const ExecutionContext& exec_ctx, std::index_sequence<I...>) {
+    {
+      mutex_lock lock(mu_);
+      if (error_) return;
+      if (!batch_[0].hasValue()) {
+        if (!AllocateBatch(value, exec_ctx)) return;
+      }
+      bool compatible[] = {
+          IsBatchCompatible(std::get<I>(value), batch_[I]->metadata())...};
+      if (std::find(std::begin(compatible), std::end(compatible), false) !=
+          std::end(compatible)) {
+        SetErrorLocked(EmitError(
+            exec_ctx, "tensors to be batched must have the same metadata"));
+        return;
+      }
+    }
+    // Slots are disjoint, the copies run concurrently.
+    (void)std::initializer_list<int>{
+        (CopyToBatch(std::get<I>(value), index, batch_[I].getPointer()), 0)...};
   }
+
+  bool AllocateBatch(const std::tuple<T...>& value,
+                     const ExecutionContext& exec_ctx) TFRT_REQUIRES(mu_) {
+    return AllocateBatch(value, exec_ctx,
+                         std::make_index_sequence<sizeof...(T)>{});
+  }
+
+  template <size_t... I>
+  bool AllocateBatch(const std::tuple<T...>& value,
+                     const ExecutionContext& exec_ctx,
+                     std::index_sequence<I...>) TFRT_REQUIRES(mu_) {
+    bool allocated[] = {
+        (batch_[I] = DenseHostTensor::CreateUninitialized(
+             GetBatchMetadata(std::get<I>(value), batch_size_), allocator_))
+            .hasValue()...};
+    if (std::find(std::begin(allocated), std::end(allocated), false) !=
+        std::end(allocated)) {
+      SetErrorLocked(
+          EmitError(exec_ctx, "failed to create uninitialized tensor"));
+      return false;
+    }
+    return true;
+  }
+
+  template <size_t... I>
+  DHTTuple<sizeof...(T)> MakeResult(std::index_sequence<I...>) {
+    return DHTTuple<sizeof...(T)>(std::move(*batch_[I])...);
+  }
+
+  void SetError(const DecodedDiagnostic& error) {
+    mutex_lock lock(mu_);
+    SetErrorLocked(error);
+  }
+
+  void SetErrorLocked(const DecodedDiagnostic& error) TFRT_REQUIRES(mu_) {
+    if (!error_) error_.emplace(error);
+  }
+
+  const ssize_t batch_size_;
+  std::atomic<ssize_t> num_pending_;
+  AsyncValueRef<DHTTuple<sizeof...(T)>> result_;
+  HostAllocator* allocator_;
+
+  mutex mu_;
+  // The batch tensors. They are written without holding the mutex once
+  // allocated, and read by the last Add call.
+  std::array<llvm::Optional<DenseHostTensor>, sizeof...(T)> batch_;
+  llvm::Optional<DecodedDiagnostic> error_ TFRT_GUARDED_BY(mu_);
 };
 
-// Convert std::vector<std::tuple<T...>> to std::tuple<DenseHostTensor...>
+// Returns a BatchBuilder that sets `result` to a batch of `batch_size`
+// elements. The builder and the batch are allocated with the host allocator.
 template <typename... T>
-static llvm::Expected<DHTTuple<sizeof...(T)>> TuplesToDHTs(
-    std::vector<std::tuple<T...>>& tuples, HostAllocator* allocator) {
-  return TuplesToDHTsHelper<sizeof...(T), 0, T...>::Convert(tuples, allocator);
+RCReference<BatchBuilder<T...>> MakeBatchBuilder(
+    ssize_t batch_size, AsyncValueRef<DHTTuple<sizeof...(T)>> result,
+    HostContext* host) {
+  return TakeRef(host->Construct<BatchBuilder<T...>>(
+      batch_size, std::move(result), host->allocator()));
 }
 
+}  // namespace internal
+
 template <typename... T>
 class BatchDataset : public DHTDataset<sizeof...(T)> {
  public:
@@ -153,6 +258,8 @@ class BatchDataset : public DHTDataset<sizeof...(T)> {
 
   RCReference<DHTIterator<sizeof...(T)>> MakeIterator() override;
 
+  bool IsBlocking() const override { return input_dataset_->IsBlocking(); }
+
  private:
   // Allow iterator to rely on private data members of this dataset.
   friend class BatchDatasetIterator<T...>;
@@ -182,12 +289,40 @@ class BatchDatasetIterator : public DHTIterator<sizeof...(T)> {
   AsyncValueRef<DHTTuple<sizeof...(T)>> GetNext(
       const ExecutionContext& exec_ctx) override;
 
+  AsyncValueRef<std::vector<DHTTuple<sizeof...(T)>>> GetNextBatch(
+      const ExecutionContext& exec_ctx, int64_t max_n) override;
+
+  // Inputs that produce elements one at a time are batched as the elements
+  // become available, so that the copies overlap with their production.
+  typename DHTIterator<sizeof...(T)>::BatchMode GetBatchMode() const override {
+    return input_iterator_->GetBatchMode() ==
+                   Iterator<T...>::BatchMode::kElementwise
+               ? DHTIterator<sizeof...(T)>::BatchMode::kElementwise
+               : DHTIterator<sizeof...(T)>::BatchMode::kAsync;
+  }
+
+  // The batches are built from elements that are already returned, so the
+  // state is the state of the input iterator.
+  llvm::Error Save(IteratorStateWriter* writer) override {
+    return input_iterator_->Save(writer);
+  }
+
+  llvm::Error Restore(IteratorStateReader* reader) override {
+    return input_iterator_->Restore(reader);
+  }
+
  private:
   void Destroy() override {
     internal::DestroyImpl<BatchDatasetIterator>(this,
                                                 parent_dataset_->allocator_);
   }
 
+  // Returns the batch of the elements of an input batch, once it is
+  // available.
+  AsyncValueRef<DHTTuple<sizeof...(T)>> BatchElements(
+      AsyncValueRef<std::vector<std::tuple<T...>>> elements,
+      const ExecutionContext& exec_ctx);
+
   RCReference<BatchDataset<T...>> parent_dataset_;
   RCReference<Iterator<T...>> input_iterator_;
 };
@@ -200,6 +335,14 @@ RCReference<DHTIterator<sizeof...(T)>> BatchDataset<T...>::MakeIterator() {
 template <typename... T>
 AsyncValueRef<DHTTuple<sizeof...(T)>> BatchDatasetIterator<T...>::GetNext(
     const ExecutionContext& exec_ctx) {
+  if (GetBatchMode() != DHTIterator<sizeof...(T)>::BatchMode::kElementwise) {
+    auto elements =
+        input_iterator_->GetNextBatch(exec_ctx, parent_dataset_->batch_size_);
+    if (!elements) return AsyncValueRef<DHTTuple<sizeof...(T)>>();
+    this->stats_.RecordElement();
+    return BatchElements(std::move(elements), exec_ctx);
+  }
+
   llvm::SmallVector<RCReference<AsyncValue>, 4> async_values;
   // Get up to batch_size values from the underlying iterator.
   for (int i = 0; i < parent_dataset_->batch_size_; i++) {
@@ -216,39 +359,97 @@ AsyncValueRef<DHTTuple<sizeof...(T)>> BatchDatasetIterator<T...>::GetNext(
     return AsyncValueRef<DHTTuple<sizeof...(T)>>();
   }
 
-  SmallVector<AsyncValue*, 4> async_value_ptrs;
-  // Translate RCReference<AsyncValue> to AsyncValue*.
-  for (auto& async_value : async_values) {
-    async_value_ptrs.push_back(async_value.get());
-  }
   auto async_result =
       exec_ctx.host()
           ->template MakeUnconstructedAsyncValueRef<DHTTuple<sizeof...(T)>>();
-  exec_ctx.host()->RunWhenReady(
-      async_value_ptrs, [exec_ctx, async_values = std::move(async_values),
-                         async_result = async_result.CopyRef(),
-                         parent_dataset = parent_dataset_.CopyRef()] {
-        std::vector<std::tuple<T...>> values;
-        values.reserve(parent_dataset->batch_size_);
-        for (auto& async_value : async_values) {
-          if (async_value->IsError()) {
-            async_result.SetError(async_value->GetError());
-            return;
-          }
-          auto& value = async_value->get<std::tuple<T...>>();
-          values.push_back(std::move(value));
-        }
-        auto result = TuplesToDHTs<T...>(values, parent_dataset->allocator_);
-        if (!result) {
-          async_result.SetError(EmitError(exec_ctx, result.takeError()));
-          return;
-        }
-        async_result.emplace(std::move(*result));
-      });
+  auto builder = internal::MakeBatchBuilder<T...>(
+      async_values.size(), async_result.CopyRef(), exec_ctx.host());
+  for (ssize_t i = 0, e = async_values.size(); i < e; ++i) {
+    AsyncValue* async_value = async_values[i].get();
+    async_value->AndThen([exec_ctx, builder = builder.CopyRef(), i,
+                          async_value = std::move(async_values[i])]() {
+      builder->Add(i, async_value.get(), exec_ctx);
+    });
+  }
 
+  this->stats_.RecordElement();
   return std::move(async_result);
 }
 
+template <typename... T>
+AsyncValueRef<std::vector<DHTTuple<sizeof...(T)>>>
+BatchDatasetIterator<T...>::GetNextBatch(const ExecutionContext& exec_ctx,
+                                         int64_t max_n) {
+  using Batches = std::vector<DHTTuple<sizeof...(T)>>;
+  if (GetBatchMode() == DHTIterator<sizeof...(T)>::BatchMode::kElementwise) {
+    return DHTIterator<sizeof...(T)>::GetNextBatch(exec_ctx, max_n);
+  }
+
+  // Get the elements of all the batches at once.
+  const int64_t batch_size = parent_dataset_->batch_size_;
+  auto elements = input_iterator_->GetNextBatch(exec_ctx, max_n * batch_size);
+  if (!elements) return AsyncValueRef<Batches>();
+  if (elements.IsError()) {
+    return AsyncValueRef<Batches>(elements.ReleaseRCRef());
+  }
+
+  auto async_result =
+      exec_ctx.host()->template MakeUnconstructedAsyncValueRef<Batches>();
+  elements.AndThen([iterator = FormRef(this), exec_ctx, batch_size,
+                    elements = elements.CopyRef(),
+                    async_result = async_result.CopyRef()]() {
+    if (elements.IsError()) {
+      async_result.SetError(elements.GetError());
+      return;
+    }
+    ArrayRef<std::tuple<T...>> remaining(elements.get());
+    Batches batches;
+    batches.reserve((remaining.size() + batch_size - 1) / batch_size);
+    while (!remaining.empty()) {
+      const size_t size = std::min<size_t>(batch_size, remaining.size());
+      auto batch = exec_ctx.host()
+                       ->template MakeUnconstructedAsyncValueRef<
+                           DHTTuple<sizeof...(T)>>();
+      auto builder = internal::MakeBatchBuilder<T...>(size, batch.CopyRef(),
+                                                      exec_ctx.host());
+      builder->AddBatch(remaining.take_front(size), exec_ctx);
+      // AddBatch completes the batch before it returns.
+      if (batch.IsError()) {
+        async_result.SetError(batch.GetError());
+        return;
+      }
+      batches.push_back(std::move(batch.get()));
+      remaining = remaining.drop_front(size);
+    }
+    iterator->stats_.RecordElements(batches.size());
+    async_result.emplace(std::move(batches));
+  });
+  return async_result;
+}
+
+template <typename... T>
+AsyncValueRef<DHTTuple<sizeof...(T)>> BatchDatasetIterator<T...>::BatchElements(
+    AsyncValueRef<std::vector<std::tuple<T...>>> elements,
+    const ExecutionContext& exec_ctx) {
+  if (elements.IsError()) {
+    return AsyncValueRef<DHTTuple<sizeof...(T)>>(elements.ReleaseRCRef());
+  }
+  auto async_result =
+      exec_ctx.host()
+          ->template MakeUnconstructedAsyncValueRef<DHTTuple<sizeof...(T)>>();
+  elements.AndThen([exec_ctx, elements = elements.CopyRef(),
+                    async_result = async_result.CopyRef()]() {
+    if (elements.IsError()) {
+      async_result.SetError(elements.GetError());
+      return;
+    }
+    auto builder = internal::MakeBatchBuilder<T...>(
+        elements.get().size(), async_result.CopyRef(), exec_ctx.host());
+    builder->AddBatch(elements.get(), exec_ctx);
+  });
+  return async_result;
+}
+
 }  // namespace data
 }  // namespace tfrt
 
@@ -0,0 +1,174 @@
+// Copyright 2020 The TensorFlow Runtime Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//===- cache_dataset.cc ---------------------------------------------------===//
+//
+// This file implements the spill file of CacheDataset.
+//
+// Every element is a sequence of values. A scalar value is its bytes. A string
+// value is its size as uint64_t followed by its bytes. A tensor value is a BTF
+// tensor record: the btf::TensorHeader, the dims as int64_t[rank], and the
+// row major tensor data.
+//
+//===----------------------------------------------------------------------===//
+
+#include "cache_dataset.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstdlib>
+
+#include "llvm/ADT/SmallVector.h"
+#include "tfrt/tensor/btf.h"
+
+namespace tfrt {
+namespace data {
+namespace internal {
+
+namespace {
+
+llvm::Optional<btf::TensorDType> GetBTFDType(DType dtype) {
+  switch (dtype.kind()) {
+    case DType::I8:
+      return btf::TensorDType::kInt8;
+    case DType::I16:
+      return btf::TensorDType::kInt16;
+    case DType::I32:
+      return btf::TensorDType::kInt32;
+    case DType::I64:
+      return btf::TensorDType::kInt64;
+    case DType::F32:
+      return btf::TensorDType::kFloat32;
+    case DType::F64:
+      return btf::TensorDType::kFloat64;
+    case DType::UI8:
+      return btf::TensorDType::kUInt8;
+    default:
+      return llvm::None;
+  }
+}
+
+llvm::Optional<DType> GetDType(btf::TensorDType dtype) {
+  switch (dtype) {
+    case btf::TensorDType::kInt8:
+      return DType(DType::I8);
+    case btf::TensorDType::kInt16:
+      return DType(DType::I16);
+    case btf::TensorDType::kInt32:
+      return DType(DType::I32);
+    case btf::TensorDType::kInt64:
+      return DType(DType::I64);
+    case btf::TensorDType::kFloat32:
+      return DType(DType::F32);
+    case btf::TensorDType::kFloat64:
+      return DType(DType::F64);
+    case btf::TensorDType::kUInt8:
+      return DType(DType::UI8);
+  }
+  return llvm::None;
+}
+
+// Reads `size` bytes from the front of `data` into `dst`.
+bool ReadBytes(string_view* data, void* dst, size_t size) {
+  if (data->size() < size) return false;
+  std::memcpy(dst, data->data(), size);
+  *data = data->drop_front(size);
+  return true;
+}
+
+}  // namespace
+
+bool WriteCachedValue(const std::string& value, std::FILE* file) {
+  const uint64_t size = value.size();
+  return std::fwrite(&size, sizeof(size), 1, file) == 1 &&
+         std::fwrite(value.data(), 1, size, file) == size;
+}
+
+bool WriteCachedValue(const DenseHostTensor& value, std::FILE* file) {
+  auto dtype = GetBTFDType(value.dtype());
+  if (!dtype) return false;
+
+  btf::TensorHeader header = {};
+  header.rank = value.shape().GetRank();
+  header.dtype = *dtype;
+  header.layout = btf::TensorLayout::kRMD;
+  SmallVector<ssize_t, 4> dims;
+  value.shape().GetDimensions(&dims);
+  SmallVector<int64_t, 4> dims64(dims.begin(), dims.end());
+  const size_t size = value.DataSizeInBytes();
+  return std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+         std::fwrite(dims64.data(), sizeof(int64_t), dims64.size(), file) ==
+             dims64.size() &&
+         std::fwrite(value.data(), 1, size, file) == size;
+}
+
+bool ReadCachedValue(string_view* data, HostAllocator* allocator,
+                     llvm::Optional<std::string>* value) {
+  uint64_t size;
+  if (!ReadBytes(data, &size, sizeof(size)) || data->size() < size) {
+    return false;
+  }
+  value->emplace(data->data(), size);
+  *data = data->drop_front(size);
+  return true;
+}
+
+bool ReadCachedValue(string_view* data, HostAllocator* allocator,
+                     llvm::Optional<DenseHostTensor>* value) {
+  btf::TensorHeader header;
+  if (!ReadBytes(data, &header, sizeof(header))) return false;
+  auto dtype = GetDType(header.dtype);
+  if (!dtype || header.layout != btf::TensorLayout::kRMD) return false;
+
+  SmallVector<int64_t, 4> dims64(header.rank);
+  if (!ReadBytes(data, dims64.data(), header.rank * sizeof(int64_t))) {
+    return false;
+  }
+  SmallVector<ssize_t, 4> dims(dims64.begin(), dims64.end());
+  auto tensor = DenseHostTensor::CreateUninitialized(
+      TensorMetadata(*dtype, dims), allocator);
+  if (!tensor || !ReadBytes(data, tensor->data(), tensor->DataSizeInBytes())) {
+    return false;
+  }
+  value->emplace(std::move(*tensor));
+  return true;
+}
+
+std::FILE* OpenSpillFile(const std::string& dir) {
+  std::string path = dir + "/tfrt_cache_dataset.XXXXXX";
+  int fd = mkstemp(&path[0]);
+  if (fd < 0) return nullptr;
+  unlink(path.c_str());
+  std::FILE* file = fdopen(fd, "w+b");
+  if (!file) close(fd);
+  return file;
+}
+
+RCReference<HostBuffer> MapSpillFile(std::FILE* file, size_t size) {
+  if (std::fflush(file) != 0) return {};
+  // mmap does not support empty mappings.
+  void* ptr = mmap(nullptr, std::max<size_t>(size, 1), PROT_READ, MAP_PRIVATE,
+                   fileno(file), 0);
+  if (ptr == MAP_FAILED) return {};
+  madvise(ptr, size, MADV_SEQUENTIAL);
+  return HostBuffer::CreateFromExternal(
+      ptr, size, [](void* ptr, size_t size) {
+        munmap(ptr, std::max<size_t>(size, 1));
+      });
+}
+
+}  // namespace internal
+}  // namespace data
+}  // namespace tfrt
@@ -0,0 +1,665 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- cache_dataset.h ------------------------------------------*- C++ -*-===//
+//
+// This file declares CacheDataset class which caches the elements of the first
+// iteration over another Dataset instance, and replays them in the following
+// iterations.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef TFRT_DATA_CACHE_DATASET_H_
+#define TFRT_DATA_CACHE_DATASET_H_
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "dataset.h"
+#include "llvm/ADT/Optional.h"
+#include "tfrt/host_context/chain.h"
+#include "tfrt/host_context/diagnostic.h"
+#include "tfrt/host_context/host_buffer.h"
+#include "tfrt/support/error_util.h"
+#include "tfrt/support/forward_decls.h"
+#include "tfrt/support/mutex.h"
+#include "tfrt/support/ref_count.h"
+#include "tfrt/tensor/dense_host_tensor.h"
+
+namespace tfrt {
+namespace data {
+
+template <typename... T>
+class CacheDatasetIterator;
+template <typename... T>
+class CacheReplayIterator;
+
+namespace internal {
+
+// Appends `value` to the spill file. Returns false if the value cannot be
+// written. Tensors are written as BTF tensor records, so only the dtypes
+// supported by BTF can be spilled.
+template <typename T>
+bool WriteCachedValue(const T& value, std::FILE* file) {
+  static_assert(std::is_arithmetic<T>::value, "T needs to be a scalar type");
+  return std::fwrite(&value, sizeof(T), 1, file) == 1;
+}
+bool WriteCachedValue(const std::string& value, std::FILE* file);
+bool WriteCachedValue(const DenseHostTensor& value, std::FILE* file);
+
+// Reads a value written by WriteCachedValue from the front of `data`, and
+// advances `data` past it. Returns false if the value cannot be read.
+template <typename T>
+bool ReadCachedValue(string_view* data, HostAllocator* allocator,
+                     llvm::Optional<T>* value) {
+  if (data->size() < sizeof(T)) return false;
+  T result;
+  std::memcpy(&result, data->data(), sizeof(T));
+  value->emplace(result);
+  *data = data->drop_front(sizeof(T));
+  return true;
+}
+bool ReadCachedValue(string_view* data, HostAllocator* allocator,
+                     llvm::Optional<std::string>* value);
+bool ReadCachedValue(string_view* data, HostAllocator* allocator,
+                     llvm::Optional<DenseHostTensor>* value);
+
+// Opens an anonymous spill file in `dir`. The file is removed from `dir`
+// right away, so it is deleted when closed. Returns nullptr on failure.
+std::FILE* OpenSpillFile(const std::string& dir);
+
+// Memory maps the first `size` bytes of the spill file for reading. Returns
+// nullptr on failure.
+RCReference<HostBuffer> MapSpillFile(std::FILE* file, size_t size);
+
+// DatasetCache holds the elements of the first iteration over a CacheDataset.
+//
+// The elements are added as they become available, in any order, and are
+// placed in the cache in their input order. The first elements are kept in
+// memory up to `memory_budget` bytes. If `spill_dir` is not empty, the
+// following elements are written sequentially to a spill file, which is
+// memory mapped once the cache is complete. Otherwise, the cache is abandoned
+// when it exceeds the memory budget.
+template <typename... T>
+class DatasetCache : public ReferenceCounted<DatasetCache<T...>> {
+ public:
+  DatasetCache(int64_t memory_budget, std::string spill_dir, HostContext* host)
+      : memory_budget_(memory_budget),
+        spill_dir_(std::move(spill_dir)),
+        allocator_(host->allocator()),
+        complete_(host->MakeUnconstructedAsyncValueRef<Chain>()) {}
+
+  ~DatasetCache() {
+    if (spill_file_) std::fclose(spill_file_);
+  }
+
+  // Adds the `index`th input element to the cache.
+  void Add(int64_t index, const std::tuple<T...>& element) {
+    State state;
+    {
+      mutex_lock lock(mu_);
+      if (state_ != State::kWriting) return;
+      pending_.emplace(index, CopyElement(element));
+      // Place the pending elements that follow the last placed element.
+      for (auto it = pending_.begin();
+           it != pending_.end() && it->first == num_placed_;
+           it = pending_.erase(it)) {
+        if (!Place(it->second)) break;
+        ++num_placed_;
+      }
+      MaybeFinishLocked();
+      state = state_;
+    }
+    Notify(state);
+  }
+
+  // Records that the input has `num_elements` elements. This must be called
+  // once the writer reaches the end of the input.
+  void SetNumElements(int64_t num_elements) {
+    State state;
+    {
+      mutex_lock lock(mu_);
+      if (state_ != State::kWriting) return;
+      num_elements_ = num_elements;
+      MaybeFinishLocked();
+      state = state_;
+    }
+    Notify(state);
+  }
+
+  // Abandons the cache and releases the cached elements. If `retry` is true,
+  // the dataset makes a new cache for the next iteration. Otherwise, the
+  // following iterations read from the input dataset.
+  void Abandon(string_view reason, bool retry) {
+    {
+      mutex_lock lock(mu_);
+      if (state_ != State::kWriting) return;
+      AbandonLocked(reason, retry);
+    }
+    Notify(State::kAbandoned);
+  }
+
+  // Returns true if all the input elements are requested by the writer.
+  bool HasAllElements() const {
+    mutex_lock lock(mu_);
+    return num_elements_ >= 0;
+  }
+
+  // Returns true if the cache is abandoned, and whether to make a new cache.
+  bool IsAbandoned(bool* retry) const {
+    mutex_lock lock(mu_);
+    *retry = retry_;
+    return state_ == State::kAbandoned;
+  }
+
+  // Returns the number of cached elements. HasAllElements() must be true.
+  int64_t num_elements() const {
+    mutex_lock lock(mu_);
+    return num_elements_;
+  }
+
+  // Available when the cache is complete, or an error if it is abandoned.
+  const AsyncValueRef<Chain>& complete() const { return complete_; }
+
+  // Returns a copy of the `index`th element. The cache must be complete. The
+  // cache is immutable once complete, so this does not acquire the mutex.
+  llvm::Expected<std::tuple<T...>> Read(int64_t index) const
+      TFRT_NO_THREAD_SAFETY_ANALYSIS {
+    assert(complete_.IsConcrete());
+    if (index < static_cast<int64_t>(memory_.size())) {
+      return CopyElement(memory_[index]);
+    }
+    const uint64_t offset = spill_offsets_[index - memory_.size()];
+    string_view data(static_cast<const char*>(spill_buffer_->data()) + offset,
+                     spill_buffer_->size() - offset);
+    return ReadElement(&data, std::index_sequence_for<T...>{});
+  }
+
+ private:
+  friend class ReferenceCounted<DatasetCache<T...>>;
+
+  enum class State { kWriting, kComplete, kAbandoned };
+
+  void Destroy() { internal::DestroyImpl<DatasetCache>(this, allocator_); }
+
+  // Sets complete_ if `state` is the result of a transition made by the
+  // caller. The state only changes once, so complete_ is set at most once.
+  // It is set without holding mu_ because it runs the waiting readers.
+  void Notify(State state) {
+    if (state == State::kComplete) {
+      complete_.emplace();
+    } else if (state == State::kAbandoned) {
+      complete_.SetError(DecodedDiagnostic(abandon_reason_));
+    }
+  }
+
+  template <size_t... I>
+  llvm::Expected<std::tuple<T...>> ReadElement(
+      string_view* data, std::index_sequence<I...>) const {
+    std::tuple<llvm::Optional<T>...> values;
+    // Use braced-init-list to read the values in sequence.
+    bool read[] = {
+        ReadCachedValue(data, allocator_, &std::get<I>(values))...};
+    if (std::find(std::begin(read), std::end(read), false) != std::end(read)) {
+      return MakeStringError("failed to read element from the cache file");
+    }
+    return std::tuple<T...>(std::move(*std::get<I>(values))...);
+  }
+
+  template <size_t... I>
+  bool WriteElement(const std::tuple<T...>& element,
+                    std::index_sequence<I...>) {
+    bool written[] = {WriteCachedValue(std::get<I>(element), spill_file_)...};
+    return std::find(std::begin(written), std::end(written), false) ==
+           std::end(written);
+  }
+
+  // Places the next element in memory or in the spill file. Returns false if
+  // the cache is abandoned.
+  bool Place(std::tuple<T...>& element) TFRT_REQUIRES(mu_) {
+    const size_t size = GetElementSizeInBytes(element);
+    if (!spill_file_ &&
+        (memory_budget_ <= 0 || memory_bytes_ + size <= memory_budget_)) {
+      memory_bytes_ += size;
+      memory_.push_back(std::move(element));
+      return true;
+    }
+
+    if (spill_dir_.empty()) {
+      AbandonLocked("cache_dataset exceeds its memory budget", false);
+      return false;
+    }
+    if (!spill_file_ && !(spill_file_ = OpenSpillFile(spill_dir_))) {
+      AbandonLocked("failed to open cache_dataset spill file", false);
+      return false;
+    }
+    spill_offsets_.push_back(spill_size_);
+    if (!WriteElement(element, std::index_sequence_for<T...>{})) {
+      AbandonLocked("failed to write cache_dataset spill file", false);
+      return false;
+    }
+    spill_size_ = std::ftell(spill_file_);
+    return true;
+  }
+
+  // Completes the cache if all the input elements are placed.
+  void MaybeFinishLocked() TFRT_REQUIRES(mu_) {
+    if (state_ != State::kWriting || num_placed_ != num_elements_) return;
+    if (spill_file_) {
+      spill_buffer_ = MapSpillFile(spill_file_, spill_size_);
+      if (!spill_buffer_) {
+        AbandonLocked("failed to map cache_dataset spill file", false);
+        return;
+      }
+    }
+    state_ = State::kComplete;
+  }
+
+  void AbandonLocked(string_view reason, bool retry) TFRT_REQUIRES(mu_) {
+    state_ = State::kAbandoned;
+    abandon_reason_ = reason.str();
+    retry_ = retry;
+    pending_.clear();
+    memory_.clear();
+    spill_offsets_.clear();
+    if (spill_file_) std::fclose(spill_file_);
+    spill_file_ = nullptr;
+  }
+
+  const int64_t memory_budget_;
+  const std::string spill_dir_;
+  HostAllocator* allocator_;
+  AsyncValueRef<Chain> complete_;
+
+  mutable mutex mu_;
+  State state_ TFRT_GUARDED_BY(mu_) = State::kWriting;
+  bool retry_ TFRT_GUARDED_BY(mu_) = false;
+  // abandon_reason_ is written once before the state changes to kAbandoned.
+  std::string abandon_reason_;
+  // The number of input elements, or -1 until the writer reaches the end of
+  // the input.
+  int64_t num_elements_ TFRT_GUARDED_BY(mu_) = -1;
+  // The number of elements placed in memory or in the spill file.
+  int64_t num_placed_ TFRT_GUARDED_BY(mu_) = 0;
+  // Elements that are available, but not placed yet because an element
+  // before them is not available.
+  std::map<int64_t, std::tuple<T...>> pending_ TFRT_GUARDED_BY(mu_);
+
+  // The elements kept in memory, followed by the elements in the spill file.
+  std::vector<std::tuple<T...>> memory_ TFRT_GUARDED_BY(mu_);
+  size_t memory_bytes_ TFRT_GUARDED_BY(mu_) = 0;
+  std::FILE* spill_file_ TFRT_GUARDED_BY(mu_) = nullptr;
+  uint64_t spill_size_ TFRT_GUARDED_BY(mu_) = 0;
+  std::vector<uint64_t> spill_offsets_ TFRT_GUARDED_BY(mu_);
+  RCReference<HostBuffer> spill_buffer_ TFRT_GUARDED_BY(mu_);
+};
+
+}  // namespace internal
+
+// CacheDataset caches the elements of the first iteration over the input
+// dataset, and replays them in the following iterations, e.g. the following
+// epochs of a RepeatDataset.
+//
+// The first iterator caches every element as soon as it is available, so the
+// cache is complete once the last element is available. An iterator made
+// after the first iterator reaches the end of the input replays the cache,
+// waiting for the cache to be complete if needed. An iterator made while the
+// first iterator is still running reads from the input dataset.
+//
+// Elements are kept in memory up to `memory_budget` bytes, or without limit
+// if it is not positive. If `spill_dir` is not empty, the elements over the
+// budget are written to a temporary spill file in that directory. Otherwise,
+// or if an element cannot be spilled, the dataset stops caching and every
+// iteration reads from the input dataset.
+//
+// If the first iterator is destroyed before the end of the input, the cache
+// is discarded, and the next iterator starts a new cache.
+template <typename... T>
+class CacheDataset : public Dataset<T...> {
+ public:
+  explicit CacheDataset(RCReference<Dataset<T...>> input_dataset,
+                        int64_t memory_budget, std::string spill_dir,
+                        HostContext* host)
+      : input_dataset_(std::move(input_dataset)),
+        memory_budget_(memory_budget),
+        spill_dir_(std::move(spill_dir)),
+        host_(host),
+        allocator_(host->allocator()) {}
+
+  // This class is not copyable or movable.
+  CacheDataset(const CacheDataset&) = delete;
+  CacheDataset& operator=(const CacheDataset&) = delete;
+
+  RCReference<Iterator<T...>> MakeIterator() override;
+
+  bool IsBlocking() const override { return input_dataset_->IsBlocking(); }
+
+ private:
+  // Allow iterators to rely on private data members of this dataset.
+  friend class CacheDatasetIterator<T...>;
+  friend class CacheReplayIterator<T...>;
+
+  void Destroy() override {
+    internal::DestroyImpl<CacheDataset<T...>>(this, allocator_);
+  }
+
+  RCReference<Dataset<T...>> input_dataset_;
+  const int64_t memory_budget_;
+  const std::string spill_dir_;
+  HostContext* host_;
+  HostAllocator* allocator_;
+
+  mutex mu_;
+  RCReference<internal::DatasetCache<T...>> cache_ TFRT_GUARDED_BY(mu_);
+};
+
+// CacheDatasetIterator reads from the input dataset and adds the elements to
+// the cache, if any.
+//
+// The state of the iterators of a CacheDataset is the number of elements
+// returned, followed by the state of the input iterator if the elements are
+// read from the input dataset. The cache itself is not saved, so an iterator
+// restored mid-iteration abandons its cache, and an iterator restored from a
+// replay of a cache that no longer exists reads up to the same position from
+// the input dataset.
+template <typename... T>
+class CacheDatasetIterator : public Iterator<T...> {
+ public:
+  explicit CacheDatasetIterator(
+      RCReference<CacheDataset<T...>> parent_dataset,
+      RCReference<internal::DatasetCache<T...>> cache)
+      : Iterator<T...>(),
+        parent_dataset_(std::move(parent_dataset)),
+        input_iterator_(parent_dataset_->input_dataset_->MakeIterator()),
+        cache_(std::move(cache)) {}
+
+  ~CacheDatasetIterator() override {
+    if (cache_ && !end_of_input_) {
+      cache_->Abandon("cache_dataset iterator destroyed before the end",
+                      /*retry=*/true);
+    }
+  }
+
+  // This class is not copyable or movable.
+  CacheDatasetIterator(const CacheDatasetIterator&) = delete;
+  CacheDatasetIterator& operator=(const CacheDatasetIterator&) = delete;
+
+  AsyncValueRef<std::tuple<T...>> GetNext(
+      const ExecutionContext& exec_ctx) override {
+    if (end_of_input_) return AsyncValueRef<std::tuple<T...>>();
+    auto input = input_iterator_->GetNext(exec_ctx);
+    if (!input) {
+      end_of_input_ = true;
+      if (cache_) cache_->SetNumElements(num_elements_);
+      return input;
+    }
+    if (!cache_) {
+      ++num_elements_;
+      this->stats_.RecordElement();
+      return input;
+    }
+
+    // The consumer may move the element out of its async value, so the cache
+    // gets a copy before the element is forwarded.
+    auto result =
+        exec_ctx.host()->template MakeUnconstructedAsyncValueRef<
+            std::tuple<T...>>();
+    AsyncValue* input_ptr = input.GetAsyncValue();
+    input_ptr->AndThen([cache = cache_.CopyRef(), index = num_elements_++,
+                        input = std::move(input),
+                        result = result.CopyRef()]() {
+      if (input.IsError()) {
+        cache->Abandon("cache_dataset input failed", /*retry=*/false);
+        result.SetError(input.GetError());
+        return;
+      }
+      cache->Add(index, input.get());
+      result.emplace(std::move(input.get()));
+    });
+    this->stats_.RecordElement();
+    return result;
+  }
+
+  llvm::Error Save(IteratorStateWriter* writer) override {
+    writer->WriteInt(num_elements_);
+    writer->WriteInt(/*has_input_state=*/true);
+    return input_iterator_->Save(writer);
+  }
+
+  llvm::Error Restore(IteratorStateReader* reader) override;
+
+ private:
+  void Destroy() override {
+    internal::DestroyImpl<CacheDatasetIterator>(this,
+                                                parent_dataset_->allocator_);
+  }
+
+  RCReference<CacheDataset<T...>> parent_dataset_;
+  RCReference<Iterator<T...>> input_iterator_;
+  // Null if the elements are not cached.
+  RCReference<internal::DatasetCache<T...>> cache_;
+  int64_t num_elements_ = 0;
+  bool end_of_input_ = false;
+};
+
+// CacheReplayIterator returns the elements of a cache. If the cache is not
+// complete yet, the elements are returned when it is complete. If the cache is
+// abandoned instead, the iterator reads from the input dataset.
+template <typename... T>
+class CacheReplayIterator : public Iterator<T...> {
+ public:
+  explicit CacheReplayIterator(
+      RCReference<CacheDataset<T...>> parent_dataset,
+      RCReference<internal::DatasetCache<T...>> cache)
+      : Iterator<T...>(),
+        parent_dataset_(std::move(parent_dataset)),
+        cache_(std::move(cache)),
+        num_elements_(cache_->num_elements()) {}
+
+  // This class is not copyable or movable.
+  CacheReplayIterator(const CacheReplayIterator&) = delete;
+  CacheReplayIterator& operator=(const CacheReplayIterator&) = delete;
+
+  AsyncValueRef<std::tuple<T...>> GetNext(
+      const ExecutionContext& exec_ctx) override;
+
+  // The elements that wait for the cache are returned, so they are part of
+  // the position whether they are read from the cache or from the input.
+  llvm::Error Save(IteratorStateWriter* writer) override {
+    mutex_lock lock(mu_);
+    writer->WriteInt(next_index_);
+    writer->WriteInt(/*has_input_state=*/static_cast<bool>(input_iterator_));
+    if (!input_iterator_) return llvm::Error::success();
+    return input_iterator_->Save(writer);
+  }
+
+  llvm::Error Restore(IteratorStateReader* reader) override;
+
+ private:
+  void Destroy() override {
+    internal::DestroyImpl<CacheReplayIterator>(this,
+                                               parent_dataset_->allocator_);
+  }
+
+  // Returns the `index`th element of the complete cache.
+  AsyncValueRef<std::tuple<T...>> Read(int64_t index,
+                                       const ExecutionContext& exec_ctx) {
+    auto element = cache_->Read(index);
+    if (!element) return EmitErrorAsync(exec_ctx, element.takeError());
+    return exec_ctx.host()
+        ->template MakeConcreteAsyncValueRef<std::tuple<T...>>(
+            std::move(*element));
+  }
+
+  // Resolves the waiting elements once the cache is complete or abandoned.
+  void OnCacheDone(const ExecutionContext& exec_ctx);
+
+  RCReference<CacheDataset<T...>> parent_dataset_;
+  RCReference<internal::DatasetCache<T...>> cache_;
+  const int64_t num_elements_;
+
+  mutex mu_;
+  int64_t next_index_ TFRT_GUARDED_BY(mu_) = 0;
+  // The elements returned before the cache is complete or abandoned, starting
+  // at the `first_waiting_index_`th element, which is not 0 if the iterator
+  // was restored.
+  std::vector<RCReference<IndirectAsyncValue>> waiting_ TFRT_GUARDED_BY(mu_);
+  int64_t first_waiting_index_ TFRT_GUARDED_BY(mu_) = 0;
+  // Set if the cache is abandoned.
+  RCReference<Iterator<T...>> input_iterator_ TFRT_GUARDED_BY(mu_);
+};
+
+template <typename... T>
+AsyncValueRef<std::tuple<T...>> CacheReplayIterator<T...>::GetNext(
+    const ExecutionContext& exec_ctx) {
+  RCReference<IndirectAsyncValue> result;
+  {
+    mutex_lock lock(mu_);
+    if (input_iterator_) {
+      auto value = input_iterator_->GetNext(exec_ctx);
+      if (value) this->stats_.RecordElement();
+      return value;
+    }
+    if (next_index_ == num_elements_) return AsyncValueRef<std::tuple<T...>>();
+    const int64_t index = next_index_++;
+    this->stats_.RecordElement();
+    if (waiting_.empty() && cache_->complete().IsConcrete()) {
+      return Read(index, exec_ctx);
+    }
+
+    // The last elements of the first iteration are not available yet.
+    result = exec_ctx.host()->MakeIndirectAsyncValue();
+    if (waiting_.empty()) first_waiting_index_ = index;
+    waiting_.push_back(result.CopyRef());
+    if (waiting_.size() > 1) {
+      return AsyncValueRef<std::tuple<T...>>(std::move(result));
+    }
+  }
+
+  // The waiter runs right away if the cache is done by now, and OnCacheDone
+  // acquires mu_, so it is registered after releasing mu_.
+  cache_->complete().AndThen([iterator = FormRef(this), exec_ctx]() {
+    iterator->OnCacheDone(exec_ctx);
+  });
+  return AsyncValueRef<std::tuple<T...>>(std::move(result));
+}
+
+template <typename... T>
+void CacheReplayIterator<T...>::OnCacheDone(const ExecutionContext& exec_ctx) {
+  // The waiting elements are resolved after releasing mu_, because their
+  // consumers may call GetNext.
+  std::vector<RCReference<IndirectAsyncValue>> waiting;
+  std::vector<AsyncValueRef<std::tuple<T...>>> elements;
+  {
+    mutex_lock lock(mu_);
+    waiting.swap(waiting_);
+    const int64_t first_index = first_waiting_index_;
+    if (cache_->complete().IsConcrete()) {
+      for (int64_t i = 0, e = waiting.size(); i < e; ++i) {
+        elements.push_back(Read(first_index + i, exec_ctx));
+      }
+    } else {
+      // Read the waiting elements and the following ones from the input,
+      // after the elements returned before them.
+      input_iterator_ = parent_dataset_->input_dataset_->MakeIterator();
+      for (int64_t i = 0; i < first_index; ++i) {
+        if (!input_iterator_->GetNext(exec_ctx)) break;
+      }
+      for (int64_t i = 0, e = waiting.size(); i < e; ++i) {
+        auto element = input_iterator_->GetNext(exec_ctx);
+        if (!element) {
+          element = EmitErrorAsync(
+              exec_ctx, "cache_dataset input has fewer elements than before");
+        }
+        elements.push_back(std::move(element));
+      }
+    }
+  }
+  for (int64_t i = 0, e = waiting.size(); i < e; ++i) {
+    waiting[i]->ForwardTo(elements[i].ReleaseRCRef());
+  }
+}
+
+template <typename... T>
+llvm::Error CacheDatasetIterator<T...>::Restore(IteratorStateReader* reader) {
+  int64_t num_elements, has_input_state;
+  if (auto error = reader->ReadInt(&num_elements)) return error;
+  if (auto error = reader->ReadInt(&has_input_state)) return error;
+  if (num_elements < 0) {
+    return MakeStringError("invalid cache_dataset iterator state");
+  }
+  if (cache_ && num_elements > 0) {
+    cache_->Abandon("cache_dataset iterator restored mid-iteration",
+                    /*retry=*/true);
+    cache_.reset();
+  }
+  num_elements_ = num_elements;
+  if (has_input_state) return input_iterator_->Restore(reader);
+
+  // The saved iterator replayed a cache. Read up to the same position.
+  ExecutionContext exec_ctx(parent_dataset_->host_);
+  for (int64_t i = 0; i < num_elements; ++i) {
+    if (!input_iterator_->GetNext(exec_ctx)) {
+      return MakeStringError(
+          "cache_dataset input has fewer elements than before");
+    }
+  }
+  return llvm::Error::success();
+}
+
+template <typename... T>
+llvm::Error CacheReplayIterator<T...>::Restore(IteratorStateReader* reader) {
+  int64_t next_index, has_input_state;
+  if (auto error = reader->ReadInt(&next_index)) return error;
+  if (auto error = reader->ReadInt(&has_input_state)) return error;
+  if (next_index < 0 || next_index > num_elements_) {
+    return MakeStringError("invalid cache_dataset iterator state");
+  }
+  mutex_lock lock(mu_);
+  next_index_ = next_index;
+  if (!has_input_state) return llvm::Error::success();
+  input_iterator_ = parent_dataset_->input_dataset_->MakeIterator();
+  return input_iterator_->Restore(reader);
+}
+
+template <typename... T>
+RCReference<Iterator<T...>> CacheDataset<T...>::MakeIterator() {
+  mutex_lock lock(mu_);
+  bool retry = false;
+  if (!cache_ || (cache_->IsAbandoned(&retry) && retry)) {
+    cache_ = TakeRef(host_->Construct<internal::DatasetCache<T...>>(
+        memory_budget_, spill_dir_, host_));
+    return TakeRef(host_->Construct<CacheDatasetIterator<T...>>(
+        FormRef(this), cache_.CopyRef()));
+  }
+  if (!cache_->IsAbandoned(&retry) && cache_->HasAllElements()) {
+    return TakeRef(host_->Construct<CacheReplayIterator<T...>>(
+        FormRef(this), cache_.CopyRef()));
+  }
+  // The cache is abandoned, or the first iterator is still running. Read from
+  // the input dataset without caching.
+  return TakeRef(host_->Construct<CacheDatasetIterator<T...>>(
+      FormRef(this), RCReference<internal::DatasetCache<T...>>()));
+}
+
+}  // namespace data
+}  // namespace tfrt
+
+#endif  // TFRT_DATA_CACHE_DATASET_H_
@@ -18,13 +18,24 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "autotuner.h"
 #include "batch_dataset.h"
+#include "cache_dataset.h"
+#include "filter_dataset.h"
 #include "interleave_dataset.h"
+#include "map_and_batch_dataset.h"
 #include "map_dataset.h"
+#include "padded_batch_dataset.h"
+#include "parallel_interleave_dataset.h"
+#include "parallel_map_dataset.h"
 #include "prefetch_dataset.h"
 #include "range_dataset.h"
 #include "repeat_dataset.h"
+#include "shard_dataset.h"
+#include "shuffle_dataset.h"
+#include "skip_dataset.h"
 #include "slice_dataset.h"
+#include "take_dataset.h"
 #include "tf_record_dataset.h"
 #include "tfrt/host_context/function.h"
 #include "tfrt/host_context/kernel_utils.h"
@@ -101,6 +112,64 @@ RCReference<MapDataset<std::tuple<T>, std::tuple<U...>>> MakeMapDataset(
       FormRef(&fn.get()), host));
 }
 
+//===----------------------------------------------------------------------===//
+// ParallelMapDataset
+//===----------------------------------------------------------------------===//
+
+// Attributes:
+// - deterministic: whether to return the elements in the input order, rather
+//   than in the order in which the map function invocations complete.
+// - num_parallel_calls: the maximum number of map function invocations in
+//   flight, kAutotune (-1) to let the Autotuner choose it, or another
+//   non-positive value to use the number of worker threads.
+template <typename T, typename... U>
+RCReference<ParallelMapDataset<std::tuple<T>, std::tuple<U...>>>
+MakeParallelMapDataset(RCReference<Dataset<T>>* dataset,
+                       RemainingArguments args, Attribute<bool> deterministic,
+                       Attribute<int64_t> num_parallel_calls,
+                       Attribute<Function> fn, HostContext* host) {
+  assert((args.size() + 1 == fn->argument_types().size()) &&
+         "ParallelMapDataset only supports input dataset with unary output.");
+  assert(fn->result_types().size() == sizeof...(U) &&
+         "Map function output size does not match expexcted.");
+
+  int64_t num_calls =
+      *num_parallel_calls > 0 || *num_parallel_calls == kAutotune
+          ? *num_parallel_calls
+          : host->GetNumWorkerThreads();
+  return TakeRef(
+      host->Construct<ParallelMapDataset<std::tuple<T>, std::tuple<U...>>>(
+          (*dataset).CopyRef(), RCArray<AsyncValue>(args.values()),
+          FormRef(&fn.get()), num_calls, *deterministic, host));
+}
+
+//===----------------------------------------------------------------------===//
+// FilterDataset
+//===----------------------------------------------------------------------===//
+
+// Creates the dataset of the elements for which `fn` returns true. The
+// arguments of `fn` are `args` followed by the values of the element.
+//
+// Attributes:
+// - num_parallel_calls: the maximum number of predicate invocations in
+//   flight, or a non-positive value to use the number of worker threads.
+template <typename... T>
+RCReference<FilterDataset<T...>> MakeFilterDataset(
+    RCReference<Dataset<T...>>* dataset, RemainingArguments args,
+    Attribute<int64_t> num_parallel_calls, Attribute<Function> fn,
+    HostContext* host) {
+  assert((args.size() + sizeof...(T) == fn->argument_types().size()) &&
+         "Filter function arguments do not match the dataset elements.");
+  assert(fn->result_types().size() == 1 &&
+         "Filter function must return a single bool.");
+
+  int64_t num_calls = *num_parallel_calls > 0 ? *num_parallel_calls
+                                              : host->GetNumWorkerThreads();
+  return TakeRef(host->Construct<FilterDataset<T...>>(
+      (*dataset).CopyRef(), RCArray<AsyncValue>(args.values()),
+      FormRef(&fn.get()), num_calls, host));
+}
+
 //===----------------------------------------------------------------------===//
 // InterleaveDataset
 //===----------------------------------------------------------------------===//
@@ -123,13 +192,64 @@ MakeInterleaveDataset(RCReference<Dataset<T>>* dataset, int64_t cycle_length,
           host));
 }
 
+//===----------------------------------------------------------------------===//
+// ParallelInterleaveDataset
+//===----------------------------------------------------------------------===//
+
+// Attributes:
+// - buffer_output_elements: the number of elements to read ahead from each
+//   open iterator, or kAutotune (-1) to let the Autotuner choose it.
+// - sloppy: whether to return elements from whichever open iterator has one
+//   ready, rather than in the deterministic interleave order.
+template <typename T, typename... U>
+RCReference<ParallelInterleaveDataset<std::tuple<T>, std::tuple<U...>>>
+MakeParallelInterleaveDataset(RCReference<Dataset<T>>* dataset,
+                              int64_t cycle_length, int64_t block_length,
+                              Attribute<int64_t> buffer_output_elements,
+                              Attribute<bool> sloppy, Attribute<Function> fn,
+                              HostContext* host) {
+  assert(fn->argument_types().size() == 1 &&
+         "Interleave only supports functions with unary inputs.");
+  assert(
+      fn->result_types().size() == 1 &&
+      "Interleave expects only one function output, which must be a dataset.");
+
+  return TakeRef(host->Construct<
+                 ParallelInterleaveDataset<std::tuple<T>, std::tuple<U...>>>(
+      (*dataset).CopyRef(), cycle_length, block_length,
+      *buffer_output_elements, *sloppy, FormRef(&fn.get()), host));
+}
+
 //===----------------------------------------------------------------------===//
 // TFRecordDataset
 //===----------------------------------------------------------------------===//
 
-RCReference<TFRecordDataset> MakeTFRecordDataset(std::string path,
-                                                 HostContext* host) {
-  return TakeRef(host->Construct<TFRecordDataset>(std::move(path), host));
+// Optional attributes, in this order:
+// - compression_type: "ZLIB" or "GZIP" if the file is compressed, or "" or
+//   "NONE" otherwise. Compressed files are read sequentially. "" by default.
+// - num_parallel_reads: the number of chunks of the file read in parallel on
+//   the blocking work queue, or 1 to read the file sequentially. 1 by
+//   default.
+// An attribute can only be omitted if the attributes after it are omitted too.
+llvm::Expected<RCReference<TFRecordDataset>> MakeTFRecordDataset(
+    std::string path, RemainingAttributes attributes, HostContext* host) {
+  if (attributes.size() > 2) {
+    return MakeStringError(
+        "tf_record_dataset takes at most 2 attributes, got ",
+        attributes.size());
+  }
+  string_view compression_type =
+      attributes.size() > 0 ? attributes.GetStringAttribute(0).get() : "";
+  int64_t num_parallel_reads =
+      attributes.size() > 1 ? *attributes.Get<int64_t>(1) : 1;
+  if (num_parallel_reads <= 0) {
+    return MakeStringError("num_parallel_reads must be positive, got ",
+                           num_parallel_reads);
+  }
+  auto compression = TFRecordReader::ParseCompression(compression_type);
+  if (!compression) return compression.takeError();
+  return TakeRef(host->Construct<TFRecordDataset>(
+      std::move(path), num_parallel_reads, *compression, host));
 }
 
 //===----------------------------------------------------------------------===//
@@ -145,6 +265,51 @@ RCReference<RepeatDataset<T...>> MakeRepeatDataset(
                                                       count[0], host));
 }
 
+//===----------------------------------------------------------------------===//
+// ShardDataset
+//===----------------------------------------------------------------------===//
+
+// Creates the dataset of the elements whose index modulo `num_shards` is
+// `index`. The sharding is pushed down through the datasets that can skip
+// elements without producing them, e.g. maps of ranges or TFRecord files, so
+// that each worker only reads its part of the input.
+template <typename... T>
+RCReference<Dataset<T...>> MakeShardDataset(RCReference<Dataset<T...>>* dataset,
+                                            Attribute<int64_t> num_shards,
+                                            Attribute<int64_t> index,
+                                            HostContext* host) {
+  assert(*num_shards > 0);
+  assert(*index >= 0 && *index < *num_shards);
+  if (*num_shards == 1) return (*dataset).CopyRef();
+  if (auto shard = (*dataset)->MakeShard(*num_shards, *index)) return shard;
+  return TakeRef(host->Construct<ShardDataset<T...>>(
+      (*dataset).CopyRef(), *num_shards, *index, host));
+}
+
+//===----------------------------------------------------------------------===//
+// TakeDataset and SkipDataset
+//===----------------------------------------------------------------------===//
+
+// Creates the dataset of the first `count` elements, or of all the elements
+// if `count` is negative.
+template <typename... T>
+RCReference<TakeDataset<T...>> MakeTakeDataset(
+    RCReference<Dataset<T...>>* dataset, Attribute<int64_t> count,
+    HostContext* host) {
+  return TakeRef(
+      host->Construct<TakeDataset<T...>>((*dataset).CopyRef(), *count, host));
+}
+
+// Creates the dataset of the elements after the first `count` ones, or of no
+// elements if `count` is negative.
+template <typename... T>
+RCReference<SkipDataset<T...>> MakeSkipDataset(
+    RCReference<Dataset<T...>>* dataset, Attribute<int64_t> count,
+    HostContext* host) {
+  return TakeRef(
+      host->Construct<SkipDataset<T...>>((*dataset).CopyRef(), *count, host));
+}
+
 //===----------------------------------------------------------------------===//
 // BatchDataset
 //===----------------------------------------------------------------------===//
@@ -160,15 +325,112 @@ RCReference<BatchDataset<T...>> MakeBatchDataset(
                                                      batch_size[0], host));
 }
 
+//===----------------------------------------------------------------------===//
+// MapAndBatchDataset
+//===----------------------------------------------------------------------===//
+
+// Creates the dataset of map(fn) followed by batch(batch_size) for a
+// batch-compatible `fn`, see CreateMapAndBatchDataset.
+template <typename T, typename... U>
+RCReference<MapDataset<std::tuple<DenseHostTensor>, std::tuple<U...>>>
+MakeMapAndBatchDataset(RCReference<Dataset<T>>* dataset,
+                       RemainingArguments args,
+                       ArrayAttribute<int32_t> batch_size,
+                       Attribute<Function> fn, HostContext* host) {
+  assert(batch_size.size() == 1);
+  assert((args.size() + 1 == fn->argument_types().size()) &&
+         "MapAndBatchDataset only supports input dataset with unary output.");
+  assert(fn->result_types().size() == sizeof...(U) &&
+         "Map function output size does not match expected.");
+
+  return CreateMapAndBatchDataset<T, U...>(
+      (*dataset).CopyRef(), RCArray<AsyncValue>(args.values()), batch_size[0],
+      FormRef(&fn.get()), host);
+}
+
+//===----------------------------------------------------------------------===//
+// PaddedBatchDataset and RaggedBatchDataset
+//===----------------------------------------------------------------------===//
+
+template <size_t N>
+RCReference<PaddedBatchDataset<N>> MakePaddedBatchDataset(
+    RCReference<DHTDataset<N>>* dataset, Attribute<int32_t> batch_size,
+    HostContext* host) {
+  return TakeRef(host->Construct<PaddedBatchDataset<N>>((*dataset).CopyRef(),
+                                                        *batch_size, host));
+}
+
+template <size_t N>
+RCReference<RaggedBatchDataset<N>> MakeRaggedBatchDataset(
+    RCReference<DHTDataset<N>>* dataset, Attribute<int32_t> batch_size,
+    HostContext* host) {
+  return TakeRef(host->Construct<RaggedBatchDataset<N>>((*dataset).CopyRef(),
+                                                        *batch_size, host));
+}
+
+//===----------------------------------------------------------------------===//
+// ShuffleDataset
+//===----------------------------------------------------------------------===//
+
+// Attributes:
+// - buffer_size: the number of buffered elements to sample from.
+// - reshuffle_each_iteration: whether every iterator uses a different order.
+// - seed: the random seed, or zero to use a random seed.
+template <typename... T>
+RCReference<ShuffleDataset<T...>> MakeShuffleDataset(
+    RCReference<Dataset<T...>>* dataset, Attribute<int64_t> buffer_size,
+    Attribute<bool> reshuffle_each_iteration, Attribute<int64_t> seed,
+    HostContext* host) {
+  return TakeRef(host->Construct<ShuffleDataset<T...>>(
+      (*dataset).CopyRef(), *buffer_size, *seed, *reshuffle_each_iteration,
+      host));
+}
+
+//===----------------------------------------------------------------------===//
+// CacheDataset
+//===----------------------------------------------------------------------===//
+
+// Attributes:
+// - memory_budget: the maximum size of the elements cached in memory in bytes,
+//   or a non-positive value for no limit.
+// - spill_dir: the directory of the spill file for the elements over the
+//   memory budget, or an empty string to not spill.
+template <typename... T>
+RCReference<CacheDataset<T...>> MakeCacheDataset(
+    RCReference<Dataset<T...>>* dataset, Attribute<int64_t> memory_budget,
+    StringAttribute spill_dir, HostContext* host) {
+  return TakeRef(host->Construct<CacheDataset<T...>>(
+      (*dataset).CopyRef(), *memory_budget, spill_dir.str(), host));
+}
+
 //===----------------------------------------------------------------------===//
 // PrefetchDataset
 //===----------------------------------------------------------------------===//
 
+// Optional attributes, in this order:
+// - max_buffer_bytes: the maximum size of the buffered elements in bytes, or
+//   a non-positive value for no limit. No limit by default.
+// - prefetch_num: the maximum number of buffered elements, kAutotune (-1) to
+//   let the Autotuner choose it, or another non-positive value to use the
+//   number of worker threads. kAutotune by default.
+// An attribute can only be omitted if the attributes after it are omitted too.
 template <typename... T>
-RCReference<PrefetchDataset<T...>> MakePrefetchDataset(
-    RCReference<Dataset<T...>>* dataset, HostContext* host) {
+llvm::Expected<RCReference<PrefetchDataset<T...>>> MakePrefetchDataset(
+    RCReference<Dataset<T...>>* dataset, RemainingAttributes attributes,
+    HostContext* host) {
+  if (attributes.size() > 2) {
+    return MakeStringError("prefetch_dataset takes at most 2 attributes, got ",
+                           attributes.size());
+  }
+  int64_t max_buffer_bytes =
+      attributes.size() > 0 ? *attributes.Get<int64_t>(0) : 0;
+  int64_t prefetch_num =
+      attributes.size() > 1 ? *attributes.Get<int64_t>(1) : kAutotune;
+  int64_t num_elements = prefetch_num > 0 || prefetch_num == kAutotune
+                             ? prefetch_num
+                             : host->GetNumWorkerThreads();
   return TakeRef(host->Construct<PrefetchDataset<T...>>(
-      (*dataset).CopyRef(), host->GetNumWorkerThreads(), host));
+      (*dataset).CopyRef(), num_elements, max_buffer_bytes, host));
 }
 
 //===----------------------------------------------------------------------===//
@@ -197,6 +459,66 @@ AsyncValueRef<std::tuple<T...>> IteratorGetNext(
   return value;
 }
 
+// Saves the state of the iterator to the file at `path`, see
+// IteratorBase::Save. It runs on the blocking work queue, since it waits for
+// the buffered elements and writes the file.
+template <typename... T>
+AsyncValueRef<Chain> SaveIterator(RCReference<Iterator<T...>>* iterator,
+                                  std::string path, Chain chain,
+                                  const ExecutionContext& exec_ctx) {
+  auto result = exec_ctx.host()->MakeUnconstructedAsyncValueRef<Chain>();
+  bool enqueued = exec_ctx.host()->EnqueueBlockingWork(
+      [iterator = iterator->CopyRef(), path = std::move(path),
+       result = result.CopyRef(), exec_ctx]() {
+        IteratorStateWriter writer;
+        auto error = iterator->Save(&writer);
+        if (!error) error = WriteIteratorStateFile(path, writer.data());
+        if (error) {
+          result.SetError(
+              EmitError(exec_ctx, llvm::toString(std::move(error))));
+          return;
+        }
+        result.emplace();
+      });
+  if (!enqueued) return EmitErrorAsync(exec_ctx, "failed to save iterator");
+  return result;
+}
+
+// Restores the state of a new iterator from the file at `path` written by
+// data.save_iterator for an iterator of the same dataset, see
+// IteratorBase::Restore. It runs on the blocking work queue, since it reads
+// the file.
+template <typename... T>
+AsyncValueRef<Chain> RestoreIterator(RCReference<Iterator<T...>>* iterator,
+                                     std::string path, Chain chain,
+                                     const ExecutionContext& exec_ctx) {
+  auto result = exec_ctx.host()->MakeUnconstructedAsyncValueRef<Chain>();
+  bool enqueued = exec_ctx.host()->EnqueueBlockingWork(
+      [iterator = iterator->CopyRef(), path = std::move(path),
+       result = result.CopyRef(), exec_ctx]() {
+        auto state = ReadIteratorStateFile(path);
+        llvm::Error error = llvm::Error::success();
+        if (!state) {
+          error = state.takeError();
+        } else {
+          IteratorStateReader reader(*state, exec_ctx.host());
+          error = iterator->Restore(&reader);
+          if (!error && !reader.empty()) {
+            error = MakeStringError("iterator state ", path,
+                                    " is not a state of this iterator");
+          }
+        }
+        if (error) {
+          result.SetError(
+              EmitError(exec_ctx, llvm::toString(std::move(error))));
+          return;
+        }
+        result.emplace();
+      });
+  if (!enqueued) return EmitErrorAsync(exec_ctx, "failed to restore iterator");
+  return result;
+}
+
 // Executes body_fn repeatedly until the iterator reaches end.
 //
 // Requirements:
@@ -294,6 +616,10 @@ static void RegisterIteratorKernelsForType(KernelRegistry* registry,
                       TFRT_KERNEL(MakeIteratorFromDataset<T...>));
   registry->AddKernel("data.iterator_get_next." + suffix,
                       TFRT_KERNEL(IteratorGetNext<T...>));
+  registry->AddKernel("data.save_iterator." + suffix,
+                      TFRT_KERNEL(SaveIterator<T...>));
+  registry->AddKernel("data.restore_iterator." + suffix,
+                      TFRT_KERNEL(RestoreIterator<T...>));
 }
 
 // This is the entrypoint to the library.
@@ -346,9 +672,49 @@ void RegisterDataKernels(KernelRegistry* registry) {
   registry->AddKernel("data.map_dataset.i32.f32_and_i32",
                       TFRT_KERNEL(MakeMapDataset<int32_t, float, int32_t>));
 
+  registry->AddKernel(
+      "data.parallel_map_dataset.i32.i32",
+      TFRT_KERNEL(MakeParallelMapDataset<int32_t, int32_t>));
+  registry->AddKernel(
+      "data.parallel_map_dataset.i32.f32",
+      TFRT_KERNEL(MakeParallelMapDataset<int32_t, float>));
+  registry->AddKernel(
+      "data.parallel_map_dataset.i64.i64",
+      TFRT_KERNEL(MakeParallelMapDataset<int64_t, int64_t>));
+  registry->AddKernel(
+      "data.parallel_map_dataset.str.tensor",
+      TFRT_KERNEL(MakeParallelMapDataset<std::string, DenseHostTensor>));
+  registry->AddKernel(
+      "data.parallel_map_dataset.i64.tensor_and_i64",
+      TFRT_KERNEL(MakeParallelMapDataset<int64_t, DenseHostTensor, int64_t>));
+  registry->AddKernel(
+      "data.parallel_map_dataset.str.tensor_and_i64",
+      TFRT_KERNEL(
+          MakeParallelMapDataset<std::string, DenseHostTensor, int64_t>));
+  registry->AddKernel(
+      "data.parallel_map_dataset.i32.f32_and_i32",
+      TFRT_KERNEL(MakeParallelMapDataset<int32_t, float, int32_t>));
+
+  registry->AddKernel("data.filter_dataset.i32",
+                      TFRT_KERNEL(MakeFilterDataset<int32_t>));
+  registry->AddKernel("data.filter_dataset.i64",
+                      TFRT_KERNEL(MakeFilterDataset<int64_t>));
+  registry->AddKernel("data.filter_dataset.str",
+                      TFRT_KERNEL(MakeFilterDataset<std::string>));
+  registry->AddKernel(
+      "data.filter_dataset.tensor_and_i64",
+      TFRT_KERNEL(MakeFilterDataset<DenseHostTensor, int64_t>));
+
   registry->AddKernel("data.interleave_dataset.i32.i32",
                       TFRT_KERNEL(MakeInterleaveDataset<int32_t, int32_t>));
 
+  registry->AddKernel(
+      "data.parallel_interleave_dataset.i32.i32",
+      TFRT_KERNEL(MakeParallelInterleaveDataset<int32_t, int32_t>));
+  registry->AddKernel(
+      "data.parallel_interleave_dataset.str.str",
+      TFRT_KERNEL(MakeParallelInterleaveDataset<std::string, std::string>));
+
   registry->AddKernel("data.batch_dataset.tensor",
                       TFRT_KERNEL(MakeBatchDataset<DenseHostTensor>));
   registry->AddKernel("data.batch_dataset.i32",
@@ -358,6 +724,25 @@ void RegisterDataKernels(KernelRegistry* registry) {
   registry->AddKernel("data.batch_dataset.tensor_and_i64",
                       TFRT_KERNEL(MakeBatchDataset<DenseHostTensor, int64_t>));
 
+  registry->AddKernel(
+      "data.map_and_batch_dataset.tensor.tensor",
+      TFRT_KERNEL(MakeMapAndBatchDataset<DenseHostTensor, DenseHostTensor>));
+  registry->AddKernel(
+      "data.map_and_batch_dataset.i32.tensor",
+      TFRT_KERNEL(MakeMapAndBatchDataset<int32_t, DenseHostTensor>));
+  registry->AddKernel(
+      "data.map_and_batch_dataset.i64.tensor",
+      TFRT_KERNEL(MakeMapAndBatchDataset<int64_t, DenseHostTensor>));
+
+  registry->AddKernel("data.padded_batch_dataset.tensor",
+                      TFRT_KERNEL(MakePaddedBatchDataset<1>));
+  registry->AddKernel("data.padded_batch_dataset.tensor_and_tensor",
+                      TFRT_KERNEL(MakePaddedBatchDataset<2>));
+  registry->AddKernel("data.ragged_batch_dataset.tensor",
+                      TFRT_KERNEL(MakeRaggedBatchDataset<1>));
+  registry->AddKernel("data.ragged_batch_dataset.tensor_and_tensor",
+                      TFRT_KERNEL(MakeRaggedBatchDataset<2>));
+
   registry->AddKernel("data.repeat_dataset.i32",
                       TFRT_KERNEL(MakeRepeatDataset<int32_t>));
   registry->AddKernel("data.repeat_dataset.i64",
@@ -365,6 +750,60 @@ void RegisterDataKernels(KernelRegistry* registry) {
   registry->AddKernel("data.repeat_dataset.str",
                       TFRT_KERNEL(MakeRepeatDataset<std::string>));
 
+  registry->AddKernel("data.shard_dataset.i32",
+                      TFRT_KERNEL(MakeShardDataset<int32_t>));
+  registry->AddKernel("data.shard_dataset.i64",
+                      TFRT_KERNEL(MakeShardDataset<int64_t>));
+  registry->AddKernel("data.shard_dataset.str",
+                      TFRT_KERNEL(MakeShardDataset<std::string>));
+  registry->AddKernel(
+      "data.shard_dataset.tensor_and_i64",
+      TFRT_KERNEL(MakeShardDataset<DenseHostTensor, int64_t>));
+
+  registry->AddKernel("data.take_dataset.i32",
+                      TFRT_KERNEL(MakeTakeDataset<int32_t>));
+  registry->AddKernel("data.take_dataset.i64",
+                      TFRT_KERNEL(MakeTakeDataset<int64_t>));
+  registry->AddKernel("data.take_dataset.str",
+                      TFRT_KERNEL(MakeTakeDataset<std::string>));
+  registry->AddKernel("data.take_dataset.tensor_and_i64",
+                      TFRT_KERNEL(MakeTakeDataset<DenseHostTensor, int64_t>));
+
+  registry->AddKernel("data.skip_dataset.i32",
+                      TFRT_KERNEL(MakeSkipDataset<int32_t>));
+  registry->AddKernel("data.skip_dataset.i64",
+                      TFRT_KERNEL(MakeSkipDataset<int64_t>));
+  registry->AddKernel("data.skip_dataset.str",
+                      TFRT_KERNEL(MakeSkipDataset<std::string>));
+  registry->AddKernel("data.skip_dataset.tensor_and_i64",
+                      TFRT_KERNEL(MakeSkipDataset<DenseHostTensor, int64_t>));
+
+  registry->AddKernel("data.shuffle_dataset.i32",
+                      TFRT_KERNEL(MakeShuffleDataset<int32_t>));
+  registry->AddKernel("data.shuffle_dataset.i64",
+                      TFRT_KERNEL(MakeShuffleDataset<int64_t>));
+  registry->AddKernel("data.shuffle_dataset.str",
+                      TFRT_KERNEL(MakeShuffleDataset<std::string>));
+  registry->AddKernel(
+      "data.shuffle_dataset.tensor_and_i64",
+      TFRT_KERNEL(MakeShuffleDataset<DenseHostTensor, int64_t>));
+
+  registry->AddKernel("data.cache_dataset.i32",
+                      TFRT_KERNEL(MakeCacheDataset<int32_t>));
+  registry->AddKernel("data.cache_dataset.i64",
+                      TFRT_KERNEL(MakeCacheDataset<int64_t>));
+  registry->AddKernel("data.cache_dataset.str",
+                      TFRT_KERNEL(MakeCacheDataset<std::string>));
+  registry->AddKernel(
+      "data.cache_dataset.tensor_and_i64",
+      TFRT_KERNEL(MakeCacheDataset<DenseHostTensor, int64_t>));
+
+  registry->AddKernel("data.prefetch_dataset.i32",
+                      TFRT_KERNEL(MakePrefetchDataset<int32_t>));
+  registry->AddKernel("data.prefetch_dataset.i64",
+                      TFRT_KERNEL(MakePrefetchDataset<int64_t>));
+  registry->AddKernel("data.prefetch_dataset.str",
+                      TFRT_KERNEL(MakePrefetchDataset<std::string>));
   registry->AddKernel(
       "data.prefetch_dataset.tensor_and_tensor",
       TFRT_KERNEL(MakePrefetchDataset<DenseHostTensor, DenseHostTensor>));
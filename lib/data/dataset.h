@@ -23,14 +23,21 @@
 #ifndef TFRT_LIB_DATA_DATASET_H_
 #define TFRT_LIB_DATA_DATASET_H_
 
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <string>
+#include <vector>
 
+#include "iterator_state.h"
 #include "tfrt/host_context/execution_context.h"
 #include "tfrt/host_context/host_allocator.h"
 #include "tfrt/host_context/host_context.h"
+#include "tfrt/support/error_util.h"
 #include "tfrt/support/forward_decls.h"
 #include "tfrt/support/rc_array.h"
 #include "tfrt/support/ref_count.h"
+#include "tfrt/tensor/dense_host_tensor.h"
 
 namespace tfrt {
 namespace data {
@@ -68,8 +75,126 @@ static void EmplaceTupleResult(ArrayRef<AsyncValue*> results,
        0)...};
 }
 
+// Returns a copy of a value of a dataset element. Tensors share their buffer.
+template <typename T>
+T CopyValue(const T& value) {
+  return value;
+}
+inline DenseHostTensor CopyValue(const DenseHostTensor& value) {
+  return value.CopyRef();
+}
+template <typename... T, size_t... I>
+std::tuple<T...> CopyElement(const std::tuple<T...>& element,
+                             std::index_sequence<I...>) {
+  return std::tuple<T...>(CopyValue(std::get<I>(element))...);
+}
+template <typename... T>
+std::tuple<T...> CopyElement(const std::tuple<T...>& element) {
+  return CopyElement(element, std::index_sequence_for<T...>{});
+}
+
+// Returns the approximate number of bytes held by a dataset element. It is
+// used to limit the size of the buffers in the input pipeline.
+template <typename T>
+size_t GetElementSizeInBytes(const T& value) {
+  return sizeof(T);
+}
+inline size_t GetElementSizeInBytes(const std::string& value) {
+  return sizeof(std::string) + value.size();
+}
+inline size_t GetElementSizeInBytes(const DenseHostTensor& value) {
+  return sizeof(DenseHostTensor) + value.DataSizeInBytes();
+}
+template <typename... T, size_t... I>
+size_t GetElementSizeInBytes(const std::tuple<T...>& value,
+                             std::index_sequence<I...>) {
+  size_t size = 0;
+  std::ignore = std::initializer_list<int>{
+      (size += GetElementSizeInBytes(std::get<I>(value)), 0)...};
+  return size;
+}
+template <typename... T>
+size_t GetElementSizeInBytes(const std::tuple<T...>& value) {
+  return GetElementSizeInBytes(value, std::make_index_sequence<sizeof...(T)>{});
+}
+
 }  // namespace internal
 
+// Lightweight counters of an iterator. They are updated by the iterator, or by
+// the tasks producing its elements, and read concurrently by the Autotuner.
+//
+// Iterators that never block and do little work per element only count their
+// elements, since reading the clock would cost more than producing them.
+class IteratorStats {
+ public:
+  // Returns the current time of a monotonic clock in nanoseconds, or of the
+  // clock set by SetClock.
+  static int64_t Now() { return clock().load(std::memory_order_relaxed)(); }
+
+  // Replaces the clock of the counters and of the Autotuner, e.g. by a fake
+  // clock in tests. It must be set before any iterator is created.
+  static void SetClock(int64_t (*now)()) {
+    clock().store(now, std::memory_order_relaxed);
+  }
+
+  // Records an element returned by GetNext.
+  void RecordElement() { RecordElements(1); }
+
+  // Records `n` elements returned by GetNext or GetNextBatch. Iterators that
+  // only know the number of elements of a batch once it is available record
+  // them from the task that produces it.
+  void RecordElements(int64_t n) {
+    num_elements_.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  // Adds the size of the elements produced in bytes. Iterators that buffer
+  // elements report it, so that the Autotuner can bound the buffer sizes.
+  void AddBytes(int64_t bytes) {
+    num_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  // Adds the time that a thread was blocked waiting for the input iterator.
+  void AddWaitTime(int64_t ns) {
+    wait_time_ns_.fetch_add(ns, std::memory_order_relaxed);
+  }
+
+  // Adds the time that a thread spent producing elements. Iterators that
+  // produce elements concurrently add the time of every producer.
+  void AddProduceTime(int64_t ns) {
+    produce_time_ns_.fetch_add(ns, std::memory_order_relaxed);
+  }
+
+  int64_t num_elements() const {
+    return num_elements_.load(std::memory_order_relaxed);
+  }
+  int64_t num_bytes() const {
+    return num_bytes_.load(std::memory_order_relaxed);
+  }
+  int64_t wait_time_ns() const {
+    return wait_time_ns_.load(std::memory_order_relaxed);
+  }
+  int64_t produce_time_ns() const {
+    return produce_time_ns_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  static int64_t SteadyNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  static std::atomic<int64_t (*)()>& clock() {
+    static std::atomic<int64_t (*)()> now{&SteadyNow};
+    return now;
+  }
+
+  std::atomic<int64_t> num_elements_{0};
+  std::atomic<int64_t> num_bytes_{0};
+  std::atomic<int64_t> wait_time_ns_{0};
+  std::atomic<int64_t> produce_time_ns_{0};
+};
+
 // We separate the IteratorBase from the templatized Iterator so that
 // kernels can use IteratorBase::GetNextUntyped without being specialized for
 // the output type.
@@ -79,6 +204,8 @@ class IteratorBase : public ReferenceCounted<IteratorBase> {
 
   virtual ~IteratorBase() {}
 
+  const IteratorStats& stats() const { return stats_; }
+
   // Returns a vector of (N + 1) AsyncValues where N represents the number of
   // output value types of the child Iterator class. The first N AsyncValues
   // represent the decoupled values of the std::tuple<...> returned by the
@@ -87,15 +214,49 @@ class IteratorBase : public ReferenceCounted<IteratorBase> {
   virtual SmallVector<RCReference<AsyncValue>, 4> GetNextUntyped(
       const ExecutionContext& exec_ctx) = 0;
 
+  // Writes the state of the iterator, so that an iterator of the same dataset
+  // can resume from it with Restore, e.g. after the job restarts. Sources save
+  // their position, e.g. a file offset, rather than the number of elements
+  // returned, so that restoring does not replay the input. Iterators that
+  // buffer elements save their values.
+  //
+  // Save waits for the buffered elements and for the background tasks of the
+  // iterator. It must not be called concurrently with GetNext, nor by a
+  // thread managed by the non-blocking work queue.
+  virtual llvm::Error Save(IteratorStateWriter* writer) {
+    return MakeStringError("iterator does not support saving its state");
+  }
+
+  // Restores the state written by Save. This must be called on a new iterator
+  // of the same dataset, before GetNext. The iterator returns the elements
+  // that the saved iterator would have returned after Save.
+  virtual llvm::Error Restore(IteratorStateReader* reader) {
+    return MakeStringError("iterator does not support restoring its state");
+  }
+
  protected:
   // For access to Destroy().
   friend class ReferenceCounted<IteratorBase>;
   virtual void Destroy() = 0;
+
+  IteratorStats stats_;
 };
 
 template <typename... T>
 class Iterator : public IteratorBase {
  public:
+  // How GetNextBatch produces the elements.
+  enum class BatchMode {
+    // GetNextBatch calls GetNext for every element.
+    kElementwise,
+    // GetNextBatch produces the elements at once. They might not be available
+    // when it returns.
+    kAsync,
+    // GetNextBatch produces the elements at once, and they are available when
+    // it returns, e.g. because they are stored in memory.
+    kSync,
+  };
+
   explicit Iterator() {}
 
   // If the iterator has reached end, returns an empty AsyncValueRef. Otherwise,
@@ -103,6 +264,20 @@ class Iterator : public IteratorBase {
   virtual AsyncValueRef<std::tuple<T...>> GetNext(
       const ExecutionContext& exec_ctx) = 0;
 
+  // If the iterator has reached end, returns an empty AsyncValueRef.
+  // Otherwise, returns the next `max_n` elements behind a single AsyncValue,
+  // or all the remaining elements if there are fewer, and advances the
+  // iterator past them. If any of the elements is an error, the result is
+  // that error, and the iterator still advances past all of them.
+  //
+  // Each element passed between iterators costs at least one AsyncValue.
+  // Consumers like BatchDataset call GetNextBatch to pay this cost once for
+  // `max_n` elements of the iterators that override it.
+  virtual AsyncValueRef<std::vector<std::tuple<T...>>> GetNextBatch(
+      const ExecutionContext& exec_ctx, int64_t max_n);
+
+  virtual BatchMode GetBatchMode() const { return BatchMode::kElementwise; }
+
   SmallVector<RCReference<AsyncValue>, 4> GetNextUntyped(
       const ExecutionContext& exec_ctx) override;
 };
@@ -118,6 +293,22 @@ class Dataset : public ReferenceCounted<Dataset<T...>> {
   // The iterator should keep +1 reference to the parent_dataset.
   virtual RCReference<Iterator<T...>> MakeIterator() = 0;
 
+  // Returns true if GetNext of the iterators of this dataset might block the
+  // calling thread, e.g. to read from a file. Such iterators should be driven
+  // from the blocking work queue when they are read in the background.
+  virtual bool IsBlocking() const { return false; }
+
+  // Returns a dataset of the elements of this dataset whose index modulo
+  // `num_shards` is `index`, which does not produce the other elements at
+  // all, e.g. because it reads only a part of its input. Returns an empty
+  // reference if the other elements cannot be skipped more cheaply than by
+  // producing and discarding them. ShardDataset uses it to push sharding down
+  // to the sources of the input pipeline.
+  virtual RCReference<Dataset<T...>> MakeShard(int64_t num_shards,
+                                               int64_t index) {
+    return {};
+  }
+
  private:
   // For access to Destroy().
   friend class ReferenceCounted<Dataset<T...>>;
@@ -165,6 +356,53 @@ SmallVector<RCReference<AsyncValue>, 4> Iterator<T...>::GetNextUntyped(
   return results;
 }
 
+template <typename... T>
+AsyncValueRef<std::vector<std::tuple<T...>>> Iterator<T...>::GetNextBatch(
+    const ExecutionContext& exec_ctx, int64_t max_n) {
+  using Batch = std::vector<std::tuple<T...>>;
+  SmallVector<RCReference<AsyncValue>, 16> elements;
+  SmallVector<AsyncValue*, 16> pending_elements;
+  for (int64_t i = 0; i < max_n; ++i) {
+    auto element = GetNext(exec_ctx);
+    if (!element) break;
+    if (!element.IsAvailable()) {
+      pending_elements.push_back(element.GetAsyncValue());
+    }
+    elements.push_back(element.ReleaseRCRef());
+  }
+  if (elements.empty()) return AsyncValueRef<Batch>();
+
+  // Returns the first error, or the batch of the elements. The values of the
+  // elements are moved if this is their only reference, and copied otherwise.
+  auto make_batch = [](ArrayRef<RCReference<AsyncValue>> elements,
+                       HostContext* host) {
+    for (const auto& element : elements) {
+      if (element->IsError()) return AsyncValueRef<Batch>(element.CopyRef());
+    }
+    Batch batch;
+    batch.reserve(elements.size());
+    for (const auto& element : elements) {
+      auto& value = element->get<std::tuple<T...>>();
+      if (element->IsUnique()) {
+        batch.push_back(std::move(value));
+      } else {
+        batch.push_back(internal::CopyElement(value));
+      }
+    }
+    return host->MakeConcreteAsyncValueRef<Batch>(std::move(batch));
+  };
+
+  HostContext* host = exec_ctx.host();
+  if (pending_elements.empty()) return make_batch(elements, host);
+  auto batch = host->MakeIndirectAsyncValue();
+  host->RunWhenReady(pending_elements, [elements = std::move(elements),
+                                        batch = batch.CopyRef(), host,
+                                        make_batch]() {
+    batch->ForwardTo(make_batch(elements, host).ReleaseRCRef());
+  });
+  return AsyncValueRef<Batch>(std::move(batch));
+}
+
 }  // namespace data
 }  // namespace tfrt
 
@@ -0,0 +1,454 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- filter_dataset.h -----------------------------------------*- C++ -*-===//
+//
+// This file declares FilterDataset class which yields the elements of its
+// input dataset for which a user-defined predicate returns true.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef TFRT_LIB_DATA_FILTER_DATASET_H_
+#define TFRT_LIB_DATA_FILTER_DATASET_H_
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <utility>
+
+#include "dataset.h"
+#include "tfrt/host_context/function.h"
+#include "tfrt/support/forward_decls.h"
+#include "tfrt/support/mutex.h"
+
+namespace tfrt {
+namespace data {
+
+template <typename... T>
+class FilterDatasetIterator;
+
+// FilterDataset yields the elements of its input dataset for which
+// `predicate_fn` returns true, in the order of the input elements. The
+// arguments of `predicate_fn` are the `additional_fn_args` followed by the
+// values of the element, and its result is a bool.
+//
+// Up to `num_parallel_calls` invocations of `predicate_fn` are in flight. Each
+// of them runs on a copy of the element, so that the element can still be
+// returned if it passes. Tensors are not copied, they share their buffer.
+//
+// GetNext does not wait for the predicates. If the predicate of the next
+// element is not done, it returns an IndirectAsyncValue that is forwarded to
+// the first element that passes, or to the first error. If the input reaches
+// end before an element passes, the value is the "iterator reached end" error
+// that data.iterator_get_next returns at end, and the following GetNext
+// returns an empty AsyncValueRef.
+template <typename... T>
+class FilterDataset : public Dataset<T...> {
+ public:
+  explicit FilterDataset(RCReference<Dataset<T...>> input_dataset,
+                         RCArray<AsyncValue> additional_fn_args,
+                         RCReference<const Function> predicate_fn,
+                         int64_t num_parallel_calls, HostContext* host)
+      : input_dataset_(std::move(input_dataset)),
+        additional_fn_args_(std::move(additional_fn_args)),
+        predicate_fn_(std::move(predicate_fn)),
+        num_parallel_calls_(num_parallel_calls),
+        host_(host),
+        allocator_(host->allocator()) {
+    assert(num_parallel_calls > 0);
+  }
+
+  // This class is not copyable or movable.
+  FilterDataset(const FilterDataset&) = delete;
+  FilterDataset& operator=(const FilterDataset&) = delete;
+
+  RCReference<Iterator<T...>> MakeIterator() override;
+
+  bool IsBlocking() const override { return input_dataset_->IsBlocking(); }
+
+ private:
+  // Allow iterator to rely on private data members of this dataset.
+  friend class FilterDatasetIterator<T...>;
+
+  void Destroy() override {
+    internal::DestroyImpl<FilterDataset<T...>>(this, allocator_);
+  }
+
+  RCReference<Dataset<T...>> input_dataset_;
+  RCArray<AsyncValue> additional_fn_args_;
+  RCReference<const Function> predicate_fn_;
+  const int64_t num_parallel_calls_;
+  HostContext* host_;
+  HostAllocator* allocator_;
+};
+
+template <typename... T>
+class FilterDatasetIterator : public Iterator<T...> {
+ public:
+  explicit FilterDatasetIterator(RCReference<FilterDataset<T...>> dataset)
+      : Iterator<T...>(),
+        parent_dataset_(std::move(dataset)),
+        input_iterator_(parent_dataset_->input_dataset_->MakeIterator()) {}
+
+  // This class is not copyable or movable.
+  FilterDatasetIterator(const FilterDatasetIterator&) = delete;
+  FilterDatasetIterator& operator=(const FilterDatasetIterator&) = delete;
+
+  AsyncValueRef<std::tuple<T...>> GetNext(
+      const ExecutionContext& exec_ctx) override;
+
+  // The state is the elements that passed the predicate and are not returned
+  // yet, followed by the state of the input iterator. Save waits for the
+  // running invocations to complete, and for the elements already returned.
+  llvm::Error Save(IteratorStateWriter* writer) override;
+
+  llvm::Error Restore(IteratorStateReader* reader) override;
+
+ private:
+  // An input element, the async result of the predicate on it, and whether
+  // the predicate was started, either by its task or by GetNext. The result is
+  // an error if the element is an error.
+  struct Entry {
+    AsyncValueRef<std::tuple<T...>> element;
+    AsyncValueRef<bool> keep;
+    std::shared_ptr<std::atomic<bool>> started;
+
+    Entry CopyRef() const {
+      return Entry{element.CopyRef(), keep.CopyRef(), started};
+    }
+  };
+
+  void Destroy() override {
+    internal::DestroyImpl<FilterDatasetIterator>(this,
+                                                 parent_dataset_->allocator_);
+  }
+
+  // Starts predicate invocations until `num_parallel_calls` entries are in
+  // flight or buffered, and there is an entry for each pending result and the
+  // next element, or the input iterator reaches end.
+  void StartCallsLocked(const ExecutionContext& exec_ctx) TFRT_REQUIRES(mu_);
+
+  // Drops the entries at the front whose element did not pass. Returns false
+  // if no entries are left, i.e. the input reached end. Otherwise, the
+  // predicate of the first entry is either not done, or done and its element
+  // is to be returned.
+  bool SkipRejectedLocked(const ExecutionContext& exec_ctx) TFRT_REQUIRES(mu_);
+
+  // Removes the first entry, whose predicate is done, and returns its element,
+  // or its error.
+  AsyncValueRef<std::tuple<T...>> PopFrontLocked() TFRT_REQUIRES(mu_);
+
+  // Forwards the pending results to the elements that passed, in order, and
+  // calls itself again once the predicate it stopped at is done.
+  void ForwardResults(const ExecutionContext& exec_ctx);
+
+  // Calls ForwardResults once `value` is available. If the input might block,
+  // ForwardResults runs on the blocking work queue, since it reads the input.
+  void ForwardResultsWhenReady(RCReference<AsyncValue> value,
+                               const ExecutionContext& exec_ctx);
+
+  // Enqueues the predicate to the work queue to run on a copy of the element
+  // of `entry`, once it is available, unless GetNext runs it first.
+  void EnqueuePredicate(const Entry& entry, const ExecutionContext& exec_ctx);
+
+  // Runs the predicate on the available element of `entry`, unless it was
+  // started already.
+  static void StartPredicate(const FilterDataset<T...>& dataset,
+                             const Entry& entry, HostContext* host);
+
+  template <size_t... I>
+  static void RunPredicate(const FilterDataset<T...>& dataset,
+                           const std::tuple<T...>& element,
+                           AsyncValueRef<bool> keep, HostContext* host,
+                           std::index_sequence<I...>);
+
+  RCReference<FilterDataset<T...>> parent_dataset_;
+  mutex mu_;
+  RCReference<Iterator<T...>> input_iterator_ TFRT_GUARDED_BY(mu_);
+  bool end_of_input_ TFRT_GUARDED_BY(mu_) = false;
+  // The entries of the started invocations in input order.
+  std::deque<Entry> entries_ TFRT_GUARDED_BY(mu_);
+  // The values returned by GetNext before their element was known, in order.
+  // While there are any, a callback waits for the predicate of the first
+  // entry.
+  std::deque<RCReference<IndirectAsyncValue>> pending_results_
+      TFRT_GUARDED_BY(mu_);
+};
+
+template <typename... T>
+RCReference<Iterator<T...>> FilterDataset<T...>::MakeIterator() {
+  return TakeRef(host_->Construct<FilterDatasetIterator<T...>>(FormRef(this)));
+}
+
+template <typename... T>
+template <size_t... I>
+void FilterDatasetIterator<T...>::RunPredicate(
+    const FilterDataset<T...>& dataset, const std::tuple<T...>& element,
+    AsyncValueRef<bool> keep, HostContext* host, std::index_sequence<I...>) {
+  SmallVector<AsyncValue*, 4> arguments;
+  for (auto* additional_arg : dataset.additional_fn_args_.values()) {
+    arguments.push_back(additional_arg);
+  }
+  // The function may move its arguments, so it gets a copy of the element.
+  RCReference<AsyncValue> values[] = {
+      host->template MakeConcreteAsyncValueRef<T>(
+              internal::CopyValue(std::get<I>(element)))
+          .ReleaseRCRef()...};
+  for (auto& value : values) arguments.push_back(value.get());
+
+  SmallVector<RCReference<AsyncValue>, 1> results;
+  results.resize(dataset.predicate_fn_->result_types().size());
+  dataset.predicate_fn_->Execute(arguments, results, host);
+  assert(results.size() == 1);
+  AsyncValue* result_ptr = results[0].get();
+  result_ptr->AndThen(
+      [result = std::move(results[0]), keep = std::move(keep)]() {
+        if (result->IsError()) {
+          keep.SetError(result->GetError());
+          return;
+        }
+        keep.emplace(result->get<bool>());
+      });
+}
+
+template <typename... T>
+void FilterDatasetIterator<T...>::StartPredicate(
+    const FilterDataset<T...>& dataset, const Entry& entry, HostContext* host) {
+  if (entry.started->exchange(true)) return;
+  if (entry.element.IsError()) {
+    entry.keep.SetError(entry.element.GetError());
+    return;
+  }
+  RunPredicate(dataset, entry.element.get(), entry.keep.CopyRef(), host,
+               std::index_sequence_for<T...>{});
+}
+
+template <typename... T>
+void FilterDatasetIterator<T...>::EnqueuePredicate(
+    const Entry& entry, const ExecutionContext& exec_ctx) {
+  HostContext* host = exec_ctx.host();
+  // The predicate is not pinned to the current worker, so that the
+  // predicates of consecutive elements run in parallel.
+  host->EnqueueWork([host, dataset = parent_dataset_.CopyRef(),
+                     entry = entry.CopyRef()]() {
+    entry.element.AndThen(
+        [host, dataset = dataset.CopyRef(), entry = entry.CopyRef()]() {
+          StartPredicate(*dataset, entry, host);
+        });
+  });
+}
+
+template <typename... T>
+void FilterDatasetIterator<T...>::StartCallsLocked(
+    const ExecutionContext& exec_ctx) {
+  const size_t num_entries =
+      std::max<size_t>(parent_dataset_->num_parallel_calls_,
+                       pending_results_.size() + 1);
+  while (!end_of_input_ && entries_.size() < num_entries) {
+    auto element = input_iterator_->GetNext(exec_ctx);
+    if (!element) {
+      end_of_input_ = true;
+      return;
+    }
+    entries_.push_back(
+        Entry{std::move(element),
+              exec_ctx.host()->template MakeUnconstructedAsyncValueRef<bool>(),
+              std::make_shared<std::atomic<bool>>(false)});
+    EnqueuePredicate(entries_.back(), exec_ctx);
+  }
+}
+
+template <typename... T>
+bool FilterDatasetIterator<T...>::SkipRejectedLocked(
+    const ExecutionContext& exec_ctx) {
+  while (true) {
+    StartCallsLocked(exec_ctx);
+    if (entries_.empty()) return false;
+    const Entry& front = entries_.front();
+    // Run the predicate here rather than wait for its task to start.
+    if (!front.keep.IsAvailable() && front.element.IsAvailable()) {
+      StartPredicate(*parent_dataset_, front, exec_ctx.host());
+    }
+    if (!front.keep.IsAvailable() || front.keep.IsError() ||
+        front.keep.get()) {
+      return true;
+    }
+    entries_.pop_front();
+  }
+}
+
+template <typename... T>
+AsyncValueRef<std::tuple<T...>> FilterDatasetIterator<T...>::PopFrontLocked() {
+  Entry entry = std::move(entries_.front());
+  entries_.pop_front();
+  if (entry.keep.IsError()) {
+    return AsyncValueRef<std::tuple<T...>>(entry.keep.ReleaseRCRef());
+  }
+  return std::move(entry.element);
+}
+
+template <typename... T>
+void FilterDatasetIterator<T...>::ForwardResults(
+    const ExecutionContext& exec_ctx) {
+  SmallVector<std::pair<RCReference<IndirectAsyncValue>,
+                        RCReference<AsyncValue>>,
+              4>
+      forwards;
+  RCReference<AsyncValue> wait_for;
+  {
+    mutex_lock lock(mu_);
+    while (!pending_results_.empty()) {
+      if (!SkipRejectedLocked(exec_ctx)) {
+        for (auto& pending_result : pending_results_) {
+          forwards.emplace_back(
+              std::move(pending_result),
+              exec_ctx.host()->MakeErrorAsyncValueRef("iterator reached end"));
+        }
+        pending_results_.clear();
+        break;
+      }
+      if (!entries_.front().keep.IsAvailable()) {
+        wait_for = entries_.front().keep.CopyRCRef();
+        break;
+      }
+      forwards.emplace_back(std::move(pending_results_.front()),
+                            PopFrontLocked().ReleaseRCRef());
+      pending_results_.pop_front();
+    }
+  }
+  // The consumer may call GetNext from the continuations of the results, so
+  // they are forwarded without holding the mutex.
+  for (auto& forward : forwards) {
+    forward.first->ForwardTo(std::move(forward.second));
+  }
+  if (wait_for) ForwardResultsWhenReady(std::move(wait_for), exec_ctx);
+}
+
+template <typename... T>
+void FilterDatasetIterator<T...>::ForwardResultsWhenReady(
+    RCReference<AsyncValue> value, const ExecutionContext& exec_ctx) {
+  AsyncValue* value_ptr = value.get();
+  value_ptr->AndThen([iterator = FormRef(this), value = std::move(value),
+                      exec_ctx]() {
+    HostContext* host = exec_ctx.host();
+    if (iterator->parent_dataset_->input_dataset_->IsBlocking() &&
+        host->EnqueueBlockingWork([iterator = iterator.CopyRef(), exec_ctx]() {
+          iterator->ForwardResults(exec_ctx);
+        })) {
+      return;
+    }
+    iterator->ForwardResults(exec_ctx);
+  });
+}
+
+template <typename... T>
+AsyncValueRef<std::tuple<T...>> FilterDatasetIterator<T...>::GetNext(
+    const ExecutionContext& exec_ctx) {
+  RCReference<AsyncValue> wait_for;
+  AsyncValueRef<std::tuple<T...>> result;
+  {
+    mutex_lock lock(mu_);
+    if (pending_results_.empty()) {
+      if (!SkipRejectedLocked(exec_ctx)) {
+        return AsyncValueRef<std::tuple<T...>>();
+      }
+      if (entries_.front().keep.IsAvailable()) {
+        this->stats_.RecordElement();
+        return PopFrontLocked();
+      }
+      wait_for = entries_.front().keep.CopyRCRef();
+    } else {
+      StartCallsLocked(exec_ctx);
+      // Each pending result is forwarded to a different entry, so the input
+      // reached end if no entry is left for this one.
+      if (entries_.size() <= pending_results_.size()) {
+        return AsyncValueRef<std::tuple<T...>>();
+      }
+    }
+    // Whether this element exists depends on predicates that are not done,
+    // so its value is forwarded once they are.
+    auto pending_result = exec_ctx.host()->MakeIndirectAsyncValue();
+    result = AsyncValueRef<std::tuple<T...>>(pending_result.CopyRef());
+    pending_results_.push_back(std::move(pending_result));
+  }
+  if (wait_for) ForwardResultsWhenReady(std::move(wait_for), exec_ctx);
+  this->stats_.RecordElement();
+  return result;
+}
+
+template <typename... T>
+llvm::Error FilterDatasetIterator<T...>::Save(IteratorStateWriter* writer) {
+  while (true) {
+    SmallVector<RCReference<AsyncValue>, 16> results;
+    {
+      mutex_lock lock(mu_);
+      for (const auto& pending_result : pending_results_) {
+        results.push_back(pending_result.CopyRef());
+      }
+      for (const auto& entry : entries_) {
+        if (!entry.keep.IsAvailable()) {
+          results.push_back(entry.keep.CopyRCRef());
+        }
+      }
+      if (results.empty()) break;
+    }
+    parent_dataset_->host_->Await(results);
+  }
+
+  mutex_lock lock(mu_);
+  int64_t num_kept = 0;
+  for (const auto& entry : entries_) {
+    if (entry.keep.IsError() || entry.keep.get()) ++num_kept;
+  }
+  writer->WriteInt(num_kept);
+  for (const auto& entry : entries_) {
+    if (entry.keep.IsError()) {
+      writer->WriteAsyncElement(
+          AsyncValueRef<std::tuple<T...>>(entry.keep.CopyRCRef()));
+    } else if (entry.keep.get()) {
+      writer->WriteAsyncElement(entry.element);
+    }
+  }
+  writer->WriteInt(end_of_input_);
+  return input_iterator_->Save(writer);
+}
+
+template <typename... T>
+llvm::Error FilterDatasetIterator<T...>::Restore(IteratorStateReader* reader) {
+  HostContext* host = parent_dataset_->host_;
+  mutex_lock lock(mu_);
+  int64_t num_kept;
+  if (auto error = reader->ReadInt(&num_kept)) return error;
+  for (int64_t i = 0; i < num_kept; ++i) {
+    auto element = reader->ReadAsyncElement<T...>();
+    if (!element) return element.takeError();
+    AsyncValueRef<bool> keep =
+        element->IsError() ? AsyncValueRef<bool>(element->CopyRCRef())
+                           : host->MakeConcreteAsyncValueRef<bool>(true);
+    entries_.push_back(Entry{std::move(*element), std::move(keep),
+                             std::make_shared<std::atomic<bool>>(true)});
+  }
+  int64_t end_of_input;
+  if (auto error = reader->ReadInt(&end_of_input)) return error;
+  end_of_input_ = end_of_input;
+  return input_iterator_->Restore(reader);
+}
+
+}  // namespace data
+}  // namespace tfrt
+
+#endif  // TFRT_LIB_DATA_FILTER_DATASET_H_
@@ -0,0 +1,244 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- inflate_stream.cc --------------------------------------------------===//
+//
+// This file implements InflateStream class which reads a ZLIB or GZIP
+// compressed file as a stream of uncompressed bytes.
+//
+//===----------------------------------------------------------------------===//
+
+#include "inflate_stream.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "tfrt/host_context/host_context.h"
+#include "tfrt/support/error_util.h"
+
+namespace tfrt {
+namespace data {
+
+llvm::Expected<RCReference<InflateStream>> InflateStream::Open(
+    std::string path, Format format, size_t block_size, int num_blocks,
+    HostContext* host, HostAllocator* allocator) {
+  assert(block_size > 0 && num_blocks > 0);
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return MakeStringError("failed to open file ", path, ": ",
+                           strerror(errno));
+  }
+  auto stream =
+      TakeRef(new InflateStream(std::move(path), fd, block_size, host));
+
+  // Add 16 to the window bits to decode the GZIP header and trailer instead
+  // of the ZLIB ones.
+  const int window_bits = format == Format::kGzip ? MAX_WBITS + 16 : MAX_WBITS;
+  if (inflateInit2(stream->z_stream_, window_bits) != Z_OK) {
+    return MakeStringError("failed to initialize inflate for file ",
+                           stream->path_);
+  }
+
+  const size_t num_bytes = block_size * (num_blocks + 1);
+  stream->input_ = HostBuffer::CreateUninitialized(
+      block_size, alignof(std::max_align_t), allocator);
+  if (!stream->input_) {
+    return MakeStringError("failed to allocate ", num_bytes,
+                           " bytes to read file ", stream->path_);
+  }
+  mutex_lock lock(stream->mu_);
+  stream->blocks_.resize(num_blocks);
+  for (auto& block : stream->blocks_) {
+    block.buffer = HostBuffer::CreateUninitialized(
+        block_size, alignof(std::max_align_t), allocator);
+    if (!block.buffer) {
+      return MakeStringError("failed to allocate ", num_bytes,
+                             " bytes to read file ", stream->path_);
+    }
+  }
+  return std::move(stream);
+}
+
+InflateStream::InflateStream(std::string path, int fd, size_t block_size,
+                             HostContext* host)
+    : path_(std::move(path)),
+      fd_(fd),
+      block_size_(block_size),
+      host_(host),
+      z_stream_(new z_stream()) {}
+
+InflateStream::~InflateStream() {
+  // This is a no-op if inflateInit2 failed.
+  inflateEnd(z_stream_);
+  delete z_stream_;
+  close(fd_);
+}
+
+llvm::Expected<size_t> InflateStream::Read(char* dst, size_t n) {
+  size_t num_read = 0;
+  mutex_lock lock(mu_);
+  while (num_read < n) {
+    if (num_filled_ == 0) {
+      if (error_) return MakeStringError(*error_);
+      if (end_) break;
+      MaybeStartProducer();
+      // Only wait for a block that Produce is inflating. The task might not
+      // run before this returns, e.g. if the blocking work queue is busy.
+      if (inflating_) {
+        cond_.wait(lock, [this]() TFRT_REQUIRES(mu_) {
+          return num_filled_ > 0 || !inflating_;
+        });
+      } else {
+        InflateInline();
+      }
+      continue;
+    }
+
+    // The producer does not write to the filled blocks.
+    Block& block = blocks_[head_];
+    const size_t size = std::min(block.size - read_position_, n - num_read);
+    if (dst) {
+      memcpy(dst + num_read,
+             static_cast<const char*>(block.buffer->data()) + read_position_,
+             size);
+    }
+    num_read += size;
+    read_position_ += size;
+    if (read_position_ == block.size) {
+      head_ = (head_ + 1) % blocks_.size();
+      --num_filled_;
+      read_position_ = 0;
+    }
+  }
+  // Inflate the next blocks while the caller parses these bytes.
+  MaybeStartProducer();
+  return num_read;
+}
+
+void InflateStream::MaybeStartProducer() {
+  if (!host_ || producer_started_ || end_ || error_ ||
+      num_filled_ == blocks_.size()) {
+    return;
+  }
+  producer_started_ = true;
+  // The task keeps the stream alive, and stops once it holds the last
+  // reference.
+  if (!host_->EnqueueBlockingWork(
+          [stream = FormRef(this)]() { stream->Produce(); })) {
+    // The blocking work queue is full. Read inflates the blocks instead.
+    producer_started_ = false;
+  }
+}
+
+void InflateStream::InflateInline() {
+  // The ring is empty, so the next block to fill is the head block.
+  bool end = false;
+  if (auto error = InflateBlock(&blocks_[head_], &end)) {
+    error_ = llvm::toString(std::move(error));
+    return;
+  }
+  end_ = end;
+  if (blocks_[head_].size > 0) ++num_filled_;
+}
+
+void InflateStream::Produce() {
+  while (true) {
+    Block* block;
+    {
+      mutex_lock lock(mu_);
+      if (IsUnique() || end_ || error_ || num_filled_ == blocks_.size()) {
+        producer_started_ = false;
+        cond_.notify_all();
+        return;
+      }
+      // Read does not inflate blocks while this is true.
+      inflating_ = true;
+      block = &blocks_[(head_ + num_filled_) % blocks_.size()];
+    }
+
+    // The block is not filled, so Read does not access it.
+    bool end = false;
+    auto error = InflateBlock(block, &end);
+
+    mutex_lock lock(mu_);
+    inflating_ = false;
+    if (error) {
+      error_ = llvm::toString(std::move(error));
+    } else {
+      end_ = end;
+      if (block->size > 0) ++num_filled_;
+    }
+    cond_.notify_all();
+  }
+}
+
+llvm::Error InflateStream::ReadInput() {
+  char* data = static_cast<char*>(input_->data());
+  while (true) {
+    const ssize_t result = pread(fd_, data, input_->size(), input_offset_);
+    if (result < 0) {
+      if (errno == EINTR) continue;
+      return MakeStringError("failed to read file ", path_, ": ",
+                             strerror(errno));
+    }
+    if (result == 0) input_eof_ = true;
+    input_offset_ += result;
+    z_stream_->next_in = reinterpret_cast<Bytef*>(data);
+    z_stream_->avail_in = result;
+    return llvm::Error::success();
+  }
+}
+
+llvm::Error InflateStream::InflateBlock(Block* block, bool* end) {
+  z_stream_->next_out = static_cast<Bytef*>(block->buffer->data());
+  z_stream_->avail_out = block_size_;
+  block->size = 0;
+  while (z_stream_->avail_out > 0) {
+    if (z_stream_->avail_in == 0 && !input_eof_) {
+      if (auto error = ReadInput()) return error;
+    }
+    if (z_stream_->avail_in == 0) {
+      if (!at_stream_end_) {
+        return MakeStringError("unexpected end of compressed file ", path_,
+                               " at offset ", input_offset_);
+      }
+      *end = true;
+      break;
+    }
+    if (at_stream_end_) {
+      // Another stream follows, e.g. the next member of a GZIP file.
+      inflateReset(z_stream_);
+      at_stream_end_ = false;
+    }
+    const int result = inflate(z_stream_, Z_NO_FLUSH);
+    if (result == Z_STREAM_END) {
+      at_stream_end_ = true;
+    } else if (result != Z_OK) {
+      return MakeStringError("failed to inflate file ", path_, ": ",
+                             z_stream_->msg ? z_stream_->msg : "invalid data");
+    }
+  }
+  block->size = block_size_ - z_stream_->avail_out;
+  return llvm::Error::success();
+}
+
+}  // namespace data
+}  // namespace tfrt
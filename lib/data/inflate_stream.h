@@ -0,0 +1,139 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- inflate_stream.h -----------------------------------------*- C++ -*-===//
+//
+// This file declares InflateStream class which reads a ZLIB or GZIP compressed
+// file as a stream of uncompressed bytes.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef TFRT_LIB_DATA_INFLATE_STREAM_H_
+#define TFRT_LIB_DATA_INFLATE_STREAM_H_
+
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/Support/Error.h"
+#include "tfrt/host_context/host_buffer.h"
+#include "tfrt/support/forward_decls.h"
+#include "tfrt/support/mutex.h"
+#include "tfrt/support/ref_count.h"
+
+// Avoid including zlib.h in the header.
+struct z_stream_s;
+
+namespace tfrt {
+
+class HostContext;
+
+namespace data {
+
+// InflateStream reads a compressed file with pread in large blocks and
+// inflates it into a ring of `num_blocks` reusable buffers of `block_size`
+// bytes, so that at most `num_blocks * block_size` uncompressed bytes are
+// buffered.
+//
+// If `host` is not null, the blocks are inflated ahead of the reader on the
+// blocking work queue, so that inflating the next blocks overlaps with
+// parsing the previous ones. Otherwise, or if the blocking work queue is
+// full or has not started the producer task yet, Read inflates the blocks
+// itself.
+//
+// Concatenated GZIP members are read as a single stream.
+class InflateStream : public ReferenceCounted<InflateStream> {
+ public:
+  enum class Format { kZlib, kGzip };
+
+  static llvm::Expected<RCReference<InflateStream>> Open(
+      std::string path, Format format, size_t block_size, int num_blocks,
+      HostContext* host, HostAllocator* allocator);
+
+  // Reads the next `n` uncompressed bytes into `dst`, or skips them if `dst`
+  // is null. Returns the number of bytes read, which is less than `n` only at
+  // the end of the stream.
+  llvm::Expected<size_t> Read(char* dst, size_t n);
+
+ private:
+  friend class ReferenceCounted<InflateStream>;
+
+  // A buffer of the ring and the number of uncompressed bytes it holds.
+  struct Block {
+    RCReference<HostBuffer> buffer;
+    size_t size = 0;
+  };
+
+  InflateStream(std::string path, int fd, size_t block_size, HostContext* host);
+  ~InflateStream();
+
+  // Inflates the next block of the stream into `block`. Sets *end to true if
+  // this reaches the end of the stream. Only one block is inflated at a time.
+  llvm::Error InflateBlock(Block* block, bool* end);
+
+  // Reads the next block of the compressed file into input_.
+  llvm::Error ReadInput();
+
+  // Inflates blocks until the ring is full, the stream ends, or the reader is
+  // destroyed. Runs on the blocking work queue.
+  void Produce();
+
+  // Inflates the next block on the calling thread if the ring is empty and
+  // Produce is not inflating a block.
+  void InflateInline() TFRT_REQUIRES(mu_);
+
+  // Starts Produce on the blocking work queue if the ring is not full and
+  // Produce is not started already.
+  void MaybeStartProducer() TFRT_REQUIRES(mu_);
+
+  const std::string path_;
+  const int fd_;
+  const size_t block_size_;
+  HostContext* const host_;
+
+  // The inflate state and the compressed input. They are only accessed by
+  // the thread that inflates a block: Produce while inflating_ is true, or
+  // Read while it holds mu_ and inflating_ is false.
+  z_stream_s* const z_stream_;
+  RCReference<HostBuffer> input_;
+  uint64_t input_offset_ = 0;
+  bool input_eof_ = false;
+  // True if the last compressed stream ended and no input followed it yet.
+  // An empty file is an empty stream.
+  bool at_stream_end_ = true;
+
+  mutex mu_;
+  condition_variable cond_;
+  // The ring. The filled blocks are [head_, head_ + num_filled_), and the
+  // next byte to read is at read_position_ in the head block.
+  std::vector<Block> blocks_ TFRT_GUARDED_BY(mu_);
+  size_t head_ TFRT_GUARDED_BY(mu_) = 0;
+  size_t num_filled_ TFRT_GUARDED_BY(mu_) = 0;
+  size_t read_position_ TFRT_GUARDED_BY(mu_) = 0;
+  // True from the time Produce is enqueued until it returns.
+  bool producer_started_ TFRT_GUARDED_BY(mu_) = false;
+  // True while Produce inflates a block. Produce might be enqueued and not
+  // run yet, e.g. if the blocking work queue is busy, so Read only waits for
+  // the blocks that are being inflated.
+  bool inflating_ TFRT_GUARDED_BY(mu_) = false;
+  bool end_ TFRT_GUARDED_BY(mu_) = false;
+  llvm::Optional<std::string> error_ TFRT_GUARDED_BY(mu_);
+};
+
+}  // namespace data
+}  // namespace tfrt
+
+#endif  // TFRT_LIB_DATA_INFLATE_STREAM_H_
@@ -105,7 +105,8 @@ class InterleaveDatasetIterator<std::tuple<InputTypes...>,
       : Iterator<OutputTypes...>(),
         parent_dataset_(std::move(parent_dataset)),
         input_iterator_(parent_dataset_->input_dataset_->MakeIterator()),
-        cycle_iterators_(parent_dataset_->cycle_length_) {}
+        cycle_iterators_(parent_dataset_->cycle_length_),
+        cycle_elements_(parent_dataset_->cycle_length_) {}
 
   // This class is not copyable or movable.
   InterleaveDatasetIterator(const InterleaveDatasetIterator&) = delete;
@@ -116,6 +117,13 @@ class InterleaveDatasetIterator<std::tuple<InputTypes...>,
   AsyncValueRef<std::tuple<OutputTypes...>> GetNext(
       const ExecutionContext& exec_ctx) override;
 
+  // The state is the position in the cycle, the input element and the state
+  // of every open iterator, and the state of the input iterator. Restore
+  // reopens the iterators by running the function on the input elements.
+  llvm::Error Save(IteratorStateWriter* writer) override;
+
+  llvm::Error Restore(IteratorStateReader* reader) override;
+
  private:
   void Destroy() override {
     internal::DestroyImpl<InterleaveDatasetIterator>(
@@ -128,6 +136,8 @@ class InterleaveDatasetIterator<std::tuple<InputTypes...>,
   RCReference<Iterator<InputTypes...>> input_iterator_;
 
   std::vector<RCReference<Iterator<OutputTypes...>>> cycle_iterators_;
+  // The input elements of the open iterators, which are saved with them.
+  std::vector<llvm::Optional<std::tuple<InputTypes...>>> cycle_elements_;
   size_t cycle_index_ = 0;
   size_t block_index_ = 0;
   bool end_of_input_ = false;
@@ -178,11 +188,13 @@ AsyncValueRef<std::tuple<OutputTypes...>> InterleaveDatasetIterator<
       // iterator in the cycle.
       if (!value) {
         cycle_iterators_[cycle_index_].reset();
+        cycle_elements_[cycle_index_].reset();
         --num_open_;
         AdvanceCycleIndex();
         continue;
       }
       AdvanceBlockIndex();
+      this->stats_.RecordElement();
       return value;
     }
 
@@ -221,6 +233,8 @@ AsyncValueRef<std::tuple<OutputTypes...>> InterleaveDatasetIterator<
           input_element.ReleaseRCRef());
     }
 
+    cycle_elements_[cycle_index_].emplace(
+        internal::CopyElement(input_element.get()));
     cycle_iterators_[cycle_index_] =
         MakeIteratorFromInputElement(std::move(input_element), exec_ctx);
     ++num_open_;
@@ -257,6 +271,57 @@ RCReference<Iterator<OutputTypes...>> InterleaveDatasetIterator<
   return dataset->MakeIterator();
 }
 
+template <typename... InputTypes, typename... OutputTypes>
+llvm::Error InterleaveDatasetIterator<
+    std::tuple<InputTypes...>,
+    std::tuple<OutputTypes...>>::Save(IteratorStateWriter* writer) {
+  writer->WriteInt(cycle_index_);
+  writer->WriteInt(block_index_);
+  writer->WriteInt(end_of_input_);
+  for (size_t i = 0, e = cycle_iterators_.size(); i < e; ++i) {
+    writer->WriteInt(static_cast<bool>(cycle_iterators_[i]));
+    if (!cycle_iterators_[i]) continue;
+    writer->WriteElement(*cycle_elements_[i]);
+    if (auto error = cycle_iterators_[i]->Save(writer)) return error;
+  }
+  return input_iterator_->Save(writer);
+}
+
+template <typename... InputTypes, typename... OutputTypes>
+llvm::Error InterleaveDatasetIterator<
+    std::tuple<InputTypes...>,
+    std::tuple<OutputTypes...>>::Restore(IteratorStateReader* reader) {
+  int64_t cycle_index, block_index, end_of_input;
+  if (auto error = reader->ReadInt(&cycle_index)) return error;
+  if (auto error = reader->ReadInt(&block_index)) return error;
+  if (auto error = reader->ReadInt(&end_of_input)) return error;
+  if (cycle_index < 0 || cycle_index >= parent_dataset_->cycle_length_ ||
+      block_index < 0 || block_index >= parent_dataset_->block_length_) {
+    return MakeStringError("invalid interleave_dataset iterator state");
+  }
+  cycle_index_ = cycle_index;
+  block_index_ = block_index;
+  end_of_input_ = end_of_input;
+
+  ExecutionContext exec_ctx(reader->host());
+  for (size_t i = 0, e = cycle_iterators_.size(); i < e; ++i) {
+    int64_t is_open;
+    if (auto error = reader->ReadInt(&is_open)) return error;
+    if (!is_open) continue;
+    auto element = reader->ReadElement<InputTypes...>();
+    if (!element) return element.takeError();
+    cycle_elements_[i].emplace(internal::CopyElement(*element));
+    cycle_iterators_[i] = MakeIteratorFromInputElement(
+        exec_ctx.host()
+            ->template MakeConcreteAsyncValueRef<std::tuple<InputTypes...>>(
+                std::move(*element)),
+        exec_ctx);
+    ++num_open_;
+    if (auto error = cycle_iterators_[i]->Restore(reader)) return error;
+  }
+  return input_iterator_->Restore(reader);
+}
+
 }  // namespace data
 }  // namespace tfrt
 
@@ -0,0 +1,191 @@
+// Copyright 2020 The TensorFlow Runtime Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//===- iterator_state.cc --------------------------------------------------===//
+//
+// This file implements IteratorStateWriter and IteratorStateReader classes. A
+// tensor value is its dtype kind, its rank, its dims and its row major data.
+// A state file is the magic "TFRTITS1", the state and the masked CRC32C of the
+// state.
+//
+//===----------------------------------------------------------------------===//
+
+#include "iterator_state.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "tfrt/support/crc32c.h"
+#include "tfrt/support/error_util.h"
+#include "tfrt/support/string_util.h"
+
+namespace tfrt {
+namespace data {
+
+namespace {
+
+constexpr char kMagic[] = "TFRTITS1";
+constexpr size_t kMagicSize = sizeof(kMagic) - 1;
+
+// Returns true if DenseHostTensor supports `kind`.
+bool IsDenseDType(int64_t kind) {
+  switch (kind) {
+    case DType::BOOL:
+    case DType::COMPLEX64:
+#define DTYPE_NUMERIC(ENUM) case DType::ENUM:
+#include "tfrt/tensor/dtype.def"
+      return true;
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+void IteratorStateWriter::WriteValue(const DenseHostTensor& value) {
+  WriteInt(value.dtype().kind());
+  SmallVector<ssize_t, 4> dims;
+  value.shape().GetDimensions(&dims);
+  WriteInt(dims.size());
+  for (ssize_t dim : dims) WriteInt(dim);
+  WriteBytes(value.data(), value.DataSizeInBytes());
+}
+
+llvm::Error IteratorStateReader::ReadBytes(void* dst, size_t size) {
+  if (data_.size() < size) {
+    return MakeStringError("iterator state is truncated");
+  }
+  std::memcpy(dst, data_.data(), size);
+  data_ = data_.drop_front(size);
+  return llvm::Error::success();
+}
+
+llvm::Error IteratorStateReader::ReadString(std::string* value) {
+  int64_t size;
+  if (auto error = ReadInt(&size)) return error;
+  if (size < 0 || data_.size() < static_cast<uint64_t>(size)) {
+    return MakeStringError("iterator state is truncated");
+  }
+  value->assign(data_.data(), size);
+  data_ = data_.drop_front(size);
+  return llvm::Error::success();
+}
+
+llvm::Error IteratorStateReader::ReadValue(
+    llvm::Optional<std::string>* value) {
+  std::string result;
+  if (auto error = ReadString(&result)) return error;
+  value->emplace(std::move(result));
+  return llvm::Error::success();
+}
+
+llvm::Error IteratorStateReader::ReadValue(
+    llvm::Optional<DenseHostTensor>* value) {
+  int64_t kind, rank;
+  if (auto error = ReadInt(&kind)) return error;
+  if (auto error = ReadInt(&rank)) return error;
+  // The state may be corrupted, so check the rank and the dimensions against
+  // the size of the rest of the state before allocating the tensor.
+  if (!IsDenseDType(kind) || rank < 0 ||
+      static_cast<uint64_t>(rank) > data_.size() / sizeof(int64_t)) {
+    return MakeStringError("invalid tensor in iterator state");
+  }
+  SmallVector<ssize_t, 4> dims(rank);
+  for (auto& dim : dims) {
+    int64_t size;
+    if (auto error = ReadInt(&size)) return error;
+    if (size < 0) return MakeStringError("invalid tensor in iterator state");
+    dim = size;
+  }
+  const DType dtype(static_cast<DType::Kind>(kind));
+  if (!llvm::is_contained(dims, 0)) {
+    const uint64_t max_elements =
+        data_.size() / std::max<size_t>(dtype.GetHostSize(), 1);
+    uint64_t num_elements = 1;
+    for (ssize_t dim : dims) {
+      if (num_elements > max_elements / dim) {
+        return MakeStringError("iterator state is truncated");
+      }
+      num_elements *= dim;
+    }
+  }
+  auto tensor =
+      DenseHostTensor::CreateUninitialized(TensorMetadata(dtype, dims), host_);
+  if (!tensor) return MakeStringError("failed to create uninitialized tensor");
+  if (auto error = ReadBytes(tensor->data(), tensor->DataSizeInBytes())) {
+    return error;
+  }
+  value->emplace(std::move(*tensor));
+  return llvm::Error::success();
+}
+
+llvm::Error WriteIteratorStateFile(const std::string& path,
+                                   string_view state) {
+  const uint32_t crc = crc32c::Mask(crc32c::Value(state.data(), state.size()));
+  // Write a temporary file that is unique to this call, as other threads and
+  // processes may write the same state, and rename it.
+  static std::atomic<uint64_t> next_tmp_id{0};
+  const std::string tmp_path =
+      StrCat(path, ".tmp.", getpid(), ".", next_tmp_id++);
+  {
+    std::ofstream out(tmp_path, std::ios_base::binary | std::ios_base::trunc);
+    out.write(kMagic, kMagicSize);
+    out.write(state.data(), state.size());
+    out.write(reinterpret_cast<const char*>(&crc), sizeof(crc));
+    out.close();
+    if (!out) {
+      std::remove(tmp_path.c_str());
+      return MakeStringError("failed to write file ", tmp_path);
+    }
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::remove(tmp_path.c_str());
+    return MakeStringError("failed to rename file ", tmp_path, " to ", path,
+                           ": ", strerror(errno));
+  }
+  return llvm::Error::success();
+}
+
+llvm::Expected<std::string> ReadIteratorStateFile(const std::string& path) {
+  std::ifstream in(path, std::ios_base::binary);
+  if (!in) return MakeStringError("failed to open file ", path);
+  std::string data((std::istreambuf_iterator<char>(in)),
+                   std::istreambuf_iterator<char>());
+  if (in.bad()) return MakeStringError("failed to read file ", path);
+
+  uint32_t crc;
+  if (data.size() < kMagicSize + sizeof(crc) ||
+      data.compare(0, kMagicSize, kMagic) != 0) {
+    return MakeStringError("invalid iterator state file ", path);
+  }
+  std::memcpy(&crc, data.data() + data.size() - sizeof(crc), sizeof(crc));
+  data.resize(data.size() - sizeof(crc));
+  data.erase(0, kMagicSize);
+  if (crc32c::Unmask(crc) != crc32c::Value(data.data(), data.size())) {
+    return MakeStringError("corrupted iterator state file ", path);
+  }
+  return std::move(data);
+}
+
+}  // namespace data
+}  // namespace tfrt
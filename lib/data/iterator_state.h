@@ -0,0 +1,190 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- iterator_state.h -----------------------------------------*- C++ -*-===//
+//
+// This file declares IteratorStateWriter and IteratorStateReader classes which
+// serialize the state of the iterators of the data pipeline library.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef TFRT_LIB_DATA_ITERATOR_STATE_H_
+#define TFRT_LIB_DATA_ITERATOR_STATE_H_
+
+#include <string>
+#include <tuple>
+#include <type_traits>
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/Support/Error.h"
+#include "tfrt/host_context/async_value_ref.h"
+#include "tfrt/host_context/host_context.h"
+#include "tfrt/support/forward_decls.h"
+#include "tfrt/tensor/dense_host_tensor.h"
+
+namespace tfrt {
+namespace data {
+
+// IteratorStateWriter serializes the state of an iterator into a byte string.
+// The state is the sequence of values written by IteratorBase::Save, e.g. the
+// position of the iterator and the elements it buffered, followed by the
+// state of its input iterators. IteratorBase::Restore reads them back in the
+// same order.
+//
+// The values are written in the byte order of the host. The state is meant to
+// resume a pipeline after a restart, not to be exchanged between hosts.
+class IteratorStateWriter {
+ public:
+  void WriteInt(int64_t value) { WriteBytes(&value, sizeof(value)); }
+
+  void WriteString(string_view value) {
+    WriteInt(value.size());
+    data_.append(value.data(), value.size());
+  }
+
+  // Writes a value of a dataset element.
+  template <typename T>
+  void WriteValue(const T& value) {
+    static_assert(std::is_arithmetic<T>::value, "T needs to be a scalar type");
+    WriteBytes(&value, sizeof(T));
+  }
+  void WriteValue(const std::string& value) { WriteString(value); }
+  void WriteValue(const DenseHostTensor& value);
+
+  template <typename... T>
+  void WriteElement(const std::tuple<T...>& element) {
+    WriteElement(element, std::index_sequence_for<T...>{});
+  }
+
+  // Writes an element returned by GetNext, which must be available. An error
+  // is written as its message.
+  template <typename... T>
+  void WriteAsyncElement(const AsyncValueRef<std::tuple<T...>>& element) {
+    assert(element.IsAvailable());
+    WriteInt(element.IsError());
+    if (element.IsError()) {
+      WriteString(element.GetError().message);
+    } else {
+      WriteElement(element.get());
+    }
+  }
+
+  const std::string& data() const { return data_; }
+
+ private:
+  void WriteBytes(const void* data, size_t size) {
+    data_.append(static_cast<const char*>(data), size);
+  }
+
+  template <typename... T, size_t... I>
+  void WriteElement(const std::tuple<T...>& element,
+                    std::index_sequence<I...>) {
+    // Use braced-init-list to write the values in sequence.
+    std::ignore =
+        std::initializer_list<int>{(WriteValue(std::get<I>(element)), 0)...};
+  }
+
+  std::string data_;
+};
+
+// IteratorStateReader reads the values written by IteratorStateWriter. Every
+// read fails if the state does not hold a value of the requested type.
+class IteratorStateReader {
+ public:
+  // `data` must outlive the reader.
+  IteratorStateReader(string_view data, HostContext* host)
+      : data_(data), host_(host) {}
+
+  llvm::Error ReadInt(int64_t* value) {
+    return ReadBytes(value, sizeof(*value));
+  }
+
+  llvm::Error ReadString(std::string* value);
+
+  // Reads a value of a dataset element.
+  template <typename T>
+  llvm::Error ReadValue(llvm::Optional<T>* value) {
+    T result;
+    if (auto error = ReadBytes(&result, sizeof(T))) return error;
+    value->emplace(result);
+    return llvm::Error::success();
+  }
+  llvm::Error ReadValue(llvm::Optional<std::string>* value);
+  llvm::Error ReadValue(llvm::Optional<DenseHostTensor>* value);
+
+  template <typename... T>
+  llvm::Expected<std::tuple<T...>> ReadElement() {
+    return ReadElement<T...>(std::index_sequence_for<T...>{});
+  }
+
+  // Reads an element written by WriteAsyncElement into an available async
+  // value.
+  template <typename... T>
+  llvm::Expected<AsyncValueRef<std::tuple<T...>>> ReadAsyncElement();
+
+  // Returns true if all the values are read.
+  bool empty() const { return data_.empty(); }
+
+  HostContext* host() const { return host_; }
+
+ private:
+  llvm::Error ReadBytes(void* dst, size_t size);
+
+  template <typename... T, size_t... I>
+  llvm::Expected<std::tuple<T...>> ReadElement(std::index_sequence<I...>) {
+    std::tuple<llvm::Optional<T>...> values;
+    llvm::Error error = llvm::Error::success();
+    // Use braced-init-list to read the values in sequence until one fails.
+    std::ignore = std::initializer_list<int>{
+        (error ? 0 : (error = ReadValue(&std::get<I>(values)), 0))...};
+    if (error) return std::move(error);
+    return std::tuple<T...>(std::move(*std::get<I>(values))...);
+  }
+
+  string_view data_;
+  HostContext* host_;
+};
+
+template <typename... T>
+llvm::Expected<AsyncValueRef<std::tuple<T...>>>
+IteratorStateReader::ReadAsyncElement() {
+  int64_t is_error;
+  if (auto error = ReadInt(&is_error)) return std::move(error);
+  if (is_error) {
+    std::string message;
+    if (auto error = ReadString(&message)) return std::move(error);
+    return AsyncValueRef<std::tuple<T...>>(
+        host_->MakeErrorAsyncValueRef(message));
+  }
+  auto element = ReadElement<T...>();
+  if (!element) return element.takeError();
+  return host_->MakeConcreteAsyncValueRef<std::tuple<T...>>(
+      std::move(*element));
+}
+
+// Writes `state` to the file at `path`, together with a checksum. The file is
+// replaced atomically, so that a failure while saving keeps the previous
+// state.
+llvm::Error WriteIteratorStateFile(const std::string& path,
+                                   string_view state);
+
+// Reads the state written by WriteIteratorStateFile.
+llvm::Expected<std::string> ReadIteratorStateFile(const std::string& path);
+
+}  // namespace data
+}  // namespace tfrt
+
+#endif  // TFRT_LIB_DATA_ITERATOR_STATE_H_
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- map_and_batch_dataset.h ----------------------------------*- C++ -*-===//
+//
+// This file declares CreateMapAndBatchDataset which composes BatchDataset and
+// MapDataset for a batch-compatible map function.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef TFRT_DATA_MAP_AND_BATCH_DATASET_H_
+#define TFRT_DATA_MAP_AND_BATCH_DATASET_H_
+
+#include "batch_dataset.h"
+#include "map_dataset.h"
+
+namespace tfrt {
+namespace data {
+
+// Returns the dataset of map(fn) followed by batch(batch_size) for a
+// batch-compatible `fn`, i.e. one that returns the batch of its results on the
+// elements when it is called on a batch of the elements, like an elementwise
+// normalization. The elements are batched first and `fn` is called once per
+// batch on the batch tensor, so that it runs vectorized over whole batches
+// rather than once per element.
+template <typename T, typename... U>
+RCReference<MapDataset<std::tuple<DenseHostTensor>, std::tuple<U...>>>
+CreateMapAndBatchDataset(RCReference<Dataset<T>> input_dataset,
+                         RCArray<AsyncValue> additional_fn_args,
+                         int32_t batch_size,
+                         RCReference<const Function> map_fn,
+                         HostContext* host) {
+  auto batch_dataset = TakeRef(host->Construct<BatchDataset<T>>(
+      std::move(input_dataset), batch_size, host));
+  return TakeRef(host->Construct<
+                 MapDataset<std::tuple<DenseHostTensor>, std::tuple<U...>>>(
+      std::move(batch_dataset), std::move(additional_fn_args),
+      std::move(map_fn), host));
+}
+
+}  // namespace data
+}  // namespace tfrt
+
+#endif  // TFRT_DATA_MAP_AND_BATCH_DATASET_H_
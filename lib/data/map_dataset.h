@@ -24,6 +24,8 @@
 #ifndef TFRT_LIB_DATA_MAP_DATASET_H_
 #define TFRT_LIB_DATA_MAP_DATASET_H_
 
+#include <memory>
+
 #include "dataset.h"
 #include "tfrt/host_context/function.h"
 #include "tfrt/support/forward_decls.h"
@@ -62,6 +64,169 @@ static std::tuple<T...> ArrayToTuple(
                                   std::make_index_sequence<sizeof...(T)>());
 }
 
+// Runs `map_fn` on `additional_fn_args` followed by the value of `args`, and
+// returns the async results of the function. The value of `args` is moved into
+// the arguments of the function.
+template <typename... OutputTypes, typename... InputTypes>
+SmallVector<RCReference<AsyncValue>, sizeof...(OutputTypes)>
+ExecuteMapFunction(const Function& map_fn,
+                   const RCArray<AsyncValue>& additional_fn_args,
+                   std::tuple<InputTypes...>& args, HostContext* host) {
+  // Construct arguments for function execution. The arguments consist of the
+  // 'additional_fn_args' from the MapDataset constructor, followed by the
+  // values from the underlying iterator.
+  SmallVector<AsyncValue*, 4> arguments;
+  for (auto* additional_arg : additional_fn_args.values()) {
+    arguments.push_back(additional_arg);
+  }
+  auto arg = host->template MakeConcreteAsyncValueRef<InputTypes...>(
+      std::move(std::get<0>(args)));
+  arguments.push_back(arg.GetAsyncValue());
+
+  SmallVector<RCReference<AsyncValue>, sizeof...(OutputTypes)> results;
+  results.resize(map_fn.result_types().size());
+  map_fn.Execute(arguments, results, host);
+  return results;
+}
+
+// Enqueues `map_fn` to the work queue to run on `args`, once `args` is
+// available, and returns the async result of the function. The arguments of
+// the function are the `additional_fn_args` followed by the value of `args`.
+template <typename... OutputTypes, typename... InputTypes>
+AsyncValueRef<std::tuple<OutputTypes...>> EnqueueMapFunction(
+    RCReference<const Function> map_fn, RCArray<AsyncValue> additional_fn_args,
+    AsyncValueRef<std::tuple<InputTypes...>> args,
+    const ExecutionContext& exec_ctx) {
+  HostContext* host = exec_ctx.host();
+  auto async_result = host->template MakeUnconstructedAsyncValueRef<
+      std::tuple<OutputTypes...>>();
+  // IDEA(donglin): We can optimize performance for small tasks by not
+  // enqueueing small tasks to the threadpool. We need a way to identify small
+  // tasks.
+  //
+  // Enqueue the map function to the threadpool to improve performance by
+  // running the map function in parallel. An alternative approach to increase
+  // parallelism is to compose map function with async kernels. This
+  // alternative approach likely incurs higher thread context switch overhead
+  // because different async kernels may be run by different threads.
+  //
+  // The map function consumes the input element, which was usually just
+  // produced by the worker that calls GetNext, so it prefers that worker.
+  auto run_map_fn = [host, map_fn = std::move(map_fn),
+                     additional_fn_args = std::move(additional_fn_args),
+                     args = std::move(args),
+                     async_result = async_result.CopyRef()]() mutable {
+    // IDEA(donglin): We can optimize performance by constructing a view of
+    // AsyncValue<T> from AsyncValue<std::tuple<T>> without moving data.
+    args.AndThen([host, map_fn = map_fn.CopyRef(),
+                  additional_fn_args = std::move(additional_fn_args),
+                  args = args.CopyRef(),
+                  async_result = async_result.CopyRef()]() {
+      if (args.IsError()) {
+        async_result.SetError(args.GetError());
+        return;
+      }
+      auto results = ExecuteMapFunction<OutputTypes...>(
+          *map_fn, additional_fn_args, args.get(), host);
+      for (size_t i = 0; i < sizeof...(OutputTypes); ++i) {
+        if (results[i]->IsError()) {
+          async_result.SetError(results[i]->GetError());
+          return;
+        }
+      }
+      // Translate RCReference<AsyncValue> to AsyncValue*.
+      SmallVector<AsyncValue*, 4> async_value_ptrs;
+      for (size_t i = 0; i < sizeof...(OutputTypes); ++i) {
+        async_value_ptrs.push_back(results[i].get());
+      }
+      host->RunWhenReady(async_value_ptrs,
+                         [results = std::move(results),
+                          async_result = async_result.CopyRef()]() mutable {
+                           for (auto& result : results) {
+                             if (result->IsError()) {
+                               async_result.SetError(result->GetError());
+                               return;
+                             }
+                           }
+                           async_result.emplace(ArrayToTuple<OutputTypes...>(
+                               std::move(results)));
+                         });
+    });
+  };
+  host->EnqueueWork(std::move(run_map_fn), WorkerAffinity::SameWorker());
+  return async_result;
+}
+
+// Enqueues `map_fn` to the work queue to run on every element of `args`, once
+// `args` is available, and returns the async results of the function in the
+// same order. The invocations are split into blocks with ParallelFor, so that
+// a task is enqueued per block rather than per element.
+template <typename... OutputTypes, typename... InputTypes>
+AsyncValueRef<std::vector<std::tuple<OutputTypes...>>> EnqueueMapFunctionBatch(
+    RCReference<const Function> map_fn, RCArray<AsyncValue> additional_fn_args,
+    AsyncValueRef<std::vector<std::tuple<InputTypes...>>> args,
+    const ExecutionContext& exec_ctx) {
+  using Results = SmallVector<RCReference<AsyncValue>, sizeof...(OutputTypes)>;
+  HostContext* host = exec_ctx.host();
+  auto async_result = host->template MakeUnconstructedAsyncValueRef<
+      std::vector<std::tuple<OutputTypes...>>>();
+  host->EnqueueWork([host, map_fn = std::move(map_fn),
+                     additional_fn_args = std::move(additional_fn_args),
+                     args = std::move(args),
+                     async_result = async_result.CopyRef()]() mutable {
+    args.AndThen([host, map_fn = std::move(map_fn),
+                  additional_fn_args = std::move(additional_fn_args),
+                  args = args.CopyRef(),
+                  async_result = std::move(async_result)]() mutable {
+      if (args.IsError()) {
+        async_result.SetError(args.GetError());
+        return;
+      }
+      const size_t n = args.get().size();
+      // Owned by `on_done`, which runs after all the blocks.
+      auto results = std::make_unique<std::vector<Results>>(n);
+      auto compute = [host, map_fn = std::move(map_fn),
+                      additional_fn_args = std::move(additional_fn_args),
+                      args = std::move(args),
+                      results = results.get()](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          (*results)[i] = ExecuteMapFunction<OutputTypes...>(
+              *map_fn, additional_fn_args, args.get()[i], host);
+        }
+      };
+      auto on_done = [host, results = std::move(results),
+                      async_result = std::move(async_result)]() mutable {
+        SmallVector<AsyncValue*, 16> async_value_ptrs;
+        for (const auto& element_results : *results) {
+          for (const auto& result : element_results) {
+            async_value_ptrs.push_back(result.get());
+          }
+        }
+        host->RunWhenReady(
+            async_value_ptrs,
+            [results = std::move(results),
+             async_result = std::move(async_result)]() {
+              std::vector<std::tuple<OutputTypes...>> outputs;
+              outputs.reserve(results->size());
+              for (auto& element_results : *results) {
+                for (const auto& result : element_results) {
+                  if (result->IsError()) {
+                    async_result.SetError(result->GetError());
+                    return;
+                  }
+                }
+                outputs.push_back(ArrayToTuple<OutputTypes...>(
+                    std::move(element_results)));
+              }
+              async_result.emplace(std::move(outputs));
+            });
+      };
+      host->ParallelFor(n, std::move(compute), std::move(on_done));
+    });
+  });
+  return async_result;
+}
+
 // Partial specialization of MapDataset to support multiple parameter packs.
 // MapDataset maps a user-defined function over the elements in its input
 // dataset.
@@ -84,6 +249,20 @@ class MapDataset<std::tuple<InputTypes...>, std::tuple<OutputTypes...>>
 
   RCReference<Iterator<OutputTypes...>> MakeIterator() override;
 
+  bool IsBlocking() const override { return input_dataset_->IsBlocking(); }
+
+  // The map function returns one element per input element, so the shard is
+  // the map of the shard of the input. The skipped input elements are not
+  // mapped.
+  RCReference<Dataset<OutputTypes...>> MakeShard(int64_t num_shards,
+                                                 int64_t index) override {
+    auto input_shard = input_dataset_->MakeShard(num_shards, index);
+    if (!input_shard) return {};
+    return TakeRef(host_->Construct<MapDataset>(
+        std::move(input_shard), additional_fn_args_.CopyRef(),
+        map_fn_.CopyRef(), host_));
+  }
+
  private:
   // Allow iterator to rely on private data members of this dataset.
   friend class MapDatasetIterator<std::tuple<InputTypes...>,
@@ -116,7 +295,6 @@ class MapDatasetIterator<std::tuple<InputTypes...>, std::tuple<OutputTypes...>>
 
   AsyncValueRef<std::tuple<OutputTypes...>> GetNext(
       const ExecutionContext& exec_ctx) override {
-    const Function* map_fn = parent_dataset_->map_fn_.get();
     // IDEA(donglin): consider extending RCArray to support CopyRef() without
     // doing shallow copy.
     auto additional_fn_args = parent_dataset_->additional_fn_args_.CopyRef();
@@ -124,77 +302,55 @@ class MapDatasetIterator<std::tuple<InputTypes...>, std::tuple<OutputTypes...>>
     if (!args) {
       return AsyncValueRef<std::tuple<OutputTypes...>>();
     }
+    this->stats_.RecordElement();
     if (args.IsError()) {
       return AsyncValueRef<std::tuple<OutputTypes...>>(args.ReleaseRCRef());
     }
-    auto async_result = exec_ctx.host()
-                            ->template MakeUnconstructedAsyncValueRef<
-                                std::tuple<OutputTypes...>>();
-    // IDEA(donglin): We can optimize performance for small tasks by not
-    // enqueueing small tasks to the threadpool. We need a way to identify small
-    // tasks.
-    //
-    // Enqueue the map function to the threadpool to improve performance by
-    // running the map function in parallel. An alternative approach to increase
-    // parallelism is to compose map function with async kernels. This
-    // alternative approach likely incurs higher thread context switch overhead
-    // because different async kernels may be run by different threads.
-    exec_ctx.host()->EnqueueWork([host = exec_ctx.host(),
-                                  map_fn = FormRef(map_fn),
-                                  additional_fn_args =
-                                      std::move(additional_fn_args),
-                                  args = std::move(args),
-                                  async_result =
-                                      async_result.CopyRef()]() mutable {
-      // IDEA(donglin): We can optimize performance by constructing a view of
-      // AsyncValue<T> from AsyncValue<std::tuple<T>> without moving data.
-      args.AndThen([host, map_fn = map_fn.CopyRef(),
-                    additional_fn_args = std::move(additional_fn_args),
-                    args = args.CopyRef(),
-                    async_result = async_result.CopyRef()]() {
-        if (args.IsError()) {
-          async_result.SetError(args.GetError());
-        }
-        // Construct arguments for function execution. The arguments consist of
-        // the 'additional_fn_args' from the MapDataset constructor, followed by
-        // the values from the underlying iterator.
-        SmallVector<AsyncValue*, 4> arguments;
-        for (auto* additional_arg : additional_fn_args.values()) {
-          arguments.push_back(additional_arg);
-        }
-        auto arg = host->template MakeConcreteAsyncValueRef<InputTypes...>(
-            std::move(std::get<0>(args.get())));
-        arguments.push_back(arg.GetAsyncValue());
-
-        SmallVector<RCReference<AsyncValue>, sizeof...(OutputTypes)> results;
-        results.resize(map_fn->result_types().size());
-        map_fn->Execute(arguments, results, host);
-        for (size_t i = 0; i < sizeof...(OutputTypes); ++i) {
-          if (results[i]->IsError()) {
-            async_result.SetError(results[i]->GetError());
-            return;
-          }
-        }
-        // Translate RCReference<AsyncValue> to AsyncValue*.
-        SmallVector<AsyncValue*, 4> async_value_ptrs;
-        for (size_t i = 0; i < sizeof...(OutputTypes); ++i) {
-          async_value_ptrs.push_back(results[i].get());
-        }
-        host->RunWhenReady(async_value_ptrs,
-                           [results = std::move(results),
-                            async_result = async_result.CopyRef()]() mutable {
-                             for (auto& result : results) {
-                               if (result->IsError()) {
-                                 async_result.SetError(result->GetError());
-                                 return;
-                               }
-                             }
-                             async_result.emplace(ArrayToTuple<OutputTypes...>(
-                                 std::move(results)));
-                           });
-      });
+    return EnqueueMapFunction<OutputTypes...>(
+        parent_dataset_->map_fn_.CopyRef(), std::move(additional_fn_args),
+        std::move(args), exec_ctx);
+  }
+
+  AsyncValueRef<std::vector<std::tuple<OutputTypes...>>> GetNextBatch(
+      const ExecutionContext& exec_ctx, int64_t max_n) override {
+    if (GetBatchMode() == Iterator<OutputTypes...>::BatchMode::kElementwise) {
+      return Iterator<OutputTypes...>::GetNextBatch(exec_ctx, max_n);
+    }
+    auto args = input_iterator_->GetNextBatch(exec_ctx, max_n);
+    if (!args) {
+      return AsyncValueRef<std::vector<std::tuple<OutputTypes...>>>();
+    }
+    if (args.IsError()) {
+      return AsyncValueRef<std::vector<std::tuple<OutputTypes...>>>(
+          args.ReleaseRCRef());
+    }
+    args.AndThen([iterator = FormRef(this), args = args.CopyRef()]() {
+      if (!args.IsError()) iterator->stats_.RecordElements(args.get().size());
     });
-    return async_result;
+    return EnqueueMapFunctionBatch<OutputTypes...>(
+        parent_dataset_->map_fn_.CopyRef(),
+        parent_dataset_->additional_fn_args_.CopyRef(), std::move(args),
+        exec_ctx);
+  }
+
+  // The map function invocations of a batch run on the work queue. Inputs
+  // that produce elements one at a time keep streaming them to the map
+  // function instead of waiting for a whole batch.
+  typename Iterator<OutputTypes...>::BatchMode GetBatchMode() const override {
+    return input_iterator_->GetBatchMode() ==
+                   Iterator<InputTypes...>::BatchMode::kElementwise
+               ? Iterator<OutputTypes...>::BatchMode::kElementwise
+               : Iterator<OutputTypes...>::BatchMode::kAsync;
+  }
+
+  // The map function only runs on elements that are already returned, so the
+  // state is the state of the input iterator.
+  llvm::Error Save(IteratorStateWriter* writer) override {
+    return input_iterator_->Save(writer);
+  }
+
+  llvm::Error Restore(IteratorStateReader* reader) override {
+    return input_iterator_->Restore(reader);
   }
 
  private:
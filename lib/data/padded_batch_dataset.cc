@@ -0,0 +1,179 @@
+// Copyright 2020 The TensorFlow Runtime Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//===- padded_batch_dataset.cc --------------------------------------------===//
+//
+// This file implements the helpers that pad and concatenate tensors of
+// different shapes into a batch.
+//
+//===----------------------------------------------------------------------===//
+
+#include "padded_batch_dataset.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "tfrt/support/error_util.h"
+
+namespace tfrt {
+namespace data {
+namespace internal {
+
+namespace {
+
+// Copies the `src` array with dimensions `dims` into the `dst` array with
+// dimensions `padded_dims`, and fills the padding with zeros. The strides are
+// the sizes in bytes of the subarrays of each dimension.
+void CopyPadded(const char* src, char* dst, ArrayRef<ssize_t> dims,
+                ArrayRef<ssize_t> padded_dims, ArrayRef<size_t> src_strides,
+                ArrayRef<size_t> dst_strides) {
+  const size_t num_rows = dims[0];
+  const size_t src_stride = src_strides[0];
+  const size_t dst_stride = dst_strides[0];
+  if (dims.size() == 1) {
+    std::memcpy(dst, src, num_rows * src_stride);
+  } else if (src_stride == dst_stride) {
+    // The inner dimensions are not padded, so the rows are contiguous.
+    std::memcpy(dst, src, num_rows * src_stride);
+  } else {
+    for (size_t i = 0; i < num_rows; ++i) {
+      CopyPadded(src + i * src_stride, dst + i * dst_stride, dims.drop_front(),
+                 padded_dims.drop_front(), src_strides.drop_front(),
+                 dst_strides.drop_front());
+    }
+  }
+  // The padding of every dimension is contiguous after its rows.
+  std::memset(dst + num_rows * dst_stride, 0,
+              (padded_dims[0] - num_rows) * dst_stride);
+}
+
+// Returns the sizes in bytes of the subarrays of each dimension of an array
+// with `dims` and elements of `element_size` bytes.
+SmallVector<size_t, 4> GetStrides(ArrayRef<ssize_t> dims, size_t element_size) {
+  SmallVector<size_t, 4> strides(dims.size());
+  size_t stride = element_size;
+  for (int i = dims.size() - 1; i >= 0; --i) {
+    strides[i] = stride;
+    stride *= dims[i];
+  }
+  return strides;
+}
+
+}  // namespace
+
+llvm::Expected<DenseHostTensor> PadAndBatch(
+    ArrayRef<const DenseHostTensor*> values, HostAllocator* allocator) {
+  assert(!values.empty());
+  const DType dtype = values[0]->dtype();
+  const int rank = values[0]->shape().GetRank();
+
+  // The padded shape is the maximum of every dimension over the batch.
+  SmallVector<ssize_t, 4> padded_dims(rank, 0);
+  for (const DenseHostTensor* value : values) {
+    if (value->dtype() != dtype || value->shape().GetRank() != rank) {
+      return MakeStringError(
+          "tensors to be padded and batched must have the same dtype and rank");
+    }
+    for (int i = 0; i < rank; ++i) {
+      padded_dims[i] =
+          std::max(padded_dims[i], value->shape().GetDimensionSize(i));
+    }
+  }
+
+  SmallVector<ssize_t, 4> batch_dims;
+  batch_dims.reserve(rank + 1);
+  batch_dims.push_back(values.size());
+  batch_dims.append(padded_dims.begin(), padded_dims.end());
+  auto batch = DenseHostTensor::CreateUninitialized(
+      TensorMetadata(dtype, batch_dims), allocator);
+  if (!batch) {
+    return MakeStringError("failed to create uninitialized tensor");
+  }
+
+  const size_t element_size = dtype.GetHostSize();
+  auto dst_strides = GetStrides(padded_dims, element_size);
+  const size_t slot_size =
+      rank == 0 ? element_size : dst_strides[0] * padded_dims[0];
+  char* dst = static_cast<char*>(batch->data());
+  SmallVector<ssize_t, 4> dims;
+  for (const DenseHostTensor* value : values) {
+    const char* src = static_cast<const char*>(value->data());
+    value->shape().GetDimensions(&dims);
+    if (rank == 0 || dims == padded_dims) {
+      std::memcpy(dst, src, slot_size);
+    } else {
+      CopyPadded(src, dst, dims, padded_dims, GetStrides(dims, element_size),
+                 dst_strides);
+    }
+    dst += slot_size;
+  }
+  return std::move(*batch);
+}
+
+llvm::Expected<std::pair<DenseHostTensor, DenseHostTensor>> RaggedBatch(
+    ArrayRef<const DenseHostTensor*> values, HostAllocator* allocator) {
+  assert(!values.empty());
+  const DType dtype = values[0]->dtype();
+  const TensorShape& shape = values[0]->shape();
+  if (shape.GetRank() == 0) {
+    return MakeStringError(
+        "tensors to be ragged batched must have at least one dimension");
+  }
+
+  const ssize_t num_splits = values.size() + 1;
+  auto row_splits = DenseHostTensor::CreateUninitialized(
+      TensorMetadata(GetDType<int64_t>(), ArrayRef<ssize_t>(num_splits)),
+      allocator);
+  if (!row_splits) {
+    return MakeStringError("failed to create uninitialized tensor");
+  }
+  int64_t* splits = static_cast<int64_t*>(row_splits->data());
+  splits[0] = 0;
+  for (int i = 0, e = values.size(); i < e; ++i) {
+    const TensorShape& value_shape = values[i]->shape();
+    if (values[i]->dtype() != dtype ||
+        value_shape.GetRank() != shape.GetRank()) {
+      return MakeStringError(
+          "tensors to be ragged batched must have the same dtype and rank");
+    }
+    for (int j = 1, rank = shape.GetRank(); j < rank; ++j) {
+      if (value_shape.GetDimensionSize(j) != shape.GetDimensionSize(j)) {
+        return MakeStringError(
+            "tensors to be ragged batched must have the same dimensions "
+            "except the first one");
+      }
+    }
+    splits[i + 1] = splits[i] + value_shape.GetDimensionSize(0);
+  }
+
+  SmallVector<ssize_t, 4> dims;
+  shape.GetDimensions(&dims);
+  dims[0] = splits[values.size()];
+  auto batch = DenseHostTensor::CreateUninitialized(TensorMetadata(dtype, dims),
+                                                    allocator);
+  if (!batch) {
+    return MakeStringError("failed to create uninitialized tensor");
+  }
+  char* dst = static_cast<char*>(batch->data());
+  for (const DenseHostTensor* value : values) {
+    const size_t size = value->DataSizeInBytes();
+    std::memcpy(dst, value->data(), size);
+    dst += size;
+  }
+  return std::make_pair(std::move(*batch), std::move(*row_splits));
+}
+
+}  // namespace internal
+}  // namespace data
+}  // namespace tfrt
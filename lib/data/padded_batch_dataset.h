@@ -0,0 +1,353 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- padded_batch_dataset.h -----------------------------------*- C++ -*-===//
+//
+// This file declares PaddedBatchDataset and RaggedBatchDataset classes which
+// batch tensors of different shapes.
+//
+// PaddedBatchDataset pads every tensor of a batch with zeros to the maximum
+// shape of the batch, and returns a tensor with +1 dimension.
+//
+// RaggedBatchDataset concatenates the tensors of a batch along their first
+// dimension, and returns the concatenated values together with a 1-D int64
+// row splits tensor. The tensors of the i'th element are the rows
+// [row_splits[i], row_splits[i + 1]) of the values.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef TFRT_DATA_PADDED_BATCH_DATASET_H_
+#define TFRT_DATA_PADDED_BATCH_DATASET_H_
+
+#include <array>
+
+#include "batch_dataset.h"
+#include "dataset.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/SmallVector.h"
+#include "tfrt/host_context/execution_context.h"
+#include "tfrt/support/forward_decls.h"
+#include "tfrt/support/ref_count.h"
+#include "tfrt/tensor/dense_host_tensor.h"
+
+namespace tfrt {
+namespace data {
+
+template <size_t N>
+class PaddedBatchDatasetIterator;
+template <size_t N>
+class RaggedBatchDatasetIterator;
+
+namespace internal {
+
+// Returns a tensor with +1 dimension that contains `values` padded with
+// zeros to their maximum shape. All values must have the same dtype and rank.
+llvm::Expected<DenseHostTensor> PadAndBatch(
+    ArrayRef<const DenseHostTensor*> values, HostAllocator* allocator);
+
+// Returns the concatenation of `values` along the first dimension, and the
+// row splits of the values. All values must have the same dtype and the same
+// dimensions except the first one.
+llvm::Expected<std::pair<DenseHostTensor, DenseHostTensor>> RaggedBatch(
+    ArrayRef<const DenseHostTensor*> values, HostAllocator* allocator);
+
+// Gets up to `batch_size` elements from `iterator`. If the iterator returns
+// an error synchronously, sets `error` to it and returns no elements.
+template <size_t N>
+llvm::SmallVector<RCReference<AsyncValue>, 4> GetNextElements(
+    DHTIterator<N>* iterator, int32_t batch_size,
+    const ExecutionContext& exec_ctx, RCReference<AsyncValue>* error) {
+  llvm::SmallVector<RCReference<AsyncValue>, 4> elements;
+  for (int i = 0; i < batch_size; ++i) {
+    auto element = iterator->GetNext(exec_ctx);
+    if (!element) break;
+    if (element.IsError()) {
+      *error = element.ReleaseRCRef();
+      return {};
+    }
+    elements.push_back(element.ReleaseRCRef());
+  }
+  return elements;
+}
+
+template <size_t N, size_t... I>
+const DenseHostTensor* GetTupleElement(const DHTTuple<N>& tuple,
+                                       size_t index,
+                                       std::index_sequence<I...>) {
+  const DenseHostTensor* elements[] = {&std::get<I>(tuple)...};
+  return elements[index];
+}
+
+// Returns the `component`th tensor of every element in `elements`. The
+// elements must be available.
+template <size_t N>
+llvm::SmallVector<const DenseHostTensor*, 4> GetComponent(
+    ArrayRef<RCReference<AsyncValue>> elements, size_t component) {
+  llvm::SmallVector<const DenseHostTensor*, 4> values;
+  values.reserve(elements.size());
+  for (const auto& element : elements) {
+    const auto& tuple = element->get<DHTTuple<N>>();
+    values.push_back(
+        GetTupleElement<N>(tuple, component, std::make_index_sequence<N>{}));
+  }
+  return values;
+}
+
+template <size_t N, size_t... I>
+DHTTuple<N> MakeDHTTuple(std::array<llvm::Optional<DenseHostTensor>, N>* values,
+                         std::index_sequence<I...>) {
+  return DHTTuple<N>(std::move(*(*values)[I])...);
+}
+
+}  // namespace internal
+
+template <size_t N>
+class PaddedBatchDataset : public DHTDataset<N> {
+ public:
+  explicit PaddedBatchDataset(RCReference<DHTDataset<N>> input_dataset,
+                              int32_t batch_size, HostContext* host)
+      : input_dataset_(std::move(input_dataset)),
+        batch_size_(batch_size),
+        host_(host),
+        allocator_(host->allocator()) {}
+
+  // This class is not copyable or movable.
+  PaddedBatchDataset(const PaddedBatchDataset&) = delete;
+  PaddedBatchDataset& operator=(const PaddedBatchDataset&) = delete;
+
+  RCReference<DHTIterator<N>> MakeIterator() override;
+
+  bool IsBlocking() const override { return input_dataset_->IsBlocking(); }
+
+ private:
+  // Allow iterator to rely on private data members of this dataset.
+  friend class PaddedBatchDatasetIterator<N>;
+
+  void Destroy() override {
+    internal::DestroyImpl<PaddedBatchDataset<N>>(this, allocator_);
+  }
+
+  RCReference<DHTDataset<N>> input_dataset_;
+  int32_t batch_size_;
+  HostContext* host_;
+  HostAllocator* allocator_;
+};
+
+template <size_t N>
+class PaddedBatchDatasetIterator : public DHTIterator<N> {
+ public:
+  explicit PaddedBatchDatasetIterator(
+      RCReference<PaddedBatchDataset<N>> parent_dataset)
+      : DHTIterator<N>(),
+        parent_dataset_(std::move(parent_dataset)),
+        input_iterator_(parent_dataset_->input_dataset_->MakeIterator()) {}
+
+  // This class is not copyable or movable.
+  PaddedBatchDatasetIterator(const PaddedBatchDatasetIterator&) = delete;
+  PaddedBatchDatasetIterator& operator=(const PaddedBatchDatasetIterator&) =
+      delete;
+
+  AsyncValueRef<DHTTuple<N>> GetNext(const ExecutionContext& exec_ctx) override;
+
+  llvm::Error Save(IteratorStateWriter* writer) override {
+    return input_iterator_->Save(writer);
+  }
+
+  llvm::Error Restore(IteratorStateReader* reader) override {
+    return input_iterator_->Restore(reader);
+  }
+
+ private:
+  void Destroy() override {
+    internal::DestroyImpl<PaddedBatchDatasetIterator>(
+        this, parent_dataset_->allocator_);
+  }
+
+  RCReference<PaddedBatchDataset<N>> parent_dataset_;
+  RCReference<DHTIterator<N>> input_iterator_;
+};
+
+template <size_t N>
+RCReference<DHTIterator<N>> PaddedBatchDataset<N>::MakeIterator() {
+  return TakeRef(host_->Construct<PaddedBatchDatasetIterator<N>>(
+      FormRef(this)));
+}
+
+template <size_t N>
+AsyncValueRef<DHTTuple<N>> PaddedBatchDatasetIterator<N>::GetNext(
+    const ExecutionContext& exec_ctx) {
+  RCReference<AsyncValue> error;
+  auto elements = internal::GetNextElements<N>(
+      input_iterator_.get(), parent_dataset_->batch_size_, exec_ctx, &error);
+  if (error) return AsyncValueRef<DHTTuple<N>>(std::move(error));
+  if (elements.empty()) return AsyncValueRef<DHTTuple<N>>();
+  this->stats_.RecordElement();
+
+  // The padded shape depends on every element of the batch, so the batch is
+  // built once all of them are available.
+  SmallVector<AsyncValue*, 4> element_ptrs;
+  for (auto& element : elements) element_ptrs.push_back(element.get());
+  auto async_result =
+      exec_ctx.host()->template MakeUnconstructedAsyncValueRef<DHTTuple<N>>();
+  exec_ctx.host()->RunWhenReady(
+      element_ptrs, [exec_ctx, elements = std::move(elements),
+                     async_result = async_result.CopyRef(),
+                     allocator = parent_dataset_->allocator_] {
+        for (auto& element : elements) {
+          if (element->IsError()) {
+            async_result.SetError(element->GetError());
+            return;
+          }
+        }
+        std::array<llvm::Optional<DenseHostTensor>, N> batch;
+        for (size_t i = 0; i < N; ++i) {
+          auto values = internal::GetComponent<N>(elements, i);
+          auto padded = internal::PadAndBatch(values, allocator);
+          if (!padded) {
+            async_result.SetError(EmitError(exec_ctx, padded.takeError()));
+            return;
+          }
+          batch[i].emplace(std::move(*padded));
+        }
+        async_result.emplace(
+            internal::MakeDHTTuple<N>(&batch, std::make_index_sequence<N>{}));
+      });
+
+  return std::move(async_result);
+}
+
+template <size_t N>
+class RaggedBatchDataset : public DHTDataset<2 * N> {
+ public:
+  explicit RaggedBatchDataset(RCReference<DHTDataset<N>> input_dataset,
+                              int32_t batch_size, HostContext* host)
+      : input_dataset_(std::move(input_dataset)),
+        batch_size_(batch_size),
+        host_(host),
+        allocator_(host->allocator()) {}
+
+  // This class is not copyable or movable.
+  RaggedBatchDataset(const RaggedBatchDataset&) = delete;
+  RaggedBatchDataset& operator=(const RaggedBatchDataset&) = delete;
+
+  RCReference<DHTIterator<2 * N>> MakeIterator() override;
+
+  bool IsBlocking() const override { return input_dataset_->IsBlocking(); }
+
+ private:
+  // Allow iterator to rely on private data members of this dataset.
+  friend class RaggedBatchDatasetIterator<N>;
+
+  void Destroy() override {
+    internal::DestroyImpl<RaggedBatchDataset<N>>(this, allocator_);
+  }
+
+  RCReference<DHTDataset<N>> input_dataset_;
+  int32_t batch_size_;
+  HostContext* host_;
+  HostAllocator* allocator_;
+};
+
+// RaggedBatchDatasetIterator returns the values and the row splits of every
+// input component, i.e. (values_0, row_splits_0, values_1, row_splits_1, ...).
+template <size_t N>
+class RaggedBatchDatasetIterator : public DHTIterator<2 * N> {
+ public:
+  explicit RaggedBatchDatasetIterator(
+      RCReference<RaggedBatchDataset<N>> parent_dataset)
+      : DHTIterator<2 * N>(),
+        parent_dataset_(std::move(parent_dataset)),
+        input_iterator_(parent_dataset_->input_dataset_->MakeIterator()) {}
+
+  // This class is not copyable or movable.
+  RaggedBatchDatasetIterator(const RaggedBatchDatasetIterator&) = delete;
+  RaggedBatchDatasetIterator& operator=(const RaggedBatchDatasetIterator&) =
+      delete;
+
+  AsyncValueRef<DHTTuple<2 * N>> GetNext(
+      const ExecutionContext& exec_ctx) override;
+
+  llvm::Error Save(IteratorStateWriter* writer) override {
+    return input_iterator_->Save(writer);
+  }
+
+  llvm::Error Restore(IteratorStateReader* reader) override {
+    return input_iterator_->Restore(reader);
+  }
+
+ private:
+  void Destroy() override {
+    internal::DestroyImpl<RaggedBatchDatasetIterator>(
+        this, parent_dataset_->allocator_);
+  }
+
+  RCReference<RaggedBatchDataset<N>> parent_dataset_;
+  RCReference<DHTIterator<N>> input_iterator_;
+};
+
+template <size_t N>
+RCReference<DHTIterator<2 * N>> RaggedBatchDataset<N>::MakeIterator() {
+  return TakeRef(host_->Construct<RaggedBatchDatasetIterator<N>>(
+      FormRef(this)));
+}
+
+template <size_t N>
+AsyncValueRef<DHTTuple<2 * N>> RaggedBatchDatasetIterator<N>::GetNext(
+    const ExecutionContext& exec_ctx) {
+  RCReference<AsyncValue> error;
+  auto elements = internal::GetNextElements<N>(
+      input_iterator_.get(), parent_dataset_->batch_size_, exec_ctx, &error);
+  if (error) return AsyncValueRef<DHTTuple<2 * N>>(std::move(error));
+  if (elements.empty()) return AsyncValueRef<DHTTuple<2 * N>>();
+  this->stats_.RecordElement();
+
+  SmallVector<AsyncValue*, 4> element_ptrs;
+  for (auto& element : elements) element_ptrs.push_back(element.get());
+  auto async_result =
+      exec_ctx.host()
+          ->template MakeUnconstructedAsyncValueRef<DHTTuple<2 * N>>();
+  exec_ctx.host()->RunWhenReady(
+      element_ptrs, [exec_ctx, elements = std::move(elements),
+                     async_result = async_result.CopyRef(),
+                     allocator = parent_dataset_->allocator_] {
+        for (auto& element : elements) {
+          if (element->IsError()) {
+            async_result.SetError(element->GetError());
+            return;
+          }
+        }
+        std::array<llvm::Optional<DenseHostTensor>, 2 * N> batch;
+        for (size_t i = 0; i < N; ++i) {
+          auto values = internal::GetComponent<N>(elements, i);
+          auto ragged = internal::RaggedBatch(values, allocator);
+          if (!ragged) {
+            async_result.SetError(EmitError(exec_ctx, ragged.takeError()));
+            return;
+          }
+          batch[2 * i].emplace(std::move(ragged->first));
+          batch[2 * i + 1].emplace(std::move(ragged->second));
+        }
+        async_result.emplace(internal::MakeDHTTuple<2 * N>(
+            &batch, std::make_index_sequence<2 * N>{}));
+      });
+
+  return std::move(async_result);
+}
+
+}  // namespace data
+}  // namespace tfrt
+
+#endif  // TFRT_DATA_PADDED_BATCH_DATASET_H_
@@ -0,0 +1,693 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- parallel_interleave_dataset.h ----------------------------*- C++ -*-===//
+//
+// This file declares ParallelInterleaveDataset class which interleaves the
+// elements of several datasets that are read concurrently.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef TFRT_LIB_DATA_PARALLEL_INTERLEAVE_DATASET_H_
+#define TFRT_LIB_DATA_PARALLEL_INTERLEAVE_DATASET_H_
+
+#include <deque>
+#include <memory>
+
+#include "autotuner.h"
+#include "dataset.h"
+#include "tfrt/host_context/function.h"
+#include "tfrt/support/forward_decls.h"
+#include "tfrt/support/mutex.h"
+
+namespace tfrt {
+namespace data {
+
+template <typename... T>
+class ParallelInterleaveDataset;
+
+template <typename... T>
+class ParallelInterleaveDatasetIterator;
+
+// ParallelInterleaveDataset is like InterleaveDataset, but it reads ahead from
+// its `cycle_length` open iterators concurrently. Each open iterator has a
+// background task that keeps up to `buffer_output_elements` of its elements
+// in a buffer. The task runs on the blocking work queue if the dataset
+// returned by the user-defined function is blocking (e.g. TFRecordDataset).
+// If `buffer_output_elements` is kAutotune, the Autotuner chooses it.
+//
+// If `sloppy` is false, the elements are produced in the same order as
+// InterleaveDataset. Otherwise, the next element is taken from whichever open
+// iterator has a buffered element, starting from the next one in the cycle,
+// and `block_length` is ignored.
+//
+// The iterators of the cycle are opened synchronously in GetNext, so the input
+// elements must be available when the input iterator returns them, e.g. they
+// cannot come from a ParallelMapDataset. GetNext returns an error otherwise.
+// The input elements must have a single value, which is the argument of the
+// user-defined function.
+template <typename... InputTypes, typename... OutputTypes>
+class ParallelInterleaveDataset<std::tuple<InputTypes...>,
+                                std::tuple<OutputTypes...>>
+    : public Dataset<OutputTypes...> {
+  static_assert(sizeof...(InputTypes) == 1,
+                "ParallelInterleaveDataset only supports input elements "
+                "with a single value");
+
+ public:
+  explicit ParallelInterleaveDataset(
+      RCReference<Dataset<InputTypes...>> input_dataset, int64_t cycle_length,
+      int64_t block_length, int64_t buffer_output_elements, bool sloppy,
+      RCReference<const Function> map_fn, HostContext* host)
+      : input_dataset_(std::move(input_dataset)),
+        cycle_length_(cycle_length),
+        block_length_(block_length),
+        buffer_output_elements_(buffer_output_elements),
+        sloppy_(sloppy),
+        host_(host),
+        allocator_(host->allocator()),
+        map_fn_(std::move(map_fn)) {
+    assert(cycle_length > 0);
+    assert(block_length > 0);
+    assert(buffer_output_elements > 0 || buffer_output_elements == kAutotune);
+  }
+
+  // This class is not copyable or movable.
+  ParallelInterleaveDataset(const ParallelInterleaveDataset&) = delete;
+  ParallelInterleaveDataset& operator=(const ParallelInterleaveDataset&) =
+      delete;
+
+  RCReference<Iterator<OutputTypes...>> MakeIterator() override;
+
+  // GetNext might wait for the background tasks. The interleaved datasets are
+  // only known during iteration, and they typically read from files.
+  bool IsBlocking() const override { return true; }
+
+ private:
+  // Allow iterator to rely on private data members of this dataset.
+  friend class ParallelInterleaveDatasetIterator<std::tuple<InputTypes...>,
+                                                 std::tuple<OutputTypes...>>;
+
+  void Destroy() override {
+    internal::DestroyImpl<ParallelInterleaveDataset<
+        std::tuple<InputTypes...>, std::tuple<OutputTypes...>>>(this,
+                                                                allocator_);
+  }
+
+  RCReference<Dataset<InputTypes...>> input_dataset_;
+  const int64_t cycle_length_;
+  const int64_t block_length_;
+  const int64_t buffer_output_elements_;
+  const bool sloppy_;
+  HostContext* host_;
+  HostAllocator* allocator_;
+  RCReference<const Function> map_fn_;
+};
+
+template <typename... InputTypes, typename... OutputTypes>
+class ParallelInterleaveDatasetIterator<std::tuple<InputTypes...>,
+                                        std::tuple<OutputTypes...>>
+    : public Iterator<OutputTypes...> {
+ public:
+  explicit ParallelInterleaveDatasetIterator(
+      RCReference<ParallelInterleaveDataset<std::tuple<InputTypes...>,
+                                            std::tuple<OutputTypes...>>>
+          parent_dataset)
+      : Iterator<OutputTypes...>(),
+        parent_dataset_(std::move(parent_dataset)),
+        input_iterator_(parent_dataset_->input_dataset_->MakeIterator()),
+        cycle_(parent_dataset_->cycle_length_) {
+    if (parent_dataset_->buffer_output_elements_ == kAutotune) {
+      buffer_output_elements_ = std::make_unique<TunableParameter>(
+          TunableParameter::Kind::kBufferSize,
+          /*num_producers=*/parent_dataset_->cycle_length_, &this->stats_,
+          parent_dataset_->host_);
+    }
+  }
+
+  // This class is not copyable or movable.
+  ParallelInterleaveDatasetIterator(const ParallelInterleaveDatasetIterator&) =
+      delete;
+  ParallelInterleaveDatasetIterator& operator=(
+      const ParallelInterleaveDatasetIterator&) = delete;
+
+  // Returns the next element from the buffers of the open iterators. If the
+  // buffer is empty and a background task is reading from the open iterator,
+  // waits for it, since the end of the input has to be known synchronously.
+  // If no task is reading from the open iterator, reads the next element
+  // inline.
+  AsyncValueRef<std::tuple<OutputTypes...>> GetNext(
+      const ExecutionContext& exec_ctx) override;
+
+  // The state is the position in the cycle, the input element, the buffered
+  // elements and the state of every open iterator, and the state of the input
+  // iterator. Save waits for the background tasks to stop.
+  llvm::Error Save(IteratorStateWriter* writer) override;
+
+  llvm::Error Restore(IteratorStateReader* reader) override;
+
+ private:
+  using OutputRef = AsyncValueRef<std::tuple<OutputTypes...>>;
+
+  // State of an open iterator in the cycle. It is shared with the background
+  // task reading from the iterator, and guarded by the mutex of the
+  // ParallelInterleaveDatasetIterator.
+  struct OpenIterator : public ReferenceCounted<OpenIterator> {
+    explicit OpenIterator(RCReference<Iterator<OutputTypes...>> iterator,
+                          bool is_blocking,
+                          std::tuple<InputTypes...> input_element,
+                          HostAllocator* allocator)
+        : iterator(std::move(iterator)),
+          is_blocking(is_blocking),
+          input_element(std::move(input_element)),
+          allocator(allocator) {}
+
+    void Destroy() { internal::DestroyImpl<OpenIterator>(this, allocator); }
+
+    const RCReference<Iterator<OutputTypes...>> iterator;
+    const bool is_blocking;
+    // The input element of the iterator, which is saved with it.
+    const std::tuple<InputTypes...> input_element;
+    HostAllocator* const allocator;
+    std::deque<OutputRef> buffer;
+    // True if the producer task is enqueued or running.
+    bool producer_running = false;
+    // True while a thread calls GetNext of the iterator.
+    bool input_busy = false;
+    bool end_of_input = false;
+  };
+
+  void Destroy() override {
+    internal::DestroyImpl<ParallelInterleaveDatasetIterator>(
+        this, parent_dataset_->allocator_);
+  }
+
+  // Returns a new open iterator of `dataset`, which was made from
+  // `input_element`.
+  RCReference<OpenIterator> MakeOpenIterator(
+      RCReference<Dataset<OutputTypes...>> dataset,
+      std::tuple<InputTypes...> input_element) {
+    return TakeRef(parent_dataset_->host_->template Construct<OpenIterator>(
+        dataset->MakeIterator(), dataset->IsBlocking(),
+        std::move(input_element), parent_dataset_->allocator_));
+  }
+
+  // Opens iterators from the input elements until all the slots in the cycle
+  // are used, or the input iterator reaches end. Returns an error if an input
+  // element is an error.
+  OutputRef OpenIterators(const ExecutionContext& exec_ctx);
+
+  // Returns the next element of `open_iterator`, or an empty AsyncValueRef if
+  // it reached end.
+  OutputRef GetNextFromIterator(OpenIterator* open_iterator,
+                                const ExecutionContext& exec_ctx);
+
+  // Returns the next element of any open iterator that has one buffered.
+  OutputRef GetNextSloppy(const ExecutionContext& exec_ctx);
+
+  int64_t GetBufferOutputElements() const {
+    return buffer_output_elements_ ? buffer_output_elements_->value()
+                                   : parent_dataset_->buffer_output_elements_;
+  }
+
+  // Records the time since `wait_start_ns` that GetNext waited for an
+  // element. Its consumer waited for the same time.
+  void RecordWaitTime(int64_t wait_start_ns) {
+    const int64_t wait_time_ns = IteratorStats::Now() - wait_start_ns;
+    this->stats_.AddWaitTime(wait_time_ns);
+    if (buffer_output_elements_) {
+      buffer_output_elements_->AddConsumerWaitTime(wait_time_ns);
+    }
+  }
+
+  // Closes the iterator at `index` in the cycle.
+  void CloseIterator(size_t index) {
+    cycle_[index].reset();
+    --num_open_;
+  }
+
+  // Returns true if the caller should start the producer task. The producer is
+  // restarted once the buffer drains to half of its capacity.
+  bool ShouldStartProducer(OpenIterator* open_iterator) TFRT_REQUIRES(mu_) {
+    if (open_iterator->producer_running || open_iterator->end_of_input) {
+      return false;
+    }
+    if (static_cast<int64_t>(open_iterator->buffer.size()) * 2 >
+        GetBufferOutputElements()) {
+      return false;
+    }
+    open_iterator->producer_running = true;
+    return true;
+  }
+
+  // Enqueues the task that fills the buffer of `open_iterator`.
+  void StartProducer(RCReference<OpenIterator> open_iterator,
+                     const ExecutionContext& exec_ctx);
+
+  // Reads elements from `open_iterator` until its buffer is full or it
+  // reaches end.
+  void ProduceElements(OpenIterator* open_iterator,
+                       const ExecutionContext& exec_ctx);
+
+  // Advance the next block index. If the next block index exceeds the block
+  // length, advance to the next iterator in the cycle.
+  void AdvanceBlockIndex() {
+    ++block_index_;
+    if (block_index_ == parent_dataset_->block_length_) {
+      AdvanceCycleIndex();
+    }
+  }
+
+  // Advance to the next iterator in the cycle and reset block_index_ to 0.
+  void AdvanceCycleIndex() {
+    block_index_ = 0;
+    cycle_index_ = (cycle_index_ + 1) % parent_dataset_->cycle_length_;
+  }
+
+  RCReference<Dataset<OutputTypes...>> MakeDatasetFromInputElement(
+      AsyncValueRef<std::tuple<InputTypes...>> input_element,
+      const ExecutionContext& exec_ctx);
+
+  RCReference<ParallelInterleaveDataset<std::tuple<InputTypes...>,
+                                        std::tuple<OutputTypes...>>>
+      parent_dataset_;
+  RCReference<Iterator<InputTypes...>> input_iterator_;
+  // Set if the buffer size is chosen by the Autotuner.
+  std::unique_ptr<TunableParameter> buffer_output_elements_;
+
+  // The cycle of open iterators. Only the consumer thread opens and closes
+  // iterators.
+  std::vector<RCReference<OpenIterator>> cycle_;
+  size_t cycle_index_ = 0;
+  size_t block_index_ = 0;
+  bool end_of_input_ = false;
+  size_t num_open_ = 0;  // Number of open iterators
+
+  mutex mu_;
+  // Signaled when an element is added to a buffer, or when an open iterator
+  // becomes free to use.
+  condition_variable cond_;
+};
+
+template <typename... InputTypes, typename... OutputTypes>
+RCReference<Iterator<OutputTypes...>>
+ParallelInterleaveDataset<std::tuple<InputTypes...>,
+                          std::tuple<OutputTypes...>>::MakeIterator() {
+  return TakeRef(host_->Construct<ParallelInterleaveDatasetIterator<
+                     std::tuple<InputTypes...>, std::tuple<OutputTypes...>>>(
+      FormRef(this)));
+}
+
+template <typename... InputTypes, typename... OutputTypes>
+auto ParallelInterleaveDatasetIterator<std::tuple<InputTypes...>,
+                                       std::tuple<OutputTypes...>>::
+    GetNext(const ExecutionContext& exec_ctx) -> OutputRef {
+  if (buffer_output_elements_) buffer_output_elements_->MaybeTune();
+  if (parent_dataset_->sloppy_) return GetNextSloppy(exec_ctx);
+
+  while (true) {
+    if (auto error = OpenIterators(exec_ctx)) return error;
+    if (num_open_ == 0) return OutputRef();
+
+    if (!cycle_[cycle_index_]) {
+      AdvanceCycleIndex();
+      continue;
+    }
+
+    auto value = GetNextFromIterator(cycle_[cycle_index_].get(), exec_ctx);
+    // If we're at the end of this current iterator, advance to the next
+    // iterator in the cycle. The next input element is opened in its slot.
+    if (!value) {
+      CloseIterator(cycle_index_);
+      if (auto error = OpenIterators(exec_ctx)) return error;
+      AdvanceCycleIndex();
+      continue;
+    }
+    AdvanceBlockIndex();
+    this->stats_.RecordElement();
+    return value;
+  }
+}
+
+template <typename... InputTypes, typename... OutputTypes>
+auto ParallelInterleaveDatasetIterator<std::tuple<InputTypes...>,
+                                       std::tuple<OutputTypes...>>::
+    GetNextSloppy(const ExecutionContext& exec_ctx) -> OutputRef {
+  const size_t cycle_length = cycle_.size();
+
+  while (true) {
+    if (auto error = OpenIterators(exec_ctx)) return error;
+    if (num_open_ == 0) return OutputRef();
+
+    OutputRef value;
+    OpenIterator* start_producer = nullptr;
+    OpenIterator* read_inline = nullptr;
+    {
+      mutex_lock lock(mu_);
+      // Wait until an open iterator has a buffered element or reached end, or
+      // no task is reading from it.
+      auto find_ready = [&]() TFRT_REQUIRES(mu_) -> size_t {
+        size_t idle = cycle_length;
+        for (size_t i = 0; i < cycle_length; ++i) {
+          size_t index = (cycle_index_ + i) % cycle_length;
+          OpenIterator* open_iterator = cycle_[index].get();
+          if (!open_iterator) continue;
+          if (!open_iterator->buffer.empty() || open_iterator->end_of_input) {
+            return index;
+          }
+          if (!open_iterator->input_busy && idle == cycle_length) idle = index;
+        }
+        return idle;
+      };
+      size_t index = find_ready();
+      if (index == cycle_length) {
+        const int64_t wait_start_ns = IteratorStats::Now();
+        cond_.wait(lock, [&]() TFRT_REQUIRES(mu_) {
+          index = find_ready();
+          return index != cycle_length;
+        });
+        RecordWaitTime(wait_start_ns);
+      }
+
+      OpenIterator* open_iterator = cycle_[index].get();
+      cycle_index_ = (index + 1) % cycle_length;
+      if (!open_iterator->buffer.empty()) {
+        value = std::move(open_iterator->buffer.front());
+        open_iterator->buffer.pop_front();
+        if (ShouldStartProducer(open_iterator)) start_producer = open_iterator;
+      } else if (open_iterator->end_of_input) {
+        CloseIterator(index);
+        continue;
+      } else {
+        // Nobody is reading from this iterator, read the next element inline.
+        open_iterator->input_busy = true;
+        read_inline = open_iterator;
+      }
+    }
+
+    if (read_inline) {
+      const int64_t wait_start_ns = IteratorStats::Now();
+      value = read_inline->iterator->GetNext(exec_ctx);
+      RecordWaitTime(wait_start_ns);
+      {
+        mutex_lock lock(mu_);
+        read_inline->input_busy = false;
+        if (!value) read_inline->end_of_input = true;
+        if (ShouldStartProducer(read_inline)) start_producer = read_inline;
+      }
+      cond_.notify_all();
+    }
+
+    if (start_producer) StartProducer(FormRef(start_producer), exec_ctx);
+    // Try again if the iterator read inline reached end.
+    if (value) {
+      this->stats_.RecordElement();
+      return value;
+    }
+  }
+}
+
+template <typename... InputTypes, typename... OutputTypes>
+auto ParallelInterleaveDatasetIterator<std::tuple<InputTypes...>,
+                                       std::tuple<OutputTypes...>>::
+    OpenIterators(const ExecutionContext& exec_ctx) -> OutputRef {
+  for (size_t index = 0; index < cycle_.size(); ++index) {
+    if (end_of_input_) break;
+    if (cycle_[index]) continue;
+
+    auto input_element = input_iterator_->GetNext(exec_ctx);
+
+    // The input iterator has been exhausted.
+    if (!input_element) {
+      end_of_input_ = true;
+      break;
+    }
+
+    // The dataset of the user-defined function has to be known now to open
+    // its iterator.
+    if (!input_element.IsAvailable()) {
+      return EmitErrorAsync(exec_ctx,
+                            "parallel_interleave expects its inputs to be "
+                            "available synchronously");
+    }
+    if (input_element.IsError()) return OutputRef(input_element.ReleaseRCRef());
+
+    auto input_copy = internal::CopyElement(input_element.get());
+    auto dataset =
+        MakeDatasetFromInputElement(std::move(input_element), exec_ctx);
+    auto open_iterator =
+        MakeOpenIterator(std::move(dataset), std::move(input_copy));
+    {
+      mutex_lock lock(mu_);
+      open_iterator->producer_running = true;
+    }
+    cycle_[index] = open_iterator.CopyRef();
+    ++num_open_;
+    StartProducer(std::move(open_iterator), exec_ctx);
+  }
+  return OutputRef();
+}
+
+template <typename... InputTypes, typename... OutputTypes>
+auto ParallelInterleaveDatasetIterator<std::tuple<InputTypes...>,
+                                       std::tuple<OutputTypes...>>::
+    GetNextFromIterator(OpenIterator* open_iterator,
+                        const ExecutionContext& exec_ctx) -> OutputRef {
+  OutputRef value;
+  bool start_producer = false;
+  {
+    mutex_lock lock(mu_);
+    auto is_ready = [open_iterator]() TFRT_REQUIRES(mu_) {
+      return !open_iterator->buffer.empty() || open_iterator->end_of_input ||
+             !open_iterator->input_busy;
+    };
+    if (!is_ready()) {
+      const int64_t wait_start_ns = IteratorStats::Now();
+      cond_.wait(lock, is_ready);
+      RecordWaitTime(wait_start_ns);
+    }
+    if (!open_iterator->buffer.empty()) {
+      value = std::move(open_iterator->buffer.front());
+      open_iterator->buffer.pop_front();
+      start_producer = ShouldStartProducer(open_iterator);
+    } else if (open_iterator->end_of_input) {
+      return value;
+    } else {
+      // Nobody is reading from the iterator, read the next element inline.
+      open_iterator->input_busy = true;
+    }
+  }
+
+  if (!value) {
+    const int64_t wait_start_ns = IteratorStats::Now();
+    value = open_iterator->iterator->GetNext(exec_ctx);
+    RecordWaitTime(wait_start_ns);
+    {
+      mutex_lock lock(mu_);
+      open_iterator->input_busy = false;
+      if (!value) open_iterator->end_of_input = true;
+      start_producer = ShouldStartProducer(open_iterator);
+    }
+    cond_.notify_all();
+  }
+
+  if (start_producer) StartProducer(FormRef(open_iterator), exec_ctx);
+  return value;
+}
+
+template <typename... InputTypes, typename... OutputTypes>
+void ParallelInterleaveDatasetIterator<std::tuple<InputTypes...>,
+                                       std::tuple<OutputTypes...>>::
+    StartProducer(RCReference<OpenIterator> open_iterator,
+                  const ExecutionContext& exec_ctx) {
+  HostContext* host = exec_ctx.host();
+  const bool is_blocking = open_iterator->is_blocking;
+  OpenIterator* open_iterator_ptr = open_iterator.get();
+  auto produce = [iterator = FormRef(this),
+                  open_iterator = std::move(open_iterator), exec_ctx]() {
+    iterator->ProduceElements(open_iterator.get(), exec_ctx);
+  };
+
+  if (!is_blocking) {
+    host->EnqueueWork(std::move(produce));
+    return;
+  }
+  if (!host->EnqueueBlockingWork(std::move(produce))) {
+    // The blocking work queue is overloaded. The consumer reads from the
+    // iterator inline until the producer is restarted.
+    mutex_lock lock(mu_);
+    open_iterator_ptr->producer_running = false;
+  }
+}
+
+template <typename... InputTypes, typename... OutputTypes>
+void ParallelInterleaveDatasetIterator<std::tuple<InputTypes...>,
+                                       std::tuple<OutputTypes...>>::
+    ProduceElements(OpenIterator* open_iterator,
+                    const ExecutionContext& exec_ctx) {
+  while (true) {
+    {
+      mutex_lock lock(mu_);
+      if (open_iterator->end_of_input || open_iterator->input_busy ||
+          static_cast<int64_t>(open_iterator->buffer.size()) >=
+              GetBufferOutputElements()) {
+        open_iterator->producer_running = false;
+        // Save waits for the producer to stop.
+        cond_.notify_all();
+        return;
+      }
+      open_iterator->input_busy = true;
+    }
+
+    const int64_t start_ns = IteratorStats::Now();
+    auto value = open_iterator->iterator->GetNext(exec_ctx);
+    this->stats_.AddProduceTime(IteratorStats::Now() - start_ns);
+    if (value && value.IsConcrete()) {
+      this->stats_.AddBytes(internal::GetElementSizeInBytes(value.get()));
+    }
+    {
+      mutex_lock lock(mu_);
+      open_iterator->input_busy = false;
+      if (value) {
+        open_iterator->buffer.push_back(std::move(value));
+      } else {
+        open_iterator->end_of_input = true;
+      }
+    }
+    cond_.notify_all();
+  }
+}
+
+template <typename... InputTypes, typename... OutputTypes>
+RCReference<Dataset<OutputTypes...>> ParallelInterleaveDatasetIterator<
+    std::tuple<InputTypes...>, std::tuple<OutputTypes...>>::
+    MakeDatasetFromInputElement(
+        AsyncValueRef<std::tuple<InputTypes...>> input_element,
+        const ExecutionContext& exec_ctx) {
+  // The input element has a single value, see ParallelInterleaveDataset.
+  SmallVector<AsyncValue*, 4> fn_args;
+  auto arg = exec_ctx.host()->template MakeConcreteAsyncValueRef<InputTypes...>(
+      std::move(std::get<0>(input_element.get())));
+  fn_args.push_back(arg.GetAsyncValue());
+  SmallVector<RCReference<AsyncValue>, 1> fn_results;
+  fn_results.resize(1);
+  parent_dataset_->map_fn_->Execute(fn_args, fn_results, exec_ctx.host());
+
+  // NOTE: If the inputs to this function are async, or the function is
+  // executed asynchronously, this will fail.
+  assert(fn_results[0]->IsAvailable());
+
+  return fn_results[0]
+      ->template get<RCReference<Dataset<OutputTypes...>>>()
+      .CopyRef();
+}
+
+template <typename... InputTypes, typename... OutputTypes>
+llvm::Error ParallelInterleaveDatasetIterator<
+    std::tuple<InputTypes...>,
+    std::tuple<OutputTypes...>>::Save(IteratorStateWriter* writer) {
+  writer->WriteInt(cycle_index_);
+  writer->WriteInt(block_index_);
+  writer->WriteInt(end_of_input_);
+  for (const auto& open_iterator : cycle_) {
+    writer->WriteInt(static_cast<bool>(open_iterator));
+    if (!open_iterator) continue;
+
+    SmallVector<RCReference<AsyncValue>, 16> buffered;
+    {
+      mutex_lock lock(mu_);
+      cond_.wait(lock, [&]() TFRT_REQUIRES(mu_) {
+        return !open_iterator->producer_running;
+      });
+      for (const auto& value : open_iterator->buffer) {
+        buffered.push_back(value.CopyRCRef());
+      }
+    }
+    parent_dataset_->host_->Await(buffered);
+
+    writer->WriteElement(open_iterator->input_element);
+    {
+      mutex_lock lock(mu_);
+      writer->WriteInt(open_iterator->buffer.size());
+      for (const auto& value : open_iterator->buffer) {
+        writer->WriteAsyncElement(value);
+      }
+      writer->WriteInt(open_iterator->end_of_input);
+    }
+    if (auto error = open_iterator->iterator->Save(writer)) return error;
+  }
+  return input_iterator_->Save(writer);
+}
+
+template <typename... InputTypes, typename... OutputTypes>
+llvm::Error ParallelInterleaveDatasetIterator<
+    std::tuple<InputTypes...>,
+    std::tuple<OutputTypes...>>::Restore(IteratorStateReader* reader) {
+  int64_t cycle_index, block_index, end_of_input;
+  if (auto error = reader->ReadInt(&cycle_index)) return error;
+  if (auto error = reader->ReadInt(&block_index)) return error;
+  if (auto error = reader->ReadInt(&end_of_input)) return error;
+  if (cycle_index < 0 || cycle_index >= parent_dataset_->cycle_length_ ||
+      block_index < 0 || block_index >= parent_dataset_->block_length_) {
+    return MakeStringError(
+        "invalid parallel_interleave_dataset iterator state");
+  }
+  cycle_index_ = cycle_index;
+  block_index_ = block_index;
+  end_of_input_ = end_of_input;
+
+  // The producers are started by GetNext.
+  ExecutionContext exec_ctx(reader->host());
+  for (auto& slot : cycle_) {
+    int64_t is_open;
+    if (auto error = reader->ReadInt(&is_open)) return error;
+    if (!is_open) continue;
+    auto element = reader->ReadElement<InputTypes...>();
+    if (!element) return element.takeError();
+    auto input_copy = internal::CopyElement(*element);
+    auto dataset = MakeDatasetFromInputElement(
+        exec_ctx.host()
+            ->template MakeConcreteAsyncValueRef<std::tuple<InputTypes...>>(
+                std::move(*element)),
+        exec_ctx);
+    auto open_iterator =
+        MakeOpenIterator(std::move(dataset), std::move(input_copy));
+
+    int64_t num_buffered;
+    if (auto error = reader->ReadInt(&num_buffered)) return error;
+    for (int64_t i = 0; i < num_buffered; ++i) {
+      auto value = reader->ReadAsyncElement<OutputTypes...>();
+      if (!value) return value.takeError();
+      mutex_lock lock(mu_);
+      open_iterator->buffer.push_back(std::move(*value));
+    }
+    int64_t iterator_end_of_input;
+    if (auto error = reader->ReadInt(&iterator_end_of_input)) return error;
+    {
+      mutex_lock lock(mu_);
+      open_iterator->end_of_input = iterator_end_of_input;
+    }
+    if (auto error = open_iterator->iterator->Restore(reader)) return error;
+    slot = std::move(open_iterator);
+    ++num_open_;
+  }
+  return input_iterator_->Restore(reader);
+}
+
+}  // namespace data
+}  // namespace tfrt
+
+#endif  // TFRT_LIB_DATA_PARALLEL_INTERLEAVE_DATASET_H_
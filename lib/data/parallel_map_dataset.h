@@ -0,0 +1,394 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- parallel_map_dataset.h -----------------------------------*- C++ -*-===//
+//
+// This file declares ParallelMapDataset class which maps a user-defined
+// function over the elements of its input dataset, with a bounded number of
+// function invocations in flight.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef TFRT_LIB_DATA_PARALLEL_MAP_DATASET_H_
+#define TFRT_LIB_DATA_PARALLEL_MAP_DATASET_H_
+
+#include <deque>
+#include <memory>
+
+#include "autotuner.h"
+#include "dataset.h"
+#include "map_dataset.h"
+#include "tfrt/host_context/function.h"
+#include "tfrt/support/forward_decls.h"
+#include "tfrt/support/mutex.h"
+
+namespace tfrt {
+namespace data {
+
+template <typename... T>
+class ParallelMapDataset;
+
+template <typename... T>
+class ParallelMapDatasetIterator;
+
+// ParallelMapDataset keeps up to `num_parallel_calls` invocations of `map_fn`
+// in flight, and buffers their results until they are consumed. If
+// `num_parallel_calls` is kAutotune, the Autotuner chooses it.
+//
+// If `deterministic` is true, the elements are returned in the order of the
+// input elements. Otherwise they are returned in the order in which the map
+// function invocations complete, so that a slow element does not block the
+// elements behind it.
+template <typename... InputTypes, typename... OutputTypes>
+class ParallelMapDataset<std::tuple<InputTypes...>, std::tuple<OutputTypes...>>
+    : public Dataset<OutputTypes...> {
+ public:
+  explicit ParallelMapDataset(
+      RCReference<Dataset<InputTypes...>> input_dataset,
+      RCArray<AsyncValue> additional_fn_args,
+      RCReference<const Function> map_fn, int64_t num_parallel_calls,
+      bool deterministic, HostContext* host)
+      : input_dataset_(std::move(input_dataset)),
+        host_(host),
+        allocator_(host->allocator()),
+        additional_fn_args_(std::move(additional_fn_args)),
+        map_fn_(std::move(map_fn)),
+        num_parallel_calls_(num_parallel_calls),
+        deterministic_(deterministic) {
+    assert(num_parallel_calls > 0 || num_parallel_calls == kAutotune);
+  }
+
+  // This class is not copyable or movable.
+  ParallelMapDataset(const ParallelMapDataset&) = delete;
+  ParallelMapDataset& operator=(const ParallelMapDataset&) = delete;
+
+  RCReference<Iterator<OutputTypes...>> MakeIterator() override;
+
+  bool IsBlocking() const override { return input_dataset_->IsBlocking(); }
+
+  // Like MapDataset, the shard is the map of the shard of the input.
+  RCReference<Dataset<OutputTypes...>> MakeShard(int64_t num_shards,
+                                                 int64_t index) override {
+    auto input_shard = input_dataset_->MakeShard(num_shards, index);
+    if (!input_shard) return {};
+    return TakeRef(host_->Construct<ParallelMapDataset>(
+        std::move(input_shard), additional_fn_args_.CopyRef(),
+        map_fn_.CopyRef(), num_parallel_calls_, deterministic_, host_));
+  }
+
+ private:
+  // Allow iterator to rely on private data members of this dataset.
+  friend class ParallelMapDatasetIterator<std::tuple<InputTypes...>,
+                                          std::tuple<OutputTypes...>>;
+
+  void Destroy() override {
+    internal::DestroyImpl<ParallelMapDataset<std::tuple<InputTypes...>,
+                                             std::tuple<OutputTypes...>>>(
+        this, allocator_);
+  }
+
+  RCReference<Dataset<InputTypes...>> input_dataset_;
+  HostContext* host_;
+  HostAllocator* allocator_;
+  RCArray<AsyncValue> additional_fn_args_;
+  RCReference<const Function> map_fn_;
+  const int64_t num_parallel_calls_;
+  const bool deterministic_;
+};
+
+template <typename... InputTypes, typename... OutputTypes>
+class ParallelMapDatasetIterator<std::tuple<InputTypes...>,
+                                 std::tuple<OutputTypes...>>
+    : public Iterator<OutputTypes...> {
+ public:
+  explicit ParallelMapDatasetIterator(
+      RCReference<ParallelMapDataset<std::tuple<InputTypes...>,
+                                     std::tuple<OutputTypes...>>>
+          parent_dataset)
+      : Iterator<OutputTypes...>(),
+        parent_dataset_(std::move(parent_dataset)),
+        input_iterator_(parent_dataset_->input_dataset_->MakeIterator()) {
+    if (parent_dataset_->num_parallel_calls_ == kAutotune) {
+      num_parallel_calls_ = std::make_unique<TunableParameter>(
+          TunableParameter::Kind::kParallelism, /*num_producers=*/1,
+          &this->stats_, parent_dataset_->host_);
+    }
+  }
+
+  // This class is not copyable or movable.
+  ParallelMapDatasetIterator(const ParallelMapDatasetIterator&) = delete;
+  ParallelMapDatasetIterator& operator=(const ParallelMapDatasetIterator&) =
+      delete;
+
+  AsyncValueRef<std::tuple<OutputTypes...>> GetNext(
+      const ExecutionContext& exec_ctx) override;
+
+  // The state is the buffered results, followed by the state of the input
+  // iterator. Save waits for the running invocations to complete.
+  llvm::Error Save(IteratorStateWriter* writer) override;
+
+  llvm::Error Restore(IteratorStateReader* reader) override;
+
+ private:
+  using OutputRef = AsyncValueRef<std::tuple<OutputTypes...>>;
+
+  void Destroy() override {
+    internal::DestroyImpl<ParallelMapDatasetIterator>(
+        this, parent_dataset_->allocator_);
+  }
+
+  int64_t GetNumParallelCalls() const {
+    return num_parallel_calls_ ? num_parallel_calls_->value()
+                               : parent_dataset_->num_parallel_calls_;
+  }
+
+  // Starts map function invocations until `num_parallel_calls` results are
+  // in flight or buffered, or the input iterator reaches end.
+  void StartCalls(const ExecutionContext& exec_ctx);
+
+  // Returns the result of the map function invocation for the next input
+  // element, or an empty AsyncValueRef if the input iterator reached end.
+  // Sets `start_ns` to the time at which the invocation started.
+  OutputRef StartCall(const ExecutionContext& exec_ctx, int64_t* start_ns);
+
+  // Records the duration of a map function invocation started at `start_ns`
+  // and the size of its result.
+  void RecordCall(int64_t start_ns, const OutputRef& result) {
+    this->stats_.AddProduceTime(IteratorStats::Now() - start_ns);
+    if (result.IsConcrete()) {
+      this->stats_.AddBytes(internal::GetElementSizeInBytes(result.get()));
+    }
+  }
+
+  // Returns `result` to the consumer. If the number of parallel calls is
+  // tuned, records how long the consumer may wait for it.
+  OutputRef ReturnResult(OutputRef result) {
+    this->stats_.RecordElement();
+    if (num_parallel_calls_ && !result.IsAvailable()) {
+      result.AndThen([iterator = FormRef(this),
+                      start_ns = IteratorStats::Now()]() {
+        iterator->num_parallel_calls_->AddConsumerWaitTime(
+            IteratorStats::Now() - start_ns);
+      });
+    }
+    return result;
+  }
+
+  // Called when a map function invocation completes in non-deterministic
+  // mode. Hands the result to the oldest pending GetNext, or buffers it.
+  void OnCallCompleted(OutputRef result);
+
+  RCReference<
+      ParallelMapDataset<std::tuple<InputTypes...>, std::tuple<OutputTypes...>>>
+      parent_dataset_;
+  RCReference<Iterator<InputTypes...>> input_iterator_;
+  bool end_of_input_ = false;
+  // Set if the number of parallel calls is chosen by the Autotuner.
+  std::unique_ptr<TunableParameter> num_parallel_calls_;
+
+  // Deterministic mode: results of the started invocations in input order.
+  std::deque<OutputRef> ordered_results_;
+
+  // Non-deterministic mode state, updated by the completion callbacks.
+  mutex mu_;
+  // Signaled when the last running invocation completes.
+  condition_variable cond_;
+  // Number of started invocations that have not completed yet.
+  int64_t num_running_ TFRT_GUARDED_BY(mu_) = 0;
+  // Results of completed invocations that no GetNext has claimed yet.
+  std::deque<OutputRef> completed_results_ TFRT_GUARDED_BY(mu_);
+  // Results returned by GetNext before any invocation completed. They are
+  // forwarded to the results of the next completed invocations.
+  std::deque<RCReference<IndirectAsyncValue>> pending_results_
+      TFRT_GUARDED_BY(mu_);
+};
+
+template <typename... InputTypes, typename... OutputTypes>
+RCReference<Iterator<OutputTypes...>> ParallelMapDataset<
+    std::tuple<InputTypes...>, std::tuple<OutputTypes...>>::MakeIterator() {
+  return TakeRef(host_->Construct<ParallelMapDatasetIterator<
+                     std::tuple<InputTypes...>, std::tuple<OutputTypes...>>>(
+      FormRef(this)));
+}
+
+template <typename... InputTypes, typename... OutputTypes>
+auto ParallelMapDatasetIterator<std::tuple<InputTypes...>,
+                                std::tuple<OutputTypes...>>::
+    StartCall(const ExecutionContext& exec_ctx, int64_t* start_ns)
+        -> OutputRef {
+  const int64_t wait_start_ns = IteratorStats::Now();
+  auto args = input_iterator_->GetNext(exec_ctx);
+  *start_ns = IteratorStats::Now();
+  this->stats_.AddWaitTime(*start_ns - wait_start_ns);
+  if (!args) {
+    end_of_input_ = true;
+    return OutputRef();
+  }
+  if (args.IsError()) return OutputRef(args.ReleaseRCRef());
+  return EnqueueMapFunction<OutputTypes...>(
+      parent_dataset_->map_fn_.CopyRef(),
+      parent_dataset_->additional_fn_args_.CopyRef(), std::move(args),
+      exec_ctx);
+}
+
+template <typename... InputTypes, typename... OutputTypes>
+void ParallelMapDatasetIterator<
+    std::tuple<InputTypes...>,
+    std::tuple<OutputTypes...>>::StartCalls(const ExecutionContext& exec_ctx) {
+  const int64_t num_parallel_calls = GetNumParallelCalls();
+
+  if (parent_dataset_->deterministic_) {
+    while (!end_of_input_ &&
+           static_cast<int64_t>(ordered_results_.size()) < num_parallel_calls) {
+      int64_t start_ns;
+      if (auto result = StartCall(exec_ctx, &start_ns)) {
+        auto* result_ptr = result.GetAsyncValue();
+        result_ptr->AndThen([iterator = FormRef(this), start_ns,
+                             result = result.CopyRef()]() {
+          iterator->RecordCall(start_ns, result);
+        });
+        ordered_results_.push_back(std::move(result));
+      }
+    }
+    return;
+  }
+
+  while (!end_of_input_) {
+    {
+      mutex_lock lock(mu_);
+      int64_t num_buffered = num_running_ + completed_results_.size() -
+                             pending_results_.size();
+      if (num_buffered >= num_parallel_calls) return;
+      ++num_running_;
+    }
+    int64_t start_ns;
+    auto result = StartCall(exec_ctx, &start_ns);
+    if (!result) {
+      mutex_lock lock(mu_);
+      --num_running_;
+      return;
+    }
+    auto* result_ptr = result.GetAsyncValue();
+    result_ptr->AndThen([iterator = FormRef(this), start_ns,
+                         result = std::move(result)]() mutable {
+      iterator->RecordCall(start_ns, result);
+      iterator->OnCallCompleted(std::move(result));
+    });
+  }
+}
+
+template <typename... InputTypes, typename... OutputTypes>
+void ParallelMapDatasetIterator<
+    std::tuple<InputTypes...>,
+    std::tuple<OutputTypes...>>::OnCallCompleted(OutputRef result) {
+  RCReference<IndirectAsyncValue> pending_result;
+  {
+    mutex_lock lock(mu_);
+    if (--num_running_ == 0) cond_.notify_all();
+    if (pending_results_.empty()) {
+      completed_results_.push_back(std::move(result));
+      return;
+    }
+    pending_result = std::move(pending_results_.front());
+    pending_results_.pop_front();
+  }
+  pending_result->ForwardTo(result.ReleaseRCRef());
+}
+
+template <typename... InputTypes, typename... OutputTypes>
+auto ParallelMapDatasetIterator<std::tuple<InputTypes...>,
+                                std::tuple<OutputTypes...>>::
+    GetNext(const ExecutionContext& exec_ctx) -> OutputRef {
+  if (num_parallel_calls_) num_parallel_calls_->MaybeTune();
+  StartCalls(exec_ctx);
+
+  if (parent_dataset_->deterministic_) {
+    if (ordered_results_.empty()) return OutputRef();
+    auto result = std::move(ordered_results_.front());
+    ordered_results_.pop_front();
+    return ReturnResult(std::move(result));
+  }
+
+  mutex_lock lock(mu_);
+  if (!completed_results_.empty()) {
+    auto result = std::move(completed_results_.front());
+    completed_results_.pop_front();
+    return ReturnResult(std::move(result));
+  }
+  if (num_running_ > static_cast<int64_t>(pending_results_.size())) {
+    // Return the result of whichever running invocation completes first.
+    auto pending_result = exec_ctx.host()->MakeIndirectAsyncValue();
+    OutputRef result(pending_result.CopyRef());
+    pending_results_.push_back(std::move(pending_result));
+    return ReturnResult(std::move(result));
+  }
+  return OutputRef();
+}
+
+template <typename... InputTypes, typename... OutputTypes>
+llvm::Error ParallelMapDatasetIterator<
+    std::tuple<InputTypes...>,
+    std::tuple<OutputTypes...>>::Save(IteratorStateWriter* writer) {
+  if (parent_dataset_->deterministic_) {
+    SmallVector<RCReference<AsyncValue>, 16> results;
+    for (const auto& result : ordered_results_) {
+      results.push_back(result.CopyRCRef());
+    }
+    parent_dataset_->host_->Await(results);
+    writer->WriteInt(ordered_results_.size());
+    for (const auto& result : ordered_results_) {
+      writer->WriteAsyncElement(result);
+    }
+  } else {
+    mutex_lock lock(mu_);
+    // The running invocations complete the elements that are already
+    // returned, or add their results to completed_results_.
+    cond_.wait(lock, [this]() TFRT_REQUIRES(mu_) { return num_running_ == 0; });
+    writer->WriteInt(completed_results_.size());
+    for (const auto& result : completed_results_) {
+      writer->WriteAsyncElement(result);
+    }
+  }
+  writer->WriteInt(end_of_input_);
+  return input_iterator_->Save(writer);
+}
+
+template <typename... InputTypes, typename... OutputTypes>
+llvm::Error ParallelMapDatasetIterator<
+    std::tuple<InputTypes...>,
+    std::tuple<OutputTypes...>>::Restore(IteratorStateReader* reader) {
+  int64_t num_results;
+  if (auto error = reader->ReadInt(&num_results)) return error;
+  for (int64_t i = 0; i < num_results; ++i) {
+    auto result = reader->ReadAsyncElement<OutputTypes...>();
+    if (!result) return result.takeError();
+    if (parent_dataset_->deterministic_) {
+      ordered_results_.push_back(std::move(*result));
+    } else {
+      mutex_lock lock(mu_);
+      completed_results_.push_back(std::move(*result));
+    }
+  }
+  int64_t end_of_input;
+  if (auto error = reader->ReadInt(&end_of_input)) return error;
+  end_of_input_ = end_of_input;
+  return input_iterator_->Restore(reader);
+}
+
+}  // namespace data
+}  // namespace tfrt
+
+#endif  // TFRT_LIB_DATA_PARALLEL_MAP_DATASET_H_
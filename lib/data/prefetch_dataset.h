@@ -25,10 +25,13 @@
 #ifndef TFRT_LIB_DATA_PREFETCH_DATASET_H_
 #define TFRT_LIB_DATA_PREFETCH_DATASET_H_
 
-#include <queue>
+#include <deque>
+#include <memory>
 
+#include "autotuner.h"
 #include "dataset.h"
 #include "tfrt/support/forward_decls.h"
+#include "tfrt/support/mutex.h"
 
 namespace tfrt {
 namespace data {
@@ -36,14 +39,33 @@ namespace data {
 template <typename... T>
 class PrefetchDatasetIterator;
 
+// PrefetchDataset reads elements from the input dataset in a background task,
+// and keeps up to `prefetch_num` elements (and up to `max_buffer_bytes` bytes
+// if it is positive) in a buffer ahead of the consumer. If `prefetch_num` is
+// kAutotune, the Autotuner chooses it.
+//
+// If the input dataset is blocking (e.g. it reads from a file), the background
+// task runs on the blocking work queue, otherwise it runs on the non-blocking
+// work queue.
+//
+// GetNext does not wait for the background task. If the buffer is empty while
+// the task reads from the input iterator, it returns an IndirectAsyncValue
+// that is forwarded to the next element the task reads. If the input reaches
+// end instead, the value is the "iterator reached end" error that
+// data.iterator_get_next returns at end, and the following GetNext returns an
+// empty AsyncValueRef.
 template <typename... T>
 class PrefetchDataset : public Dataset<T...> {
  public:
   explicit PrefetchDataset(RCReference<Dataset<T...>> input_dataset,
-                           int32_t prefetch_num, HostContext* host)
+                           int64_t prefetch_num, int64_t max_buffer_bytes,
+                           HostContext* host)
       : input_dataset_(std::move(input_dataset)),
         prefetch_num_(prefetch_num),
-        host_(host) {}
+        max_buffer_bytes_(max_buffer_bytes),
+        host_(host) {
+    assert(prefetch_num > 0 || prefetch_num == kAutotune);
+  }
 
   // This class is not copyable or movable.
   PrefetchDataset(const PrefetchDataset&) = delete;
@@ -51,6 +73,10 @@ class PrefetchDataset : public Dataset<T...> {
 
   RCReference<Iterator<T...>> MakeIterator() override;
 
+  // GetNext reads from a blocking input inline if the background task is not
+  // running.
+  bool IsBlocking() const override { return input_dataset_->IsBlocking(); }
+
  private:
   // Allow iterator to rely on private data members of this dataset.
   friend class PrefetchDatasetIterator<T...>;
@@ -60,7 +86,8 @@ class PrefetchDataset : public Dataset<T...> {
   }
 
   RCReference<Dataset<T...>> input_dataset_;
-  int32_t prefetch_num_;
+  int64_t prefetch_num_;
+  int64_t max_buffer_bytes_;
   HostContext* host_;
 };
 
@@ -72,31 +99,129 @@ class PrefetchDatasetIterator : public Iterator<T...> {
       RCReference<Iterator<T...>> input_iterator)
       : Iterator<T...>(),
         parent_dataset_(std::move(parent_dataset)),
-        input_iterator_(std::move(input_iterator)) {}
+        input_iterator_(std::move(input_iterator)) {
+    if (parent_dataset_->prefetch_num_ == kAutotune) {
+      prefetch_num_ = std::make_unique<TunableParameter>(
+          TunableParameter::Kind::kBufferSize, /*num_producers=*/1,
+          &this->stats_, parent_dataset_->host_);
+    }
+  }
 
   // This class is not copyable or movable.
   PrefetchDatasetIterator(const PrefetchDatasetIterator&) = delete;
   PrefetchDatasetIterator& operator=(const PrefetchDatasetIterator&) = delete;
 
+  // Returns the next buffered element. If the buffer is empty and the
+  // background task is reading from the input iterator, returns a value that
+  // is forwarded to the next element it reads. If no task is reading from the
+  // input iterator, reads the next element inline.
   AsyncValueRef<std::tuple<T...>> GetNext(
-      const ExecutionContext& exec_ctx) override {
-    while (buffer_.size() < parent_dataset_->prefetch_num_) {
-      buffer_.push(input_iterator_->GetNext(exec_ctx));
-    }
-    auto result = std::move(buffer_.front());
-    buffer_.pop();
-    return result;
-  }
+      const ExecutionContext& exec_ctx) override;
+
+  // The state is the buffered elements, followed by the state of the input
+  // iterator. Save waits for the producer task to resolve the returned values,
+  // fill the buffer and stop.
+  llvm::Error Save(IteratorStateWriter* writer) override;
+
+  llvm::Error Restore(IteratorStateReader* reader) override;
 
  private:
+  struct BufferEntry {
+    AsyncValueRef<std::tuple<T...>> value;
+    int64_t size_in_bytes;
+  };
+
+  // A value returned by GetNext while the buffer was empty.
+  struct PendingResult {
+    RCReference<IndirectAsyncValue> result;
+    // When GetNext returned it, to record how long its consumer waited.
+    int64_t wait_start_ns;
+  };
+
   void Destroy() override {
     internal::DestroyImpl<PrefetchDatasetIterator>(
         this, parent_dataset_->host_->allocator());
   }
 
+  int64_t GetPrefetchNum() const {
+    return prefetch_num_ ? prefetch_num_->value()
+                         : parent_dataset_->prefetch_num_;
+  }
+
+  // Records the time since `wait_start_ns` that GetNext waited for an
+  // element. Its consumer waited for the same time.
+  void RecordWaitTime(int64_t wait_start_ns) {
+    const int64_t wait_time_ns = IteratorStats::Now() - wait_start_ns;
+    this->stats_.AddWaitTime(wait_time_ns);
+    if (prefetch_num_) prefetch_num_->AddConsumerWaitTime(wait_time_ns);
+  }
+
+  bool IsBufferFull() const TFRT_REQUIRES(mu_) {
+    const int64_t max_buffer_bytes = parent_dataset_->max_buffer_bytes_;
+    return static_cast<int64_t>(buffer_.size()) >= GetPrefetchNum() ||
+           (max_buffer_bytes > 0 && buffered_bytes_ >= max_buffer_bytes);
+  }
+
+  // Returns true if the caller should start the producer task. The producer is
+  // restarted once the buffer drains to half of its capacity, so that it does
+  // not bounce between running and stopped on every consumed element, or if
+  // values returned by GetNext wait for it.
+  bool ShouldStartProducer() TFRT_REQUIRES(mu_) {
+    if (producer_running_ || end_of_input_) return false;
+    if (pending_results_.empty()) {
+      if (static_cast<int64_t>(buffer_.size()) * 2 > GetPrefetchNum()) {
+        return false;
+      }
+      const int64_t max_buffer_bytes = parent_dataset_->max_buffer_bytes_;
+      if (max_buffer_bytes > 0 && buffered_bytes_ * 2 > max_buffer_bytes) {
+        return false;
+      }
+    }
+    producer_running_ = true;
+    return true;
+  }
+
+  // Enqueues the task that fills the buffer ahead of the consumer.
+  void StartProducer(const ExecutionContext& exec_ctx);
+
+  // Reads elements from the input iterator and forwards the pending results
+  // to them. If `fill_buffer` is true, continues until the buffer is full,
+  // otherwise stops once no result is pending. Also stops if the input
+  // iterator reaches end.
+  void ProduceElements(const ExecutionContext& exec_ctx, bool fill_buffer);
+
+  // Takes the element that the input iterator returned into the buffer, or
+  // forwards the first pending result to it. Takes the pending results to
+  // resolve to the end of the iterator if `value` is empty.
+  void AddElementLocked(AsyncValueRef<std::tuple<T...>> value,
+                        int64_t size_in_bytes,
+                        SmallVectorImpl<PendingResult>* resolved)
+      TFRT_REQUIRES(mu_);
+
+  // Forwards the results taken by AddElementLocked to their values.
+  void ForwardResults(SmallVectorImpl<PendingResult>* resolved,
+                      AsyncValueRef<std::tuple<T...>> value,
+                      const ExecutionContext& exec_ctx);
+
   RCReference<PrefetchDataset<T...>> parent_dataset_;
   RCReference<Iterator<T...>> input_iterator_;
-  std::queue<AsyncValueRef<std::tuple<T...>>> buffer_;
+  // Set if the buffer size is chosen by the Autotuner.
+  std::unique_ptr<TunableParameter> prefetch_num_;
+
+  mutex mu_;
+  // Signaled when the producer task stops, or when the input iterator becomes
+  // free to use, for Save.
+  condition_variable cond_;
+  std::deque<BufferEntry> buffer_ TFRT_GUARDED_BY(mu_);
+  // The values returned by GetNext while the buffer was empty, in order. The
+  // buffer is empty while there are any.
+  std::deque<PendingResult> pending_results_ TFRT_GUARDED_BY(mu_);
+  int64_t buffered_bytes_ TFRT_GUARDED_BY(mu_) = 0;
+  // True if the producer task is enqueued or running.
+  bool producer_running_ TFRT_GUARDED_BY(mu_) = false;
+  // True while a thread calls GetNext of the input iterator.
+  bool input_busy_ TFRT_GUARDED_BY(mu_) = false;
+  bool end_of_input_ TFRT_GUARDED_BY(mu_) = false;
 };
 
 template <typename... T>
@@ -106,6 +231,200 @@ RCReference<Iterator<T...>> PrefetchDataset<T...>::MakeIterator() {
       FormRef(this), std::move(input_iterator)));
 }
 
+template <typename... T>
+AsyncValueRef<std::tuple<T...>> PrefetchDatasetIterator<T...>::GetNext(
+    const ExecutionContext& exec_ctx) {
+  if (prefetch_num_) prefetch_num_->MaybeTune();
+
+  AsyncValueRef<std::tuple<T...>> value;
+  bool start_producer = false;
+  {
+    mutex_lock lock(mu_);
+    if (!buffer_.empty()) {
+      value = std::move(buffer_.front().value);
+      buffered_bytes_ -= buffer_.front().size_in_bytes;
+      buffer_.pop_front();
+      start_producer = ShouldStartProducer();
+    } else if (end_of_input_) {
+      return value;
+    } else if (input_busy_) {
+      // Whoever reads from the input iterator forwards this value to the next
+      // element, or restarts the producer task to do so.
+      auto pending_result = exec_ctx.host()->MakeIndirectAsyncValue();
+      value = AsyncValueRef<std::tuple<T...>>(pending_result.CopyRef());
+      pending_results_.push_back(
+          PendingResult{std::move(pending_result), IteratorStats::Now()});
+      return value;
+    } else {
+      // Nobody is reading from the input iterator, read the next element
+      // inline.
+      input_busy_ = true;
+    }
+  }
+
+  if (!value) {
+    const int64_t wait_start_ns = IteratorStats::Now();
+    value = input_iterator_->GetNext(exec_ctx);
+    RecordWaitTime(wait_start_ns);
+    SmallVector<PendingResult, 4> resolved;
+    {
+      mutex_lock lock(mu_);
+      input_busy_ = false;
+      // This value is returned to the caller, only the end of the input
+      // resolves the results of the calls that came later.
+      if (!value) AddElementLocked(value.CopyRef(), 0, &resolved);
+      start_producer = ShouldStartProducer();
+    }
+    // Save waits for the input iterator to become free to use.
+    cond_.notify_all();
+    ForwardResults(&resolved, value.CopyRef(), exec_ctx);
+  }
+
+  if (start_producer) StartProducer(exec_ctx);
+  if (value) this->stats_.RecordElement();
+  return value;
+}
+
+template <typename... T>
+void PrefetchDatasetIterator<T...>::StartProducer(
+    const ExecutionContext& exec_ctx) {
+  HostContext* host = exec_ctx.host();
+  auto produce = [iterator = FormRef(this), exec_ctx]() {
+    iterator->ProduceElements(exec_ctx, /*fill_buffer=*/true);
+  };
+
+  if (!parent_dataset_->input_dataset_->IsBlocking()) {
+    host->EnqueueWork(std::move(produce));
+    return;
+  }
+  if (!host->EnqueueBlockingWork(std::move(produce))) {
+    // The blocking work queue is overloaded. Stop prefetching, the consumer
+    // reads from the input iterator inline until the producer is restarted.
+    // The values that GetNext already returned are resolved right away.
+    ProduceElements(exec_ctx, /*fill_buffer=*/false);
+  }
+}
+
+template <typename... T>
+void PrefetchDatasetIterator<T...>::AddElementLocked(
+    AsyncValueRef<std::tuple<T...>> value, int64_t size_in_bytes,
+    SmallVectorImpl<PendingResult>* resolved) {
+  if (!value) {
+    end_of_input_ = true;
+    resolved->append(std::make_move_iterator(pending_results_.begin()),
+                     std::make_move_iterator(pending_results_.end()));
+    pending_results_.clear();
+    return;
+  }
+  if (!pending_results_.empty()) {
+    resolved->push_back(std::move(pending_results_.front()));
+    pending_results_.pop_front();
+    return;
+  }
+  buffer_.push_back(BufferEntry{std::move(value), size_in_bytes});
+  buffered_bytes_ += size_in_bytes;
+}
+
+template <typename... T>
+void PrefetchDatasetIterator<T...>::ForwardResults(
+    SmallVectorImpl<PendingResult>* resolved,
+    AsyncValueRef<std::tuple<T...>> value, const ExecutionContext& exec_ctx) {
+  // The consumer may call GetNext from the continuations of the results, so
+  // they are forwarded without holding the mutex.
+  for (auto& pending_result : *resolved) {
+    RecordWaitTime(pending_result.wait_start_ns);
+    if (value) {
+      this->stats_.RecordElement();
+      pending_result.result->ForwardTo(value.CopyRCRef());
+    } else {
+      pending_result.result->ForwardTo(
+          exec_ctx.host()->MakeErrorAsyncValueRef("iterator reached end"));
+    }
+  }
+}
+
+template <typename... T>
+void PrefetchDatasetIterator<T...>::ProduceElements(
+    const ExecutionContext& exec_ctx, bool fill_buffer) {
+  while (true) {
+    {
+      mutex_lock lock(mu_);
+      // The producer holds the last reference if the consumer released the
+      // iterator, e.g. TakeDataset after its last element. It still resolves
+      // the values that GetNext returned. If the input iterator is busy, the
+      // thread reading from it restarts the producer for them.
+      if (end_of_input_ || input_busy_ ||
+          (pending_results_.empty() &&
+           (!fill_buffer || IsBufferFull() || this->IsUnique()))) {
+        producer_running_ = false;
+        // Save waits for the producer to stop.
+        cond_.notify_all();
+        return;
+      }
+      input_busy_ = true;
+    }
+
+    const int64_t start_ns = IteratorStats::Now();
+    auto value = input_iterator_->GetNext(exec_ctx);
+    this->stats_.AddProduceTime(IteratorStats::Now() - start_ns);
+    // Elements that are not yet available are not counted towards the
+    // buffer size limit in bytes.
+    int64_t size_in_bytes = value && value.IsConcrete()
+                               ? internal::GetElementSizeInBytes(value.get())
+                               : 0;
+    this->stats_.AddBytes(size_in_bytes);
+    SmallVector<PendingResult, 4> resolved;
+    {
+      mutex_lock lock(mu_);
+      input_busy_ = false;
+      AddElementLocked(value.CopyRef(), size_in_bytes, &resolved);
+    }
+    ForwardResults(&resolved, std::move(value), exec_ctx);
+  }
+}
+
+template <typename... T>
+llvm::Error PrefetchDatasetIterator<T...>::Save(IteratorStateWriter* writer) {
+  SmallVector<RCReference<AsyncValue>, 16> buffered;
+  {
+    mutex_lock lock(mu_);
+    cond_.wait(lock, [this]() TFRT_REQUIRES(mu_) {
+      return !producer_running_ && !input_busy_ && pending_results_.empty();
+    });
+    for (const auto& entry : buffer_) {
+      buffered.push_back(entry.value.CopyRCRef());
+    }
+  }
+  parent_dataset_->host_->Await(buffered);
+
+  mutex_lock lock(mu_);
+  writer->WriteInt(buffer_.size());
+  for (const auto& entry : buffer_) writer->WriteAsyncElement(entry.value);
+  writer->WriteInt(end_of_input_);
+  return input_iterator_->Save(writer);
+}
+
+template <typename... T>
+llvm::Error PrefetchDatasetIterator<T...>::Restore(
+    IteratorStateReader* reader) {
+  int64_t num_buffered;
+  if (auto error = reader->ReadInt(&num_buffered)) return error;
+  mutex_lock lock(mu_);
+  for (int64_t i = 0; i < num_buffered; ++i) {
+    auto element = reader->ReadAsyncElement<T...>();
+    if (!element) return element.takeError();
+    const int64_t size_in_bytes =
+        element->IsError() ? 0
+                           : internal::GetElementSizeInBytes(element->get());
+    buffer_.push_back(BufferEntry{std::move(*element), size_in_bytes});
+    buffered_bytes_ += size_in_bytes;
+  }
+  int64_t end_of_input;
+  if (auto error = reader->ReadInt(&end_of_input)) return error;
+  end_of_input_ = end_of_input;
+  return input_iterator_->Restore(reader);
+}
+
 }  // namespace data
 }  // namespace tfrt
 
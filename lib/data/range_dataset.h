@@ -51,6 +51,14 @@ class RangeDataset : public Dataset<T> {
 
   RCReference<Iterator<T>> MakeIterator() override;
 
+  // The shard is the range with `num_shards` times the step, starting at the
+  // `index`th value.
+  RCReference<Dataset<T>> MakeShard(int64_t num_shards,
+                                    int64_t index) override {
+    return TakeRef(host_->Construct<RangeDataset<T>>(
+        start_ + index * step_, stop_, num_shards * step_, host_));
+  }
+
  private:
   friend class RangeDatasetIterator<T>;
 
@@ -77,18 +85,55 @@ class RangeDatasetIterator : public Iterator<T> {
 
   AsyncValueRef<std::tuple<T>> GetNext(
       const ExecutionContext& exec_ctx) override {
-    bool has_next = (dataset_->step_ > 0 && next_ < dataset_->stop_) ||
-                    (dataset_->step_ < 0 && next_ > dataset_->stop_);
-    if (!has_next) {
+    if (!HasNext()) {
       return AsyncValueRef<std::tuple<T>>();
     }
     auto result = next_;
     next_ += dataset_->step_;
+    this->stats_.RecordElement();
     return exec_ctx.host()->template MakeConcreteAsyncValueRef<std::tuple<T>>(
         std::make_tuple(result));
   }
 
+  AsyncValueRef<std::vector<std::tuple<T>>> GetNextBatch(
+      const ExecutionContext& exec_ctx, int64_t max_n) override {
+    if (!HasNext()) {
+      return AsyncValueRef<std::vector<std::tuple<T>>>();
+    }
+    std::vector<std::tuple<T>> batch;
+    for (; static_cast<int64_t>(batch.size()) < max_n && HasNext();
+         next_ += dataset_->step_) {
+      batch.emplace_back(next_);
+    }
+    this->stats_.RecordElements(batch.size());
+    return exec_ctx.host()
+        ->template MakeConcreteAsyncValueRef<std::vector<std::tuple<T>>>(
+            std::move(batch));
+  }
+
+  typename Iterator<T>::BatchMode GetBatchMode() const override {
+    return Iterator<T>::BatchMode::kSync;
+  }
+
+  // The state is the next value.
+  llvm::Error Save(IteratorStateWriter* writer) override {
+    writer->WriteInt(next_);
+    return llvm::Error::success();
+  }
+
+  llvm::Error Restore(IteratorStateReader* reader) override {
+    int64_t next;
+    if (auto error = reader->ReadInt(&next)) return error;
+    next_ = next;
+    return llvm::Error::success();
+  }
+
  private:
+  bool HasNext() const {
+    return (dataset_->step_ > 0 && next_ < dataset_->stop_) ||
+           (dataset_->step_ < 0 && next_ > dataset_->stop_);
+  }
+
   void Destroy() override {
     internal::DestroyImpl<RangeDatasetIterator>(this, dataset_->allocator_);
   }
@@ -24,6 +24,9 @@
 #ifndef TFRT_DATA_REPEAT_DATASET_H_
 #define TFRT_DATA_REPEAT_DATASET_H_
 
+#include <algorithm>
+#include <iterator>
+
 #include "dataset.h"
 
 namespace tfrt {
@@ -51,6 +54,8 @@ class RepeatDataset : public Dataset<T...> {
 
   RCReference<Iterator<T...>> MakeIterator() override;
 
+  bool IsBlocking() const override { return input_dataset_->IsBlocking(); }
+
  private:
   friend class RepeatDatasetIterator<T...>;
 
@@ -78,16 +83,58 @@ class RepeatDatasetIterator : public Iterator<T...> {
 
   AsyncValueRef<std::tuple<T...>> GetNext(
       const ExecutionContext& exec_ctx) override {
+    if (deferred_error_) {
+      this->stats_.RecordElement();
+      return std::move(deferred_error_);
+    }
     auto value = input_iterator_->GetNext(exec_ctx);
     if (!value && epoch_ + 1 < parent_dataset_->epochs_) {
       epoch_++;
       input_iterator_ = parent_dataset_->input_dataset_->MakeIterator();
-      return input_iterator_->GetNext(exec_ctx);
+      value = input_iterator_->GetNext(exec_ctx);
     }
 
+    if (value) this->stats_.RecordElement();
     return value;
   }
 
+  AsyncValueRef<std::vector<std::tuple<T...>>> GetNextBatch(
+      const ExecutionContext& exec_ctx, int64_t max_n) override;
+
+  // A batch of an epoch that ends before `max_n` elements is completed with
+  // the elements of the next epoch. This requires the number of elements of
+  // the batch, so that the input batches must be available synchronously.
+  typename Iterator<T...>::BatchMode GetBatchMode() const override {
+    return input_iterator_->GetBatchMode() == Iterator<T...>::BatchMode::kSync
+               ? Iterator<T...>::BatchMode::kSync
+               : Iterator<T...>::BatchMode::kElementwise;
+  }
+
+  // The state is the epoch and the deferred error, if any, followed by the
+  // state of the input iterator in that epoch.
+  llvm::Error Save(IteratorStateWriter* writer) override {
+    writer->WriteInt(epoch_);
+    writer->WriteInt(static_cast<bool>(deferred_error_));
+    if (deferred_error_) writer->WriteAsyncElement(deferred_error_);
+    return input_iterator_->Save(writer);
+  }
+
+  llvm::Error Restore(IteratorStateReader* reader) override {
+    int64_t epoch, has_deferred_error;
+    if (auto error = reader->ReadInt(&epoch)) return error;
+    if (epoch < 0 || epoch >= parent_dataset_->epochs_) {
+      return MakeStringError("invalid repeat_dataset iterator state");
+    }
+    epoch_ = epoch;
+    if (auto error = reader->ReadInt(&has_deferred_error)) return error;
+    if (has_deferred_error) {
+      auto element = reader->ReadAsyncElement<T...>();
+      if (!element) return element.takeError();
+      deferred_error_ = std::move(*element);
+    }
+    return input_iterator_->Restore(reader);
+  }
+
  private:
   void Destroy() override {
     internal::DestroyImpl<RepeatDatasetIterator>(this,
@@ -99,6 +146,9 @@ class RepeatDatasetIterator : public Iterator<T...> {
 
   // The current epoch number.
   int32_t epoch_ = 0;
+  // An input error that GetNextBatch returns after the elements of the
+  // previous epoch that it collected before the error.
+  AsyncValueRef<std::tuple<T...>> deferred_error_;
 };
 
 template <typename... T>
@@ -106,6 +156,50 @@ RCReference<Iterator<T...>> RepeatDataset<T...>::MakeIterator() {
   return TakeRef(host_->Construct<RepeatDatasetIterator<T...>>(FormRef(this)));
 }
 
+template <typename... T>
+AsyncValueRef<std::vector<std::tuple<T...>>>
+RepeatDatasetIterator<T...>::GetNextBatch(const ExecutionContext& exec_ctx,
+                                          int64_t max_n) {
+  using Batch = std::vector<std::tuple<T...>>;
+  if (deferred_error_) {
+    this->stats_.RecordElement();
+    return AsyncValueRef<Batch>(deferred_error_.ReleaseRCRef());
+  }
+  if (GetBatchMode() != Iterator<T...>::BatchMode::kSync) {
+    return Iterator<T...>::GetNextBatch(exec_ctx, max_n);
+  }
+
+  AsyncValueRef<Batch> result;
+  int64_t num_elements = 0;
+  while (num_elements < max_n) {
+    auto batch = input_iterator_->GetNextBatch(exec_ctx, max_n - num_elements);
+    if (!batch) {
+      if (epoch_ + 1 == parent_dataset_->epochs_) break;
+      epoch_++;
+      input_iterator_ = parent_dataset_->input_dataset_->MakeIterator();
+      continue;
+    }
+    assert(batch.IsAvailable());
+    if (batch.IsError()) {
+      if (!result) return batch;
+      deferred_error_ = AsyncValueRef<std::tuple<T...>>(batch.ReleaseRCRef());
+      break;
+    }
+    auto& elements = batch.get();
+    num_elements += elements.size();
+    if (!result) {
+      result = std::move(batch);
+      continue;
+    }
+    // The batch spans two epochs.
+    std::move(elements.begin(), elements.end(),
+              std::back_inserter(result.get()));
+  }
+
+  if (result) this->stats_.RecordElements(num_elements);
+  return result;
+}
+
 }  // namespace data
 }  // namespace tfrt
 
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- shard_dataset.h ------------------------------------------*- C++ -*-===//
+//
+// This file declares ShardDataset class which wraps around another Dataset
+// instance and yields one out of every `num_shards` elements.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef TFRT_DATA_SHARD_DATASET_H_
+#define TFRT_DATA_SHARD_DATASET_H_
+
+#include "dataset.h"
+
+namespace tfrt {
+namespace data {
+
+template <typename... T>
+class ShardDatasetIterator;
+
+// ShardDataset yields the elements of its input dataset whose index modulo
+// `num_shards` is `index`, so that `num_shards` workers that run the same
+// input pipeline with different indices each get a disjoint part of it.
+//
+// It produces and discards the other elements, so data.shard_dataset only
+// uses it if the input dataset cannot skip them itself, see
+// Dataset::MakeShard.
+template <typename... T>
+class ShardDataset : public Dataset<T...> {
+ public:
+  explicit ShardDataset(RCReference<Dataset<T...>> input_dataset,
+                        int64_t num_shards, int64_t index, HostContext* host)
+      : input_dataset_(std::move(input_dataset)),
+        num_shards_(num_shards),
+        index_(index),
+        host_(host),
+        allocator_(host->allocator()) {
+    assert(num_shards > 0);
+    assert(index >= 0 && index < num_shards);
+  }
+
+  // This class is not copyable or movable.
+  ShardDataset(const ShardDataset&) = delete;
+  ShardDataset& operator=(const ShardDataset&) = delete;
+
+  RCReference<Iterator<T...>> MakeIterator() override;
+
+  bool IsBlocking() const override { return input_dataset_->IsBlocking(); }
+
+  // A shard of a shard is a shard of the input with more shards.
+  RCReference<Dataset<T...>> MakeShard(int64_t num_shards,
+                                       int64_t index) override {
+    return TakeRef(host_->Construct<ShardDataset<T...>>(
+        input_dataset_.CopyRef(), num_shards_ * num_shards,
+        index_ + num_shards_ * index, host_));
+  }
+
+ private:
+  friend class ShardDatasetIterator<T...>;
+
+  void Destroy() override {
+    internal::DestroyImpl<ShardDataset<T...>>(this, allocator_);
+  }
+
+  RCReference<Dataset<T...>> input_dataset_;
+  const int64_t num_shards_;
+  const int64_t index_;
+  HostContext* host_;
+  HostAllocator* allocator_;
+};
+
+template <typename... T>
+class ShardDatasetIterator : public Iterator<T...> {
+ public:
+  explicit ShardDatasetIterator(RCReference<ShardDataset<T...>> dataset)
+      : Iterator<T...>(),
+        parent_dataset_(std::move(dataset)),
+        input_iterator_(parent_dataset_->input_dataset_->MakeIterator()),
+        num_to_skip_(parent_dataset_->index_) {}
+
+  // This class is not copyable or movable.
+  ShardDatasetIterator(const ShardDatasetIterator&) = delete;
+  ShardDatasetIterator& operator=(const ShardDatasetIterator&) = delete;
+
+  AsyncValueRef<std::tuple<T...>> GetNext(
+      const ExecutionContext& exec_ctx) override {
+    for (; num_to_skip_ > 0; --num_to_skip_) {
+      auto skipped = input_iterator_->GetNext(exec_ctx);
+      if (!skipped) return skipped;
+      // Only the errors that are available right away are returned, rather
+      // than waiting for the skipped elements.
+      if (skipped.IsError()) {
+        --num_to_skip_;
+        this->stats_.RecordElement();
+        return skipped;
+      }
+    }
+    auto value = input_iterator_->GetNext(exec_ctx);
+    if (!value) return value;
+    num_to_skip_ = parent_dataset_->num_shards_ - 1;
+    this->stats_.RecordElement();
+    return value;
+  }
+
+  llvm::Error Save(IteratorStateWriter* writer) override {
+    writer->WriteInt(num_to_skip_);
+    return input_iterator_->Save(writer);
+  }
+
+  llvm::Error Restore(IteratorStateReader* reader) override {
+    if (auto error = reader->ReadInt(&num_to_skip_)) return error;
+    return input_iterator_->Restore(reader);
+  }
+
+ private:
+  void Destroy() override {
+    internal::DestroyImpl<ShardDatasetIterator>(this,
+                                                parent_dataset_->allocator_);
+  }
+
+  RCReference<ShardDataset<T...>> parent_dataset_;
+  RCReference<Iterator<T...>> input_iterator_;
+  // Number of input elements to skip before the next element of the shard.
+  int64_t num_to_skip_;
+};
+
+template <typename... T>
+RCReference<Iterator<T...>> ShardDataset<T...>::MakeIterator() {
+  return TakeRef(host_->Construct<ShardDatasetIterator<T...>>(FormRef(this)));
+}
+
+}  // namespace data
+}  // namespace tfrt
+
+#endif  // TFRT_DATA_SHARD_DATASET_H_
@@ -0,0 +1,234 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- shuffle_dataset.h ----------------------------------------*- C++ -*-===//
+//
+// This file declares ShuffleDataset class which randomly shuffles the elements
+// of another Dataset instance.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef TFRT_DATA_SHUFFLE_DATASET_H_
+#define TFRT_DATA_SHUFFLE_DATASET_H_
+
+#include <atomic>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include "dataset.h"
+#include "tfrt/support/forward_decls.h"
+
+namespace tfrt {
+namespace data {
+
+template <typename... T>
+class ShuffleDatasetIterator;
+
+// ShuffleDataset keeps a buffer of `buffer_size` elements from the input
+// dataset. GetNext() returns an element chosen uniformly at random from the
+// buffer, and replaces it with the next input element.
+//
+// The buffered elements are the async values returned by the input iterator,
+// so a slow input element only delays the consumer that draws it.
+//
+// If `seed` is zero, a random seed is chosen when the dataset is created. If
+// `reshuffle_each_iteration` is true, every iterator (e.g. every epoch of a
+// RepeatDataset) uses a different order. Otherwise, every iterator returns
+// the elements in the same order.
+template <typename... T>
+class ShuffleDataset : public Dataset<T...> {
+ public:
+  explicit ShuffleDataset(RCReference<Dataset<T...>> input_dataset,
+                          int64_t buffer_size, int64_t seed,
+                          bool reshuffle_each_iteration, HostContext* host)
+      : input_dataset_(std::move(input_dataset)),
+        buffer_size_(buffer_size),
+        seed_(seed != 0 ? seed : std::random_device()()),
+        reshuffle_each_iteration_(reshuffle_each_iteration),
+        host_(host),
+        allocator_(host->allocator()) {
+    assert(buffer_size > 0);
+  }
+
+  // This class is not copyable or movable.
+  ShuffleDataset(const ShuffleDataset&) = delete;
+  ShuffleDataset& operator=(const ShuffleDataset&) = delete;
+
+  RCReference<Iterator<T...>> MakeIterator() override;
+
+  bool IsBlocking() const override { return input_dataset_->IsBlocking(); }
+
+ private:
+  // Allow iterator to rely on private data members of this dataset.
+  friend class ShuffleDatasetIterator<T...>;
+
+  void Destroy() override {
+    internal::DestroyImpl<ShuffleDataset<T...>>(this, allocator_);
+  }
+
+  // Returns the seed of a new iterator.
+  uint64_t GetIteratorSeed() {
+    if (!reshuffle_each_iteration_) return seed_;
+    // Distinct iterations get uncorrelated seeds (splitmix64 increment).
+    return seed_ + num_iterators_.fetch_add(1) * 0x9e3779b97f4a7c15ULL;
+  }
+
+  RCReference<Dataset<T...>> input_dataset_;
+  const int64_t buffer_size_;
+  const uint64_t seed_;
+  const bool reshuffle_each_iteration_;
+  std::atomic<uint64_t> num_iterators_{0};
+  HostContext* host_;
+  HostAllocator* allocator_;
+};
+
+template <typename... T>
+class ShuffleDatasetIterator : public Iterator<T...> {
+ public:
+  explicit ShuffleDatasetIterator(
+      RCReference<ShuffleDataset<T...>> parent_dataset)
+      : Iterator<T...>(),
+        parent_dataset_(std::move(parent_dataset)),
+        input_iterator_(parent_dataset_->input_dataset_->MakeIterator()),
+        buffer_(parent_dataset_->buffer_size_),
+        rng_(parent_dataset_->GetIteratorSeed()) {}
+
+  // This class is not copyable or movable.
+  ShuffleDatasetIterator(const ShuffleDatasetIterator&) = delete;
+  ShuffleDatasetIterator& operator=(const ShuffleDatasetIterator&) = delete;
+
+  AsyncValueRef<std::tuple<T...>> GetNext(
+      const ExecutionContext& exec_ctx) override;
+
+  // The state is the random engine, the buffered elements, and the state of
+  // the input iterator.
+  llvm::Error Save(IteratorStateWriter* writer) override;
+
+  llvm::Error Restore(IteratorStateReader* reader) override;
+
+ private:
+  void Destroy() override {
+    internal::DestroyImpl<ShuffleDatasetIterator>(this,
+                                                  parent_dataset_->allocator_);
+  }
+
+  // Returns the index in buffer_ of the `offset`th buffered element.
+  size_t GetIndex(size_t offset) const {
+    size_t index = head_ + offset;
+    return index < buffer_.size() ? index : index - buffer_.size();
+  }
+
+  RCReference<ShuffleDataset<T...>> parent_dataset_;
+  RCReference<Iterator<T...>> input_iterator_;
+
+  // Ring buffer of the num_buffered_ elements starting at head_.
+  std::vector<AsyncValueRef<std::tuple<T...>>> buffer_;
+  size_t head_ = 0;
+  size_t num_buffered_ = 0;
+  bool end_of_input_ = false;
+  std::mt19937_64 rng_;
+};
+
+template <typename... T>
+RCReference<Iterator<T...>> ShuffleDataset<T...>::MakeIterator() {
+  return TakeRef(
+      host_->Construct<ShuffleDatasetIterator<T...>>(FormRef(this)));
+}
+
+template <typename... T>
+AsyncValueRef<std::tuple<T...>> ShuffleDatasetIterator<T...>::GetNext(
+    const ExecutionContext& exec_ctx) {
+  // Fill the buffer. This only reads the whole buffer on the first call, and
+  // one input element per call afterwards. Input elements are not awaited.
+  while (!end_of_input_ && num_buffered_ < buffer_.size()) {
+    auto value = input_iterator_->GetNext(exec_ctx);
+    if (!value) {
+      end_of_input_ = true;
+      // Release the input iterator and the resources it holds.
+      input_iterator_.reset();
+      break;
+    }
+    buffer_[GetIndex(num_buffered_)] = std::move(value);
+    ++num_buffered_;
+  }
+  if (num_buffered_ == 0) return AsyncValueRef<std::tuple<T...>>();
+
+  // Move a random element to the head of the ring, and pop it.
+  const size_t offset = rng_() % num_buffered_;
+  if (offset != 0) std::swap(buffer_[head_], buffer_[GetIndex(offset)]);
+  auto value = std::move(buffer_[head_]);
+  head_ = GetIndex(1);
+  --num_buffered_;
+  this->stats_.RecordElement();
+  return value;
+}
+
+template <typename... T>
+llvm::Error ShuffleDatasetIterator<T...>::Save(IteratorStateWriter* writer) {
+  SmallVector<RCReference<AsyncValue>, 16> buffered;
+  for (size_t i = 0; i < num_buffered_; ++i) {
+    buffered.push_back(buffer_[GetIndex(i)].CopyRCRef());
+  }
+  parent_dataset_->host_->Await(buffered);
+
+  std::ostringstream rng;
+  rng << rng_;
+  writer->WriteString(rng.str());
+  writer->WriteInt(num_buffered_);
+  for (size_t i = 0; i < num_buffered_; ++i) {
+    writer->WriteAsyncElement(buffer_[GetIndex(i)]);
+  }
+  writer->WriteInt(end_of_input_);
+  if (end_of_input_) return llvm::Error::success();
+  return input_iterator_->Save(writer);
+}
+
+template <typename... T>
+llvm::Error ShuffleDatasetIterator<T...>::Restore(
+    IteratorStateReader* reader) {
+  std::string rng_state;
+  if (auto error = reader->ReadString(&rng_state)) return error;
+  std::istringstream rng(rng_state);
+  rng >> rng_;
+  int64_t num_buffered;
+  if (auto error = reader->ReadInt(&num_buffered)) return error;
+  if (!rng || num_buffered < 0 ||
+      num_buffered > static_cast<int64_t>(buffer_.size())) {
+    return MakeStringError("invalid shuffle_dataset iterator state");
+  }
+  for (int64_t i = 0; i < num_buffered; ++i) {
+    auto element = reader->ReadAsyncElement<T...>();
+    if (!element) return element.takeError();
+    buffer_[i] = std::move(*element);
+  }
+  head_ = 0;
+  num_buffered_ = num_buffered;
+
+  int64_t end_of_input;
+  if (auto error = reader->ReadInt(&end_of_input)) return error;
+  end_of_input_ = end_of_input;
+  if (end_of_input_) {
+    input_iterator_.reset();
+    return llvm::Error::success();
+  }
+  return input_iterator_->Restore(reader);
+}
+
+}  // namespace data
+}  // namespace tfrt
+
+#endif  // TFRT_DATA_SHUFFLE_DATASET_H_
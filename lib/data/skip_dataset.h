@@ -0,0 +1,178 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- skip_dataset.h -------------------------------------------*- C++ -*-===//
+//
+// This file declares SkipDataset class which wraps around another Dataset
+// instance and yields its elements after the first `count` ones.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef TFRT_DATA_SKIP_DATASET_H_
+#define TFRT_DATA_SKIP_DATASET_H_
+
+#include "dataset.h"
+
+namespace tfrt {
+namespace data {
+
+template <typename... T>
+class SkipDatasetIterator;
+
+// SkipDataset yields the elements of its input dataset after the first
+// `count` ones, or no elements if `count` is negative.
+//
+// The skipped elements are not waited for. Inputs that produce their elements
+// at once, like RangeDataset and SliceDataset, skip them in a single batch.
+template <typename... T>
+class SkipDataset : public Dataset<T...> {
+ public:
+  explicit SkipDataset(RCReference<Dataset<T...>> input_dataset,
+                       int64_t count, HostContext* host)
+      : input_dataset_(std::move(input_dataset)),
+        count_(count),
+        host_(host),
+        allocator_(host->allocator()) {}
+
+  // This class is not copyable or movable.
+  SkipDataset(const SkipDataset&) = delete;
+  SkipDataset& operator=(const SkipDataset&) = delete;
+
+  RCReference<Iterator<T...>> MakeIterator() override;
+
+  bool IsBlocking() const override { return input_dataset_->IsBlocking(); }
+
+ private:
+  friend class SkipDatasetIterator<T...>;
+
+  void Destroy() override {
+    internal::DestroyImpl<SkipDataset<T...>>(this, allocator_);
+  }
+
+  RCReference<Dataset<T...>> input_dataset_;
+  const int64_t count_;
+  HostContext* host_;
+  HostAllocator* allocator_;
+};
+
+template <typename... T>
+class SkipDatasetIterator : public Iterator<T...> {
+ public:
+  explicit SkipDatasetIterator(RCReference<SkipDataset<T...>> dataset)
+      : Iterator<T...>(),
+        parent_dataset_(std::move(dataset)),
+        input_iterator_(parent_dataset_->input_dataset_->MakeIterator()),
+        num_to_skip_(parent_dataset_->count_) {}
+
+  // This class is not copyable or movable.
+  SkipDatasetIterator(const SkipDatasetIterator&) = delete;
+  SkipDatasetIterator& operator=(const SkipDatasetIterator&) = delete;
+
+  AsyncValueRef<std::tuple<T...>> GetNext(
+      const ExecutionContext& exec_ctx) override {
+    if (auto error = SkipElements(exec_ctx)) {
+      this->stats_.RecordElement();
+      return error;
+    }
+    auto value = input_iterator_->GetNext(exec_ctx);
+    if (value) this->stats_.RecordElement();
+    return value;
+  }
+
+  AsyncValueRef<std::vector<std::tuple<T...>>> GetNextBatch(
+      const ExecutionContext& exec_ctx, int64_t max_n) override {
+    using Batch = std::vector<std::tuple<T...>>;
+    if (GetBatchMode() == Iterator<T...>::BatchMode::kElementwise) {
+      return Iterator<T...>::GetNextBatch(exec_ctx, max_n);
+    }
+    if (auto error = SkipElements(exec_ctx)) {
+      return AsyncValueRef<Batch>(error.ReleaseRCRef());
+    }
+    auto batch = input_iterator_->GetNextBatch(exec_ctx, max_n);
+    if (batch) {
+      batch.AndThen([iterator = FormRef(this), batch = batch.CopyRef()]() {
+        if (!batch.IsError()) {
+          iterator->stats_.RecordElements(batch.get().size());
+        }
+      });
+    }
+    return batch;
+  }
+
+  typename Iterator<T...>::BatchMode GetBatchMode() const override {
+    return input_iterator_->GetBatchMode();
+  }
+
+  // The state is the number of elements left to skip, followed by the state
+  // of the input iterator.
+  llvm::Error Save(IteratorStateWriter* writer) override {
+    writer->WriteInt(num_to_skip_);
+    return input_iterator_->Save(writer);
+  }
+
+  llvm::Error Restore(IteratorStateReader* reader) override {
+    if (auto error = reader->ReadInt(&num_to_skip_)) return error;
+    return input_iterator_->Restore(reader);
+  }
+
+ private:
+  void Destroy() override {
+    internal::DestroyImpl<SkipDatasetIterator>(this,
+                                               parent_dataset_->allocator_);
+  }
+
+  // Skips the input elements that are left to skip. Returns the first of them
+  // that is an error available right away, if any, rather than waiting for
+  // the skipped elements.
+  AsyncValueRef<std::tuple<T...>> SkipElements(
+      const ExecutionContext& exec_ctx) {
+    if (num_to_skip_ > 0 &&
+        input_iterator_->GetBatchMode() == Iterator<T...>::BatchMode::kSync) {
+      auto skipped = input_iterator_->GetNextBatch(exec_ctx, num_to_skip_);
+      num_to_skip_ = 0;
+      if (skipped && skipped.IsError()) {
+        return AsyncValueRef<std::tuple<T...>>(skipped.ReleaseRCRef());
+      }
+      return AsyncValueRef<std::tuple<T...>>();
+    }
+    while (num_to_skip_ != 0) {
+      auto skipped = input_iterator_->GetNext(exec_ctx);
+      if (!skipped) {
+        num_to_skip_ = 0;
+        break;
+      }
+      if (num_to_skip_ > 0) --num_to_skip_;
+      if (skipped.IsError()) return skipped;
+    }
+    return AsyncValueRef<std::tuple<T...>>();
+  }
+
+  RCReference<SkipDataset<T...>> parent_dataset_;
+  RCReference<Iterator<T...>> input_iterator_;
+  // Number of input elements left to skip, or a negative value to skip all
+  // of them.
+  int64_t num_to_skip_;
+};
+
+template <typename... T>
+RCReference<Iterator<T...>> SkipDataset<T...>::MakeIterator() {
+  return TakeRef(host_->Construct<SkipDatasetIterator<T...>>(FormRef(this)));
+}
+
+}  // namespace data
+}  // namespace tfrt
+
+#endif  // TFRT_DATA_SKIP_DATASET_H_
@@ -24,6 +24,8 @@
 #ifndef TFRT_DATA_SLICE_DATASET_H_
 #define TFRT_DATA_SLICE_DATASET_H_
 
+#include <algorithm>
+
 #include "dataset.h"
 #include "tfrt/support/forward_decls.h"
 #include "tfrt/tensor/dense_host_tensor.h"
@@ -48,6 +50,11 @@ class SliceDataset : public Dataset<T> {
 
   RCReference<Iterator<T>> MakeIterator() override;
 
+  // The shard holds the elements of the shard, e.g. the file names read by a
+  // worker.
+  RCReference<Dataset<T>> MakeShard(int64_t num_shards,
+                                    int64_t index) override;
+
  private:
   friend class SliceDatasetIterator<T>;
 
@@ -79,11 +86,55 @@ class SliceDatasetIterator : public Iterator<T> {
 
     T& element = *iterator_;
     iterator_++;
+    this->stats_.RecordElement();
     return exec_ctx.host()->template MakeConcreteAsyncValueRef<std::tuple<T>>(
-        std::make_tuple(element));
+        CopyElement(element));
+  }
+
+  AsyncValueRef<std::vector<std::tuple<T>>> GetNextBatch(
+      const ExecutionContext& exec_ctx, int64_t max_n) override {
+    if (iterator_ == end_) {
+      return AsyncValueRef<std::vector<std::tuple<T>>>();
+    }
+    const int64_t n = std::min<int64_t>(max_n, end_ - iterator_);
+    std::vector<std::tuple<T>> batch;
+    batch.reserve(n);
+    for (int64_t i = 0; i < n; ++i, ++iterator_) {
+      batch.push_back(CopyElement(*iterator_));
+    }
+    this->stats_.RecordElements(n);
+    return exec_ctx.host()
+        ->template MakeConcreteAsyncValueRef<std::vector<std::tuple<T>>>(
+            std::move(batch));
+  }
+
+  typename Iterator<T>::BatchMode GetBatchMode() const override {
+    return Iterator<T>::BatchMode::kSync;
+  }
+
+  // The state is the index of the next element.
+  llvm::Error Save(IteratorStateWriter* writer) override {
+    writer->WriteInt(iterator_ - parent_dataset_->data_.begin());
+    return llvm::Error::success();
+  }
+
+  llvm::Error Restore(IteratorStateReader* reader) override {
+    int64_t index;
+    if (auto error = reader->ReadInt(&index)) return error;
+    if (index < 0 || index > end_ - parent_dataset_->data_.begin()) {
+      return MakeStringError("invalid slice_dataset iterator state");
+    }
+    iterator_ = parent_dataset_->data_.begin() + index;
+    return llvm::Error::success();
   }
 
  private:
+  friend class SliceDataset<T>;
+
+  static std::tuple<T> CopyElement(const T& element) {
+    return std::make_tuple(element);
+  }
+
   // This class is not copyable or movable.
   SliceDatasetIterator(const SliceDatasetIterator&) = delete;
   SliceDatasetIterator& operator=(const SliceDatasetIterator&) = delete;
@@ -102,18 +153,10 @@ class SliceDatasetIterator : public Iterator<T> {
 // not have copy constructor. This implementation passes DenseHostTensor by
 // reference.
 template <>
-inline AsyncValueRef<std::tuple<DenseHostTensor>>
-SliceDatasetIterator<DenseHostTensor>::GetNext(
-    const ExecutionContext& exec_ctx) {
-  if (iterator_ == end_) {
-    return AsyncValueRef<std::tuple<DenseHostTensor>>();
-  }
-
-  DenseHostTensor& element = *iterator_;
-  iterator_++;
-  return exec_ctx.host()
-      ->template MakeConcreteAsyncValueRef<std::tuple<DenseHostTensor>>(
-          std::make_tuple(element.CopyRef()));
+inline std::tuple<DenseHostTensor>
+SliceDatasetIterator<DenseHostTensor>::CopyElement(
+    const DenseHostTensor& element) {
+  return std::make_tuple(element.CopyRef());
 }
 
 template <typename T>
@@ -122,6 +165,20 @@ RCReference<Iterator<T>> SliceDataset<T>::MakeIterator() {
       FormRef(this), data_.begin(), data_.end()));
 }
 
+template <typename T>
+RCReference<Dataset<T>> SliceDataset<T>::MakeShard(int64_t num_shards,
+                                                   int64_t index) {
+  const int64_t size = data_.size();
+  std::vector<T> data;
+  data.reserve(std::max<int64_t>(size - index + num_shards - 1, 0) /
+               num_shards);
+  for (int64_t i = index; i < size; i += num_shards) {
+    data.push_back(
+        std::move(std::get<0>(SliceDatasetIterator<T>::CopyElement(data_[i]))));
+  }
+  return TakeRef(host_->Construct<SliceDataset<T>>(std::move(data), host_));
+}
+
 }  // namespace data
 }  // namespace tfrt
 
@@ -0,0 +1,175 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- take_dataset.h -------------------------------------------*- C++ -*-===//
+//
+// This file declares TakeDataset class which wraps around another Dataset
+// instance and yields at most `count` of its elements.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef TFRT_DATA_TAKE_DATASET_H_
+#define TFRT_DATA_TAKE_DATASET_H_
+
+#include <algorithm>
+
+#include "dataset.h"
+
+namespace tfrt {
+namespace data {
+
+template <typename... T>
+class TakeDatasetIterator;
+
+// TakeDataset yields the first `count` elements of its input dataset, or all
+// of them if `count` is negative.
+//
+// The iterators release their input iterator as soon as they return the last
+// element, so that the input pipeline stops reading ahead, e.g. in
+// PrefetchDataset, and closes its files.
+template <typename... T>
+class TakeDataset : public Dataset<T...> {
+ public:
+  explicit TakeDataset(RCReference<Dataset<T...>> input_dataset,
+                       int64_t count, HostContext* host)
+      : input_dataset_(std::move(input_dataset)),
+        count_(count),
+        host_(host),
+        allocator_(host->allocator()) {}
+
+  // This class is not copyable or movable.
+  TakeDataset(const TakeDataset&) = delete;
+  TakeDataset& operator=(const TakeDataset&) = delete;
+
+  RCReference<Iterator<T...>> MakeIterator() override;
+
+  bool IsBlocking() const override { return input_dataset_->IsBlocking(); }
+
+ private:
+  friend class TakeDatasetIterator<T...>;
+
+  void Destroy() override {
+    internal::DestroyImpl<TakeDataset<T...>>(this, allocator_);
+  }
+
+  RCReference<Dataset<T...>> input_dataset_;
+  const int64_t count_;
+  HostContext* host_;
+  HostAllocator* allocator_;
+};
+
+template <typename... T>
+class TakeDatasetIterator : public Iterator<T...> {
+ public:
+  explicit TakeDatasetIterator(RCReference<TakeDataset<T...>> dataset)
+      : Iterator<T...>(), parent_dataset_(std::move(dataset)) {
+    if (parent_dataset_->count_ != 0) {
+      input_iterator_ = parent_dataset_->input_dataset_->MakeIterator();
+    }
+  }
+
+  // This class is not copyable or movable.
+  TakeDatasetIterator(const TakeDatasetIterator&) = delete;
+  TakeDatasetIterator& operator=(const TakeDatasetIterator&) = delete;
+
+  AsyncValueRef<std::tuple<T...>> GetNext(
+      const ExecutionContext& exec_ctx) override {
+    if (!input_iterator_) return AsyncValueRef<std::tuple<T...>>();
+    auto value = input_iterator_->GetNext(exec_ctx);
+    if (!value) {
+      input_iterator_.reset();
+      return value;
+    }
+    if (++num_taken_ == parent_dataset_->count_) input_iterator_.reset();
+    this->stats_.RecordElement();
+    return value;
+  }
+
+  AsyncValueRef<std::vector<std::tuple<T...>>> GetNextBatch(
+      const ExecutionContext& exec_ctx, int64_t max_n) override {
+    using Batch = std::vector<std::tuple<T...>>;
+    if (GetBatchMode() == Iterator<T...>::BatchMode::kElementwise) {
+      return Iterator<T...>::GetNextBatch(exec_ctx, max_n);
+    }
+    if (!input_iterator_) return AsyncValueRef<Batch>();
+    const int64_t count = parent_dataset_->count_;
+    const int64_t n =
+        count < 0 ? max_n : std::min<int64_t>(max_n, count - num_taken_);
+    auto batch = input_iterator_->GetNextBatch(exec_ctx, n);
+    // A batch has fewer than `n` elements only at the end of the input, so
+    // that its size is not needed to count the elements taken.
+    num_taken_ += n;
+    if (!batch || num_taken_ == count) input_iterator_.reset();
+    if (batch) {
+      batch.AndThen([iterator = FormRef(this), batch = batch.CopyRef()]() {
+        if (!batch.IsError()) {
+          iterator->stats_.RecordElements(batch.get().size());
+        }
+      });
+    }
+    return batch;
+  }
+
+  // The batches of the input are truncated to the remaining count.
+  typename Iterator<T...>::BatchMode GetBatchMode() const override {
+    return input_iterator_ ? input_iterator_->GetBatchMode()
+                           : Iterator<T...>::BatchMode::kSync;
+  }
+
+  // The state is the number of elements taken, followed by the state of the
+  // input iterator if it is not released.
+  llvm::Error Save(IteratorStateWriter* writer) override {
+    writer->WriteInt(num_taken_);
+    writer->WriteInt(static_cast<bool>(input_iterator_));
+    if (!input_iterator_) return llvm::Error::success();
+    return input_iterator_->Save(writer);
+  }
+
+  llvm::Error Restore(IteratorStateReader* reader) override {
+    int64_t has_input;
+    if (auto error = reader->ReadInt(&num_taken_)) return error;
+    if (auto error = reader->ReadInt(&has_input)) return error;
+    if (!has_input) {
+      input_iterator_.reset();
+      return llvm::Error::success();
+    }
+    if (!input_iterator_) {
+      return MakeStringError("invalid take_dataset iterator state");
+    }
+    return input_iterator_->Restore(reader);
+  }
+
+ private:
+  void Destroy() override {
+    internal::DestroyImpl<TakeDatasetIterator>(this,
+                                               parent_dataset_->allocator_);
+  }
+
+  RCReference<TakeDataset<T...>> parent_dataset_;
+  // Null once the iterator reached end.
+  RCReference<Iterator<T...>> input_iterator_;
+  int64_t num_taken_ = 0;
+};
+
+template <typename... T>
+RCReference<Iterator<T...>> TakeDataset<T...>::MakeIterator() {
+  return TakeRef(host_->Construct<TakeDatasetIterator<T...>>(FormRef(this)));
+}
+
+}  // namespace data
+}  // namespace tfrt
+
+#endif  // TFRT_DATA_TAKE_DATASET_H_
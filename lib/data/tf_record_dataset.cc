@@ -21,43 +21,41 @@
 
 #include "tf_record_dataset.h"
 
+#include <algorithm>
+
 #include "tfrt/support/error_util.h"
 
 namespace tfrt {
 namespace data {
 
 namespace {
-// The following is copied from tensorflow/core/platform/raw_coding.h
-static const bool kLittleEndian = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
-
-inline uint32_t DecodeFixed32(const char* ptr) {
-  if (kLittleEndian) {
-    // Load the raw bytes
-    uint32_t result;
-    memcpy(&result, ptr,
-           sizeof(result));  // gcc optimizes this to a plain load
-    return result;
-  } else {
-    return ((static_cast<uint32_t>(static_cast<unsigned char>(ptr[0]))) |
-            (static_cast<uint32_t>(static_cast<unsigned char>(ptr[1])) << 8) |
-            (static_cast<uint32_t>(static_cast<unsigned char>(ptr[2])) << 16) |
-            (static_cast<uint32_t>(static_cast<unsigned char>(ptr[3])) << 24));
-  }
-}
 
-inline uint64_t DecodeFixed64(const char* ptr) {
-  if (kLittleEndian) {
-    // Load the raw bytes
-    uint64_t result;
-    memcpy(&result, ptr,
-           sizeof(result));  // gcc optimizes this to a plain load
-    return result;
-  } else {
-    uint64_t lo = DecodeFixed32(ptr);
-    uint64_t hi = DecodeFixed32(ptr + 4);
-    return (hi << 32) | lo;
+// Minimum size of the chunks read in parallel.
+constexpr uint64_t kChunkSize = 4 << 20;
+
+// Reads the records of the shard with index in [first, first + n) into
+// strings.
+llvm::Expected<std::vector<std::string>> ReadChunk(
+    const std::string& path, const TFRecordIndex& index, int64_t num_shards,
+    int64_t shard_index, int64_t first, int64_t n, HostAllocator* allocator) {
+  TFRecordReader reader(path, TFRecordReader::Options(), allocator);
+  std::vector<std::string> records;
+  records.reserve(n);
+  for (int64_t i = first; i < first + n; ++i) {
+    const uint64_t offset = index.offset(shard_index + i * num_shards);
+    if (reader.offset() != offset) reader.Seek(offset);
+    bool eof = false;
+    auto record = reader.ReadRecord(&eof);
+    if (eof) {
+      return MakeStringError("unexpected end of file at offset ", offset,
+                             " in ", path, ", the index is stale");
+    }
+    if (!record) return record.takeError();
+    records.push_back(record->data.str());
   }
+  return std::move(records);
 }
+
 }  // namespace
 
 //===----------------------------------------------------------------------===//
@@ -68,90 +66,218 @@ RCReference<Iterator<std::string>> TFRecordDataset::MakeIterator() {
   return TakeRef(host_->Construct<TFRecordDatasetIterator>(FormRef(this)));
 }
 
+llvm::Expected<const TFRecordIndex*> TFRecordDataset::GetIndex() {
+  mutex_lock lock(index_->mu);
+  if (!index_->index) {
+    auto index = TFRecordIndex::Load(path_, allocator_);
+    if (!index) return index.takeError();
+    index_->index.emplace(std::move(*index));
+  }
+  return index_->index.getPointer();
+}
+
 //===----------------------------------------------------------------------===//
 // Implementation for TFRecordDatasetIterator member functions
 //===----------------------------------------------------------------------===//
 AsyncValueRef<std::tuple<std::string>> TFRecordDatasetIterator::GetNext(
     const ExecutionContext& exec_ctx) {
+  if (parent_dataset_->num_parallel_reads_ > 1) {
+    return GetNextInParallel(exec_ctx);
+  }
+
+  const int64_t start_ns = IteratorStats::Now();
   bool eof = false;
-  auto result = ReadRecord(&eof);
+  if (auto error = SkipRecords(&eof)) {
+    stats_.RecordElement();
+    return EmitErrorAsync(exec_ctx, std::move(error));
+  }
+  if (eof) return AsyncValueRef<std::tuple<std::string>>();
+  auto record = reader_.ReadRecord(&eof);
   if (eof) {
     return AsyncValueRef<std::tuple<std::string>>();
   }
-  if (!result) {
-    return EmitErrorAsync(exec_ctx, result.takeError());
+  num_to_skip_ = parent_dataset_->num_shards_ - 1;
+  ++next_record_;
+  stats_.RecordElement();
+  if (!record) {
+    return EmitErrorAsync(exec_ctx, record.takeError());
   }
-  return exec_ctx.host()->MakeConcreteAsyncValueRef<std::tuple<std::string>>(
-      std::move(*result));
+  auto value =
+      exec_ctx.host()->MakeConcreteAsyncValueRef<std::tuple<std::string>>(
+          record->data.str());
+  stats_.AddProduceTime(IteratorStats::Now() - start_ns);
+  return value;
 }
 
-// Logic based on tensorflow/core/io/record_reader.*
-// Note: RecordReader maintains the offset. For now, we're relying on
-// ifstream reading sequentially.
-llvm::Expected<std::string> TFRecordDatasetIterator::ReadChecksummed(
-    size_t n, bool* eof) {
-  // The crc has size uint32.
-  const size_t to_read = n + sizeof(uint32_t);
-
-  std::string result;
-  result.clear();
-  result.resize(to_read);
-
-  char* buffer = &result[0];
-  stream_.read(buffer, to_read);
-
-  if (stream_.eof()) {
-    if (stream_.gcount() == 0) {
-      // The previous record read was the final one. We're trying to read past
-      // the end of the file, but there's nothing left.
-      *eof = true;
-      return MakeStringError("end of file");
-    }
-    // Unable to read the full to_read number of bytes; this is
-    // a partial record.
+llvm::Error TFRecordDatasetIterator::Save(IteratorStateWriter* writer) {
+  if (parent_dataset_->num_parallel_reads_ > 1 && index_) {
+    // The records of the chunks that are not returned yet are read again.
+    int64_t next = next_chunk_record_ + chunk_position_;
+    for (const auto& chunk : chunks_) next -= chunk.num_records;
+    const int64_t record = std::min<int64_t>(
+        parent_dataset_->shard_index_ + next * parent_dataset_->num_shards_,
+        index_->num_records());
+    writer->WriteInt(index_->offset(record));
+    writer->WriteInt(record);
+    writer->WriteInt(0);
+    return llvm::Error::success();
+  }
+  writer->WriteInt(reader_.offset());
+  writer->WriteInt(next_record_);
+  writer->WriteInt(num_to_skip_);
+  return llvm::Error::success();
+}
+
+llvm::Error TFRecordDatasetIterator::Restore(IteratorStateReader* reader) {
+  int64_t offset, next_record, num_to_skip;
+  if (auto error = reader->ReadInt(&offset)) return error;
+  if (auto error = reader->ReadInt(&next_record)) return error;
+  if (auto error = reader->ReadInt(&num_to_skip)) return error;
+  const int64_t num_shards = parent_dataset_->num_shards_;
+  const int64_t shard_record =
+      next_record + num_to_skip - parent_dataset_->shard_index_;
+  if (offset < 0 || next_record < 0 || num_to_skip < 0 || shard_record < 0 ||
+      shard_record % num_shards != 0) {
+    return MakeStringError("invalid tf_record_dataset iterator state");
   }
-  if (stream_.fail()) {
-    return MakeStringError("failed to read data from stream");
+  next_record_ = next_record;
+  num_to_skip_ = num_to_skip;
+  if (parent_dataset_->num_parallel_reads_ > 1) {
+    next_chunk_record_ = shard_record / num_shards;
+  } else {
+    reader_.Seek(offset);
   }
+  return llvm::Error::success();
+}
 
-  // TODO(rachelim): Check the checksum.
+llvm::Error TFRecordDatasetIterator::SkipRecords(bool* eof) {
+  if (num_to_skip_ == 0) return llvm::Error::success();
 
-  result.resize(n);
-  return result;
-}
+  // Compressed files have no index, and their records are skipped by
+  // inflating them.
+  if (!index_loaded_ &&
+      parent_dataset_->compression_ == TFRecordReader::Compression::kNone) {
+    index_loaded_ = true;
+    // The errors of the file are reported when it is read.
+    auto index = parent_dataset_->GetIndex();
+    if (index) {
+      index_ = *index;
+    } else {
+      llvm::consumeError(index.takeError());
+    }
+  }
+  if (index_) {
+    next_record_ += num_to_skip_;
+    num_to_skip_ = 0;
+    if (next_record_ >= static_cast<int64_t>(index_->num_records())) {
+      *eof = true;
+    } else {
+      reader_.Seek(index_->offset(next_record_));
+    }
+    return llvm::Error::success();
+  }
 
-// TODO(rachelim): Instead of having a bool* eof, consider subclassing
-// ErrorInfo and returning a special error type for eof.
-llvm::Expected<std::string> TFRecordDatasetIterator::ReadRecord(bool* eof) {
-  if (stream_.eof() && stream_.gcount() == 0) {
-    *eof = true;
-    return MakeStringError("end of file");
+  for (; num_to_skip_ > 0; --num_to_skip_, ++next_record_) {
+    if (auto error = reader_.SkipRecord(eof)) return error;
+    if (*eof) break;
   }
+  return llvm::Error::success();
+}
 
-  if (stream_.fail()) {
-    return MakeStringError("failed to read file: ", parent_dataset_->path_);
+AsyncValueRef<std::tuple<std::string>>
+TFRecordDatasetIterator::GetNextInParallel(const ExecutionContext& exec_ctx) {
+  if (!index_loaded_) {
+    index_loaded_ = true;
+    auto index = parent_dataset_->GetIndex();
+    if (!index) {
+      stats_.RecordElement();
+      return EmitErrorAsync(exec_ctx, index.takeError());
+    }
+    index_ = *index;
   }
+  // The iterator ends after failing to load the index.
+  if (!index_) return AsyncValueRef<std::tuple<std::string>>();
 
-  // Read header.
-  auto header = ReadChecksummed(sizeof(uint64_t), eof);
-  if (*eof) {
-    return MakeStringError("end of file");
+  ReadChunks(exec_ctx);
+  if (chunks_.empty()) return AsyncValueRef<std::tuple<std::string>>();
+  auto records = chunks_.front().records.CopyRef();
+  const int64_t position = chunk_position_++;
+  if (chunk_position_ == chunks_.front().num_records) {
+    chunks_.pop_front();
+    chunk_position_ = 0;
+    ReadChunks(exec_ctx);
   }
+  stats_.RecordElement();
 
-  if (!header) {
-    return header.takeError();
+  if (records.IsAvailable()) {
+    if (records.IsError()) {
+      return AsyncValueRef<std::tuple<std::string>>(records.CopyRCRef());
+    }
+    return exec_ctx.host()->MakeConcreteAsyncValueRef<std::tuple<std::string>>(
+        std::move(records.get()[position]));
   }
-  const uint64_t length = DecodeFixed64(header->data());
+  auto value = exec_ctx.host()
+                   ->MakeUnconstructedAsyncValueRef<std::tuple<std::string>>();
+  records.AndThen([records = records.CopyRef(), position,
+                   value = value.CopyRef()]() {
+    if (records.IsError()) {
+      value.SetError(records.GetError());
+      return;
+    }
+    // Every record is moved out of the chunk by a single GetNext call.
+    value.emplace(std::move(records.get()[position]));
+  });
+  return value;
+}
 
-  // Read body.
-  auto body = ReadChecksummed(length, eof);
-  if (*eof) {
-    // Successfully read the header, but got eof on the body, i.e. this is
-    // a partial record. Raise an error.
-    *eof = false;
-    return MakeStringError("failed to read body of TFRecord");
+void TFRecordDatasetIterator::ReadChunks(const ExecutionContext& exec_ctx) {
+  const int64_t num_shards = parent_dataset_->num_shards_;
+  const int64_t shard_index = parent_dataset_->shard_index_;
+  const int64_t num_records = index_->num_records();
+  const int64_t num_shard_records =
+      shard_index < num_records
+          ? (num_records - shard_index + num_shards - 1) / num_shards
+          : 0;
+
+  while (static_cast<int64_t>(chunks_.size()) <
+             parent_dataset_->num_parallel_reads_ &&
+         next_chunk_record_ < num_shard_records) {
+    // The chunk holds at least kChunkSize bytes, or the remaining records.
+    const int64_t first = next_chunk_record_;
+    uint64_t chunk_size = 0;
+    while (next_chunk_record_ < num_shard_records && chunk_size < kChunkSize) {
+      chunk_size +=
+          index_->record_size(shard_index + next_chunk_record_ * num_shards);
+      ++next_chunk_record_;
+    }
+    const int64_t n = next_chunk_record_ - first;
+
+    HostContext* host = exec_ctx.host();
+    auto records =
+        host->MakeUnconstructedAsyncValueRef<std::vector<std::string>>();
+    auto read = [dataset = parent_dataset_.get(), index = index_, num_shards,
+                 shard_index, first, n,
+                 exec_ctx](AsyncValueRef<std::vector<std::string>> records) {
+      auto chunk = ReadChunk(dataset->path_, *index, num_shards, shard_index,
+                             first, n, dataset->allocator_);
+      if (!chunk) {
+        records.SetError(
+            EmitError(exec_ctx, llvm::toString(chunk.takeError())));
+        return;
+      }
+      records.emplace(std::move(*chunk));
+    };
+    // The task keeps the dataset, and thus the index, alive.
+    if (!host->EnqueueBlockingWork(
+            [read, dataset = parent_dataset_.CopyRef(),
+             records = records.CopyRef()]() mutable {
+              read(std::move(records));
+            })) {
+      // The blocking work queue is overloaded. Read the chunk inline.
+      read(records.CopyRef());
+    }
+    chunks_.push_back(Chunk{n, std::move(records)});
   }
-  return body;
 }
 
 }  // namespace data
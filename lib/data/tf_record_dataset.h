@@ -24,23 +24,74 @@
 #ifndef TFRT_LIB_DATA_TF_RECORD_DATASET_H_
 #define TFRT_LIB_DATA_TF_RECORD_DATASET_H_
 
-#include <fstream>
+#include <deque>
+#include <memory>
 
 #include "dataset.h"
+#include "llvm/ADT/Optional.h"
+#include "tf_record_index.h"
+#include "tf_record_reader.h"
 #include "tfrt/support/forward_decls.h"
+#include "tfrt/support/mutex.h"
 
 namespace tfrt {
 namespace data {
 
 // TFRecordDataset reads TFRecord bytes from a file.
+//
+// If `num_parallel_reads` is greater than 1, the file is read as a sequence of
+// chunks of consecutive records, and up to `num_parallel_reads` chunks are
+// read in parallel on the blocking work queue. The records are still returned
+// in file order. This requires the TFRecordIndex of the file, which is loaded
+// from its sidecar file, or built and written by the first iterator.
+//
+// ZLIB and GZIP compressed files are inflated on the blocking work queue
+// ahead of the records being parsed, see InflateStream. They cannot be read
+// from an arbitrary record, so they are always read sequentially and without
+// an index.
+//
 // TODO(rachelim): Consider using a custom data type to represent the
-// bytes read from a TFRecord file. This will make the code more type safe
-// and allow for future optimizations to use mmap instead of copying bytes
-// from the file onto the heap.
+// bytes read from a TFRecord file. TFRecordReader reads the records without
+// copying them, but they are still copied from the file buffer into strings.
 class TFRecordDataset : public Dataset<std::string> {
  public:
-  explicit TFRecordDataset(std::string path, HostContext* host)
-      : path_(std::move(path)), host_(host), allocator_(host->allocator()) {}
+  explicit TFRecordDataset(std::string path, int64_t num_parallel_reads,
+                           HostContext* host)
+      : TFRecordDataset(std::move(path), num_parallel_reads,
+                        TFRecordReader::Compression::kNone, host) {}
+
+  TFRecordDataset(std::string path, int64_t num_parallel_reads,
+                  TFRecordReader::Compression compression, HostContext* host)
+      : TFRecordDataset(std::move(path), num_parallel_reads, compression,
+                        /*num_shards=*/1, /*shard_index=*/0,
+                        std::make_shared<SharedIndex>(), host) {}
+
+  // The index of the file, which is loaded once for a dataset and its shards.
+  struct SharedIndex {
+    mutex mu;
+    // The index is immutable once it is loaded.
+    llvm::Optional<TFRecordIndex> index TFRT_GUARDED_BY(mu);
+  };
+
+  // Reads the records whose index modulo `num_shards` is `shard_index`. The
+  // iterators seek to these records if the file has an index. Otherwise, the
+  // other records are skipped without reading their body.
+  TFRecordDataset(std::string path, int64_t num_parallel_reads,
+                  TFRecordReader::Compression compression, int64_t num_shards,
+                  int64_t shard_index, std::shared_ptr<SharedIndex> index,
+                  HostContext* host)
+      : path_(std::move(path)),
+        num_parallel_reads_(compression == TFRecordReader::Compression::kNone
+                                ? num_parallel_reads
+                                : 1),
+        compression_(compression),
+        num_shards_(num_shards),
+        shard_index_(shard_index),
+        index_(std::move(index)),
+        host_(host),
+        allocator_(host->allocator()) {
+    assert(num_parallel_reads > 0);
+  }
 
   // This class is not copyable or movable.
   TFRecordDataset(const TFRecordDataset&) = delete;
@@ -48,6 +99,17 @@ class TFRecordDataset : public Dataset<std::string> {
 
   RCReference<Iterator<std::string>> MakeIterator() override;
 
+  // GetNext reads from the file synchronously, unless the file is read in
+  // parallel.
+  bool IsBlocking() const override { return true; }
+
+  RCReference<Dataset<std::string>> MakeShard(int64_t num_shards,
+                                              int64_t index) override {
+    return TakeRef(host_->Construct<TFRecordDataset>(
+        path_, num_parallel_reads_, compression_, num_shards_ * num_shards,
+        shard_index_ + num_shards_ * index, index_, host_));
+  }
+
  private:
   friend class TFRecordDatasetIterator;
 
@@ -55,7 +117,16 @@ class TFRecordDataset : public Dataset<std::string> {
     internal::DestroyImpl<TFRecordDataset>(this, allocator_);
   }
 
+  // Returns the index of the file, loading it on the first call for the
+  // dataset and its shards.
+  llvm::Expected<const TFRecordIndex*> GetIndex();
+
   const std::string path_;
+  const int64_t num_parallel_reads_;
+  const TFRecordReader::Compression compression_;
+  const int64_t num_shards_;
+  const int64_t shard_index_;
+  const std::shared_ptr<SharedIndex> index_;
   HostContext* host_;
   HostAllocator* allocator_;
 };
@@ -65,7 +136,9 @@ class TFRecordDatasetIterator : public Iterator<std::string> {
   explicit TFRecordDatasetIterator(RCReference<TFRecordDataset> parent_dataset)
       : Iterator<std::string>(),
         parent_dataset_(std::move(parent_dataset)),
-        stream_(parent_dataset_->path_.c_str(), std::ios_base::binary) {}
+        reader_(parent_dataset_->path_, MakeReaderOptions(*parent_dataset_),
+                parent_dataset_->allocator_),
+        num_to_skip_(parent_dataset_->shard_index_) {}
 
   // This class is not copyable or movable.
   TFRecordDatasetIterator(const TFRecordDatasetIterator&) = delete;
@@ -74,30 +147,60 @@ class TFRecordDatasetIterator : public Iterator<std::string> {
   AsyncValueRef<std::tuple<std::string>> GetNext(
       const ExecutionContext& exec_ctx) override;
 
+  // The state is the file offset of the next record, its index in the file,
+  // and the number of records of the other shards to skip before the next
+  // record of the shard. Restore seeks to the offset, or starts reading the
+  // chunks from the next record if the file is read in parallel.
+  llvm::Error Save(IteratorStateWriter* writer) override;
+
+  llvm::Error Restore(IteratorStateReader* reader) override;
+
  private:
+  // A chunk of consecutive records of the shard read in parallel.
+  struct Chunk {
+    int64_t num_records;
+    AsyncValueRef<std::vector<std::string>> records;
+  };
+
   void Destroy() override {
     internal::DestroyImpl<TFRecordDatasetIterator>(this,
                                                    parent_dataset_->allocator_);
   }
 
-  // Reads n + 4 bytes from the input stream and verifies that the checksum of
-  // the first n bytes is stored in the last 4 bytes. Updates *eof to true
-  // iff stream_ is already at eof and no bytes are read. Returns an error if
-  // less than n + 4 bytes can be read, or the checksum doesn't match.
-  // Otherwise, advances the input stream by n + 4 bytes and returns the first
-  // n bytes.
-  // If eof is set to true, caller should not process the return value.
-  llvm::Expected<std::string> ReadChecksummed(size_t n, bool* eof);
-
-  // Reads a record from the input stream and advances the input stream to point
-  // to the start of the next record. Updates *eof to true iff stream_ is
-  // already at the end of file and there is no error. Otherwise, returns the
-  // record or an error. If eof is set to true, caller should not process the
-  // return value.
-  llvm::Expected<std::string> ReadRecord(bool* eof);
+  static TFRecordReader::Options MakeReaderOptions(
+      const TFRecordDataset& dataset) {
+    TFRecordReader::Options options;
+    options.compression = dataset.compression_;
+    options.host = dataset.host_;
+    return options;
+  }
+
+  // Skips the records of the other shards before the next record of the
+  // shard. Seeks to the next record if the file has an index.
+  llvm::Error SkipRecords(bool* eof);
+
+  AsyncValueRef<std::tuple<std::string>> GetNextInParallel(
+      const ExecutionContext& exec_ctx);
+
+  // Starts reading chunks until `num_parallel_reads` chunks are in flight.
+  void ReadChunks(const ExecutionContext& exec_ctx);
 
   RCReference<TFRecordDataset> parent_dataset_;
-  std::ifstream stream_;
+  TFRecordReader reader_;
+  // Number of records to skip before the next record of the shard.
+  int64_t num_to_skip_;
+  // Index of the next record in the file.
+  int64_t next_record_ = 0;
+  // The index of the file, if it is loaded.
+  const TFRecordIndex* index_ = nullptr;
+  bool index_loaded_ = false;
+
+  // The chunks read in parallel, in file order, and the position of the next
+  // record in the first chunk.
+  std::deque<Chunk> chunks_;
+  int64_t chunk_position_ = 0;
+  // Index in the shard of the first record of the next chunk to read.
+  int64_t next_chunk_record_ = 0;
 };
 
 }  // namespace data
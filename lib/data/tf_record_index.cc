@@ -0,0 +1,181 @@
+// Copyright 2020 The TensorFlow Runtime Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//===- tf_record_index.cc -------------------------------------------------===//
+//
+// This file implements TFRecordIndex class which holds the record offsets of a
+// TFRecord file.
+//
+//===----------------------------------------------------------------------===//
+
+#include "tf_record_index.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "tf_record_reader.h"
+#include "tfrt/support/crc32c.h"
+#include "tfrt/support/error_util.h"
+#include "tfrt/support/string_util.h"
+
+namespace tfrt {
+namespace data {
+
+namespace {
+
+constexpr char kMagic[] = "TFRIDX01";
+constexpr size_t kMagicSize = sizeof(kMagic) - 1;
+
+void AppendFixed(std::string* out, uint64_t value, size_t size) {
+  for (size_t i = 0; i < size; ++i) out->push_back((value >> (8 * i)) & 0xff);
+}
+
+// Returns whether the file of `a` was last modified before the file of `b`.
+bool ModifiedBefore(const struct stat& a, const struct stat& b) {
+  if (a.st_mtim.tv_sec != b.st_mtim.tv_sec) {
+    return a.st_mtim.tv_sec < b.st_mtim.tv_sec;
+  }
+  return a.st_mtim.tv_nsec < b.st_mtim.tv_nsec;
+}
+
+uint64_t DecodeFixed(const char* ptr, size_t size) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < size; ++i) {
+    value |= static_cast<uint64_t>(static_cast<unsigned char>(ptr[i]))
+             << (8 * i);
+  }
+  return value;
+}
+
+}  // namespace
+
+llvm::Expected<TFRecordIndex> TFRecordIndex::Build(const std::string& path,
+                                                   HostAllocator* allocator) {
+  // Only the headers are read, so memory mapping avoids reading the bodies.
+  TFRecordReader reader(path, TFRecordReader::Options(), allocator);
+  std::vector<uint64_t> offsets;
+  while (true) {
+    const uint64_t offset = reader.offset();
+    bool eof = false;
+    if (auto error = reader.SkipRecord(&eof)) return std::move(error);
+    offsets.push_back(offset);
+    if (eof) break;
+  }
+  return TFRecordIndex(std::move(offsets));
+}
+
+llvm::Expected<TFRecordIndex> TFRecordIndex::Read(
+    const std::string& index_path) {
+  std::ifstream in(index_path, std::ios_base::binary);
+  if (!in) return MakeStringError("failed to open file ", index_path);
+  const std::string data((std::istreambuf_iterator<char>(in)),
+                         std::istreambuf_iterator<char>());
+  if (in.bad()) return MakeStringError("failed to read file ", index_path);
+
+  const size_t header_size = kMagicSize + sizeof(uint64_t);
+  if (data.size() < header_size + sizeof(uint64_t) + sizeof(uint32_t) ||
+      data.compare(0, kMagicSize, kMagic) != 0) {
+    return MakeStringError("invalid TFRecord index ", index_path);
+  }
+  const uint64_t num_records =
+      DecodeFixed(data.data() + kMagicSize, sizeof(uint64_t));
+  const size_t crc_offset = data.size() - sizeof(uint32_t);
+  if ((crc_offset - header_size) / sizeof(uint64_t) != num_records + 1 ||
+      (crc_offset - header_size) % sizeof(uint64_t) != 0) {
+    return MakeStringError("invalid TFRecord index ", index_path);
+  }
+  if (crc32c::Unmask(DecodeFixed(data.data() + crc_offset,
+                                 sizeof(uint32_t))) !=
+      crc32c::Value(data.data(), crc_offset)) {
+    return MakeStringError("corrupted TFRecord index ", index_path);
+  }
+
+  std::vector<uint64_t> offsets(num_records + 1);
+  for (uint64_t i = 0; i <= num_records; ++i) {
+    offsets[i] = DecodeFixed(data.data() + header_size + i * sizeof(uint64_t),
+                             sizeof(uint64_t));
+  }
+  return TFRecordIndex(std::move(offsets));
+}
+
+llvm::Expected<TFRecordIndex> TFRecordIndex::Load(const std::string& path,
+                                                  HostAllocator* allocator) {
+  struct stat stat_buf;
+  if (stat(path.c_str(), &stat_buf) != 0) {
+    return MakeStringError("failed to stat file ", path, ": ",
+                           strerror(errno));
+  }
+
+  // The index is stale if the file was modified after the index was written,
+  // even if its size did not change.
+  const std::string index_path = GetIndexPath(path);
+  struct stat index_stat_buf;
+  if (stat(index_path.c_str(), &index_stat_buf) == 0 &&
+      !ModifiedBefore(index_stat_buf, stat_buf)) {
+    auto index = Read(index_path);
+    if (index &&
+        index->offsets_.back() == static_cast<uint64_t>(stat_buf.st_size)) {
+      return std::move(*index);
+    }
+    llvm::consumeError(index.takeError());
+  }
+
+  auto index = Build(path, allocator);
+  if (!index) return index.takeError();
+  llvm::consumeError(index->Write(index_path));
+  return std::move(*index);
+}
+
+llvm::Error TFRecordIndex::Write(const std::string& index_path) const {
+  std::string data(kMagic, kMagicSize);
+  data.reserve(kMagicSize + (offsets_.size() + 1) * sizeof(uint64_t) +
+               sizeof(uint32_t));
+  AppendFixed(&data, num_records(), sizeof(uint64_t));
+  for (uint64_t offset : offsets_) {
+    AppendFixed(&data, offset, sizeof(uint64_t));
+  }
+  AppendFixed(&data, crc32c::Mask(crc32c::Value(data.data(), data.size())),
+              sizeof(uint32_t));
+
+  // Write a temporary file that is unique to this call, as other threads and
+  // processes may write the same index, and rename it.
+  static std::atomic<uint64_t> next_tmp_id{0};
+  const std::string tmp_path =
+      StrCat(index_path, ".tmp.", getpid(), ".", next_tmp_id++);
+  {
+    std::ofstream out(tmp_path, std::ios_base::binary | std::ios_base::trunc);
+    out.write(data.data(), data.size());
+    out.close();
+    if (!out) {
+      std::remove(tmp_path.c_str());
+      return MakeStringError("failed to write file ", tmp_path);
+    }
+  }
+  if (std::rename(tmp_path.c_str(), index_path.c_str()) != 0) {
+    std::remove(tmp_path.c_str());
+    return MakeStringError("failed to rename file ", tmp_path, " to ",
+                           index_path, ": ", strerror(errno));
+  }
+  return llvm::Error::success();
+}
+
+}  // namespace data
+}  // namespace tfrt
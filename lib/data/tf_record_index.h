@@ -0,0 +1,98 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- tf_record_index.h ----------------------------------------*- C++ -*-===//
+//
+// This file declares TFRecordIndex class which holds the record offsets of a
+// TFRecord file.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef TFRT_LIB_DATA_TF_RECORD_INDEX_H_
+#define TFRT_LIB_DATA_TF_RECORD_INDEX_H_
+
+#include <string>
+#include <vector>
+
+#include "llvm/Support/Error.h"
+#include "tfrt/host_context/host_allocator.h"
+#include "tfrt/support/forward_decls.h"
+
+namespace tfrt {
+namespace data {
+
+// TFRecordIndex holds the file offsets of the records of a TFRecord file, so
+// that the file can be read from any record with TFRecordReader::Seek, e.g. to
+// read parts of the file in parallel or to resume reading mid-file.
+//
+// The index is stored in a sidecar file next to the TFRecord file, see
+// GetIndexPath. It holds the magic "TFRIDX01", the number of records N, the
+// N + 1 offsets of the records and of the end of the last record, and the
+// masked CRC32C of the preceding bytes, all little endian. An index file is
+// stale if the TFRecord file was modified after it, or if the size of the
+// TFRecord file is not the end offset.
+class TFRecordIndex {
+ public:
+  // Builds the index of the TFRecord file at `path` by reading its record
+  // headers.
+  static llvm::Expected<TFRecordIndex> Build(const std::string& path,
+                                             HostAllocator* allocator);
+
+  // Reads the index file at `index_path`.
+  static llvm::Expected<TFRecordIndex> Read(const std::string& index_path);
+
+  // Returns the index of the TFRecord file at `path` from its sidecar file.
+  // If there is no sidecar file or it is stale, builds the index and writes
+  // the sidecar file, so that the file is only scanned the first time.
+  // Failures to write the sidecar file are ignored, e.g. for read-only
+  // directories.
+  static llvm::Expected<TFRecordIndex> Load(const std::string& path,
+                                            HostAllocator* allocator);
+
+  // Returns the path of the sidecar index file of the TFRecord file at
+  // `path`.
+  static std::string GetIndexPath(const std::string& path) {
+    return path + ".index";
+  }
+
+  // Writes the index file at `index_path`. The file is replaced atomically,
+  // so that concurrent readers never see a partial index.
+  llvm::Error Write(const std::string& index_path) const;
+
+  size_t num_records() const { return offsets_.size() - 1; }
+
+  // Returns the file offset of the `i`th record. offset(num_records()) is the
+  // end of the last record.
+  uint64_t offset(size_t i) const { return offsets_[i]; }
+
+  // Returns the size of the `i`th record in the file, including its header
+  // and footer.
+  uint64_t record_size(size_t i) const {
+    return offsets_[i + 1] - offsets_[i];
+  }
+
+ private:
+  explicit TFRecordIndex(std::vector<uint64_t> offsets)
+      : offsets_(std::move(offsets)) {}
+
+  // The offsets of the records, followed by the end of the last record.
+  std::vector<uint64_t> offsets_;
+};
+
+}  // namespace data
+}  // namespace tfrt
+
+#endif  // TFRT_LIB_DATA_TF_RECORD_INDEX_H_
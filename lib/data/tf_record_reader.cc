@@ -0,0 +1,320 @@
+// Copyright 2020 The TensorFlow Runtime Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//===- tf_record_reader.cc ------------------------------------------------===//
+//
+// This file implements TFRecordReader class which reads records from a TFRecord
+// file without copying them.
+//
+//===----------------------------------------------------------------------===//
+
+#include "tf_record_reader.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "tfrt/host_context/host_allocator.h"
+#include "tfrt/support/byte_order.h"
+#include "tfrt/support/crc32c.h"
+#include "tfrt/support/error_util.h"
+
+namespace tfrt {
+namespace data {
+
+namespace {
+// The following is copied from tensorflow/core/platform/raw_coding.h
+inline uint32_t DecodeFixed32(const char* ptr) {
+  if (kLittleEndian) {
+    // Load the raw bytes
+    uint32_t result;
+    memcpy(&result, ptr,
+           sizeof(result));  // gcc optimizes this to a plain load
+    return result;
+  } else {
+    return ((static_cast<uint32_t>(static_cast<unsigned char>(ptr[0]))) |
+            (static_cast<uint32_t>(static_cast<unsigned char>(ptr[1])) << 8) |
+            (static_cast<uint32_t>(static_cast<unsigned char>(ptr[2])) << 16) |
+            (static_cast<uint32_t>(static_cast<unsigned char>(ptr[3])) << 24));
+  }
+}
+
+inline uint64_t DecodeFixed64(const char* ptr) {
+  if (kLittleEndian) {
+    // Load the raw bytes
+    uint64_t result;
+    memcpy(&result, ptr,
+           sizeof(result));  // gcc optimizes this to a plain load
+    return result;
+  } else {
+    uint64_t lo = DecodeFixed32(ptr);
+    uint64_t hi = DecodeFixed32(ptr + 4);
+    return (hi << 32) | lo;
+  }
+}
+
+// A record is the length, the masked crc of the length, the data, and the
+// masked crc of the data.
+constexpr size_t kHeaderSize = sizeof(uint64_t) + sizeof(uint32_t);
+constexpr size_t kFooterSize = sizeof(uint32_t);
+
+// Blocks are read from and to file offsets aligned to this value.
+constexpr size_t kReadAlignment = 4096;
+
+bool VerifyChecksum(const char* data, size_t n) {
+  return crc32c::Unmask(DecodeFixed32(data + n)) == crc32c::Value(data, n);
+}
+}  // namespace
+
+llvm::Expected<TFRecordReader::Compression> TFRecordReader::ParseCompression(
+    string_view type) {
+  if (type.empty() || type == "NONE") return Compression::kNone;
+  if (type == "ZLIB") return Compression::kZlib;
+  if (type == "GZIP") return Compression::kGzip;
+  return MakeStringError("invalid TFRecord compression type: ", type);
+}
+
+TFRecordReader::TFRecordReader(std::string path, Options options,
+                               HostAllocator* allocator)
+    : path_(std::move(path)), options_(options), allocator_(allocator) {}
+
+TFRecordReader::~TFRecordReader() {
+  if (fd_ >= 0) close(fd_);
+}
+
+llvm::Error TFRecordReader::Open() {
+  if (options_.compression != Compression::kNone) {
+    auto stream = InflateStream::Open(
+        path_,
+        options_.compression == Compression::kGzip
+            ? InflateStream::Format::kGzip
+            : InflateStream::Format::kZlib,
+        options_.block_size, options_.num_inflate_blocks, options_.host,
+        allocator_);
+    if (!stream) return stream.takeError();
+    stream_ = std::move(*stream);
+    return llvm::Error::success();
+  }
+
+  fd_ = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd_ < 0) {
+    return MakeStringError("failed to open file ", path_, ": ",
+                           strerror(errno));
+  }
+
+  struct stat stat_buf;
+  if (!options_.use_mmap || fstat(fd_, &stat_buf) != 0 ||
+      !S_ISREG(stat_buf.st_mode) || stat_buf.st_size == 0) {
+    return llvm::Error::success();
+  }
+
+  const size_t size = stat_buf.st_size;
+  void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd_, 0);
+  // Fall back to pread if the file cannot be memory mapped.
+  if (ptr == MAP_FAILED) return llvm::Error::success();
+  madvise(ptr, size, MADV_SEQUENTIAL);
+
+  buffer_ = HostBuffer::CreateFromExternal(
+      ptr, size, [](void* ptr, size_t size) { munmap(ptr, size); });
+  buffer_end_ = size;
+  at_eof_ = true;
+  close(fd_);
+  fd_ = -1;
+  return llvm::Error::success();
+}
+
+llvm::Expected<size_t> TFRecordReader::Fill(size_t n) {
+  // offset_ is past the end of the buffer after skipping a record.
+  const size_t available = offset_ < buffer_end_ ? buffer_end_ - offset_ : 0;
+  if (available >= n || at_eof_) return std::min(available, n);
+
+  if (stream_ && offset_ > buffer_end_) {
+    // The stream only moves forward, so the bytes before offset_ are skipped.
+    auto skipped = stream_->Read(nullptr, offset_ - buffer_end_);
+    if (!skipped) return skipped.takeError();
+    buffer_end_ += *skipped;
+    if (buffer_end_ < offset_) {
+      at_eof_ = true;
+      return 0;
+    }
+  }
+
+  // The new block starts with the bytes remaining in the current block, and
+  // is large enough for `n` bytes after rounding the read down to alignment.
+  const size_t capacity = std::max(options_.block_size, n) + kReadAlignment;
+  const uint64_t read_end =
+      (offset_ + capacity) / kReadAlignment * kReadAlignment;
+  const size_t size = read_end - offset_;
+
+  const char* remaining =
+      available > 0 ? static_cast<const char*>(buffer_->data()) +
+                          (offset_ - buffer_offset_)
+                    : nullptr;
+  if (buffer_ && buffer_->IsUnique() && buffer_->size() >= size) {
+    // No record points into the current block, so it can be reused.
+    if (available > 0) memmove(buffer_->data(), remaining, available);
+  } else {
+    auto buffer = HostBuffer::CreateUninitialized(
+        size, alignof(std::max_align_t), allocator_);
+    if (!buffer) {
+      return MakeStringError("failed to allocate ", size,
+                             " bytes to read file ", path_);
+    }
+    if (available > 0) memcpy(buffer->data(), remaining, available);
+    buffer_ = std::move(buffer);
+  }
+  buffer_offset_ = offset_;
+
+  char* data = static_cast<char*>(buffer_->data());
+  size_t num_read = available;
+  if (stream_) {
+    auto result = stream_->Read(data + num_read, size - num_read);
+    if (!result) {
+      buffer_end_ = offset_ + num_read;
+      return result.takeError();
+    }
+    num_read += *result;
+    at_eof_ = num_read < size;
+    buffer_end_ = offset_ + num_read;
+    return std::min(num_read, n);
+  }
+  while (num_read < size) {
+    ssize_t result =
+        pread(fd_, data + num_read, size - num_read, offset_ + num_read);
+    if (result < 0) {
+      if (errno == EINTR) continue;
+      buffer_end_ = offset_ + num_read;
+      return MakeStringError("failed to read file ", path_, ": ",
+                             strerror(errno));
+    }
+    if (result == 0) {
+      at_eof_ = true;
+      break;
+    }
+    num_read += result;
+  }
+  buffer_end_ = offset_ + num_read;
+  return std::min(num_read, n);
+}
+
+void TFRecordReader::Seek(uint64_t offset) {
+  offset_ = offset;
+  if (options_.compression != Compression::kNone) {
+    // Fill skips forward to the offset. Seeking before the buffer restarts
+    // the stream from the start of the file.
+    if (offset < buffer_offset_) {
+      stream_.reset();
+      opened_ = false;
+      buffer_.reset();
+      buffer_offset_ = 0;
+      buffer_end_ = 0;
+      at_eof_ = false;
+    }
+    return;
+  }
+  // A memory mapped file is a single buffer. Blocks read with pread are
+  // dropped if they do not hold the offset, and the next Fill reads from it.
+  if (fd_ >= 0 && (offset < buffer_offset_ || offset > buffer_end_)) {
+    buffer_offset_ = offset;
+    buffer_end_ = offset;
+    at_eof_ = false;
+  }
+}
+
+llvm::Expected<uint64_t> TFRecordReader::ReadLength(bool* eof) {
+  if (!opened_) {
+    opened_ = true;
+    if (auto error = Open()) return std::move(error);
+  }
+
+  auto available = Fill(kHeaderSize);
+  if (!available) return available.takeError();
+  if (*available == 0) {
+    // The previous record read was the final one.
+    *eof = true;
+    return MakeStringError("end of file");
+  }
+  if (*available < kHeaderSize) {
+    return MakeStringError("failed to read header of TFRecord at offset ",
+                           offset_, " in ", path_);
+  }
+  const char* header = static_cast<const char*>(buffer_->data()) +
+                       (offset_ - buffer_offset_);
+  if (!VerifyChecksum(header, sizeof(uint64_t))) {
+    return MakeStringError("corrupted header of TFRecord at offset ", offset_,
+                           " in ", path_);
+  }
+  return DecodeFixed64(header);
+}
+
+// Logic based on tensorflow/core/io/record_reader.*
+llvm::Expected<TFRecord> TFRecordReader::ReadRecord(bool* eof) {
+  auto length = ReadLength(eof);
+  if (!length) return length.takeError();
+
+  // Read body. This may move the header to a new block.
+  const size_t record_size = kHeaderSize + *length + kFooterSize;
+  auto available = Fill(record_size);
+  if (!available) return available.takeError();
+  if (*available < record_size) {
+    return MakeStringError("failed to read body of TFRecord at offset ",
+                           offset_, " in ", path_);
+  }
+  const char* body = static_cast<const char*>(buffer_->data()) +
+                     (offset_ - buffer_offset_) + kHeaderSize;
+  if (!VerifyChecksum(body, *length)) {
+    return MakeStringError("corrupted body of TFRecord at offset ", offset_,
+                           " in ", path_);
+  }
+
+  offset_ += record_size;
+  return TFRecord{buffer_.CopyRef(), string_view(body, *length)};
+}
+
+llvm::Error TFRecordReader::SkipRecord(bool* eof) {
+  auto length = ReadLength(eof);
+  if (*eof) {
+    llvm::consumeError(length.takeError());
+    return llvm::Error::success();
+  }
+  if (!length) return length.takeError();
+
+  const uint64_t record_end = offset_ + kHeaderSize + *length + kFooterSize;
+  if (record_end > buffer_end_) {
+    // Only check that the file holds the whole record, by reading from its
+    // last byte. The body is not read.
+    const uint64_t record_offset = offset_;
+    size_t available = 0;
+    if (!at_eof_) {
+      offset_ = record_end - 1;
+      auto filled = Fill(1);
+      if (!filled) return filled.takeError();
+      available = *filled;
+    }
+    if (available == 0) {
+      return MakeStringError("failed to read body of TFRecord at offset ",
+                             record_offset, " in ", path_);
+    }
+  }
+  offset_ = record_end;
+  return llvm::Error::success();
+}
+
+}  // namespace data
+}  // namespace tfrt
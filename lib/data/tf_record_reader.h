@@ -0,0 +1,140 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- tf_record_reader.h ---------------------------------------*- C++ -*-===//
+//
+// This file declares TFRecordReader class which reads records from a TFRecord
+// file without copying them.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef TFRT_LIB_DATA_TF_RECORD_READER_H_
+#define TFRT_LIB_DATA_TF_RECORD_READER_H_
+
+#include <string>
+
+#include "inflate_stream.h"
+#include "llvm/Support/Error.h"
+#include "tfrt/host_context/host_buffer.h"
+#include "tfrt/support/forward_decls.h"
+
+namespace tfrt {
+namespace data {
+
+// A record read by TFRecordReader. The record bytes are a slice of `buffer`,
+// so they stay valid for as long as the record is alive.
+struct TFRecord {
+  RCReference<HostBuffer> buffer;
+  string_view data;
+};
+
+// TFRecordReader reads the records of a TFRecord file sequentially, and
+// verifies their CRC32C checksums.
+//
+// Regular files are memory mapped, and records are slices of the mapping.
+// Other files are read in large blocks with pread, and records are slices of
+// the block buffers. A block buffer is reused once all the records that point
+// into it are destroyed.
+//
+// Compressed files are read through an InflateStream, and the records are
+// slices of block buffers filled from the stream. Their offsets are offsets
+// in the uncompressed stream, so seeking backwards inflates the file again
+// from the start.
+class TFRecordReader {
+ public:
+  enum class Compression { kNone, kZlib, kGzip };
+
+  struct Options {
+    // Memory map regular files. Otherwise, read them with pread. Compressed
+    // files are never memory mapped.
+    bool use_mmap = true;
+    // Minimum size of the blocks read with pread, and size of the blocks
+    // inflated from compressed files.
+    size_t block_size = 1 << 20;
+    Compression compression = Compression::kNone;
+    // Number of blocks of a compressed file inflated ahead of the reader.
+    int num_inflate_blocks = 2;
+    // If not null, compressed files are inflated on the blocking work queue
+    // of this host. Otherwise, the reader inflates them.
+    HostContext* host = nullptr;
+  };
+
+  // Parses a TFRecord compression type: "" or "NONE", "ZLIB" or "GZIP".
+  static llvm::Expected<Compression> ParseCompression(string_view type);
+
+  TFRecordReader(std::string path, Options options, HostAllocator* allocator);
+  ~TFRecordReader();
+
+  // This class is not copyable or movable.
+  TFRecordReader(const TFRecordReader&) = delete;
+  TFRecordReader& operator=(const TFRecordReader&) = delete;
+
+  // Reads a record and advances the reader to the start of the next record.
+  // Updates *eof to true iff the reader is already at the end of file and
+  // there is no error. Otherwise, returns the record or an error. If eof is
+  // set to true, caller should not process the return value.
+  llvm::Expected<TFRecord> ReadRecord(bool* eof);
+
+  // Advances the reader to the start of the next record without reading the
+  // record body or verifying its checksum. Updates *eof to true iff the
+  // reader is already at the end of file and there is no error.
+  llvm::Error SkipRecord(bool* eof);
+
+  // Returns the file offset of the next record.
+  uint64_t offset() const { return offset_; }
+
+  // Moves the reader to the record at file `offset`, e.g. an offset from a
+  // TFRecordIndex or a previous offset().
+  void Seek(uint64_t offset);
+
+ private:
+  // Opens the file, and memory maps it if possible. Compressed files are
+  // opened as an InflateStream.
+  llvm::Error Open();
+
+  // Reads and verifies the header of the record at offset_, and returns the
+  // length of the record body. Does not advance the reader.
+  llvm::Expected<uint64_t> ReadLength(bool* eof);
+
+  // Makes sure that the `n` bytes at offset_ are in buffer_, reading a new
+  // block from the file if needed. Returns the number of bytes available at
+  // offset_, which is less than `n` only at the end of file.
+  llvm::Expected<size_t> Fill(size_t n);
+
+  const std::string path_;
+  const Options options_;
+  HostAllocator* allocator_;
+  bool opened_ = false;
+  int fd_ = -1;
+
+  // File offset of the next record.
+  uint64_t offset_ = 0;
+  // The uncompressed stream of a compressed file. Its position is
+  // buffer_end_.
+  RCReference<InflateStream> stream_;
+
+  // Buffer of the file bytes in [buffer_offset_, buffer_end_). This is the
+  // whole file if it is memory mapped.
+  RCReference<HostBuffer> buffer_;
+  uint64_t buffer_offset_ = 0;
+  uint64_t buffer_end_ = 0;
+  bool at_eof_ = false;
+};
+
+}  // namespace data
+}  // namespace tfrt
+
+#endif  // TFRT_LIB_DATA_TF_RECORD_READER_H_
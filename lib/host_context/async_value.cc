@@ -20,6 +20,10 @@
 
 #include "tfrt/host_context/async_value.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
 #include "llvm/ADT/FunctionExtras.h"
 #include "tfrt/host_context/function.h"
 #include "tfrt/host_context/host_context.h"
@@ -33,14 +37,35 @@ namespace tfrt {
 // callbacks are informed.
 class NotifierListNode {
  public:
-  explicit NotifierListNode(llvm::unique_function<void()> notification)
-      : next_(nullptr), notification_(std::move(notification)) {}
+  static constexpr size_t kStorageSize =
+      std::max(AsyncValue::kInlineWaiterSize,
+               sizeof(llvm::unique_function<void()>));
 
  private:
   friend class AsyncValue;
+
+  // Runs the waiter stored in `storage_` and destroys it.
+  void Run() { run_(storage_); }
+
+  // Returns the waiter list pointer that stands for an AsyncValue kept alive
+  // by KeepAliveUntilAvailable.
+  static NotifierListNode* KeepAlive(AsyncValue* value) {
+    return reinterpret_cast<NotifierListNode*>(
+        reinterpret_cast<uintptr_t>(value) | AsyncValue::kKeepAliveTag);
+  }
+
+  // Returns the AsyncValue kept alive by `list`, or nullptr if `list` is a
+  // waiter node.
+  static AsyncValue* GetKeptAlive(NotifierListNode* list) {
+    auto bits = reinterpret_cast<uintptr_t>(list);
+    if (!(bits & AsyncValue::kKeepAliveTag)) return nullptr;
+    return reinterpret_cast<AsyncValue*>(bits & ~AsyncValue::kKeepAliveTag);
+  }
+
   // This is the next thing waiting on the AsyncValue.
   NotifierListNode* next_;
-  llvm::unique_function<void()> notification_;
+  void (*run_)(void* storage);
+  alignas(void*) char storage_[kStorageSize];
 };
 
 /*static*/ uint16_t AsyncValue::CreateTypeInfoAndReturnTypeIdImpl(
@@ -106,24 +131,73 @@ void AsyncValue::NotifyAvailable(State available_state) {
 }
 
 void AsyncValue::RunWaiters(NotifierListNode* list) {
+  static_assert(alignof(NotifierListNode) > kKeepAliveTag &&
+                    alignof(AsyncValue) > kKeepAliveTag,
+                "The keep alive tag must not overlap with pointer bits.");
   HostContext* host = GetHostContext();
   while (list) {
+    if (auto* value = NotifierListNode::GetKeptAlive(list)) {
+      value->DropRef();
+      return;
+    }
     auto* node = list;
     // TODO(chky): pass state into notification_ so that waiters do not need to
     // check atomic state again.
-    node->notification_();
+    node->Run();
     list = node->next_;
-    host->Destruct(node);
+    host->Deallocate<NotifierListNode>(node);
+  }
+}
+
+void AsyncValue::EnqueueWaiter(void (*invoke)(void* waiter),
+                               const void* waiter, size_t size,
+                               WaitersAndState old_value) {
+  assert(size <= NotifierListNode::kStorageSize);
+  auto* node = GetHostContext()->Allocate<NotifierListNode>();
+  node->run_ = invoke;
+  std::memcpy(node->storage_, waiter, size);
+  EnqueueWaiter(node, old_value);
+}
+
+void AsyncValue::EnqueueWaiter(llvm::unique_function<void()>&& waiter,
+                               WaitersAndState old_value) {
+  using Waiter = llvm::unique_function<void()>;
+  auto* node = GetHostContext()->Allocate<NotifierListNode>();
+  node->run_ = [](void* storage) {
+    auto* waiter = static_cast<Waiter*>(storage);
+    (*waiter)();
+    waiter->~Waiter();
+  };
+  new (node->storage_) Waiter(std::move(waiter));
+  EnqueueWaiter(node, old_value);
+}
+
+void AsyncValue::KeepAliveUntilAvailable(RCReference<AsyncValue> value) {
+  auto old_value = waiters_and_state_.load(std::memory_order_acquire);
+  // The reference can only replace an empty waiter list, as nodes can be
+  // added in front of it but it has no next link itself.
+  while (old_value.getPointer() == nullptr) {
+    if (old_value.getInt() == State::kConcrete ||
+        old_value.getInt() == State::kError) {
+      return;
+    }
+    auto new_value = WaitersAndState(NotifierListNode::KeepAlive(value.get()),
+                                     old_value.getInt());
+    if (waiters_and_state_.compare_exchange_weak(old_value, new_value,
+                                                 std::memory_order_release,
+                                                 std::memory_order_acquire)) {
+      value.release();
+      return;
+    }
   }
+  AndThen([value = value.release()]() { value->DropRef(); });
 }
 
 // If the value is available or becomes available, this calls the closure
 // immediately. Otherwise, the add closure to the waiter list where it will be
 // called when the value becomes available.
-void AsyncValue::EnqueueWaiter(llvm::unique_function<void()>&& waiter,
+void AsyncValue::EnqueueWaiter(NotifierListNode* node,
                                WaitersAndState old_value) {
-  // Create the node for our waiter.
-  auto* node = GetHostContext()->Construct<NotifierListNode>(std::move(waiter));
   auto old_state = old_value.getInt();
 
   // Swap the next link in. old_value.getInt() must be unavailable when
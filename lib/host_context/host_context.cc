@@ -151,6 +151,11 @@ void HostContext::EnqueueWork(llvm::unique_function<void()> work) {
   work_queue_->AddTask(TaskFunction(std::move(work)));
 }
 
+void HostContext::EnqueueWork(llvm::unique_function<void()> work,
+                              WorkerAffinity affinity) {
+  work_queue_->AddTask(TaskFunction(std::move(work)), affinity);
+}
+
 // Add some work to the workqueue managed by this CPU device.
 bool HostContext::EnqueueBlockingWork(llvm::unique_function<void()> work) {
   Optional<TaskFunction> task = work_queue_->AddBlockingTask(
@@ -162,6 +167,10 @@ int HostContext::GetNumWorkerThreads() const {
   return work_queue_->GetParallelismLevel();
 }
 
+int HostContext::GetCurrentWorkerIndex() const {
+  return work_queue_->GetCurrentWorkerIndex();
+}
+
 // Run the specified function when the specified set of AsyncValue's are all
 // resolved.  This is a set-version of "AndThen".
 void HostContext::RunWhenReady(ArrayRef<AsyncValue*> values,
@@ -0,0 +1,770 @@
+/*
+ * Copyright 2020 The TensorFlow Runtime Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===- replay_work_queue.cc -----------------------------------------------===//
+//
+// This file implements work queues that record the task schedule of a
+// multi-threaded run into a log, and replay it later with the same
+// interleaving.
+//
+// Tasks are identified by the task that enqueued them and the order in which
+// they were enqueued by that task: (parent task id, child index). Task ids are
+// assigned in the order of enqueue events in the log. This identity does not
+// depend on thread timing as long as each task enqueues the same work in the
+// same order, so a replayed run can match its tasks with the recorded ones.
+//
+// The log is a header followed by a sequence of events, all integers are
+// encoded as unsigned LEB128 varints:
+//
+//   header:  "TFRTWQ" <version> <num_threads>
+//   enqueue: 0 <parent task id + 1, or 0 for a non worker thread> <child index>
+//   run:     1 <task id> <worker index, or num_threads for a blocking task>
+//
+// Run events are written in the order tasks started on the worker threads.
+// The replay work queue starts the non-blocking tasks in exactly that order,
+// on the same worker threads. The run event of a blocking task is written when
+// it is enqueued, and blocking tasks are started as soon as a blocking thread
+// is available.
+//
+// The log is written to the file as it grows, so that the log of a run that
+// crashes is still usable up to the last written event.
+//
+//===----------------------------------------------------------------------===//
+
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/None.h"
+#include "tfrt/host_context/async_value.h"
+#include "tfrt/host_context/concurrent_work_queue.h"
+#include "tfrt/support/error_util.h"
+#include "tfrt/support/latch.h"
+#include "tfrt/support/logging.h"
+#include "tfrt/support/mutex.h"
+#include "tfrt/support/string_util.h"
+
+namespace tfrt {
+namespace {
+
+constexpr char kLogMagic[] = "TFRTWQ";
+constexpr uint8_t kLogVersion = 1;
+
+enum class LogEvent : uint8_t { kEnqueue = 0, kRun = 1 };
+
+// Task id of the tasks that are executed outside of the recorded schedule.
+constexpr uint64_t kUnknownTaskId = std::numeric_limits<uint64_t>::max();
+
+// Blocking tasks that allow queuing run on at most this many threads, like the
+// default number of blocking threads of the multi-threaded work queue. The
+// other ones wait in a backlog.
+constexpr int kMaxQueuedBlockingThreads = 8;
+
+// The recording work queue writes the log to the file when it is at least this
+// large, and whenever a thread starts waiting.
+constexpr size_t kLogFlushSize = 64 << 10;
+
+// Identity of the task in the log: parent task id + 1 (zero if the task was
+// enqueued by a thread not managed by the work queue), and the child index.
+using TaskKey = std::pair<uint64_t, uint64_t>;
+
+// Context of the task running in the current thread. Used to compute the keys
+// of the tasks it enqueues.
+struct TaskContext {
+  const ConcurrentWorkQueue* queue;
+  uint64_t task_id;
+  uint64_t num_children;
+};
+
+// Context of the worker thread.
+struct WorkerContext {
+  const ConcurrentWorkQueue* queue;
+  int worker_index;
+};
+
+thread_local TaskContext* current_task = nullptr;
+thread_local WorkerContext current_worker = {nullptr, -1};
+
+// Sets the current task context for the lifetime of the object.
+class TaskContextScope {
+ public:
+  TaskContextScope(const ConcurrentWorkQueue* queue, uint64_t task_id)
+      : context_{queue, task_id, 0}, parent_(current_task) {
+    current_task = &context_;
+  }
+  ~TaskContextScope() { current_task = parent_; }
+
+ private:
+  TaskContext context_;
+  TaskContext* parent_;
+};
+
+void AppendVarint(uint64_t value, std::string* out) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+bool ReadVarint(string_view* in, uint64_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 64 && !in->empty(); shift += 7) {
+    uint8_t byte = static_cast<uint8_t>(in->front());
+    *in = in->drop_front();
+    *value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) return true;
+  }
+  return false;
+}
+
+// Base class for the recording and replay work queues. Keeps track of the
+// in-flight tasks, and computes task keys.
+class ScheduleWorkQueue : public ConcurrentWorkQueue {
+ public:
+  explicit ScheduleWorkQueue(int num_threads) : num_threads_(num_threads) {}
+
+  int GetParallelismLevel() const final { return num_threads_; }
+
+  int GetCurrentWorkerIndex() const final {
+    return current_worker.queue == this ? current_worker.worker_index : -1;
+  }
+
+  void Quiesce() override;
+  void Await(ArrayRef<RCReference<AsyncValue>> values) override;
+
+ protected:
+  // Returns the key for the next task enqueued by the caller thread.
+  TaskKey NextTaskKey() TFRT_REQUIRES(mu_);
+
+  // Runs `task` on the current thread with a task context for `task_id`.
+  void RunTask(uint64_t task_id, TaskFunction task);
+
+  // Decrements the number of in-flight tasks and wakes up waiting threads.
+  void TaskDone();
+
+  // Runs `task` on a blocking thread. If `allow_queuing` is true and
+  // kMaxQueuedBlockingThreads threads already run queued tasks, the task waits
+  // in the backlog until one of them is done. Otherwise, the task starts on a
+  // new thread right away.
+  void AddBlockingTaskWithId(uint64_t task_id, TaskFunction task,
+                             bool allow_queuing) TFRT_REQUIRES(mu_);
+
+  // Stops and joins all threads. Must be called by derived class destructors.
+  void StopThreads();
+
+  // Called when a thread not managed by the work queue starts or stops
+  // waiting in Await or Quiesce.
+  virtual void OnExternalWait() TFRT_REQUIRES(mu_) {}
+
+  const int num_threads_;
+
+  mutex mu_;
+  condition_variable work_cv_;
+  condition_variable done_cv_;
+
+  std::vector<std::thread> worker_threads_;
+
+  bool stop_ TFRT_GUARDED_BY(mu_) = false;
+
+  // Number of tasks that were enqueued but not completed.
+  int64_t num_in_flight_ TFRT_GUARDED_BY(mu_) = 0;
+
+  // Number of tasks running in the blocking threads.
+  int64_t num_running_blocking_ TFRT_GUARDED_BY(mu_) = 0;
+
+  // Number of non-worker threads waiting in Await or Quiesce.
+  int num_external_waiters_ TFRT_GUARDED_BY(mu_) = 0;
+
+  // Number of tasks enqueued by non-worker threads.
+  uint64_t num_external_children_ TFRT_GUARDED_BY(mu_) = 0;
+
+ private:
+  struct BlockingTask {
+    uint64_t id;
+    TaskFunction task;
+  };
+
+  // Starts a thread that runs `task`, and then the tasks of the backlog if
+  // `runs_backlog` is true.
+  void StartBlockingThread(uint64_t task_id, TaskFunction task,
+                           bool runs_backlog) TFRT_REQUIRES(mu_);
+
+  // Joins the blocking threads that exited, so that they do not accumulate for
+  // the lifetime of the work queue.
+  void ReapBlockingThreads() TFRT_REQUIRES(mu_);
+
+  std::unordered_map<std::thread::id, std::thread> blocking_threads_
+      TFRT_GUARDED_BY(mu_);
+  std::vector<std::thread::id> exited_blocking_threads_ TFRT_GUARDED_BY(mu_);
+  std::deque<BlockingTask> blocking_backlog_ TFRT_GUARDED_BY(mu_);
+  // Number of blocking threads that run the tasks of the backlog.
+  int num_backlog_threads_ TFRT_GUARDED_BY(mu_) = 0;
+};
+
+TaskKey ScheduleWorkQueue::NextTaskKey() {
+  if (current_task && current_task->queue == this)
+    return {current_task->task_id + 1, current_task->num_children++};
+  return {0, num_external_children_++};
+}
+
+void ScheduleWorkQueue::RunTask(uint64_t task_id, TaskFunction task) {
+  TaskContextScope scope(this, task_id);
+  task();
+  // Destroy the task while the context is still active, destructors can
+  // resolve async values and enqueue new tasks.
+  task.reset();
+}
+
+void ScheduleWorkQueue::TaskDone() {
+  mutex_lock lock(mu_);
+  --num_in_flight_;
+  done_cv_.notify_all();
+  work_cv_.notify_all();
+}
+
+void ScheduleWorkQueue::AddBlockingTaskWithId(uint64_t task_id,
+                                              TaskFunction task,
+                                              bool allow_queuing) {
+  ReapBlockingThreads();
+  if (!allow_queuing) {
+    StartBlockingThread(task_id, std::move(task), /*runs_backlog=*/false);
+  } else if (num_backlog_threads_ < kMaxQueuedBlockingThreads) {
+    ++num_backlog_threads_;
+    StartBlockingThread(task_id, std::move(task), /*runs_backlog=*/true);
+  } else {
+    blocking_backlog_.push_back({task_id, std::move(task)});
+  }
+}
+
+void ScheduleWorkQueue::StartBlockingThread(uint64_t task_id,
+                                            TaskFunction task,
+                                            bool runs_backlog) {
+  ++num_running_blocking_;
+  std::thread thread([this, task_id, task = std::move(task),
+                      runs_backlog]() mutable {
+    RunTask(task_id, std::move(task));
+
+    mutex_lock lock(mu_);
+    while (true) {
+      --num_running_blocking_;
+      --num_in_flight_;
+      done_cv_.notify_all();
+      work_cv_.notify_all();
+      if (!runs_backlog || blocking_backlog_.empty()) break;
+
+      BlockingTask next = std::move(blocking_backlog_.front());
+      blocking_backlog_.pop_front();
+      ++num_running_blocking_;
+      mu_.unlock();
+      RunTask(next.id, std::move(next.task));
+      mu_.lock();
+    }
+    if (runs_backlog) --num_backlog_threads_;
+    // The thread does not access the work queue after this point, so it can
+    // be joined by the next ReapBlockingThreads.
+    exited_blocking_threads_.push_back(std::this_thread::get_id());
+  });
+  // The thread can't exit before it is added to the map, because it has to
+  // acquire mu_ first.
+  blocking_threads_.emplace(thread.get_id(), std::move(thread));
+}
+
+void ScheduleWorkQueue::ReapBlockingThreads() {
+  for (const auto& id : exited_blocking_threads_) {
+    auto it = blocking_threads_.find(id);
+    it->second.join();
+    blocking_threads_.erase(it);
+  }
+  exited_blocking_threads_.clear();
+}
+
+void ScheduleWorkQueue::Quiesce() {
+  mutex_lock lock(mu_);
+  ++num_external_waiters_;
+  OnExternalWait();
+  done_cv_.wait(lock, [this]() TFRT_REQUIRES(mu_) {
+    return num_in_flight_ == 0;
+  });
+  --num_external_waiters_;
+}
+
+void ScheduleWorkQueue::Await(ArrayRef<RCReference<AsyncValue>> values) {
+  // We are done when values_remaining drops to zero.
+  tfrt::latch values_remaining(values.size());
+
+  // As each value becomes available, we decrement the count.
+  for (auto& value : values) {
+    value->AndThen([&values_remaining]() { values_remaining.count_down(); });
+  }
+
+  {
+    mutex_lock lock(mu_);
+    ++num_external_waiters_;
+    OnExternalWait();
+  }
+
+  values_remaining.wait();
+
+  mutex_lock lock(mu_);
+  --num_external_waiters_;
+}
+
+void ScheduleWorkQueue::StopThreads() {
+  Quiesce();
+
+  std::unordered_map<std::thread::id, std::thread> blocking_threads;
+  {
+    mutex_lock lock(mu_);
+    stop_ = true;
+    work_cv_.notify_all();
+    std::swap(blocking_threads, blocking_threads_);
+    exited_blocking_threads_.clear();
+  }
+
+  for (auto& thread : worker_threads_) thread.join();
+  for (auto& thread : blocking_threads) thread.second.join();
+}
+
+//===----------------------------------------------------------------------===//
+// Recording work queue.
+//===----------------------------------------------------------------------===//
+
+// Work queue that mimics the scheduling policy of the multi-threaded work
+// queue: worker threads push new tasks to the front of their own queue, and
+// other threads push to the back of a random queue. Idle workers steal tasks
+// from the back of other queues. All scheduling decisions are written to the
+// log file.
+//
+// All queues are guarded by a single mutex, this work queue is intended for
+// debugging and profiling scheduling-dependent problems, not for production
+// use.
+class RecordingWorkQueue : public ScheduleWorkQueue {
+ public:
+  RecordingWorkQueue(int num_threads, string_view log_path);
+  ~RecordingWorkQueue() override;
+
+  std::string name() const override {
+    return StrCat("Recording work queue (", num_threads_, " threads)");
+  }
+
+  void AddTask(TaskFunction task) override;
+  Optional<TaskFunction> AddBlockingTask(TaskFunction task,
+                                         bool allow_queuing) override;
+
+ private:
+  struct PendingTask {
+    uint64_t id;
+    TaskFunction task;
+  };
+
+  void WorkerLoop(int worker_index);
+
+  // Assigns an id to the next task and writes an enqueue event.
+  uint64_t RecordEnqueue() TFRT_REQUIRES(mu_);
+
+  void RecordRun(uint64_t task_id, int worker_index) TFRT_REQUIRES(mu_);
+
+  // Writes the buffered events to the log file if there are at least `size`
+  // bytes of them.
+  void FlushLog(size_t size) TFRT_REQUIRES(mu_);
+
+  void OnExternalWait() TFRT_REQUIRES(mu_) override { FlushLog(1); }
+
+  // Pops the next task for the worker from its own queue, or steals one from
+  // another worker.
+  Optional<PendingTask> NextTask(int worker_index) TFRT_REQUIRES(mu_);
+
+  const std::string log_path_;
+
+  std::vector<std::deque<PendingTask>> queues_ TFRT_GUARDED_BY(mu_);
+  std::minstd_rand rng_ TFRT_GUARDED_BY(mu_);
+
+  uint64_t num_tasks_ TFRT_GUARDED_BY(mu_) = 0;
+  // The events that are not written to `log_file_` yet.
+  std::string log_ TFRT_GUARDED_BY(mu_);
+  std::ofstream log_file_ TFRT_GUARDED_BY(mu_);
+  bool log_failed_ TFRT_GUARDED_BY(mu_) = false;
+};
+
+RecordingWorkQueue::RecordingWorkQueue(int num_threads, string_view log_path)
+    : ScheduleWorkQueue(num_threads),
+      log_path_(log_path),
+      queues_(num_threads) {
+  {
+    mutex_lock lock(mu_);
+    log_file_.open(log_path_, std::ios::binary | std::ios::trunc);
+    log_.append(kLogMagic, sizeof(kLogMagic) - 1);
+    log_.push_back(static_cast<char>(kLogVersion));
+    AppendVarint(num_threads, &log_);
+    FlushLog(1);
+  }
+
+  for (int i = 0; i < num_threads; ++i)
+    worker_threads_.emplace_back([this, i]() { WorkerLoop(i); });
+}
+
+RecordingWorkQueue::~RecordingWorkQueue() {
+  StopThreads();
+
+  mutex_lock lock(mu_);
+  FlushLog(1);
+}
+
+void RecordingWorkQueue::FlushLog(size_t size) {
+  if (log_.size() < size || log_failed_) return;
+  // Flush the stream, so that the events reach the file even if the process
+  // crashes later.
+  log_file_.write(log_.data(), log_.size());
+  log_file_.flush();
+  log_.clear();
+  if (!log_file_) {
+    TFRT_LOG(ERROR) << "Failed to write work queue log to " << log_path_;
+    log_failed_ = true;
+  }
+}
+
+uint64_t RecordingWorkQueue::RecordEnqueue() {
+  TaskKey key = NextTaskKey();
+  log_.push_back(static_cast<char>(LogEvent::kEnqueue));
+  AppendVarint(key.first, &log_);
+  AppendVarint(key.second, &log_);
+  ++num_in_flight_;
+  return num_tasks_++;
+}
+
+void RecordingWorkQueue::RecordRun(uint64_t task_id, int worker_index) {
+  log_.push_back(static_cast<char>(LogEvent::kRun));
+  AppendVarint(task_id, &log_);
+  AppendVarint(worker_index, &log_);
+  FlushLog(kLogFlushSize);
+}
+
+void RecordingWorkQueue::AddTask(TaskFunction task) {
+  mutex_lock lock(mu_);
+  uint64_t id = RecordEnqueue();
+
+  if (current_worker.queue == this) {
+    queues_[current_worker.worker_index].push_front({id, std::move(task)});
+  } else {
+    queues_[rng_() % num_threads_].push_back({id, std::move(task)});
+  }
+  work_cv_.notify_one();
+}
+
+Optional<TaskFunction> RecordingWorkQueue::AddBlockingTask(
+    TaskFunction task, bool allow_queuing) {
+  mutex_lock lock(mu_);
+  uint64_t id = RecordEnqueue();
+  RecordRun(id, num_threads_);
+  AddBlockingTaskWithId(id, std::move(task), allow_queuing);
+  return llvm::None;
+}
+
+Optional<RecordingWorkQueue::PendingTask> RecordingWorkQueue::NextTask(
+    int worker_index) {
+  auto& own = queues_[worker_index];
+  if (!own.empty()) {
+    PendingTask task = std::move(own.front());
+    own.pop_front();
+    return {std::move(task)};
+  }
+
+  for (int i = 1; i < num_threads_; ++i) {
+    auto& victim = queues_[(worker_index + i) % num_threads_];
+    if (!victim.empty()) {
+      PendingTask task = std::move(victim.back());
+      victim.pop_back();
+      return {std::move(task)};
+    }
+  }
+
+  return llvm::None;
+}
+
+void RecordingWorkQueue::WorkerLoop(int worker_index) {
+  current_worker = {this, worker_index};
+
+  mutex_lock lock(mu_);
+  while (true) {
+    Optional<PendingTask> task = NextTask(worker_index);
+    if (!task.hasValue()) {
+      if (stop_) break;
+      FlushLog(1);
+      work_cv_.wait(lock);
+      continue;
+    }
+
+    RecordRun(task->id, worker_index);
+
+    mu_.unlock();
+    RunTask(task->id, std::move(task->task));
+    TaskDone();
+    mu_.lock();
+  }
+}
+
+//===----------------------------------------------------------------------===//
+// Replay work queue.
+//===----------------------------------------------------------------------===//
+
+// Parsed work queue log.
+struct ScheduleLog {
+  int num_threads;
+  llvm::DenseMap<TaskKey, uint64_t> task_ids;
+  // Task id and worker index of the non-blocking tasks in the start order.
+  std::vector<std::pair<uint64_t, int>> schedule;
+};
+
+Expected<ScheduleLog> ParseScheduleLog(string_view data) {
+  string_view magic(kLogMagic, sizeof(kLogMagic) - 1);
+  if (!data.startswith(magic))
+    return MakeStringError("invalid work queue log header");
+  data = data.drop_front(magic.size());
+
+  if (data.empty() || static_cast<uint8_t>(data.front()) != kLogVersion)
+    return MakeStringError("unsupported work queue log version");
+  data = data.drop_front();
+
+  ScheduleLog log;
+  uint64_t num_threads;
+  if (!ReadVarint(&data, &num_threads) || num_threads == 0)
+    return MakeStringError("invalid number of threads in work queue log");
+  log.num_threads = num_threads;
+
+  uint64_t num_tasks = 0;
+  while (!data.empty()) {
+    auto event = static_cast<LogEvent>(data.front());
+    data = data.drop_front();
+
+    uint64_t first, second;
+    if (!ReadVarint(&data, &first) || !ReadVarint(&data, &second))
+      return MakeStringError("truncated work queue log");
+
+    switch (event) {
+      case LogEvent::kEnqueue:
+        log.task_ids[{first, second}] = num_tasks++;
+        break;
+      case LogEvent::kRun:
+        if (first >= num_tasks || second > num_threads)
+          return MakeStringError("invalid run event in work queue log");
+        // Blocking tasks are not scheduled, they start immediately.
+        if (second < num_threads) log.schedule.emplace_back(first, second);
+        break;
+      default:
+        return MakeStringError("unknown event in work queue log");
+    }
+  }
+
+  return std::move(log);
+}
+
+// Work queue that replays a recorded schedule: non-blocking tasks start in the
+// recorded order on the recorded worker threads.
+//
+// If the program diverges from the recording (enqueues a task that is not in
+// the log), the task is executed in the caller thread. If a task from the log
+// is never enqueued, and all threads are waiting, it is skipped.
+class ReplayWorkQueue : public ScheduleWorkQueue {
+ public:
+  explicit ReplayWorkQueue(ScheduleLog log);
+  ~ReplayWorkQueue() override;
+
+  std::string name() const override {
+    return StrCat("Replay work queue (", num_threads_, " threads)");
+  }
+
+  void AddTask(TaskFunction task) override;
+  Optional<TaskFunction> AddBlockingTask(TaskFunction task,
+                                         bool allow_queuing) override;
+
+ private:
+  void WorkerLoop(int worker_index);
+
+  // Returns the id of the next task, or kUnknownTaskId if the program diverged
+  // from the recording.
+  uint64_t NextTaskId() TFRT_REQUIRES(mu_);
+
+  // Runs a task that is not in the recorded schedule in the caller thread.
+  void RunUnknownTask(TaskFunction task);
+
+  // Skips the scheduled tasks that can't be enqueued anymore.
+  void MaybeSkipStalledTask() TFRT_REQUIRES(mu_);
+
+  void OnExternalWait() TFRT_REQUIRES(mu_) override { work_cv_.notify_all(); }
+
+  const ScheduleLog log_;
+
+  // Position of the next task to start in the `log_.schedule`.
+  size_t cursor_ TFRT_GUARDED_BY(mu_) = 0;
+
+  // Enqueued tasks waiting for their turn.
+  llvm::DenseMap<uint64_t, TaskFunction> pending_ TFRT_GUARDED_BY(mu_);
+
+  // Number of non-blocking tasks running in the worker threads.
+  int num_running_ TFRT_GUARDED_BY(mu_) = 0;
+
+  bool diverged_ TFRT_GUARDED_BY(mu_) = false;
+};
+
+ReplayWorkQueue::ReplayWorkQueue(ScheduleLog log)
+    : ScheduleWorkQueue(log.num_threads), log_(std::move(log)) {
+  for (int i = 0; i < num_threads_; ++i)
+    worker_threads_.emplace_back([this, i]() { WorkerLoop(i); });
+}
+
+ReplayWorkQueue::~ReplayWorkQueue() { StopThreads(); }
+
+uint64_t ReplayWorkQueue::NextTaskId() {
+  // Tasks enqueued by unknown tasks are unknown too.
+  if (current_task && current_task->queue == this &&
+      current_task->task_id == kUnknownTaskId)
+    return kUnknownTaskId;
+
+  TaskKey key = NextTaskKey();
+  auto it = log_.task_ids.find(key);
+  if (it == log_.task_ids.end() || pending_.count(it->second)) {
+    if (!diverged_) {
+      TFRT_LOG(WARNING) << "Program diverged from the recorded work queue "
+                           "schedule, running unknown tasks inline";
+      diverged_ = true;
+    }
+    return kUnknownTaskId;
+  }
+  return it->second;
+}
+
+void ReplayWorkQueue::RunUnknownTask(TaskFunction task) {
+  RunTask(kUnknownTaskId, std::move(task));
+}
+
+void ReplayWorkQueue::AddTask(TaskFunction task) {
+  {
+    mutex_lock lock(mu_);
+    uint64_t id = NextTaskId();
+    if (id != kUnknownTaskId) {
+      pending_.try_emplace(id, std::move(task));
+      ++num_in_flight_;
+      work_cv_.notify_all();
+      return;
+    }
+  }
+  RunUnknownTask(std::move(task));
+}
+
+Optional<TaskFunction> ReplayWorkQueue::AddBlockingTask(TaskFunction task,
+                                                        bool allow_queuing) {
+  mutex_lock lock(mu_);
+  ++num_in_flight_;
+  AddBlockingTaskWithId(NextTaskId(), std::move(task), allow_queuing);
+  return llvm::None;
+}
+
+void ReplayWorkQueue::MaybeSkipStalledTask() {
+  // Only threads waiting in Await or Quiesce can't enqueue new tasks. If any
+  // other thread is running, the next scheduled task might still arrive.
+  if (num_external_waiters_ == 0 || num_running_ > 0 ||
+      num_running_blocking_ > 0)
+    return;
+
+  while (cursor_ < log_.schedule.size() &&
+         !pending_.count(log_.schedule[cursor_].first)) {
+    ++cursor_;
+    if (!diverged_) {
+      TFRT_LOG(WARNING) << "Recorded task was never enqueued, skipping it";
+      diverged_ = true;
+    }
+  }
+}
+
+void ReplayWorkQueue::WorkerLoop(int worker_index) {
+  current_worker = {this, worker_index};
+
+  mutex_lock lock(mu_);
+  while (true) {
+    MaybeSkipStalledTask();
+
+    Optional<uint64_t> task_id;
+    if (cursor_ < log_.schedule.size()) {
+      // Wait for our turn in the recorded schedule.
+      const auto& next = log_.schedule[cursor_];
+      if (next.second == worker_index && pending_.count(next.first)) {
+        task_id = next.first;
+        ++cursor_;
+      }
+    } else if (!pending_.empty()) {
+      // Recorded schedule is exhausted, run the remaining tasks in id order.
+      task_id = std::min_element(pending_.begin(), pending_.end(),
+                                 [](const auto& a, const auto& b) {
+                                   return a.first < b.first;
+                                 })
+                    ->first;
+    }
+
+    if (!task_id.hasValue()) {
+      if (stop_) break;
+      work_cv_.wait(lock);
+      continue;
+    }
+
+    auto it = pending_.find(*task_id);
+    TaskFunction task = std::move(it->second);
+    pending_.erase(it);
+    ++num_running_;
+
+    // Let the worker with the next scheduled task start it.
+    work_cv_.notify_all();
+
+    mu_.unlock();
+    RunTask(*task_id, std::move(task));
+    mu_.lock();
+
+    --num_running_;
+    --num_in_flight_;
+    done_cv_.notify_all();
+  }
+}
+
+}  // namespace
+
+std::unique_ptr<ConcurrentWorkQueue> CreateRecordingWorkQueue(
+    int num_threads, string_view log_path) {
+  assert(num_threads > 0);
+  return std::make_unique<RecordingWorkQueue>(num_threads, log_path);
+}
+
+Expected<std::unique_ptr<ConcurrentWorkQueue>> CreateReplayWorkQueue(
+    string_view log_path) {
+  std::ifstream file(std::string(log_path), std::ios::binary);
+  if (!file) return MakeStringError("failed to open work queue log ", log_path);
+
+  std::stringstream data;
+  data << file.rdbuf();
+
+  auto log = ParseScheduleLog(data.str());
+  if (!log) return log.takeError();
+
+  return std::make_unique<ReplayWorkQueue>(std::move(*log));
+}
+
+}  // namespace tfrt
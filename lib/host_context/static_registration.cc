@@ -17,10 +17,12 @@
 // This file implements the work queue factories and registers them.
 //
 //===----------------------------------------------------------------------===//
+#include <chrono>
 #include <cstddef>
 #include <string>
 #include <thread>
 
+#include "llvm/Support/Error.h"
 #include "tfrt/host_context/concurrent_work_queue.h"
 #include "tfrt/support/logging.h"
 
@@ -50,15 +52,29 @@ struct MakeMultiThreadedWorkQueue {
         std::min(kMaxNumThreads, num_threads),
         std::min(kMaxNumThreads, num_blocking_threads));
   }
+
+  static std::unique_ptr<ConcurrentWorkQueue> make(
+      int num_threads, int num_blocking_threads,
+      std::chrono::nanoseconds blocking_idle_timeout,
+      int max_num_pending_blocking_tasks) {
+    return CreateMultiThreadedWorkQueue(
+        std::min(kMaxNumThreads, num_threads),
+        std::min(kMaxNumThreads, num_blocking_threads), blocking_idle_timeout,
+        max_num_pending_blocking_tasks);
+  }
 };
 
 // Factory function for a multi-threaded thread pool.  Parses the given argument
-// to determine the construction parameters.  The argument must be either "X" or
-// "X,Y", where X and Y are integers. X will determine the number of threads to
-// use for blocking work, and Y will determine the number of threads for
-// nonblocking work. If X is not specified, the pool will use a number of
-// threads based on the number of CPUs in the system. Y is not specified, a
-// `kDefaultNumThreads` number of threads will be used for blocking work.
+// to determine the construction parameters.  The argument must be "X", "X,Y"
+// or "X,Y,T,P", where X, Y, T and P are integers. X is the number of threads
+// for nonblocking work, and Y the maximum number of threads for blocking work.
+// T is for how long, in milliseconds, a blocking thread started on demand waits
+// for the next task before exiting, and P is the maximum number of queued
+// blocking tasks that wait for a free blocking thread. If the argument is
+// empty, the pool uses a number of threads based on the number of CPUs in the
+// system. If Y is not specified, `kDefaultNumThreads` threads are used for
+// blocking work. If T and P are not specified, the defaults of
+// CreateMultiThreadedWorkQueue are used.
 template <typename MakeWorkQueue>
 std::unique_ptr<ConcurrentWorkQueue> MultiThreadedWorkQueueFactory(
     string_view arg) {
@@ -71,42 +87,67 @@ std::unique_ptr<ConcurrentWorkQueue> MultiThreadedWorkQueueFactory(
         std::max(static_cast<int>(num_cpus * kBlockingCpuFraction), 1);
     int num_nonblocking = std::max(num_cpus - num_blocking, 1);
     return MakeWorkQueue::make(num_nonblocking, num_blocking);
-  } else {
-    size_t comma = arg.find(',');
-    int num_threads;
-    int num_blocking = kDefaultNumThreads;
-    if (comma == std::string::npos) {
-      size_t pos;
-      num_threads = std::stoi(std::string(arg), &pos);
-      if (pos != arg.size()) {
-        TFRT_LOG(ERROR) << "Invalid argument for mstd work queue: "
-                        << std::string(arg);
-        return nullptr;
-      }
-    } else {
-      size_t pos;
-      num_threads =
-          std::stoi(std::string(arg.data(), arg.data() + comma), &pos);
-      if (pos != comma) {
-        TFRT_LOG(ERROR) << "Invalid argument for mstd work queue: "
-                        << std::string(arg);
-        return nullptr;
-      }
-      num_blocking = std::stoi(
-          std::string(arg.data() + comma + 1, arg.data() + arg.size()), &pos);
-      if (pos != arg.size() - comma - 1) {
-        TFRT_LOG(ERROR) << "Invalid argument for mstd work queue: "
-                        << std::string(arg);
-        return nullptr;
-      }
-    }
-    return MakeWorkQueue::make(num_threads, num_blocking);
   }
+
+  SmallVector<string_view, 4> parts;
+  arg.split(parts, ',');
+  SmallVector<int, 4> values;
+  for (string_view part : parts) {
+    // Only the maximum number of queued blocking tasks can be zero.
+    const int min_value = values.size() < 3 ? 1 : 0;
+    int value;
+    if (part.getAsInteger(10, value) || value < min_value) break;
+    values.push_back(value);
+  }
+  if (values.size() != parts.size() || values.size() == 3 ||
+      values.size() > 4) {
+    TFRT_LOG(ERROR) << "Invalid argument for mstd work queue: "
+                    << std::string(arg);
+    return nullptr;
+  }
+  if (values.size() == 4) {
+    return MakeWorkQueue::make(values[0], values[1],
+                               std::chrono::milliseconds(values[2]),
+                               values[3]);
+  }
+  int num_blocking = values.size() == 2 ? values[1] : kDefaultNumThreads;
+  return MakeWorkQueue::make(values[0], num_blocking);
+}
+
+// Factory function for a recording thread pool. The argument must be "X,PATH",
+// where X is the number of worker threads, and PATH is the path of the log
+// file, which the work queue writes incrementally while it runs.
+std::unique_ptr<ConcurrentWorkQueue> RecordingWorkQueueFactory(
+    string_view arg) {
+  size_t comma = arg.find(',');
+  int num_threads;
+  if (comma == std::string::npos ||
+      arg.substr(0, comma).getAsInteger(10, num_threads) || num_threads <= 0) {
+    TFRT_LOG(ERROR) << "Invalid argument for record work queue: "
+                    << std::string(arg);
+    return nullptr;
+  }
+  return CreateRecordingWorkQueue(std::min(kMaxNumThreads, num_threads),
+                                  arg.substr(comma + 1));
+}
+
+// Factory function for a replay thread pool. The argument is the path of the
+// log file written by the recording thread pool.
+std::unique_ptr<ConcurrentWorkQueue> ReplayWorkQueueFactory(string_view arg) {
+  auto work_queue = CreateReplayWorkQueue(arg);
+  if (!work_queue) {
+    TFRT_LOG(ERROR) << "Failed to create replay work queue: "
+                    << llvm::toString(work_queue.takeError());
+    return nullptr;
+  }
+  return std::move(*work_queue);
 }
 
 }  // namespace
 
 TFRT_WORK_QUEUE_FACTORY("s", SingleThreadedWorkQueueFactory);
+TFRT_WORK_QUEUE_FACTORY("record", RecordingWorkQueueFactory);
+TFRT_WORK_QUEUE_FACTORY("replay", ReplayWorkQueueFactory);
 TFRT_WORK_QUEUE_FACTORY(
     "mstd", MultiThreadedWorkQueueFactory<MakeMultiThreadedWorkQueue>);
 
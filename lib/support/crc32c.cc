@@ -0,0 +1,172 @@
+// Copyright 2020 The TensorFlow Runtime Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//===- crc32c.cc - CRC32C Checksums ---------------------------------------===//
+//
+// This file implements CRC32C checksums.
+//
+//===----------------------------------------------------------------------===//
+#include "tfrt/support/crc32c.h"
+
+#include <array>
+#include <cstring>
+
+#include "tfrt/support/byte_order.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define TFRT_CRC32C_SSE42 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define TFRT_CRC32C_ARMV8 1
+#endif
+
+namespace tfrt {
+namespace crc32c {
+namespace {
+
+// Reversed Castagnoli polynomial.
+constexpr uint32_t kPolynomial = 0x82f63b78;
+
+// Tables for the slicing-by-8 algorithm. tables[0] is the classic byte-wise
+// table, and tables[k][b] is the crc of byte b followed by k zero bytes.
+struct Tables {
+  Tables() {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t crc = i;
+      for (int j = 0; j < 8; ++j) crc = (crc >> 1) ^ (kPolynomial & -(crc & 1));
+      tables[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+      for (int k = 1; k < 8; ++k) {
+        uint32_t prev = tables[k - 1][i];
+        tables[k][i] = (prev >> 8) ^ tables[0][prev & 0xff];
+      }
+    }
+  }
+
+  std::array<std::array<uint32_t, 256>, 8> tables;
+};
+
+inline uint32_t LoadLittleEndian32(const char* ptr) {
+  uint32_t result;
+  memcpy(&result, ptr, sizeof(result));
+  return kLittleEndian ? result : __builtin_bswap32(result);
+}
+
+uint32_t ExtendPortable(uint32_t init_crc, const char* data, size_t n) {
+  static const Tables* tables = new Tables();
+  const auto& t = tables->tables;
+
+  uint32_t crc = ~init_crc;
+  const char* end = data + n;
+
+  auto step_byte = [&t, &crc](char c) {
+    crc = (crc >> 8) ^ t[0][(crc ^ static_cast<uint8_t>(c)) & 0xff];
+  };
+
+  // Process bytes until the pointer is 8 byte aligned.
+  while (data != end && (reinterpret_cast<uintptr_t>(data) & 7) != 0) {
+    step_byte(*data++);
+  }
+
+  while (end - data >= 8) {
+    uint32_t lo = LoadLittleEndian32(data) ^ crc;
+    uint32_t hi = LoadLittleEndian32(data + 4);
+    crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^
+          t[4][lo >> 24] ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^
+          t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+    data += 8;
+  }
+
+  while (data != end) step_byte(*data++);
+
+  return ~crc;
+}
+
+#if defined(TFRT_CRC32C_SSE42)
+
+__attribute__((target("sse4.2"))) uint32_t ExtendHardware(uint32_t init_crc,
+                                                          const char* data,
+                                                          size_t n) {
+  uint64_t crc = ~init_crc;
+  const char* end = data + n;
+
+  while (data != end && (reinterpret_cast<uintptr_t>(data) & 7) != 0) {
+    crc = _mm_crc32_u8(crc, *data++);
+  }
+  while (end - data >= 8) {
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    crc = _mm_crc32_u64(crc, value);
+    data += 8;
+  }
+  while (data != end) crc = _mm_crc32_u8(crc, *data++);
+
+  return ~static_cast<uint32_t>(crc);
+}
+
+bool HasHardwareSupport() { return __builtin_cpu_supports("sse4.2"); }
+
+#elif defined(TFRT_CRC32C_ARMV8)
+
+uint32_t ExtendHardware(uint32_t init_crc, const char* data, size_t n) {
+  uint32_t crc = ~init_crc;
+  const char* end = data + n;
+
+  while (data != end && (reinterpret_cast<uintptr_t>(data) & 7) != 0) {
+    crc = __crc32cb(crc, *data++);
+  }
+  while (end - data >= 8) {
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    crc = __crc32cd(crc, value);
+    data += 8;
+  }
+  while (data != end) crc = __crc32cb(crc, *data++);
+
+  return ~crc;
+}
+
+// The CRC32 instructions are enabled at compile time.
+bool HasHardwareSupport() { return true; }
+
+#else
+
+uint32_t ExtendHardware(uint32_t init_crc, const char* data, size_t n) {
+  return ExtendPortable(init_crc, data, n);
+}
+
+bool HasHardwareSupport() { return false; }
+
+#endif
+
+using ExtendFn = uint32_t (*)(uint32_t, const char*, size_t);
+
+ExtendFn GetExtendFn() {
+  static const ExtendFn extend_fn =
+      HasHardwareSupport() ? ExtendHardware : ExtendPortable;
+  return extend_fn;
+}
+
+}  // namespace
+
+uint32_t Extend(uint32_t init_crc, const char* data, size_t n) {
+  return GetExtendFn()(init_crc, data, n);
+}
+
+bool IsHardwareAccelerated() { return GetExtendFn() == ExtendHardware; }
+
+}  // namespace crc32c
+}  // namespace tfrt
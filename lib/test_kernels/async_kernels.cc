@@ -31,8 +31,11 @@ namespace tfrt {
 static AsyncValueRef<int32_t> HexAsyncAddI32(int32_t arg0, int32_t arg1,
                                              HostContext* host) {
   // Even though a single scalar add is trivial, we can do it on a background
-  // thread if we'd like!
-  return host->EnqueueWork([arg0, arg1] { return arg0 + arg1; });
+  // thread if we'd like! The executor runs the users of the sum on the thread
+  // that computes it, so keeping it on the worker that ran this kernel keeps
+  // chains of async adds on one worker, with the operands in its cache.
+  return host->EnqueueWork([arg0, arg1] { return arg0 + arg1; },
+                           WorkerAffinity::SameWorker());
 }
 
 static AsyncValueRef<bool> HexAsyncConstantI1(Attribute<int8_t> arg,
@@ -14,6 +14,7 @@
 
 // RUN: tfrt_translate -mlir-to-bef %s | bef_executor | FileCheck %s --dump-input=fail
 // RUN: tfrt_opt %s | tfrt_opt
+// RUN: tfrt_translate -mlir-to-bef %s | bef_executor --functions=benchmark_async_edges --host_allocator_type=profiled_allocator | FileCheck %s --check-prefix=ALLOCS --dump-input=fail
 
 // A function to demonstrate the use of benchmark kernels.
 
@@ -57,3 +58,43 @@ func @benchmark2() {
 
   hex.return
 }
+
+// A function with many async edges. Each async result has one or more users,
+// so the executor adds an AndThen waiter per edge. The profiled allocator RUN
+// line reports the host allocations, which include the waiter nodes.
+func @benchmark_async_edges() {
+  // ALLOCS: BM:async_edges:Count:
+  // ALLOCS: HostAllocator profile:
+  // ALLOCS: Total number of allocations = {{[0-9]+}}
+
+  // CHECK: BM:async_edges:Duration(us):
+  // CHECK: BM:async_edges:Count:
+  // CHECK: BM:async_edges:Time Min(us):
+  // CHECK: BM:async_edges:Time 50%(us):
+  // CHECK: BM:async_edges:Time 95%(us):
+  // CHECK: BM:async_edges:Time 99%(us):
+
+  %c = hex.constant.i32 1
+
+  tfrt_test.benchmark "async_edges"(%c : i32) duration_secs = 1, max_count = 100, num_warmup_runs = 10
+  {
+    %a0 = "hex.async_add.i32"(%c, %c) : (i32, i32) -> i32
+    %a1 = "hex.async_add.i32"(%a0, %c) : (i32, i32) -> i32
+    %a2 = "hex.async_add.i32"(%a0, %a1) : (i32, i32) -> i32
+    %a3 = "hex.async_add.i32"(%a1, %a2) : (i32, i32) -> i32
+    %a4 = "hex.async_add.i32"(%a2, %a3) : (i32, i32) -> i32
+    %a5 = "hex.async_add.i32"(%a3, %a4) : (i32, i32) -> i32
+    %a6 = "hex.async_add.i32"(%a4, %a5) : (i32, i32) -> i32
+    %a7 = "hex.async_add.i32"(%a5, %a6) : (i32, i32) -> i32
+    %b0 = "hex.async_add.i32"(%a0, %a7) : (i32, i32) -> i32
+    %b1 = "hex.async_add.i32"(%a1, %a7) : (i32, i32) -> i32
+    %b2 = "hex.async_add.i32"(%a2, %a7) : (i32, i32) -> i32
+    %b3 = "hex.async_add.i32"(%a3, %a7) : (i32, i32) -> i32
+    %c0 = "hex.async_add.i32"(%b0, %b1) : (i32, i32) -> i32
+    %c1 = "hex.async_add.i32"(%b2, %b3) : (i32, i32) -> i32
+    %x = "hex.async_add.i32"(%c0, %c1) : (i32, i32) -> i32
+    hex.return %x : i32
+  }
+
+  hex.return
+}
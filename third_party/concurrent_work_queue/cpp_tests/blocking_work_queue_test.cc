@@ -10,6 +10,9 @@
 
 #include "blocking_work_queue.h"
 
+#include <chrono>
+#include <thread>
+
 #include "benchmark/benchmark.h"
 #include "environment.h"
 #include "gtest/gtest.h"
@@ -92,6 +95,91 @@ TEST(BlockingWorkQueueTest, Quiescing) {
   ASSERT_FALSE(quiescing.HasPendingTasks());
 }
 
+TEST(BlockingWorkQueueTest, ElasticThreads) {
+  WorkQueue work_queue(/*num_threads=*/1,
+                       /*max_num_dynamic_threads=*/2,
+                       /*idle_wait_time=*/std::chrono::milliseconds(10),
+                       /*max_num_elastic_threads=*/2,
+                       /*max_num_pending_tasks=*/2);
+
+  latch barrier(1);
+  latch executed(5);
+
+  auto task = [&]() -> TaskFunction {
+    return TaskFunction([&]() {
+      barrier.wait();
+      executed.count_down();
+    });
+  };
+
+  // Wait until the static thread is parked, and submit a task to it.
+  while (!work_queue.AllBlocked()) std::this_thread::yield();
+  ASSERT_FALSE(work_queue.EnqueueBlockingTask(task()).hasValue());
+  while (work_queue.AllBlocked()) std::this_thread::yield();
+
+  // Static thread is busy, the next two tasks start elastic threads.
+  ASSERT_FALSE(work_queue.EnqueueBlockingTask(task()).hasValue());
+  ASSERT_FALSE(work_queue.EnqueueBlockingTask(task()).hasValue());
+  ASSERT_EQ(work_queue.NumDynamicThreads(), 2);
+  ASSERT_EQ(work_queue.NumElasticThreads(), 2);
+
+  // Elastic threads are busy, the next two tasks wait in the backlog.
+  ASSERT_FALSE(work_queue.EnqueueBlockingTask(task()).hasValue());
+  ASSERT_FALSE(work_queue.EnqueueBlockingTask(task()).hasValue());
+  ASSERT_EQ(work_queue.NumDynamicThreads(), 2);
+  ASSERT_EQ(work_queue.NumPendingTasks(), 2);
+
+  // Backlog is full, task is rejected.
+  auto rejected = work_queue.EnqueueBlockingTask(task());
+  ASSERT_TRUE(rejected.hasValue());
+
+  // Let the tasks start.
+  barrier.count_down();
+  // Wait for completion.
+  executed.wait();
+
+  // Idle elastic threads must exit after the idle wait time.
+  while (work_queue.NumDynamicThreads() > 0) std::this_thread::yield();
+  ASSERT_EQ(work_queue.NumPendingTasks(), 0);
+}
+
+// Threads started by RunBlockingTask do not count towards the elastic thread
+// limit.
+TEST(BlockingWorkQueueTest, ElasticThreadsCountedSeparately) {
+  WorkQueue work_queue(/*num_threads=*/1,
+                       /*max_num_dynamic_threads=*/1,
+                       /*idle_wait_time=*/std::chrono::milliseconds(10),
+                       /*max_num_elastic_threads=*/1,
+                       /*max_num_pending_tasks=*/1);
+
+  latch barrier(1);
+  latch executed(3);
+
+  auto task = [&]() -> TaskFunction {
+    return TaskFunction([&]() {
+      barrier.wait();
+      executed.count_down();
+    });
+  };
+
+  // Wait until the static thread is parked, and submit a task to it.
+  while (!work_queue.AllBlocked()) std::this_thread::yield();
+  ASSERT_FALSE(work_queue.EnqueueBlockingTask(task()).hasValue());
+  while (work_queue.AllBlocked()) std::this_thread::yield();
+
+  // Start a dynamic thread, and then an elastic thread for a queued task.
+  ASSERT_FALSE(work_queue.RunBlockingTask(task()).hasValue());
+  ASSERT_FALSE(work_queue.EnqueueBlockingTask(task()).hasValue());
+  ASSERT_EQ(work_queue.NumDynamicThreads(), 2);
+  ASSERT_EQ(work_queue.NumElasticThreads(), 1);
+  ASSERT_EQ(work_queue.NumPendingTasks(), 0);
+
+  barrier.count_down();
+  executed.wait();
+
+  while (work_queue.NumDynamicThreads() > 0) std::this_thread::yield();
+}
+
 // -------------------------------------------------------------------------- //
 // Performance benchmarks.
 // -------------------------------------------------------------------------- //
@@ -172,5 +260,65 @@ BM_NoOp(8, 8);
 BM_NoOp(16, 16);
 BM_NoOp(32, 32);
 
+// Benchmark blocking IO throughput.
+//
+// Submit `num_tasks` tasks each sleeping for `io_latency_us` microseconds to
+// simulate a blocking IO call, into an elastic work queue with a single static
+// thread that can grow up to `max_threads` threads.
+//
+// Reports the peak number of dynamically started threads, and the number of
+// rejected tasks (backpressure) that were executed in the caller thread.
+static void BM_BlockingIO(benchmark::State& state) {
+  BenchmarkUseRealTime();
+
+  const int num_tasks = state.range(0);
+  const int max_threads = state.range(1);
+  const std::chrono::microseconds io_latency(100);
+
+  WorkQueue work_queue(/*num_threads=*/1,
+                       /*max_num_dynamic_threads=*/max_threads,
+                       /*idle_wait_time=*/std::chrono::milliseconds(100),
+                       /*max_num_elastic_threads=*/max_threads - 1,
+                       /*max_num_pending_tasks=*/128);
+
+  std::atomic<int> peak_threads{0};
+  int num_rejected = 0;
+
+  for (auto _ : state) {
+    ::tfrt::latch latch(num_tasks);
+
+    for (int i = 0; i < num_tasks; ++i) {
+      auto rejected = work_queue.EnqueueBlockingTask(TaskFunction([&]() {
+        std::this_thread::sleep_for(io_latency);
+
+        int num_threads = work_queue.NumDynamicThreads();
+        int peak = peak_threads.load();
+        while (num_threads > peak &&
+               !peak_threads.compare_exchange_weak(peak, num_threads)) {
+        }
+
+        latch.count_down();
+      }));
+
+      // Backpressure: run the rejected task in the caller thread.
+      if (rejected) {
+        (*rejected)();
+        ++num_rejected;
+      }
+    }
+
+    latch.wait();
+  }
+
+  state.counters["peak_threads"] = 1 + peak_threads.load();
+  state.counters["rejected"] = num_rejected;
+  state.SetItemsProcessed(num_tasks * state.iterations());
+}
+
+BENCHMARK(BM_BlockingIO)
+    ->ArgPair(1000, 4)
+    ->ArgPair(1000, 16)
+    ->ArgPair(1000, 64);
+
 }  // namespace
 }  // namespace tfrt
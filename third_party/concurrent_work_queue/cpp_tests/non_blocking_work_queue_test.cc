@@ -12,6 +12,7 @@
 
 #include "benchmark/benchmark.h"
 #include "environment.h"
+#include "gtest/gtest.h"
 #include "tfrt/host_context/task_function.h"
 #include "tfrt/support/latch.h"
 
@@ -21,6 +22,54 @@ namespace {
 using ThreadingEnvironment = ::tfrt::internal::StdThreadingEnvironment;
 using WorkQueue = ::tfrt::internal::NonBlockingWorkQueue<ThreadingEnvironment>;
 
+TEST(NonBlockingWorkQueueTest, CurrentThreadId) {
+  WorkQueue work_queue(4);
+  ASSERT_EQ(work_queue.CurrentThreadId(), -1);
+
+  std::atomic<int> thread_id{-1};
+  latch executed(1);
+  work_queue.AddTask(TaskFunction([&]() {
+    thread_id = work_queue.CurrentThreadId();
+    executed.count_down();
+  }));
+  executed.wait();
+
+  ASSERT_GE(thread_id.load(), 0);
+  ASSERT_LT(thread_id.load(), 4);
+}
+
+TEST(NonBlockingWorkQueueTest, AddTaskWithAffinity) {
+  WorkQueue work_queue(4);
+
+  const std::vector<WorkerAffinity> affinities = {
+      WorkerAffinity::Any(),      WorkerAffinity::SameWorker(),
+      WorkerAffinity::Worker(0),  WorkerAffinity::Worker(3),
+      WorkerAffinity::Worker(-5), WorkerAffinity::Worker(100)};
+
+  // Submit tasks from a free-standing thread and from a worker thread, all of
+  // them must be executed regardless of the hint.
+  latch executed(2 * affinities.size());
+  for (auto affinity : affinities) {
+    work_queue.AddTask(TaskFunction([&]() { executed.count_down(); }),
+                       affinity);
+  }
+  work_queue.AddTask(TaskFunction([&]() {
+    for (auto affinity : affinities) {
+      work_queue.AddTask(TaskFunction([&]() { executed.count_down(); }),
+                         affinity);
+    }
+  }));
+  executed.wait();
+}
+
+TEST(NonBlockingWorkQueueTest, WorkerAffinity) {
+  ASSERT_TRUE(WorkerAffinity::Any().IsAny());
+  ASSERT_TRUE(WorkerAffinity::SameWorker().IsSameWorker());
+  ASSERT_EQ(WorkerAffinity::SameWorker().worker_index(), -1);
+  ASSERT_EQ(WorkerAffinity::Worker(2).worker_index(), 2);
+  ASSERT_TRUE(WorkerAffinity::Worker(-1).IsAny());
+}
+
 // Benchmark work queue throughput.
 //
 // Submit `num_producers` tasks to `producer` work queue, each submitting
@@ -82,5 +131,74 @@ BM_NoOp(8, 8);
 BM_NoOp(16, 16);
 BM_NoOp(32, 32);
 
+// Benchmark producer-consumer chains.
+//
+// Submits `num_chains` tasks, each of them updates a buffer of `buffer_size`
+// floats, and submits a continuation that reduces it, `chain_length` times.
+// Continuations are pinned to the producer worker if `same_worker` is true,
+// otherwise they are sent to the next worker.
+void Chain(WorkQueue& work_queue, int num_threads, bool same_worker,
+           benchmark::State& state) {
+  const int num_chains = state.range(0);
+  const int buffer_size = state.range(1);
+  const int chain_length = 16;
+
+  struct ChainState {
+    std::vector<float> buffer;
+    float sum = 0.0;
+    int remaining = 0;
+  };
+
+  for (auto _ : state) {
+    ::tfrt::latch latch(num_chains);
+    std::vector<ChainState> chains(num_chains);
+
+    std::function<void(ChainState*)> step = [&](ChainState* chain) {
+      for (int i = 0; i < buffer_size; ++i) chain->buffer[i] += 1.0;
+
+      WorkerAffinity affinity =
+          same_worker ? WorkerAffinity::SameWorker()
+                      : WorkerAffinity::Worker(
+                            (work_queue.CurrentThreadId() + 1) % num_threads);
+
+      auto consume = [&, chain]() {
+        for (float value : chain->buffer) chain->sum += value;
+        if (--chain->remaining == 0) {
+          latch.count_down();
+        } else {
+          step(chain);
+        }
+      };
+      work_queue.AddTask(TaskFunction(std::move(consume)), affinity);
+    };
+
+    for (auto& chain : chains) {
+      chain.buffer.resize(buffer_size);
+      chain.remaining = chain_length;
+      work_queue.AddTask(TaskFunction([&, chain = &chain]() { step(chain); }));
+    }
+
+    latch.wait();
+    benchmark::DoNotOptimize(chains);
+  }
+
+  state.SetItemsProcessed(num_chains * chain_length * state.iterations());
+}
+
+#define BM_Chain(name, same_worker, threads)              \
+  static void BM_Chain_##name##_tpool_##threads(          \
+      benchmark::State& state) {                          \
+    BenchmarkUseRealTime();                               \
+    WorkQueue work_queue(threads);                        \
+    Chain(work_queue, threads, same_worker, state);       \
+  }                                                       \
+  BENCHMARK(BM_Chain_##name##_tpool_##threads)            \
+      ->ArgPair(64, 1024)                                 \
+      ->ArgPair(64, 16384)                                \
+      ->ArgPair(64, 65536)
+
+BM_Chain(SameWorker, true, 8);
+BM_Chain(NextWorker, false, 8);
+
 }  // namespace
 }  // namespace tfrt
@@ -10,6 +10,14 @@
 // This work queue uses TaskQueue for storing pending tasks. Tasks executed
 // in mostly FIFO order, which is optimal for IO tasks.
 //
+// The work queue can be elastic: if all statically allocated threads are busy,
+// queued tasks are handed off to dynamically started threads, up to
+// `max_num_elastic_threads`, and once that limit is reached they are kept in
+// a bounded backlog of `max_num_pending_tasks`. When the backlog is full the
+// task is returned to the caller, which is the backpressure signal for the
+// producer. Dynamically started threads exit after `idle_wait_time` without
+// any work to do.
+//
 //===----------------------------------------------------------------------===//
 
 #ifndef TFRT_THIRD_PARTY_CONCURRENT_WORK_QUEUE_BLOCKING_WORK_QUEUE_H_
@@ -50,14 +58,23 @@ class BlockingWorkQueue
   using PendingTask = typename Base::PendingTask;
 
  public:
+  // If `max_num_elastic_threads` is zero, queued tasks are executed only by the
+  // `num_threads` statically allocated threads. Otherwise, up to
+  // `max_num_elastic_threads` dynamic threads are started on demand to run
+  // queued tasks when all static threads are busy, and at most
+  // `max_num_pending_tasks` tasks can wait for a free dynamic thread.
   explicit BlockingWorkQueue(
       int num_threads,
       int max_num_dynamic_threads = std::numeric_limits<int>::max(),
-      std::chrono::nanoseconds idle_wait_time = std::chrono::seconds(1));
+      std::chrono::nanoseconds idle_wait_time = std::chrono::seconds(1),
+      int max_num_elastic_threads = 0,
+      int max_num_pending_tasks = std::numeric_limits<int>::max());
   ~BlockingWorkQueue() = default;
 
-  // Enqueues `task` for execution by one of the statically allocated thread.
-  // Return task wrapped in optional if all per-thread queues are full.
+  // Enqueues `task` for execution by one of the statically allocated thread,
+  // or by one of the elastic threads if all static threads are busy. Return
+  // task wrapped in optional if all per-thread queues (or the elastic backlog)
+  // are full.
   Optional<TaskFunction> EnqueueBlockingTask(TaskFunction task);
 
   // Runs `task` in one of the dynamically started threads. Returns task
@@ -66,6 +83,25 @@ class BlockingWorkQueue
 
   void Quiesce();
 
+  // Returns the number of currently running dynamically started threads,
+  // including the elastic threads.
+  int NumDynamicThreads() {
+    mutex_lock lock(mutex_);
+    return num_dynamic_threads_ + num_elastic_threads_;
+  }
+
+  // Returns the number of currently running threads started for queued tasks.
+  int NumElasticThreads() {
+    mutex_lock lock(mutex_);
+    return num_elastic_threads_;
+  }
+
+  // Returns the number of queued tasks waiting for an elastic thread.
+  int NumPendingTasks() {
+    mutex_lock lock(mutex_);
+    return static_cast<int>(backlog_.size());
+  }
+
  private:
   template <typename WorkQueue>
   friend class WorkQueueBase;
@@ -73,6 +109,7 @@ class BlockingWorkQueue
   using Base::GetPerThread;
   using Base::IsNotifyParkedThreadRequired;
   using Base::IsQuiescing;
+  using Base::NumBlockedThreads;
   using Base::WithPendingTaskCounter;
 
   using Base::coprimes_;
@@ -94,9 +131,32 @@ class BlockingWorkQueue
   // not found.
   Optional<TaskFunction> WaitNextTask(mutex_lock* lock) TFRT_REQUIRES(mutex_);
 
+  // Starts a new dynamic thread that runs `task`, and then keeps running tasks
+  // from the `idle_task_queue_` and the `backlog_`. The thread counts towards
+  // `num_elastic_threads_` if `elastic` is true, and `num_dynamic_threads_`
+  // otherwise.
+  void StartDynamicThread(TaskFunction task, bool elastic)
+      TFRT_REQUIRES(mutex_);
+
+  // Returns true if at least one of the statically allocated threads is parked
+  // and there are no pending tasks in the static threads queues. This is a weak
+  // signal, but good enough to decide where to submit the next task.
+  bool HasIdleStaticThread();
+
+  // Hands off a queued `task` to the elastic part of the work queue. Returns
+  // task wrapped in optional if the backlog is full.
+  Optional<TaskFunction> EnqueueElasticTask(TaskFunction task);
+
   // Maximum number of dynamically started threads.
   const int max_num_dynamic_threads_;
 
+  // Maximum number of dynamically started threads that can be started for
+  // queued tasks. Zero disables the elastic mode.
+  const int max_num_elastic_threads_;
+
+  // Maximum number of queued tasks waiting in the `backlog_`.
+  const int max_num_pending_tasks_;
+
   // For how long dynamically started thread waits for the next task before
   // stopping.
   const std::chrono::nanoseconds idle_wait_time_;
@@ -106,9 +166,14 @@ class BlockingWorkQueue
   condition_variable wake_do_work_cv_;
   condition_variable thread_exited_cv_;
 
-  // Number of started dynamic threads.
+  // Number of dynamic threads started by RunBlockingTask.
   int num_dynamic_threads_ TFRT_GUARDED_BY(mutex_) = 0;
 
+  // Number of dynamic threads started for queued tasks. They are limited
+  // separately, so that RunBlockingTask can not use up the elastic threads and
+  // vice versa.
+  int num_elastic_threads_ TFRT_GUARDED_BY(mutex_) = 0;
+
   // Number of dynamic threads waiting for the next task.
   int num_idle_dynamic_threads_ TFRT_GUARDED_BY(mutex_) = 0;
 
@@ -116,6 +181,10 @@ class BlockingWorkQueue
   // idle threads. It does not keep more tasks than there are idle threads.
   std::queue<TaskFunction> idle_task_queue_ TFRT_GUARDED_BY(mutex_);
 
+  // Queued tasks waiting for one of the elastic threads to complete its
+  // current task.
+  std::queue<TaskFunction> backlog_ TFRT_GUARDED_BY(mutex_);
+
   // Idle threads must stop waiting for the next task in the `idle_task_queue_`.
   bool stop_waiting_ = false;
 };
@@ -123,9 +192,12 @@ class BlockingWorkQueue
 template <typename ThreadingEnvironment>
 BlockingWorkQueue<ThreadingEnvironment>::BlockingWorkQueue(
     int num_threads, int max_num_dynamic_threads,
-    std::chrono::nanoseconds idle_wait_time)
+    std::chrono::nanoseconds idle_wait_time, int max_num_elastic_threads,
+    int max_num_pending_tasks)
     : WorkQueueBase<BlockingWorkQueue>(num_threads),
       max_num_dynamic_threads_(max_num_dynamic_threads),
+      max_num_elastic_threads_(max_num_elastic_threads),
+      max_num_pending_tasks_(max_num_pending_tasks),
       idle_wait_time_(idle_wait_time) {}
 
 template <typename ThreadingEnvironment>
@@ -135,6 +207,21 @@ BlockingWorkQueue<ThreadingEnvironment>::EnqueueBlockingTask(
   // In quiescing mode we count the number of pending tasks, and are allowed to
   // execute tasks in the caller thread.
   const bool is_quiescing = IsQuiescing();
+
+  // If all statically allocated threads are busy, hand off the task to the
+  // elastic threads instead of queueing it behind a long running task.
+  if (max_num_elastic_threads_ > 0 && !HasIdleStaticThread()) {
+    Optional<TaskFunction> rejected = EnqueueElasticTask(std::move(task));
+    if (!rejected.hasValue()) return llvm::None;
+
+    // See the comment below about executing tasks in quiescing mode.
+    if (is_quiescing) {
+      (*rejected)();
+      return llvm::None;
+    }
+    return rejected;
+  }
+
   if (is_quiescing) task = WithPendingTaskCounter(std::move(task));
 
   // If the worker queue is full, we will return `task` to the caller.
@@ -201,7 +288,7 @@ Optional<TaskFunction> BlockingWorkQueue<ThreadingEnvironment>::RunBlockingTask(
 
   // There are idle threads. We enqueue the task to the queue and then notify
   // one of the idle threads.
-  if (idle_task_queue_.size() < num_idle_dynamic_threads_) {
+  if (static_cast<int>(idle_task_queue_.size()) < num_idle_dynamic_threads_) {
     idle_task_queue_.emplace(wrap(std::move(task)));
     wake_do_work_cv_.notify_one();
 
@@ -211,50 +298,108 @@ Optional<TaskFunction> BlockingWorkQueue<ThreadingEnvironment>::RunBlockingTask(
   // There are no idle threads and we are not at the thread limit. We
   // start a new thread to run the task.
   if (num_dynamic_threads_ < max_num_dynamic_threads_) {
-    auto do_work = [this, task = wrap(std::move(task))]() mutable {
-      task();
-      // Reset executed task to call destructor without holding the lock,
-      // because it might be expensive. Also we want to call it before
-      // notifying quiescing thread, because destructor potentially could
-      // drop the last references on captured async values.
-      task.reset();
+    StartDynamicThread(wrap(std::move(task)), /*elastic=*/false);
+    return llvm::None;
+  }
 
-      mutex_lock lock(mutex_);
+  // There are no idle threads and we are at the thread limit. Return task
+  // to the caller.
+  return {std::move(task)};
+}
 
-      // Try to get the next task. If one is found, run it. If there is no
-      // task to execute, GetNextTask will return None that converts to
-      // false.
-      while (llvm::Optional<TaskFunction> task = WaitNextTask(&lock)) {
-        mutex_.unlock();
-        // Do not hold the lock while executing and destructing the task.
-        (*task)();
-        task.reset();
-        mutex_.lock();
-      }
+template <typename ThreadingEnvironment>
+bool BlockingWorkQueue<ThreadingEnvironment>::HasIdleStaticThread() {
+  if (NumBlockedThreads() == 0) return false;
+  for (ThreadData& thread_data : thread_data_) {
+    if (!thread_data.queue.Empty()) return false;
+  }
+  return true;
+}
 
-      // No more work to do or shutdown occurred. Exit the thread.
-      --num_dynamic_threads_;
-      if (stop_waiting_) thread_exited_cv_.notify_one();
-    };
+template <typename ThreadingEnvironment>
+Optional<TaskFunction>
+BlockingWorkQueue<ThreadingEnvironment>::EnqueueElasticTask(TaskFunction task) {
+  mutex_lock lock(mutex_);
 
-    std::unique_ptr<Thread> thread =
-        threading_environment_.StartThread(std::move(do_work));
+  // See the comment in RunBlockingTask about attaching a PendingTask counter.
+  auto wrap = [&](TaskFunction task) -> TaskFunction {
+    return IsQuiescing() ? WithPendingTaskCounter(std::move(task))
+                         : std::move(task);
+  };
 
-    // Detach the thread. We rely on num_threads_ to detect thread exiting.
-    ThreadingEnvironment::Detatch(thread.get());
-    ++num_dynamic_threads_;
+  // There are idle threads. Hand off the task to one of them.
+  if (static_cast<int>(idle_task_queue_.size()) < num_idle_dynamic_threads_) {
+    idle_task_queue_.emplace(wrap(std::move(task)));
+    wake_do_work_cv_.notify_one();
+    return llvm::None;
+  }
 
+  // Grow the number of threads up to the elastic limit.
+  if (num_elastic_threads_ < max_num_elastic_threads_) {
+    StartDynamicThread(wrap(std::move(task)), /*elastic=*/true);
     return llvm::None;
   }
 
-  // There are no idle threads and we are at the thread limit. Return task
-  // to the caller.
+  // Keep the task in the backlog until one of the running threads completes.
+  if (static_cast<int>(backlog_.size()) < max_num_pending_tasks_) {
+    backlog_.emplace(wrap(std::move(task)));
+    return llvm::None;
+  }
+
+  // Backlog is full. Return task to the caller.
   return {std::move(task)};
 }
 
+template <typename ThreadingEnvironment>
+void BlockingWorkQueue<ThreadingEnvironment>::StartDynamicThread(
+    TaskFunction task, bool elastic) {
+  int* num_threads = elastic ? &num_elastic_threads_ : &num_dynamic_threads_;
+  auto do_work = [this, num_threads, task = std::move(task)]() mutable {
+    task();
+    // Reset executed task to call destructor without holding the lock,
+    // because it might be expensive. Also we want to call it before
+    // notifying quiescing thread, because destructor potentially could
+    // drop the last references on captured async values.
+    task.reset();
+
+    mutex_lock lock(mutex_);
+
+    // Try to get the next task. If one is found, run it. If there is no
+    // task to execute, GetNextTask will return None that converts to
+    // false.
+    while (llvm::Optional<TaskFunction> task = WaitNextTask(&lock)) {
+      mutex_.unlock();
+      // Do not hold the lock while executing and destructing the task.
+      (*task)();
+      task.reset();
+      mutex_.lock();
+    }
+
+    // No more work to do or shutdown occurred. Exit the thread.
+    --*num_threads;
+    if (stop_waiting_) thread_exited_cv_.notify_one();
+  };
+
+  std::unique_ptr<Thread> thread =
+      threading_environment_.StartThread(std::move(do_work));
+
+  // Detach the thread. We rely on the thread counters to detect thread
+  // exiting.
+  ThreadingEnvironment::Detatch(thread.get());
+  ++*num_threads;
+}
+
 template <typename ThreadingEnvironment>
 Optional<TaskFunction> BlockingWorkQueue<ThreadingEnvironment>::WaitNextTask(
     mutex_lock* lock) {
+  // Tasks in the backlog are waiting for a running thread, take one without
+  // becoming idle.
+  if (!backlog_.empty()) {
+    TaskFunction task = std::move(backlog_.front());
+    backlog_.pop();
+    return {std::move(task)};
+  }
+
   ++num_idle_dynamic_threads_;
 
   const auto timeout = std::chrono::system_clock::now() + idle_wait_time_;
@@ -293,9 +438,10 @@ void BlockingWorkQueue<ThreadingEnvironment>::Quiesce() {
 
   // Wait until all dynamicaly started threads stopped.
   thread_exited_cv_.wait(lock, [this]() TFRT_REQUIRES(mutex_) {
-    return num_dynamic_threads_ == 0;
+    return num_dynamic_threads_ == 0 && num_elastic_threads_ == 0;
   });
   assert(idle_task_queue_.empty());
+  assert(backlog_.empty());
 
   // Prepare for the next call to Quiesce.
   stop_waiting_ = false;
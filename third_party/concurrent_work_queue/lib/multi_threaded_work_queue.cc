@@ -9,6 +9,8 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <chrono>
+#include <limits>
 #include <memory>
 #include <thread>
 
@@ -25,11 +27,19 @@
 
 namespace tfrt {
 
+// Default limit on the number of queued blocking tasks per blocking thread.
+static constexpr int kMaxPendingBlockingTasksPerThread = 1024;
+
+// Default idle timeout for the blocking threads started on demand.
+static constexpr std::chrono::seconds kBlockingIdleTimeout{1};
+
 class MultiThreadedWorkQueue : public ConcurrentWorkQueue {
   using ThreadingEnvironment = ::tfrt::internal::StdThreadingEnvironment;
 
  public:
-  MultiThreadedWorkQueue(int num_threads, int max_blocking_work_queue_threads);
+  MultiThreadedWorkQueue(int num_threads, int max_blocking_work_queue_threads,
+                         std::chrono::nanoseconds blocking_idle_timeout,
+                         int max_num_pending_blocking_tasks);
   ~MultiThreadedWorkQueue() override;
 
   std::string name() const override {
@@ -38,7 +48,12 @@ class MultiThreadedWorkQueue : public ConcurrentWorkQueue {
 
   int GetParallelismLevel() const final { return num_threads_; }
 
+  int GetCurrentWorkerIndex() const final {
+    return non_blocking_work_queue_.CurrentThreadId();
+  }
+
   void AddTask(TaskFunction task) final;
+  void AddTask(TaskFunction task, WorkerAffinity affinity) final;
   Optional<TaskFunction> AddBlockingTask(TaskFunction task,
                                          bool allow_queuing) final;
   void Quiesce() final;
@@ -51,11 +66,20 @@ class MultiThreadedWorkQueue : public ConcurrentWorkQueue {
   internal::BlockingWorkQueue<ThreadingEnvironment> blocking_work_queue_;
 };
 
+// Blocking work queue keeps a single statically allocated thread, and starts
+// the rest of the `max_blocking_work_queue_threads` on demand.
 MultiThreadedWorkQueue::MultiThreadedWorkQueue(
-    int num_threads, int max_blocking_work_queue_threads)
+    int num_threads, int max_blocking_work_queue_threads,
+    std::chrono::nanoseconds blocking_idle_timeout,
+    int max_num_pending_blocking_tasks)
     : num_threads_(num_threads),
       non_blocking_work_queue_(num_threads),
-      blocking_work_queue_(max_blocking_work_queue_threads) {}
+      blocking_work_queue_(
+          /*num_threads=*/1,
+          /*max_num_dynamic_threads=*/std::numeric_limits<int>::max(),
+          /*idle_wait_time=*/blocking_idle_timeout,
+          /*max_num_elastic_threads=*/max_blocking_work_queue_threads - 1,
+          /*max_num_pending_tasks=*/max_num_pending_blocking_tasks) {}
 
 MultiThreadedWorkQueue::~MultiThreadedWorkQueue() {
   // Pending tasks in the underlying queues might submit new tasks to each other
@@ -67,6 +91,11 @@ void MultiThreadedWorkQueue::AddTask(TaskFunction task) {
   non_blocking_work_queue_.AddTask(std::move(task));
 }
 
+void MultiThreadedWorkQueue::AddTask(TaskFunction task,
+                                     WorkerAffinity affinity) {
+  non_blocking_work_queue_.AddTask(std::move(task), affinity);
+}
+
 Optional<TaskFunction> MultiThreadedWorkQueue::AddBlockingTask(
     TaskFunction task, bool allow_queuing) {
   if (allow_queuing) {
@@ -129,9 +158,20 @@ void MultiThreadedWorkQueue::Await(ArrayRef<RCReference<AsyncValue>> values) {
 
 std::unique_ptr<ConcurrentWorkQueue> CreateMultiThreadedWorkQueue(
     int num_threads, int num_blocking_threads) {
+  return CreateMultiThreadedWorkQueue(
+      num_threads, num_blocking_threads, kBlockingIdleTimeout,
+      num_blocking_threads * kMaxPendingBlockingTasksPerThread);
+}
+
+std::unique_ptr<ConcurrentWorkQueue> CreateMultiThreadedWorkQueue(
+    int num_threads, int num_blocking_threads,
+    std::chrono::nanoseconds blocking_idle_timeout,
+    int max_num_pending_blocking_tasks) {
   assert(num_threads > 0 && num_blocking_threads > 0);
-  return std::make_unique<MultiThreadedWorkQueue>(num_threads,
-                                                  num_blocking_threads);
+  assert(max_num_pending_blocking_tasks >= 0);
+  return std::make_unique<MultiThreadedWorkQueue>(
+      num_threads, num_blocking_threads, blocking_idle_timeout,
+      max_num_pending_blocking_tasks);
 }
 
 }  // namespace tfrt
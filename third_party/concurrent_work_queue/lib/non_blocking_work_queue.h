@@ -18,6 +18,11 @@
 // mostly LIFO task execution order, which is optimal for cache locality for
 // compute intensive tasks.
 //
+// Tasks can be submitted with a WorkerAffinity hint. A hint that resolves to
+// the caller's own worker goes to the front of its queue, as usual. A hint
+// naming another worker goes to the back of that worker's queue, because only
+// the owner thread may push to the front.
+//
 // Work stealing algorithm is based on:
 //
 //   "Thread Scheduling for Multiprogrammed Multiprocessors"
@@ -62,7 +67,9 @@ class NonBlockingWorkQueue
   ~NonBlockingWorkQueue() = default;
 
   void AddTask(TaskFunction task);
+  void AddTask(TaskFunction task, WorkerAffinity affinity);
 
+  using Base::CurrentThreadId;
   using Base::Steal;
 
  private:
@@ -82,6 +89,10 @@ class NonBlockingWorkQueue
   LLVM_NODISCARD Optional<TaskFunction> NextTask(Queue* queue);
   LLVM_NODISCARD Optional<TaskFunction> Steal(Queue* queue);
   LLVM_NODISCARD bool Empty(Queue* queue);
+
+  // Pushes `task` into the queue of the worker `thread_id` and notifies parked
+  // threads. If the queue is full, executes `task` in the caller thread.
+  void PushTask(TaskFunction task, int thread_id, bool push_front);
 };
 
 template <typename ThreadingEnvironment>
@@ -91,12 +102,6 @@ NonBlockingWorkQueue<ThreadingEnvironment>::NonBlockingWorkQueue(
 
 template <typename ThreadingEnvironment>
 void NonBlockingWorkQueue<ThreadingEnvironment>::AddTask(TaskFunction task) {
-  // Keep track of the number of pending tasks.
-  if (IsQuiescing()) task = WithPendingTaskCounter(std::move(task));
-
-  // If the worker queue is full, we will execute `task` in the current thread.
-  llvm::Optional<TaskFunction> inline_task;
-
   // If a caller thread is managed by `this` we push the new task into the front
   // of thread own queue (LIFO execution order). PushFront is completely lock
   // free (PushBack requires a mutex lock), and improves data locality (in
@@ -109,14 +114,48 @@ void NonBlockingWorkQueue<ThreadingEnvironment>::AddTask(TaskFunction task) {
   PerThread* pt = GetPerThread();
   if (pt->parent == this) {
     // Worker thread of this pool, push onto the thread's queue.
-    Queue& q = thread_data_[pt->thread_id].queue;
-    inline_task = q.PushFront(std::move(task));
+    PushTask(std::move(task), pt->thread_id, /*push_front=*/true);
   } else {
     // A free-standing thread (or worker of another pool).
     unsigned rnd = FastReduce(pt->rng(), num_threads_);
-    Queue& q = thread_data_[rnd].queue;
-    inline_task = q.PushBack(std::move(task));
+    PushTask(std::move(task), rnd, /*push_front=*/false);
   }
+}
+
+template <typename ThreadingEnvironment>
+void NonBlockingWorkQueue<ThreadingEnvironment>::AddTask(
+    TaskFunction task, WorkerAffinity affinity) {
+  PerThread* pt = GetPerThread();
+  const bool is_worker = pt->parent == this;
+
+  // SameWorker() resolves to the caller's own queue. Callers that are not
+  // workers of this pool have no queue, so the hint means "any worker".
+  const int worker_index = affinity.IsSameWorker()
+                               ? (is_worker ? pt->thread_id : -1)
+                               : affinity.worker_index();
+
+  // Hints without a worker and out of range hints are treated as "any worker".
+  if (worker_index < 0 || worker_index >= num_threads_)
+    return AddTask(std::move(task));
+
+  // PushFront is only allowed for the queue owner, any other thread must push
+  // to the back of the target worker queue.
+  const bool is_owner = is_worker && pt->thread_id == worker_index;
+  PushTask(std::move(task), worker_index, /*push_front=*/is_owner);
+}
+
+template <typename ThreadingEnvironment>
+void NonBlockingWorkQueue<ThreadingEnvironment>::PushTask(TaskFunction task,
+                                                          int thread_id,
+                                                          bool push_front) {
+  // Keep track of the number of pending tasks.
+  if (IsQuiescing()) task = WithPendingTaskCounter(std::move(task));
+
+  // If the worker queue is full, we will execute `task` in the current thread.
+  Queue& q = thread_data_[thread_id].queue;
+  llvm::Optional<TaskFunction> inline_task =
+      push_front ? q.PushFront(std::move(task)) : q.PushBack(std::move(task));
+
   // Note: below we touch `*this` after making `task` available to worker
   // threads. Strictly speaking, this can lead to a racy-use-after-free.
   // Consider that Schedule is called from a thread that is neither main thread